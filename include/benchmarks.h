@@ -0,0 +1,8 @@
+#ifndef BENCHMARKS_H_INCLUDED
+#define BENCHMARKS_H_INCLUDED
+
+// Runs the CPU scaling benchmarks and prints the results to stdout.
+// Runs before any window or GL context exists, so nothing here may touch GL.
+void benchmarks_run(void);
+
+#endif // BENCHMARKS_H_INCLUDED
@@ -0,0 +1,84 @@
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+// Archetype based entity/component storage. Components are plain structs
+// registered by size, an entity's component set is a bit mask. All entities
+// with the same mask share an archetype whose data lives in fixed size chunks,
+// one contiguous column per component, so systems walk tight arrays instead of
+// chasing per-entity structs.
+
+#define ENTITY_MAX_COMPONENTS 32
+#define ENTITY_CHUNK_CAPACITY 1024  // entities per chunk
+#define ENTITY_NONE 0u
+
+typedef unsigned int EntityId;      // low 24 bits index, high 8 bits generation
+typedef unsigned int ComponentMask;
+
+#define COMPONENT_BIT(type) (1u << (type))
+
+typedef struct {
+    int count;
+    EntityId *entities;
+    void *columns[ENTITY_MAX_COMPONENTS];  // NULL for components not in the archetype
+} EntityChunk;
+
+typedef struct {
+    ComponentMask mask;
+    int row_size;
+    int column_offset[ENTITY_MAX_COMPONENTS];
+    int entity_count;
+    int chunk_count, chunk_capacity;
+    EntityChunk *chunks;
+} Archetype;
+
+typedef struct {
+    int component_count;
+    int component_size[ENTITY_MAX_COMPONENTS];
+
+    int archetype_count, archetype_capacity;
+    Archetype *archetypes;
+
+    // Entity index -> location, slots are recycled through a free list
+    int entity_count, entity_capacity;
+    int *entity_archetype;
+    int *entity_chunk;
+    int *entity_row;
+    unsigned char *entity_generation;
+    int *free_list;
+    int free_count;
+} EntityStore;
+
+// Iterates chunk by chunk over every archetype containing all of mask
+typedef struct {
+    EntityStore *store;
+    ComponentMask mask;
+    int archetype, chunk;
+
+    // Current chunk, valid after entity_query_next returned 1
+    int count;
+    EntityId *entities;
+    void **columns;
+} EntityQuery;
+
+// component_size[i] is the size of component type i
+void entity_store_init(EntityStore *store, const int *component_size, int component_count);
+void entity_store_cleanup(EntityStore *store);
+
+// New entity with zeroed components
+EntityId entity_create(EntityStore *store, ComponentMask mask);
+void entity_destroy(EntityStore *store, EntityId entity);
+int entity_alive(const EntityStore *store, EntityId entity);
+
+// Moves the entity to the archetype of mask, keeping the shared components
+void entity_set_mask(EntityStore *store, EntityId entity, ComponentMask mask);
+ComponentMask entity_mask(const EntityStore *store, EntityId entity);
+
+// NULL if the entity does not have the component
+void *entity_get(EntityStore *store, EntityId entity, int type);
+
+void entity_query_begin(EntityQuery *query, EntityStore *store, ComponentMask mask);
+int entity_query_next(EntityQuery *query);
+
+#define entity_query_column(query, type) ((query)->columns[(type)])
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef INSTANCE_CULL_H
+#define INSTANCE_CULL_H
+
+#include <rafgl.h>
+#include <static_batch.h>
+
+// Frustum culling of one mesh's instances on the GPU. The instances and their
+// world bounding spheres stay in GL buffers, a transform feedback pass runs
+// one point per instance through a geometry shader that tests the sphere
+// against the frustum planes and emits the survivors, so the output buffer
+// holds them compacted in StaticInstance layout. GL 3.3 has no indirect
+// draws, the number of survivors comes from a
+// GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN query that is only read once it is
+// available. Outputs go round a ring and the newest one whose count came back
+// is drawn, so the CPU never waits and the drawn set lags the camera by a
+// frame or two. Spheres are grown by INSTANCE_CULL_MARGIN to hide the lag.
+
+#define INSTANCE_CULL_LATENCY 3     // outputs in flight
+#define INSTANCE_CULL_MARGIN 0.5f   // world units added to every radius
+#define INSTANCE_CULL_ATTRIB_SPHERE 9  // after the StaticInstance attributes
+
+typedef struct {
+    const rafgl_meshPUN_t *mesh;
+
+    int count, capacity;
+    StaticInstance *instances;  // staged until instance_cull_upload()
+    float *spheres;             // xyz = world center, w = radius
+
+    GLuint source_buffer, sphere_buffer;
+    GLuint vao;                 // cull pass input
+    GLuint program;
+    GLint planes, margin;
+
+    GLuint outputs[INSTANCE_CULL_LATENCY];
+    GLuint queries[INSTANCE_CULL_LATENCY];
+    int output_frame[INSTANCE_CULL_LATENCY];  // frame of the pass, -1 when free
+    int output_count[INSTANCE_CULL_LATENCY];  // survivors, -1 until read back
+
+    int frame;
+    int ready;                  // newest output with a count, -1 for none
+
+    // Statistics of the last draw
+    int drawn, lag;
+} InstanceCull;
+
+// mesh has to live in the mesh buffer of the batch it is drawn with
+void instance_cull_init(InstanceCull *cull, const rafgl_meshPUN_t *mesh, int capacity);
+void instance_cull_cleanup(InstanceCull *cull);
+
+// Returns 0 when full
+int instance_cull_add(InstanceCull *cull, const mat4_t *model, vec3_t color, int layer,
+                      vec3_t center, float radius);
+// Uploads the added instances, previous outputs are dropped
+void instance_cull_upload(InstanceCull *cull);
+// Drops the outputs, every instance is drawn again until a new count comes
+// back. For culling that resumes after frames without instance_cull_run().
+void instance_cull_reset(InstanceCull *cull);
+
+// Culls against view_projection, a camera or a cube face, without waiting
+// for anything
+void instance_cull_run(InstanceCull *cull, mat4_t view_projection);
+// Draws the newest culled set with whatever program is bound, every instance
+// until the first count comes back. Returns the number of draw calls.
+int instance_cull_draw(InstanceCull *cull, const StaticBatch *batch);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef LIGHT_SYSTEM_H
+#define LIGHT_SYSTEM_H
+
+#include <rafgl.h>
+
+// Point lights stored as structure-of-arrays streams. Only the rest state and
+// the flicker parameters live here, shadow resources are kept by the caller.
+// light_system_animate() evaluates flicker and jitter for all lights at once
+// and writes the result straight into a std140 staging block that
+// light_system_upload() copies into the lighting uniform buffer.
+
+#define LIGHT_SYSTEM_LANES 8            // streams are padded to a multiple of this
+#define LIGHT_SYSTEM_MAX_GPU_LIGHTS 64  // must match MAX_LIGHTS in deferred/frag.glsl
+#define LIGHT_SYSTEM_UBO_BINDING 0
+
+// One element of the LightBlock uniform block (std140)
+typedef struct {
+    float position_radius[4];  // xyz = animated position, w = radius
+    float color_intensity[4];  // rgb = animated color, a = intensity
+} LightGPU;
+
+typedef struct {
+    vec3_t position;
+    vec3_t color;
+    float radius;
+    float flicker_speed;        // 0 disables the flicker
+    float time_offset;
+    float intensity_base;
+    float intensity_variation;
+    vec3_t jitter;              // amplitude of the position wobble per axis
+} LightDesc;
+
+typedef struct {
+    int count;
+    int capacity;
+
+    // Rest state
+    float *base_x, *base_y, *base_z;
+    float *radius;
+    float *color_r, *color_g, *color_b;
+
+    // Flicker parameters
+    float *flicker_speed, *time_offset;
+    float *intensity_base, *intensity_variation;
+    float *jitter_x, *jitter_y, *jitter_z;
+
+    // Animated lights in upload layout
+    LightGPU *gpu;
+
+    GLuint ubo;
+} LightSystem;
+
+// CPU side only, usable without a GL context
+void light_system_init(LightSystem *ls, int capacity);
+void light_system_cleanup(LightSystem *ls);
+int light_system_add(LightSystem *ls, const LightDesc *desc);
+void light_system_set_position(LightSystem *ls, int index, vec3_t position);
+void light_system_set_color(LightSystem *ls, int index, vec3_t color);
+void light_system_set_radius(LightSystem *ls, int index, float radius);
+void light_system_animate(LightSystem *ls, float time);
+vec3_t light_system_position(const LightSystem *ls, int index);
+const char *light_system_kernel_name(void);
+
+// Creates the uniform buffer and binds it to LIGHT_SYSTEM_UBO_BINDING
+void light_system_create_buffer(LightSystem *ls);
+// Links the LightBlock of a program to LIGHT_SYSTEM_UBO_BINDING
+void light_system_bind_program(GLuint program);
+// Uploads the first count animated lights
+void light_system_upload(LightSystem *ls, int count);
+
+#endif
@@ -41,6 +41,13 @@ QUICK NOTES
   sources. Most code is covered by test cases that have been manually calculated
   and checked on the whiteboard. Since indices and math code is prone to be
   confusing we used pair programming to avoid mistakes.
+- `m4_mul()`, `m4_invert_affine()`, the point/direction transforms and the
+  batch and frustum functions use SSE when the compiler targets it (always the
+  case on x86-64) and AVX when it is enabled (e.g. `-mavx` or `-march=native`).
+  Every SIMD path has a scalar fallback that produces the same results. Define
+  MATH_3D_NO_SIMD before including this file to force the scalar code.
+- The batch functions (`*_batch()`) work on plain arrays of `vec3_t`. Results
+  may be written back into the input array.
 
 
 FURTHER IDEARS
@@ -68,6 +75,8 @@ there is a proper use case and we can find good names for them.
 VERSION HISTORY
 
 v1.0  2016-02-15  Initial release
+v1.1  2026-10-17  SSE/AVX kernels, batch point/direction/AABB transforms and
+                  frustum culling tests
 
 **/
 
@@ -77,6 +86,15 @@ v1.0  2016-02-15  Initial release
 #include <math.h>
 #include <stdio.h>
 
+#if !defined(MATH_3D_NO_SIMD) && defined(__SSE__)
+#	define MATH_3D_SSE 1
+#	include <xmmintrin.h>
+#endif
+#if !defined(MATH_3D_NO_SIMD) && defined(__AVX__)
+#	define MATH_3D_AVX 1
+#	include <immintrin.h>
+#endif
+
 
 // Define PI directly because we would need to define the _BSD_SOURCE or
 // _XOPEN_SOURCE feature test macros to get it from math.h. That would be a
@@ -191,6 +209,11 @@ static inline mat4_t m4_mul          (mat4_t a, mat4_t b);
               mat4_t m4_invert_affine(mat4_t matrix);
               vec3_t m4_mul_pos      (mat4_t matrix, vec3_t position);
               vec3_t m4_mul_dir      (mat4_t matrix, vec3_t direction);
+              void   m4_mul_aabb     (mat4_t matrix, vec3_t min, vec3_t max, vec3_t* result_min, vec3_t* result_max);
+
+              void   m4_mul_pos_batch (mat4_t matrix, const vec3_t* positions, vec3_t* results, int count);
+              void   m4_mul_dir_batch (mat4_t matrix, const vec3_t* directions, vec3_t* results, int count);
+              void   m4_mul_aabb_batch(mat4_t matrix, const vec3_t* mins, const vec3_t* maxs, vec3_t* result_mins, vec3_t* result_maxs, int count);
 
               void   m4_print        (mat4_t matrix);
               void   m4_printp       (mat4_t matrix, int width, int precision);
@@ -198,6 +221,35 @@ static inline mat4_t m4_mul          (mat4_t a, mat4_t b);
               void   m4_fprintp      (FILE* stream, mat4_t matrix, int width, int precision);
 
 
+//
+// View frustum
+//
+// Six planes (a, b, c, d) extracted from a combined view-projection matrix in
+// the order left, right, bottom, top, near, far. The plane normals point into
+// the frustum and are normalized, so a*x + b*y + c*z + d is the signed distance
+// of the point (x, y, z) to a plane.
+//
+// The multi-object tests take their inputs as separate coordinate arrays
+// (structure of arrays) and return a bit mask with bit i set if object i is
+// at least partially inside. The 4 and 8 wide variants process exactly 4 or 8
+// objects, `frustum_spheres_batch()` any number. `frustum_aabbs4_classify()`
+// also reports which boxes are entirely inside, so hierarchies can stop
+// testing below them.
+//
+
+typedef struct { float planes[6][4]; } frustum_t;
+
+              frustum_t frustum_from_m4  (mat4_t view_projection);
+              int       frustum_sphere   (const frustum_t* frustum, vec3_t center, float radius);
+              int       frustum_aabb     (const frustum_t* frustum, vec3_t min, vec3_t max);
+              int       frustum_spheres4 (const frustum_t* frustum, const float* x, const float* y, const float* z, const float* radius);
+              int       frustum_spheres8 (const frustum_t* frustum, const float* x, const float* y, const float* z, const float* radius);
+              int       frustum_aabbs4   (const frustum_t* frustum, const float* min_x, const float* min_y, const float* min_z, const float* max_x, const float* max_y, const float* max_z);
+              int       frustum_aabbs8   (const frustum_t* frustum, const float* min_x, const float* min_y, const float* min_z, const float* max_x, const float* max_y, const float* max_z);
+              int       frustum_aabbs4_classify(const frustum_t* frustum, const float* min_x, const float* min_y, const float* min_z, const float* max_x, const float* max_y, const float* max_z, int* inside);
+              int       frustum_spheres_batch(const frustum_t* frustum, const float* x, const float* y, const float* z, const float* radius, unsigned char* visible, int count);
+
+
 
 //
 // 3D vector functions header implementation
@@ -326,6 +378,36 @@ static inline mat4_t m4_transpose(mat4_t matrix) {
 static inline mat4_t m4_mul(mat4_t a, mat4_t b) {
 	mat4_t result;
 	
+#if defined(MATH_3D_AVX)
+	// Two result columns per iteration. Each 128 bit lane of the register holds
+	// one column of b and _mm256_shuffle_ps broadcasts within each lane.
+	__m128 a0 = _mm_loadu_ps(a.m[0]), a1 = _mm_loadu_ps(a.m[1]);
+	__m128 a2 = _mm_loadu_ps(a.m[2]), a3 = _mm_loadu_ps(a.m[3]);
+	__m256 aa0 = _mm256_insertf128_ps(_mm256_castps128_ps256(a0), a0, 1);
+	__m256 aa1 = _mm256_insertf128_ps(_mm256_castps128_ps256(a1), a1, 1);
+	__m256 aa2 = _mm256_insertf128_ps(_mm256_castps128_ps256(a2), a2, 1);
+	__m256 aa3 = _mm256_insertf128_ps(_mm256_castps128_ps256(a3), a3, 1);
+	for(int i = 0; i < 4; i += 2) {
+		__m256 bb = _mm256_loadu_ps(b.m[i]);
+		__m256 r = _mm256_mul_ps(aa0, _mm256_shuffle_ps(bb, bb, _MM_SHUFFLE(0, 0, 0, 0)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(aa1, _mm256_shuffle_ps(bb, bb, _MM_SHUFFLE(1, 1, 1, 1))));
+		r = _mm256_add_ps(r, _mm256_mul_ps(aa2, _mm256_shuffle_ps(bb, bb, _MM_SHUFFLE(2, 2, 2, 2))));
+		r = _mm256_add_ps(r, _mm256_mul_ps(aa3, _mm256_shuffle_ps(bb, bb, _MM_SHUFFLE(3, 3, 3, 3))));
+		_mm256_storeu_ps(result.m[i], r);
+	}
+#elif defined(MATH_3D_SSE)
+	// Column i of the result is the sum of the columns of a weighted by the
+	// components of column i of b.
+	__m128 a0 = _mm_loadu_ps(a.m[0]), a1 = _mm_loadu_ps(a.m[1]);
+	__m128 a2 = _mm_loadu_ps(a.m[2]), a3 = _mm_loadu_ps(a.m[3]);
+	for(int i = 0; i < 4; i++) {
+		__m128 r = _mm_mul_ps(a0, _mm_set1_ps(b.m[i][0]));
+		r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b.m[i][1])));
+		r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b.m[i][2])));
+		r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b.m[i][3])));
+		_mm_storeu_ps(result.m[i], r);
+	}
+#else
 	for(int i = 0; i < 4; i++) {
 		for(int j = 0; j < 4; j++) {
 			float sum = 0;
@@ -335,6 +417,7 @@ static inline mat4_t m4_mul(mat4_t a, mat4_t b) {
 			result.m[i][j] = sum;
 		}
 	}
+#endif
 	
 	return result;
 }
@@ -344,6 +427,77 @@ static inline mat4_t m4_mul(mat4_t a, mat4_t b) {
 
 #ifdef MATH_3D_IMPLEMENTATION
 
+#if defined(MATH_3D_SSE)
+
+// Cross product of the xyz lanes, the w lane of the result is 0
+static inline __m128 m3d_cross_sse(__m128 a, __m128 b) {
+	__m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 a_zxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+	__m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 b_zxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+	return _mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx));
+}
+
+// Reduces (x, y, z, w) to a 3D vector with the same perspective divide rule as
+// the scalar code: only divide if w isn't 0 or 1.
+static inline vec3_t m3d_reduce_sse(__m128 r) {
+	float v[4];
+	_mm_storeu_ps(v, r);
+	if (v[3] != 0 && v[3] != 1)
+		return vec3(v[0] / v[3], v[1] / v[3], v[2] / v[3]);
+	return vec3(v[0], v[1], v[2]);
+}
+
+// Loads 4 consecutive vec3_t (12 floats) and transposes them into x, y and z
+// registers. a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+static inline void m3d_load_soa4(const vec3_t* v, __m128* x, __m128* y, __m128* z) {
+	const float* f = (const float*)v;
+	__m128 a = _mm_loadu_ps(f), b = _mm_loadu_ps(f + 4), c = _mm_loadu_ps(f + 8);
+	__m128 t = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));  // x2 y2 x3 y3
+	__m128 u = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1));  // y0 z0 y1 z1
+	*x = _mm_shuffle_ps(a, t, _MM_SHUFFLE(2, 0, 3, 0));
+	*y = _mm_shuffle_ps(u, t, _MM_SHUFFLE(3, 1, 2, 0));
+	*z = _mm_shuffle_ps(u, c, _MM_SHUFFLE(3, 0, 3, 1));
+}
+
+// Inverse of m3d_load_soa4()
+static inline void m3d_store_soa4(vec3_t* v, __m128 x, __m128 y, __m128 z) {
+	float* f = (float*)v;
+	__m128 xy = _mm_unpacklo_ps(x, y);                         // x0 y0 x1 y1
+	__m128 zx = _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)); // z0 z0 x1 x1
+	__m128 yz = _mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)); // y1 y1 z1 z1
+	__m128 xy2 = _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2));// x2 x2 y2 y2
+	__m128 zx3 = _mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2));// z2 z2 x3 x3
+	__m128 yz3 = _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3));// y3 y3 z3 z3
+	_mm_storeu_ps(f,     _mm_shuffle_ps(xy, zx, _MM_SHUFFLE(2, 0, 1, 0)));
+	_mm_storeu_ps(f + 4, _mm_shuffle_ps(yz, xy2, _MM_SHUFFLE(2, 0, 2, 0)));
+	_mm_storeu_ps(f + 8, _mm_shuffle_ps(zx3, yz3, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+#endif // MATH_3D_SSE
+
+#if defined(MATH_3D_AVX)
+
+static inline __m256 m3d_combine_avx(__m128 lo, __m128 hi) {
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+static inline void m3d_load_soa8(const vec3_t* v, __m256* x, __m256* y, __m256* z) {
+	__m128 x0, y0, z0, x1, y1, z1;
+	m3d_load_soa4(v, &x0, &y0, &z0);
+	m3d_load_soa4(v + 4, &x1, &y1, &z1);
+	*x = m3d_combine_avx(x0, x1);
+	*y = m3d_combine_avx(y0, y1);
+	*z = m3d_combine_avx(z0, z1);
+}
+
+static inline void m3d_store_soa8(vec3_t* v, __m256 x, __m256 y, __m256 z) {
+	m3d_store_soa4(v, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y), _mm256_castps256_ps128(z));
+	m3d_store_soa4(v + 4, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1));
+}
+
+#endif // MATH_3D_AVX
+
 /**
  * Creates a matrix to rotate around an axis by a given angle. The axis doesn't
  * need to be normalized.
@@ -521,6 +675,44 @@ mat4_t m4_look_at(vec3_t from, vec3_t to, vec3_t up) {
  * https://www.khanacademy.org/math/precalculus/precalc-matrices/determinants-and-inverses-of-large-matrices/v/inverting-3x3-part-2-determinant-and-adjugate-of-a-matrix
  */
 mat4_t m4_invert_affine(mat4_t matrix) {
+#if defined(MATH_3D_SSE)
+	// Same math as the scalar version below with the three columns of R as SSE
+	// vectors. The rows of inv(R) are the cross products of the columns of R
+	// (which are the cofactors) divided by the determinant.
+	__m128 c0 = _mm_loadu_ps(matrix.m[0]);
+	__m128 c1 = _mm_loadu_ps(matrix.m[1]);
+	__m128 c2 = _mm_loadu_ps(matrix.m[2]);
+	
+	__m128 r0 = m3d_cross_sse(c1, c2);
+	__m128 r1 = m3d_cross_sse(c2, c0);
+	__m128 r2 = m3d_cross_sse(c0, c1);
+	
+	float det = matrix.m00 * _mm_cvtss_f32(r0) + matrix.m10 * _mm_cvtss_f32(r1) + matrix.m20 * _mm_cvtss_f32(r2);
+	if (fabsf(det) < 0.00001)
+		return m4_identity();
+	
+	__m128 d = _mm_set1_ps(det);
+	r0 = _mm_div_ps(r0, d);
+	r1 = _mm_div_ps(r1, d);
+	r2 = _mm_div_ps(r2, d);
+	__m128 r3 = _mm_setzero_ps();
+	
+	// The rows become the columns of the result, the w lanes are all 0
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	
+	__m128 t = _mm_mul_ps(r0, _mm_set1_ps(matrix.m30));
+	t = _mm_add_ps(t, _mm_mul_ps(r1, _mm_set1_ps(matrix.m31)));
+	t = _mm_add_ps(t, _mm_mul_ps(r2, _mm_set1_ps(matrix.m32)));
+	t = _mm_xor_ps(t, _mm_set1_ps(-0.0f));
+	
+	mat4_t result;
+	_mm_storeu_ps(result.m[0], r0);
+	_mm_storeu_ps(result.m[1], r1);
+	_mm_storeu_ps(result.m[2], r2);
+	_mm_storeu_ps(result.m[3], t);
+	result.m33 = 1;
+	return result;
+#else
 	// Create shorthands to access matrix members
 	float m00 = matrix.m00,  m10 = matrix.m10,  m20 = matrix.m20,  m30 = matrix.m30;
 	float m01 = matrix.m01,  m11 = matrix.m11,  m21 = matrix.m21,  m31 = matrix.m31;
@@ -554,6 +746,7 @@ mat4_t m4_invert_affine(mat4_t matrix) {
 		i02, i12, i22,  -(i02*m30 + i12*m31 + i22*m32),
 		0,   0,   0,      1
 	);
+#endif
 }
 
 /**
@@ -564,6 +757,13 @@ mat4_t m4_invert_affine(mat4_t matrix) {
  * dividing through the 4th component (if it's not 0 or 1).
  */
 vec3_t m4_mul_pos(mat4_t matrix, vec3_t position) {
+#if defined(MATH_3D_SSE)
+	__m128 r = _mm_mul_ps(_mm_loadu_ps(matrix.m[0]), _mm_set1_ps(position.x));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(matrix.m[1]), _mm_set1_ps(position.y)));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(matrix.m[2]), _mm_set1_ps(position.z)));
+	r = _mm_add_ps(r, _mm_loadu_ps(matrix.m[3]));
+	return m3d_reduce_sse(r);
+#else
 	vec3_t result = vec3(
 		matrix.m00 * position.x + matrix.m10 * position.y + matrix.m20 * position.z + matrix.m30,
 		matrix.m01 * position.x + matrix.m11 * position.y + matrix.m21 * position.z + matrix.m31,
@@ -575,6 +775,7 @@ vec3_t m4_mul_pos(mat4_t matrix, vec3_t position) {
 		return vec3(result.x / w, result.y / w, result.z / w);
 	
 	return result;
+#endif
 }
 
 /**
@@ -589,6 +790,12 @@ vec3_t m4_mul_pos(mat4_t matrix, vec3_t position) {
  * or 1.
  */
 vec3_t m4_mul_dir(mat4_t matrix, vec3_t direction) {
+#if defined(MATH_3D_SSE)
+	__m128 r = _mm_mul_ps(_mm_loadu_ps(matrix.m[0]), _mm_set1_ps(direction.x));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(matrix.m[1]), _mm_set1_ps(direction.y)));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(matrix.m[2]), _mm_set1_ps(direction.z)));
+	return m3d_reduce_sse(r);
+#else
 	vec3_t result = vec3(
 		matrix.m00 * direction.x + matrix.m10 * direction.y + matrix.m20 * direction.z,
 		matrix.m01 * direction.x + matrix.m11 * direction.y + matrix.m21 * direction.z,
@@ -600,6 +807,403 @@ vec3_t m4_mul_dir(mat4_t matrix, vec3_t direction) {
 		return vec3(result.x / w, result.y / w, result.z / w);
 	
 	return result;
+#endif
+}
+
+/**
+ * Transforms an axis aligned bounding box and returns the axis aligned box that
+ * encloses the result. Only the affine part of the matrix is used.
+ * 
+ * Implementation details:
+ * 
+ * Each component of the new box starts at the translation. Then every matrix
+ * element adds its contribution: the smaller of the products with the old
+ * minimum and maximum goes to the new minimum, the larger to the new maximum.
+ * 
+ * Sources:
+ * 
+ * Jim Arvo, "Transforming Axis-Aligned Bounding Boxes", Graphics Gems, 1990
+ */
+void m4_mul_aabb(mat4_t matrix, vec3_t min, vec3_t max, vec3_t* result_min, vec3_t* result_max) {
+	float old_min[3] = { min.x, min.y, min.z }, old_max[3] = { max.x, max.y, max.z };
+	float new_min[3], new_max[3];
+	
+	for(int j = 0; j < 3; j++) {
+		new_min[j] = new_max[j] = matrix.m[3][j];
+		for(int i = 0; i < 3; i++) {
+			float e = matrix.m[i][j] * old_min[i];
+			float f = matrix.m[i][j] * old_max[i];
+			new_min[j] += (e < f) ? e : f;
+			new_max[j] += (e < f) ? f : e;
+		}
+	}
+	
+	*result_min = vec3(new_min[0], new_min[1], new_min[2]);
+	*result_max = vec3(new_max[0], new_max[1], new_max[2]);
+}
+
+/**
+ * Applies `m4_mul_pos()` to `count` points. The SIMD paths transpose groups of
+ * 4 (SSE) or 8 (AVX) points into x, y and z registers and transform them with
+ * the matrix elements broadcast. The remainder is done one point at a time.
+ */
+void m4_mul_pos_batch(mat4_t matrix, const vec3_t* positions, vec3_t* results, int count) {
+	int i = 0;
+	
+#if defined(MATH_3D_AVX)
+	__m256 m00 = _mm256_set1_ps(matrix.m00), m10 = _mm256_set1_ps(matrix.m10), m20 = _mm256_set1_ps(matrix.m20), m30 = _mm256_set1_ps(matrix.m30);
+	__m256 m01 = _mm256_set1_ps(matrix.m01), m11 = _mm256_set1_ps(matrix.m11), m21 = _mm256_set1_ps(matrix.m21), m31 = _mm256_set1_ps(matrix.m31);
+	__m256 m02 = _mm256_set1_ps(matrix.m02), m12 = _mm256_set1_ps(matrix.m12), m22 = _mm256_set1_ps(matrix.m22), m32 = _mm256_set1_ps(matrix.m32);
+	__m256 m03 = _mm256_set1_ps(matrix.m03), m13 = _mm256_set1_ps(matrix.m13), m23 = _mm256_set1_ps(matrix.m23), m33 = _mm256_set1_ps(matrix.m33);
+	__m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1);
+	
+	for(; i + 8 <= count; i += 8) {
+		__m256 x, y, z;
+		m3d_load_soa8(positions + i, &x, &y, &z);
+		__m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m00, x), _mm256_mul_ps(m10, y)), _mm256_mul_ps(m20, z)), m30);
+		__m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m01, x), _mm256_mul_ps(m11, y)), _mm256_mul_ps(m21, z)), m31);
+		__m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m02, x), _mm256_mul_ps(m12, y)), _mm256_mul_ps(m22, z)), m32);
+		__m256 w  = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m03, x), _mm256_mul_ps(m13, y)), _mm256_mul_ps(m23, z)), m33);
+		
+		// Select with and/andnot/or, GCC turns a blendv on this mask into scalar code
+		__m256 divide = _mm256_and_ps(_mm256_cmp_ps(w, zero, _CMP_NEQ_UQ), _mm256_cmp_ps(w, one, _CMP_NEQ_UQ));
+		rx = _mm256_or_ps(_mm256_and_ps(divide, _mm256_div_ps(rx, w)), _mm256_andnot_ps(divide, rx));
+		ry = _mm256_or_ps(_mm256_and_ps(divide, _mm256_div_ps(ry, w)), _mm256_andnot_ps(divide, ry));
+		rz = _mm256_or_ps(_mm256_and_ps(divide, _mm256_div_ps(rz, w)), _mm256_andnot_ps(divide, rz));
+		m3d_store_soa8(results + i, rx, ry, rz);
+	}
+#elif defined(MATH_3D_SSE)
+	__m128 m00 = _mm_set1_ps(matrix.m00), m10 = _mm_set1_ps(matrix.m10), m20 = _mm_set1_ps(matrix.m20), m30 = _mm_set1_ps(matrix.m30);
+	__m128 m01 = _mm_set1_ps(matrix.m01), m11 = _mm_set1_ps(matrix.m11), m21 = _mm_set1_ps(matrix.m21), m31 = _mm_set1_ps(matrix.m31);
+	__m128 m02 = _mm_set1_ps(matrix.m02), m12 = _mm_set1_ps(matrix.m12), m22 = _mm_set1_ps(matrix.m22), m32 = _mm_set1_ps(matrix.m32);
+	__m128 m03 = _mm_set1_ps(matrix.m03), m13 = _mm_set1_ps(matrix.m13), m23 = _mm_set1_ps(matrix.m23), m33 = _mm_set1_ps(matrix.m33);
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1);
+	
+	for(; i + 4 <= count; i += 4) {
+		__m128 x, y, z;
+		m3d_load_soa4(positions + i, &x, &y, &z);
+		__m128 rx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m10, y)), _mm_mul_ps(m20, z)), m30);
+		__m128 ry = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m01, x), _mm_mul_ps(m11, y)), _mm_mul_ps(m21, z)), m31);
+		__m128 rz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m02, x), _mm_mul_ps(m12, y)), _mm_mul_ps(m22, z)), m32);
+		__m128 w  = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m03, x), _mm_mul_ps(m13, y)), _mm_mul_ps(m23, z)), m33);
+		
+		// SSE has no blend, select with and/andnot/or
+		__m128 divide = _mm_and_ps(_mm_cmpneq_ps(w, zero), _mm_cmpneq_ps(w, one));
+		rx = _mm_or_ps(_mm_and_ps(divide, _mm_div_ps(rx, w)), _mm_andnot_ps(divide, rx));
+		ry = _mm_or_ps(_mm_and_ps(divide, _mm_div_ps(ry, w)), _mm_andnot_ps(divide, ry));
+		rz = _mm_or_ps(_mm_and_ps(divide, _mm_div_ps(rz, w)), _mm_andnot_ps(divide, rz));
+		m3d_store_soa4(results + i, rx, ry, rz);
+	}
+#endif
+	
+	for(; i < count; i++)
+		results[i] = m4_mul_pos(matrix, positions[i]);
+}
+
+/**
+ * Applies `m4_mul_dir()` to `count` directions. Same structure as
+ * `m4_mul_pos_batch()` without the translation.
+ */
+void m4_mul_dir_batch(mat4_t matrix, const vec3_t* directions, vec3_t* results, int count) {
+	int i = 0;
+	
+#if defined(MATH_3D_AVX)
+	__m256 m00 = _mm256_set1_ps(matrix.m00), m10 = _mm256_set1_ps(matrix.m10), m20 = _mm256_set1_ps(matrix.m20);
+	__m256 m01 = _mm256_set1_ps(matrix.m01), m11 = _mm256_set1_ps(matrix.m11), m21 = _mm256_set1_ps(matrix.m21);
+	__m256 m02 = _mm256_set1_ps(matrix.m02), m12 = _mm256_set1_ps(matrix.m12), m22 = _mm256_set1_ps(matrix.m22);
+	__m256 m03 = _mm256_set1_ps(matrix.m03), m13 = _mm256_set1_ps(matrix.m13), m23 = _mm256_set1_ps(matrix.m23);
+	__m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1);
+	
+	for(; i + 8 <= count; i += 8) {
+		__m256 x, y, z;
+		m3d_load_soa8(directions + i, &x, &y, &z);
+		__m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m00, x), _mm256_mul_ps(m10, y)), _mm256_mul_ps(m20, z));
+		__m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m01, x), _mm256_mul_ps(m11, y)), _mm256_mul_ps(m21, z));
+		__m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m02, x), _mm256_mul_ps(m12, y)), _mm256_mul_ps(m22, z));
+		__m256 w  = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m03, x), _mm256_mul_ps(m13, y)), _mm256_mul_ps(m23, z));
+		
+		__m256 divide = _mm256_and_ps(_mm256_cmp_ps(w, zero, _CMP_NEQ_UQ), _mm256_cmp_ps(w, one, _CMP_NEQ_UQ));
+		rx = _mm256_or_ps(_mm256_and_ps(divide, _mm256_div_ps(rx, w)), _mm256_andnot_ps(divide, rx));
+		ry = _mm256_or_ps(_mm256_and_ps(divide, _mm256_div_ps(ry, w)), _mm256_andnot_ps(divide, ry));
+		rz = _mm256_or_ps(_mm256_and_ps(divide, _mm256_div_ps(rz, w)), _mm256_andnot_ps(divide, rz));
+		m3d_store_soa8(results + i, rx, ry, rz);
+	}
+#elif defined(MATH_3D_SSE)
+	__m128 m00 = _mm_set1_ps(matrix.m00), m10 = _mm_set1_ps(matrix.m10), m20 = _mm_set1_ps(matrix.m20);
+	__m128 m01 = _mm_set1_ps(matrix.m01), m11 = _mm_set1_ps(matrix.m11), m21 = _mm_set1_ps(matrix.m21);
+	__m128 m02 = _mm_set1_ps(matrix.m02), m12 = _mm_set1_ps(matrix.m12), m22 = _mm_set1_ps(matrix.m22);
+	__m128 m03 = _mm_set1_ps(matrix.m03), m13 = _mm_set1_ps(matrix.m13), m23 = _mm_set1_ps(matrix.m23);
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1);
+	
+	for(; i + 4 <= count; i += 4) {
+		__m128 x, y, z;
+		m3d_load_soa4(directions + i, &x, &y, &z);
+		__m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m10, y)), _mm_mul_ps(m20, z));
+		__m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m01, x), _mm_mul_ps(m11, y)), _mm_mul_ps(m21, z));
+		__m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m02, x), _mm_mul_ps(m12, y)), _mm_mul_ps(m22, z));
+		__m128 w  = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m03, x), _mm_mul_ps(m13, y)), _mm_mul_ps(m23, z));
+		
+		__m128 divide = _mm_and_ps(_mm_cmpneq_ps(w, zero), _mm_cmpneq_ps(w, one));
+		rx = _mm_or_ps(_mm_and_ps(divide, _mm_div_ps(rx, w)), _mm_andnot_ps(divide, rx));
+		ry = _mm_or_ps(_mm_and_ps(divide, _mm_div_ps(ry, w)), _mm_andnot_ps(divide, ry));
+		rz = _mm_or_ps(_mm_and_ps(divide, _mm_div_ps(rz, w)), _mm_andnot_ps(divide, rz));
+		m3d_store_soa4(results + i, rx, ry, rz);
+	}
+#endif
+	
+	for(; i < count; i++)
+		results[i] = m4_mul_dir(matrix, directions[i]);
+}
+
+/**
+ * Applies `m4_mul_aabb()` to `count` boxes. The SSE path transforms 4 boxes at
+ * a time, with the min/max selection done by _mm_min_ps and _mm_max_ps.
+ */
+void m4_mul_aabb_batch(mat4_t matrix, const vec3_t* mins, const vec3_t* maxs, vec3_t* result_mins, vec3_t* result_maxs, int count) {
+	int i = 0;
+	
+#if defined(MATH_3D_SSE)
+	for(; i + 4 <= count; i += 4) {
+		__m128 old_min[3], old_max[3], new_min[3], new_max[3];
+		m3d_load_soa4(mins + i, &old_min[0], &old_min[1], &old_min[2]);
+		m3d_load_soa4(maxs + i, &old_max[0], &old_max[1], &old_max[2]);
+		
+		for(int j = 0; j < 3; j++) {
+			new_min[j] = new_max[j] = _mm_set1_ps(matrix.m[3][j]);
+			for(int k = 0; k < 3; k++) {
+				__m128 m = _mm_set1_ps(matrix.m[k][j]);
+				__m128 e = _mm_mul_ps(m, old_min[k]);
+				__m128 f = _mm_mul_ps(m, old_max[k]);
+				new_min[j] = _mm_add_ps(new_min[j], _mm_min_ps(e, f));
+				new_max[j] = _mm_add_ps(new_max[j], _mm_max_ps(e, f));
+			}
+		}
+		
+		m3d_store_soa4(result_mins + i, new_min[0], new_min[1], new_min[2]);
+		m3d_store_soa4(result_maxs + i, new_max[0], new_max[1], new_max[2]);
+	}
+#endif
+	
+	for(; i < count; i++)
+		m4_mul_aabb(matrix, mins[i], maxs[i], &result_mins[i], &result_maxs[i]);
+}
+
+/**
+ * Extracts the six frustum planes from a view-projection matrix. Each plane is
+ * the sum or difference of the fourth row and one of the other rows, then
+ * normalized so the plane equation gives real distances.
+ * 
+ * Sources:
+ * 
+ * Gil Gribb, Klaus Hartmann, "Fast Extraction of Viewing Frustum Planes from the
+ * World-View-Projection Matrix", 2001
+ */
+frustum_t frustum_from_m4(mat4_t view_projection) {
+	frustum_t frustum;
+	
+	for(int p = 0; p < 6; p++) {
+		int row = p / 2;
+		float sign = (p & 1) ? -1.0f : 1.0f;
+		float* plane = frustum.planes[p];
+		for(int i = 0; i < 4; i++)
+			plane[i] = view_projection.m[i][3] + sign * view_projection.m[i][row];
+		
+		float length = sqrtf(plane[0]*plane[0] + plane[1]*plane[1] + plane[2]*plane[2]);
+		for(int i = 0; i < 4; i++)
+			plane[i] /= length;
+	}
+	
+	return frustum;
+}
+
+/**
+ * Returns 1 if the sphere is at least partially inside the frustum. Spheres
+ * near the frustum corners may be reported visible although they aren't.
+ */
+int frustum_sphere(const frustum_t* frustum, vec3_t center, float radius) {
+	for(int p = 0; p < 6; p++) {
+		const float* plane = frustum->planes[p];
+		if (plane[0] * center.x + plane[1] * center.y + plane[2] * center.z + plane[3] < -radius)
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * Returns 1 if the box is at least partially inside the frustum. For each plane
+ * only the box corner furthest along the plane normal is tested.
+ */
+int frustum_aabb(const frustum_t* frustum, vec3_t min, vec3_t max) {
+	for(int p = 0; p < 6; p++) {
+		const float* plane = frustum->planes[p];
+		float dx = fmaxf(plane[0] * min.x, plane[0] * max.x);
+		float dy = fmaxf(plane[1] * min.y, plane[1] * max.y);
+		float dz = fmaxf(plane[2] * min.z, plane[2] * max.z);
+		if (dx + dy + dz + plane[3] < 0)
+			return 0;
+	}
+	return 1;
+}
+
+int frustum_spheres4(const frustum_t* frustum, const float* x, const float* y, const float* z, const float* radius) {
+#if defined(MATH_3D_SSE)
+	__m128 cx = _mm_loadu_ps(x), cy = _mm_loadu_ps(y), cz = _mm_loadu_ps(z);
+	__m128 neg_radius = _mm_xor_ps(_mm_loadu_ps(radius), _mm_set1_ps(-0.0f));
+	int mask = 0xF;
+	
+	for(int p = 0; p < 6 && mask; p++) {
+		const float* plane = frustum->planes[p];
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_set1_ps(plane[0]), cx),
+			_mm_mul_ps(_mm_set1_ps(plane[1]), cy)),
+			_mm_mul_ps(_mm_set1_ps(plane[2]), cz)),
+			_mm_set1_ps(plane[3]));
+		mask &= _mm_movemask_ps(_mm_cmpge_ps(d, neg_radius));
+	}
+	return mask;
+#else
+	int mask = 0;
+	for(int i = 0; i < 4; i++)
+		mask |= frustum_sphere(frustum, vec3(x[i], y[i], z[i]), radius[i]) << i;
+	return mask;
+#endif
+}
+
+int frustum_spheres8(const frustum_t* frustum, const float* x, const float* y, const float* z, const float* radius) {
+#if defined(MATH_3D_AVX)
+	__m256 cx = _mm256_loadu_ps(x), cy = _mm256_loadu_ps(y), cz = _mm256_loadu_ps(z);
+	__m256 neg_radius = _mm256_xor_ps(_mm256_loadu_ps(radius), _mm256_set1_ps(-0.0f));
+	int mask = 0xFF;
+	
+	for(int p = 0; p < 6 && mask; p++) {
+		const float* plane = frustum->planes[p];
+		__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(_mm256_set1_ps(plane[0]), cx),
+			_mm256_mul_ps(_mm256_set1_ps(plane[1]), cy)),
+			_mm256_mul_ps(_mm256_set1_ps(plane[2]), cz)),
+			_mm256_set1_ps(plane[3]));
+		mask &= _mm256_movemask_ps(_mm256_cmp_ps(d, neg_radius, _CMP_GE_OQ));
+	}
+	return mask;
+#else
+	return frustum_spheres4(frustum, x, y, z, radius) |
+		(frustum_spheres4(frustum, x + 4, y + 4, z + 4, radius + 4) << 4);
+#endif
+}
+
+int frustum_aabbs4(const frustum_t* frustum, const float* min_x, const float* min_y, const float* min_z, const float* max_x, const float* max_y, const float* max_z) {
+#if defined(MATH_3D_SSE)
+	__m128 nx = _mm_loadu_ps(min_x), ny = _mm_loadu_ps(min_y), nz = _mm_loadu_ps(min_z);
+	__m128 px = _mm_loadu_ps(max_x), py = _mm_loadu_ps(max_y), pz = _mm_loadu_ps(max_z);
+	__m128 zero = _mm_setzero_ps();
+	int mask = 0xF;
+	
+	for(int p = 0; p < 6 && mask; p++) {
+		const float* plane = frustum->planes[p];
+		__m128 a = _mm_set1_ps(plane[0]), b = _mm_set1_ps(plane[1]), c = _mm_set1_ps(plane[2]);
+		__m128 dx = _mm_max_ps(_mm_mul_ps(a, nx), _mm_mul_ps(a, px));
+		__m128 dy = _mm_max_ps(_mm_mul_ps(b, ny), _mm_mul_ps(b, py));
+		__m128 dz = _mm_max_ps(_mm_mul_ps(c, nz), _mm_mul_ps(c, pz));
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(dx, dy), dz), _mm_set1_ps(plane[3]));
+		mask &= _mm_movemask_ps(_mm_cmpge_ps(d, zero));
+	}
+	return mask;
+#else
+	int mask = 0;
+	for(int i = 0; i < 4; i++)
+		mask |= frustum_aabb(frustum, vec3(min_x[i], min_y[i], min_z[i]), vec3(max_x[i], max_y[i], max_z[i])) << i;
+	return mask;
+#endif
+}
+
+int frustum_aabbs8(const frustum_t* frustum, const float* min_x, const float* min_y, const float* min_z, const float* max_x, const float* max_y, const float* max_z) {
+#if defined(MATH_3D_AVX)
+	__m256 nx = _mm256_loadu_ps(min_x), ny = _mm256_loadu_ps(min_y), nz = _mm256_loadu_ps(min_z);
+	__m256 px = _mm256_loadu_ps(max_x), py = _mm256_loadu_ps(max_y), pz = _mm256_loadu_ps(max_z);
+	__m256 zero = _mm256_setzero_ps();
+	int mask = 0xFF;
+	
+	for(int p = 0; p < 6 && mask; p++) {
+		const float* plane = frustum->planes[p];
+		__m256 a = _mm256_set1_ps(plane[0]), b = _mm256_set1_ps(plane[1]), c = _mm256_set1_ps(plane[2]);
+		__m256 dx = _mm256_max_ps(_mm256_mul_ps(a, nx), _mm256_mul_ps(a, px));
+		__m256 dy = _mm256_max_ps(_mm256_mul_ps(b, ny), _mm256_mul_ps(b, py));
+		__m256 dz = _mm256_max_ps(_mm256_mul_ps(c, nz), _mm256_mul_ps(c, pz));
+		__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(dx, dy), dz), _mm256_set1_ps(plane[3]));
+		mask &= _mm256_movemask_ps(_mm256_cmp_ps(d, zero, _CMP_GE_OQ));
+	}
+	return mask;
+#else
+	return frustum_aabbs4(frustum, min_x, min_y, min_z, max_x, max_y, max_z) |
+		(frustum_aabbs4(frustum, min_x + 4, min_y + 4, min_z + 4, max_x + 4, max_y + 4, max_z + 4) << 4);
+#endif
+}
+
+/**
+ * Same mask as `frustum_aabbs4()`, `inside` receives the bits of the boxes whose
+ * every corner is inside all six planes.
+ */
+int frustum_aabbs4_classify(const frustum_t* frustum, const float* min_x, const float* min_y, const float* min_z, const float* max_x, const float* max_y, const float* max_z, int* inside) {
+#if defined(MATH_3D_SSE)
+	__m128 nx = _mm_loadu_ps(min_x), ny = _mm_loadu_ps(min_y), nz = _mm_loadu_ps(min_z);
+	__m128 px = _mm_loadu_ps(max_x), py = _mm_loadu_ps(max_y), pz = _mm_loadu_ps(max_z);
+	__m128 zero = _mm_setzero_ps();
+	int mask = 0xF, all = 0xF;
+	
+	for(int p = 0; p < 6 && mask; p++) {
+		const float* plane = frustum->planes[p];
+		__m128 a = _mm_set1_ps(plane[0]), b = _mm_set1_ps(plane[1]), c = _mm_set1_ps(plane[2]), d = _mm_set1_ps(plane[3]);
+		__m128 ax0 = _mm_mul_ps(a, nx), ax1 = _mm_mul_ps(a, px);
+		__m128 by0 = _mm_mul_ps(b, ny), by1 = _mm_mul_ps(b, py);
+		__m128 cz0 = _mm_mul_ps(c, nz), cz1 = _mm_mul_ps(c, pz);
+		__m128 outer = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_max_ps(ax0, ax1), _mm_max_ps(by0, by1)), _mm_max_ps(cz0, cz1)), d);
+		__m128 inner = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_min_ps(ax0, ax1), _mm_min_ps(by0, by1)), _mm_min_ps(cz0, cz1)), d);
+		mask &= _mm_movemask_ps(_mm_cmpge_ps(outer, zero));
+		all &= _mm_movemask_ps(_mm_cmpge_ps(inner, zero));
+	}
+	*inside = all & mask;
+	return mask;
+#else
+	int mask = 0, all = 0;
+	for(int i = 0; i < 4; i++) {
+		int in = 1, whole = 1;
+		for(int p = 0; p < 6 && in; p++) {
+			const float* plane = frustum->planes[p];
+			float x0 = plane[0] * min_x[i], x1 = plane[0] * max_x[i];
+			float y0 = plane[1] * min_y[i], y1 = plane[1] * max_y[i];
+			float z0 = plane[2] * min_z[i], z1 = plane[2] * max_z[i];
+			in = fmaxf(x0, x1) + fmaxf(y0, y1) + fmaxf(z0, z1) + plane[3] >= 0;
+			whole = whole && fminf(x0, x1) + fminf(y0, y1) + fminf(z0, z1) + plane[3] >= 0;
+		}
+		mask |= in << i;
+		all |= (in && whole) << i;
+	}
+	*inside = all;
+	return mask;
+#endif
+}
+
+/**
+ * Tests `count` spheres and writes 1 (visible) or 0 into `visible`. Returns the
+ * number of visible spheres.
+ */
+int frustum_spheres_batch(const frustum_t* frustum, const float* x, const float* y, const float* z, const float* radius, unsigned char* visible, int count) {
+	int i = 0, visible_count = 0;
+	
+	for(; i + 8 <= count; i += 8) {
+		int mask = frustum_spheres8(frustum, x + i, y + i, z + i, radius + i);
+		for(int j = 0; j < 8; j++) {
+			visible[i + j] = (mask >> j) & 1;
+			visible_count += visible[i + j];
+		}
+	}
+	
+	for(; i < count; i++) {
+		visible[i] = frustum_sphere(frustum, vec3(x[i], y[i], z[i]), radius[i]);
+		visible_count += visible[i];
+	}
+	
+	return visible_count;
 }
 
 void m4_print(mat4_t matrix) {
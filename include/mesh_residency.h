@@ -0,0 +1,105 @@
+#ifndef MESH_RESIDENCY_H
+#define MESH_RESIDENCY_H
+
+#include <rafgl.h>
+#include <rafgl_jobs.h>
+
+// Streaming of prop meshes into a fixed region of a rafgl_mesh_buffer_t. Every
+// registered mesh keeps a coarse proxy (vertex clustering of the full mesh)
+// resident for good, its full vertices only while instances of it keep being
+// requested within the streaming radius of the camera and inside the view.
+// Meshes are parsed on the job system and copied into the region on the main
+// thread, until then their instances draw the proxy. The file of the next mesh
+// waiting for a load slot is prefetched into the page cache. A mesh nobody
+// requested for MESH_RESIDENCY_EVICT_FRAMES frames is dropped, and a load that
+// does not fit drops the least recently requested meshes first.
+
+#define MESH_RESIDENCY_MAX_MESHES 64
+#define MESH_RESIDENCY_PROXY_GRID 12     // cells per axis of the proxy clustering
+#define MESH_RESIDENCY_EVICT_FRAMES 120  // frames a mesh stays after its last request
+#define MESH_RESIDENCY_MAX_LOADS 2       // meshes parsed at the same time
+
+typedef enum {
+    MESH_UNLOADED,
+    MESH_LOADING,
+    MESH_RESIDENT,
+    MESH_FAILED,  // the file could not be parsed, never retried
+} MeshState;
+
+typedef struct {
+    const char *path;
+    rafgl_meshPUN_t *mesh;  // full mesh, drawable while MESH_RESIDENT
+    rafgl_meshPUN_t proxy;  // vertex_count is 0 until the first load
+    MeshState state;
+
+    // Local bounding sphere and box, known after the first load
+    int has_bounds;
+    vec3_t center;
+    float radius;
+    vec3_t min, max;
+
+    unsigned int full_vertex_count;  // known after the first load
+
+    int last_requested;  // frame of the last request inside the radius and view
+    float distance;      // closest requested instance this frame, loads go nearest first
+    int prefetched;      // the file was handed to rafgl_vfs_prefetch while waiting for a load
+
+    // Load in flight, written by the job
+    rafgl_job_t job;
+    rafgl_jobs_counter_t counter;
+    rafgl_vertexPUN_t *vertices, *proxy_vertices;
+    unsigned int vertex_count, proxy_vertex_count;
+    vec3_t loaded_center;
+    float loaded_radius;
+    vec3_t loaded_min, loaded_max;
+} StreamedMesh;
+
+typedef struct {
+    unsigned int first, count;
+} MeshRange;
+
+typedef struct {
+    rafgl_mesh_buffer_t *buffer;
+    unsigned int region_first, region_size;  // in vertices
+
+    // Unused ranges of the region, sorted by first and never adjacent
+    int free_count;
+    MeshRange free_ranges[MESH_RESIDENCY_MAX_MESHES * 2 + 1];
+
+    int count;
+    StreamedMesh meshes[MESH_RESIDENCY_MAX_MESHES];
+
+    float radius;
+    vec3_t camera;
+    frustum_t frustum;
+    int frame;
+    size_t reported_bytes;
+} MeshResidency;
+
+// Reserves budget bytes of vertices at the end of buffer, nothing may be
+// appended to buffer before everything has been added and loaded
+void mesh_residency_init(MeshResidency *mr, rafgl_mesh_buffer_t *buffer, size_t budget, float radius);
+void mesh_residency_cleanup(MeshResidency *mr);
+
+// mesh is filled in when its data is resident, returns the handle
+int mesh_residency_add(MeshResidency *mr, rafgl_meshPUN_t *mesh, const char *path);
+// Handle of a mesh passed to mesh_residency_add(), -1 for any other mesh
+int mesh_residency_find(const MeshResidency *mr, const rafgl_meshPUN_t *mesh);
+// Local bounding box of a mesh, 0 before its first load
+int mesh_residency_bounds(const MeshResidency *mr, int handle, vec3_t *min, vec3_t *max);
+// Parses every mesh once for its proxy and bounds and keeps the full data of
+// as many as fit, blocks until done
+void mesh_residency_load(MeshResidency *mr);
+
+// Once per frame: finishes loads, evicts and starts new loads for what was
+// requested since the last call. Run it before the frame's requests, a range
+// freed here is only reused after the draws that referenced it were built.
+void mesh_residency_update(MeshResidency *mr);
+void mesh_residency_begin(MeshResidency *mr, vec3_t camera, mat4_t view_projection);
+// Mesh to draw an instance with: the full mesh when resident, otherwise the
+// proxy, NULL before the first load finished
+const rafgl_meshPUN_t *mesh_residency_request(MeshResidency *mr, int handle, const mat4_t *model);
+
+size_t mesh_residency_resident_bytes(const MeshResidency *mr);
+
+#endif
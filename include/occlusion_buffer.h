@@ -0,0 +1,64 @@
+#ifndef OCCLUSION_BUFFER_H
+#define OCCLUSION_BUFFER_H
+
+#include <rafgl.h>
+
+// Software occlusion culling. Occluders are boxes that lie inside solid scene
+// geometry (walls, counters, table tops), their front faces are rasterized on
+// the CPU into a small depth buffer and the world bounds of everything else
+// are tested against it before their draws are submitted. A pixel only takes
+// an occluder depth when a face covers all of it, and takes the farthest depth
+// the face has over it, so a box the buffer hides is hidden on screen as well.
+// Rows are rasterized in bands on the job system, four pixels at a time, and
+// every band keeps the farthest depth of each of its tiles so most tests are
+// decided without touching single pixels. Depths are NDC z.
+
+#define OCCLUSION_TILE 8               // pixels per side of a hierarchy tile
+#define OCCLUSION_MAX_POLYGONS 1024    // front faces of the occluder boxes
+#define OCCLUSION_MAX_EDGES 5          // a quad clipped by the near plane
+#define OCCLUSION_DEPTH_EPSILON 1e-5f  // pushes occluder depths back against rounding
+
+// Screen space edge functions and depth plane of one occluder face, set up
+// for pixel centers. Faces are drawn whole rather than as two triangles, as
+// the pixels along a shared diagonal would be covered by neither. A pixel is
+// covered when every edge is >= 0 there.
+typedef struct {
+    int edge_count;
+    float edge_a[OCCLUSION_MAX_EDGES], edge_b[OCCLUSION_MAX_EDGES], edge_c[OCCLUSION_MAX_EDGES];
+    float depth_a, depth_b, depth_c;  // farthest depth over the pixel, not its center
+    float depth_max;
+    int x0, y0, x1, y1;               // covered pixels lie in [x0, x1) x [y0, y1)
+} OcclusionPolygon;
+
+typedef struct {
+    int width, height;      // multiples of OCCLUSION_TILE
+    int tiles_x, tiles_y;
+    float *depth;           // width * height, row 0 at the bottom, 1 where no occluder
+    float *tile_max;        // tiles_x * tiles_y, farthest depth of the tile's pixels
+    mat4_t view_projection;
+
+    int polygon_count;
+    OcclusionPolygon *polygons;
+
+    // Statistics since occlusion_buffer_begin()
+    int occluders, tested, culled;
+} OcclusionBuffer;
+
+// Dimensions are rounded up to whole tiles
+void occlusion_buffer_init(OcclusionBuffer *ob, int width, int height);
+void occlusion_buffer_cleanup(OcclusionBuffer *ob);
+
+// Starts a frame seen through view_projection, drops the previous occluders
+void occlusion_buffer_begin(OcclusionBuffer *ob, mat4_t view_projection);
+// The box min, max in the space of model has to be solid in the scene
+void occlusion_buffer_add_box(OcclusionBuffer *ob, const mat4_t *model, vec3_t min, vec3_t max);
+// Rasterizes the added occluders, blocks until done
+void occlusion_buffer_rasterize(OcclusionBuffer *ob);
+
+// 0 when the world space box is hidden behind the occluders or off screen
+int occlusion_buffer_test(OcclusionBuffer *ob, vec3_t min, vec3_t max);
+
+// Grey RGBA image of the depth buffer for debugging, nearer is brighter
+void occlusion_buffer_visualize(const OcclusionBuffer *ob, unsigned char *rgba);
+
+#endif
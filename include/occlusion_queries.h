@@ -0,0 +1,70 @@
+#ifndef OCCLUSION_QUERIES_H
+#define OCCLUSION_QUERIES_H
+
+#include <rafgl.h>
+
+// GPU occlusion culling of heavy props. Every registered prop the camera sees
+// gets a GL_ANY_SAMPLES_PASSED query on its world box, drawn without color or
+// depth writes after the big occluders, and its real draw is made conditional
+// on that query with GL_QUERY_NO_WAIT, so the GPU skips it when no sample
+// passed and the CPU never waits. Results are read back frames later, only
+// once available, and give temporal coherence: a prop that came back visible
+// is drawn unconditionally and only queried again every
+// OCCLUSION_QUERY_VISIBLE_FRAMES frames, one that came back hidden is queried
+// every frame until it shows up again.
+
+#define OCCLUSION_QUERY_MAX_PROPS 64
+#define OCCLUSION_QUERY_LATENCY 3          // queries in flight per prop
+#define OCCLUSION_QUERY_VISIBLE_FRAMES 8
+#define OCCLUSION_QUERY_NEAR_MARGIN 0.5f   // farther than the near plane corners reach
+
+typedef struct {
+    GLuint queries[OCCLUSION_QUERY_LATENCY];
+    int issued_frame[OCCLUSION_QUERY_LATENCY];  // -1 when free
+    int next;                                   // slot the next query goes to
+
+    int visible;        // last result read back
+    int result_frame;   // frame of the query that gave it
+    int last_issued;    // frame of the last query
+
+    // This frame
+    int slot;           // query issued, -1 for an unconditional draw
+    vec3_t min, max;
+} OcclusionQueryProp;
+
+typedef struct {
+    int count;
+    OcclusionQueryProp props[OCCLUSION_QUERY_MAX_PROPS];
+    int issue[OCCLUSION_QUERY_MAX_PROPS];  // props with a query this frame
+    int issue_count;
+
+    GLuint program;
+    GLint view_projection, box_min, box_max;
+    GLuint vao, vertex_buffer, index_buffer;  // unit cube
+
+    int frame;
+    vec3_t camera;
+
+    // Statistics of the current frame
+    int requested, queried, read_back, hidden;
+} OcclusionQueries;
+
+void occlusion_queries_init(OcclusionQueries *oq);
+void occlusion_queries_cleanup(OcclusionQueries *oq);
+// Program drawing the boxes, the occlusion_proxy shaders
+void occlusion_queries_set_program(OcclusionQueries *oq, GLuint program);
+
+// Returns the handle of a new prop, -1 when full
+int occlusion_queries_add(OcclusionQueries *oq);
+
+// Once per frame before the requests: reads back whatever results are
+// available without waiting
+void occlusion_queries_begin(OcclusionQueries *oq, vec3_t camera);
+// The prop is drawn this frame with world bounds min, max. Returns the query
+// to make its draw conditional on, 0 to draw it unconditionally.
+GLuint occlusion_queries_request(OcclusionQueries *oq, int handle, vec3_t min, vec3_t max);
+// Draws the boxes of this frame's queries against the depth of the bound
+// framebuffer, before any conditional draw
+void occlusion_queries_issue(OcclusionQueries *oq, mat4_t view_projection);
+
+#endif
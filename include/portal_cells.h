@@ -0,0 +1,81 @@
+#ifndef PORTAL_CELLS_H
+#define PORTAL_CELLS_H
+
+#include <rafgl.h>
+
+// Cell and portal visibility for interiors. Cells are boxes of open space
+// (rooms, without their walls) and portals are the convex openings between
+// two cells (doors). The camera query starts in the cell holding the eye and
+// walks through every portal that projects into what is seen of the current
+// cell, narrowing the screen rectangle to the portal each time, so a cell
+// ends up with the union of the rectangles it was seen through. Content that
+// lies entirely inside a cell is visible when its projection overlaps its
+// cell's rectangle. A light walks the same way once for each face of a cube
+// around it, through portals within its radius, and reaches every cell one
+// of the faces sees. Anything outside every cell, and everything while the
+// eye is outside every cell, is never culled here.
+
+#define PORTAL_CELLS_MAX_DEPTH 16  // portals passed on one path from the eye
+
+// Normalized device coordinates, empty when x0 >= x1 or y0 >= y1
+typedef struct {
+    float x0, y0, x1, y1;
+} PortalRect;
+
+typedef struct {
+    vec3_t corners[4];  // convex, in order around the opening
+    vec3_t min, max;    // bounds of the corners
+    int cells[2];
+} Portal;
+
+typedef struct {
+    int cell_count, cell_capacity;
+    vec3_t *cell_min, *cell_max;
+    int *cell_first, *cell_portal_count;  // runs of cell_portals, set by portal_cells_finish()
+    int *cell_portals;
+
+    int portal_count, portal_capacity;
+    Portal *portals;
+
+    // Last camera query
+    mat4_t view_projection;
+    int camera_cell;          // -1 outside every cell
+    unsigned char *visible;   // per cell
+    PortalRect *rects;        // per cell, where it is seen
+
+    // Lights added since portal_cells_clear_lights()
+    int all_lit;              // a light outside every cell reaches everything
+    unsigned char *lit;       // per cell
+    unsigned char *light_seen;  // per cell, of the cube face being walked
+    PortalRect *light_rects;
+
+    // Statistics of the last camera query
+    int visited, visible_cells;
+} PortalCells;
+
+void portal_cells_init(PortalCells *pc, int cell_capacity, int portal_capacity);
+void portal_cells_cleanup(PortalCells *pc);
+
+// Both return the new index, -1 when full. Portals take effect after
+// portal_cells_finish().
+int portal_cells_add_cell(PortalCells *pc, vec3_t min, vec3_t max);
+int portal_cells_add_portal(PortalCells *pc, int cell_a, int cell_b, const vec3_t corners[4]);
+void portal_cells_finish(PortalCells *pc);
+
+// Cell holding the point, -1 if none
+int portal_cells_locate(const PortalCells *pc, vec3_t point);
+// Cell holding the whole box, -1 if none. Walls and anything else that
+// straddles cells get -1 and are never culled by the portals.
+int portal_cells_locate_box(const PortalCells *pc, vec3_t min, vec3_t max);
+
+// Finds the cells seen from eye through view_projection
+void portal_cells_query_camera(PortalCells *pc, vec3_t eye, mat4_t view_projection);
+// 0 when the box lying in cell is hidden from the last camera query
+int portal_cells_test(const PortalCells *pc, int cell, vec3_t min, vec3_t max);
+
+void portal_cells_clear_lights(PortalCells *pc);
+void portal_cells_add_light(PortalCells *pc, vec3_t position, float radius);
+// 0 when no light added since the clear reaches into cell
+int portal_cells_lit(const PortalCells *pc, int cell);
+
+#endif
@@ -2,6 +2,7 @@
 #define RAFGL_H_INCLUDED
 
 #include <string.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <math.h>
 
@@ -108,15 +109,25 @@ typedef struct _rafgl_texture_t
 {
     GLuint tex_id;
     int width, height, channels;
+    int layers;                     /* GL_TEXTURE_2D_ARRAY only */
     GLuint tex_type;
 } rafgl_texture_t;
 
+/* two channel RGTC2 (BC5) image with its whole mip chain, level 0 first, 16 bytes per 4x4 block */
+typedef struct _rafgl_rgtc2_image_t
+{
+    int width, height, levels;
+    size_t size;
+    unsigned char *data;
+} rafgl_rgtc2_image_t;
+
 typedef struct _rafgl_list_t
 {
     void *head;
     void *tail;
     int element_size;
     int count;
+    struct _rafgl_pool_t *pool;     /* node allocator, NULL allocates nodes with malloc */
 } rafgl_list_t;
 
 
@@ -160,17 +171,59 @@ typedef struct _rafgl_vertexPUN_t
     vec3_t position;
     float u, v;
     vec3_t normal;
+    /* GL_INT_2_10_10_10_REV: x and y hold the octahedron encoded tangent, w the bitangent sign */
+    uint32_t tangent;
 } rafgl_vertexPUN_t;
 
 typedef struct _rafgl_meshPUN_t
 {
     GLuint vao_id;
+    unsigned int first_vertex;      /* non zero only for meshes suballocated from a rafgl_mesh_buffer_t */
     unsigned int vertex_count;
     unsigned int triangle_count;
     int loaded;
     char name[64];
 } rafgl_meshPUN_t;
 
+/* one newmtl of a .mtl, map paths are resolved against the .mtl's directory and empty when not given */
+typedef struct _rafgl_obj_material_t
+{
+    char name[64];
+    vec3_t diffuse;                 /* Kd */
+    float roughness, metallic;      /* Pr and Pm, -1 when not given */
+    char diffuse_map[256];          /* map_Kd */
+    char normal_map[256];           /* norm, map_Bump or bump */
+    char specular_map[256];         /* map_Ks */
+    char roughness_map[256];        /* map_Pr */
+    char metallic_map[256];         /* map_Pm */
+} rafgl_obj_material_t;
+
+/* faces of one object using one material, drawn with glDrawArrays(GL_TRIANGLES, first_vertex, vertex_count) on the model's VAO */
+typedef struct _rafgl_submeshPUN_t
+{
+    unsigned int first_vertex, vertex_count;
+    int material;                   /* into the model's materials, -1 before the first usemtl */
+    char name[64];                  /* of the "o" or "g" the faces are in */
+} rafgl_submeshPUN_t;
+
+/* every object and material group of an OBJ as a range of one mesh, so the whole asset is one vertex buffer */
+typedef struct _rafgl_modelPUN_t
+{
+    rafgl_meshPUN_t mesh;
+    int submesh_count, material_count;
+    rafgl_submeshPUN_t *submeshes;
+    rafgl_obj_material_t *materials;
+} rafgl_modelPUN_t;
+
+struct _rafgl_arena_t;    /* rafgl_memory.h */
+
+/* one vertex buffer and VAO shared by many meshes, each mesh is a range starting at its first_vertex */
+typedef struct _rafgl_mesh_buffer_t
+{
+    GLuint vao_id, vbo_id;
+    unsigned int vertex_count, vertex_capacity;
+} rafgl_mesh_buffer_t;
+
 typedef struct _rafgl_framebuffer_simple_t
 {
     GLuint fbo_id, tex_id;
@@ -199,6 +252,11 @@ int rafgl_raster_init(rafgl_raster_t *fnaf_flashlight, int width, int height);
 int rafgl_raster_copy(rafgl_raster_t *raster_to, rafgl_raster_t *raster_from);
 /* reads an image from the disk and loads it into the raster (raster should NOT BE "inited" beforehand */
 int rafgl_raster_load_from_image(rafgl_raster_t *fnaf_flashlight, const char *image_path);
+/* decodes an image file already read into memory, -1 if it is not an image */
+int rafgl_raster_load_from_memory(rafgl_raster_t *fnaf_flashlight, const unsigned char *file_data, size_t file_size);
+/* texture ("baseColorTexture", "normalTexture", "metallicRoughnessTexture"...) of a .glb material, embedded in the BIN
+ * chunk or a file next to the .glb, returns 0 on success like rafgl_raster_load_from_image */
+int rafgl_raster_load_from_GLB(rafgl_raster_t *raster, const char *glb_path, int material, const char *texture);
 /* */
 int rafgl_raster_save_to_png(rafgl_raster_t *fnaf_flashlight, const char *image_path);
 /* free */
@@ -222,6 +280,17 @@ void rafgl_texture_load_from_raster(rafgl_texture_t *texture, rafgl_raster_t *fn
 void rafgl_texture_show(const rafgl_texture_t *texture, int flip);
 /* free */
 void rafgl_texture_cleanup(rafgl_texture_t *texture);
+/* 2D texture array of layers empty RGBA layers, filtered like rafgl_texture_load_from_raster */
+void rafgl_texture_array_init(rafgl_texture_t *texture, int width, int height, int layers);
+/* copies a raster of the array's size into one layer, -1 if it does not fit */
+int rafgl_texture_array_load_layer(rafgl_texture_t *texture, int layer, rafgl_raster_t *raster);
+/* box filtered mips of two raster channels, compressed into red and green, safe to run on job system workers */
+int rafgl_rgtc2_image_from_raster(rafgl_rgtc2_image_t *image, const rafgl_raster_t *raster, int red_channel, int green_channel);
+void rafgl_rgtc2_image_cleanup(rafgl_rgtc2_image_t *image);
+/* 2D texture array of layers RGTC2 layers with full mip chains, trilinear filtered */
+void rafgl_texture_array_init_rgtc2(rafgl_texture_t *texture, int width, int height, int layers);
+/* uploads every mip level of image into one layer, -1 if it does not fit */
+int rafgl_texture_array_load_layer_rgtc2(rafgl_texture_t *texture, int layer, const rafgl_rgtc2_image_t *image);
 
 void rafgl_texture_load_cubemap_named(rafgl_texture_t *tex, const char *cubemap_name, const char *file_ext);
 void rafgl_texture_load_cubemap(rafgl_texture_t *tex, const char *cubemap_paths[]);
@@ -231,15 +300,37 @@ char* rafgl_file_read_content(const char *filepath);
 /* checks the file size */
 int rafgl_file_size(const char *filepath);
 
+/* linked programs are stored here as driver binaries, keyed by their sources, defines and the driver */
+#define RAFGL_PROGRAM_CACHE_DIRECTORY "cache" SYSTEM_SEPARATOR "shaders"
+
 /* creates a shader program from vertex and fragment files on the disk */
 GLuint rafgl_program_create(const char *vertex_source_filepath, const char *fragment_source_filepath);
-/* creates a shader program from vertex and fragment source in memory */
-GLuint rafgl_program_create_from_source(const char *vertex_source, const char *fragment_source);
+/* creates a shader program from vertex and fragment source in memory, defines is a '|' separated
+   list such as "TEXTURED|NUM_SHADOWED_LIGHTS=3" (or NULL), each entry becomes a #define after #version */
+GLuint rafgl_program_create_from_source(const char *vertex_source, const char *fragment_source, const char *defines);
 /* creates a shader program from vertex and fragment files with standardized names and locations */
 GLuint rafgl_program_create_from_name(const char *program_name);
+/* creates a transform feedback program from the vertex and geometry files (vert.glsl, geom.glsl) with standardized
+   names and locations, the varyings are captured interleaved into buffer 0 */
+GLuint rafgl_program_create_feedback(const char *program_name, const char **varyings, int varying_count);
+/* same as rafgl_program_create_from_name with defines, every (name, define set) pair is compiled once and
+   cached, the order of the defines does not matter */
+GLuint rafgl_program_variant(const char *program_name, const char *defines);
+/* starts compiling a variant without waiting for it, on drivers with parallel shader compile it builds in
+   the background until rafgl_program_variant or rafgl_program_variants_finish asks for it */
+void rafgl_program_variant_request(const char *program_name, const char *defines);
+/* waits for every requested variant */
+void rafgl_program_variants_finish(void);
+/* deletes every cached variant */
+void rafgl_program_variants_cleanup(void);
+/* draws the first triangle of vao with program into a single pixel of the bound framebuffer, so drivers that
+   compile lazily do it during loading instead of on the first frame */
+void rafgl_program_warm_up(GLuint program, GLuint vao, int vertex_count);
 
 /* generic linked list */
 int rafgl_list_init(rafgl_list_t *list, int element_size);
+/* nodes come from the pool, whose element size must fit a next pointer plus the largest appended element */
+int rafgl_list_init_pooled(rafgl_list_t *list, int element_size, struct _rafgl_pool_t *pool);
 int rafgl_list_append(rafgl_list_t *list, void *data);
 int rafgl_list_append_sized(rafgl_list_t *list, int size, void *data);
 int rafgl_list_remove(rafgl_list_t *list, int index);
@@ -295,14 +386,51 @@ void rafgl_raster_draw_circle(rafgl_raster_t *fnaf_flashlight, int cx, int cy, i
 void rafgl_raster_draw_rectangle(rafgl_raster_t *fnaf_flashlight, int x0, int y0, int w, int h, uint32_t colour);
 
 void rafgl_raster_bilinear_upsample(rafgl_raster_t *to, rafgl_raster_t *from);
+/* 2x2 box filter into the next mip level, to has to be inited at half the size (at least 1) */
+void rafgl_raster_box_downsample(rafgl_raster_t *to, const rafgl_raster_t *from);
 
 int rafgl_raster_draw_string(rafgl_raster_t *fnaf_flashlight, const char *s, int x, int y, uint32_t colour, int font_size);
 
 void rafgl_log_fps(int b);
 
 void rafgl_meshPUN_init(rafgl_meshPUN_t *m);
+/* shared vertex buffer, starts with room for vertex_capacity vertices and grows as needed */
+void rafgl_mesh_buffer_init(rafgl_mesh_buffer_t *buffer, unsigned int vertex_capacity);
+void rafgl_mesh_buffer_cleanup(rafgl_mesh_buffer_t *buffer);
+/* meshes loaded while a buffer is bound are appended to it and share its VAO, NULL goes back to a VAO per mesh */
+void rafgl_mesh_buffer_bind(rafgl_mesh_buffer_t *buffer);
+/* appends vertex_count uninitialized vertices for the caller to manage, growing to exactly fit, returns the first one */
+unsigned int rafgl_mesh_buffer_reserve(rafgl_mesh_buffer_t *buffer, unsigned int vertex_count);
+/* overwrites vertices already in the buffer */
+void rafgl_mesh_buffer_write(rafgl_mesh_buffer_t *buffer, unsigned int first_vertex, const rafgl_vertexPUN_t *vertices, unsigned int vertex_count);
+/* vertices an OBJ load finishes at a time, the GL loaders map and fill one such range of the vertex buffer per chunk */
+#define RAFGL_OBJ_CHUNK_VERTICES 4096
+/* OBJs of at least two pieces this size are counted and parsed a piece per job */
+#define RAFGL_OBJ_PIECE_BYTES (256 << 10)
+/* parses an OBJ into a triangle list with tangents. Temporaries come from arena, so workers can load with an arena of
+ * their own. The vertices are rafgl_malloc'ed (RAFGL_MEM_MESH) for the caller to free, NULL when the file can't be read.
+ * name receives up to 64 bytes of the object name when not NULL */
+rafgl_vertexPUN_t* rafgl_vertexPUN_load_OBJ(struct _rafgl_arena_t *arena, const char *obj_path, vec3_t position_offset, unsigned int *vertex_count, char *name);
+/* streams an OBJ straight into the vertex buffer, RAFGL_OBJ_CHUNK_VERTICES at a time, the expanded triangle list never
+ * exists in RAM. Besides the chunk only the positions, UVs, normals and one tangent sum per distinct corner are kept */
 void rafgl_meshPUN_load_from_OBJ(rafgl_meshPUN_t *m, const char *obj_path);
 void rafgl_meshPUN_load_from_OBJ_offset(rafgl_meshPUN_t *m, const char *obj_path, vec3_t position_offset);
+/* loads like rafgl_meshPUN_load_from_OBJ and keeps a submesh per run of faces with the same object and material, in
+ * file order, and the materials of every mtllib. A usemtl naming no material of the .mtl files gets one with only the
+ * name. The arrays are rafgl_malloc'ed (RAFGL_MEM_MESH), rafgl_modelPUN_cleanup gives them back */
+void rafgl_modelPUN_init(rafgl_modelPUN_t *model);
+void rafgl_modelPUN_load_from_OBJ(rafgl_modelPUN_t *model, const char *obj_path);
+void rafgl_modelPUN_cleanup(rafgl_modelPUN_t *model);
+/* -1 when the model has no material of that name */
+int rafgl_modelPUN_find_material(const rafgl_modelPUN_t *model, const char *name);
+/* binary glTF 2.0: every triangle primitive of every mesh in file order, node transforms are not applied. A primitive
+ * stored without indices and interleaved like rafgl_vertexPUN_t, with its packed tangent in a _RAFGL_TANGENT attribute,
+ * is uploaded straight from the mapped BIN chunk, anything else is expanded and converted RAFGL_OBJ_CHUNK_VERTICES at a
+ * time. TANGENT is used when present, otherwise tangents are generated like for an OBJ. */
+rafgl_vertexPUN_t* rafgl_vertexPUN_load_GLB(struct _rafgl_arena_t *arena, const char *glb_path, unsigned int *vertex_count);
+void rafgl_meshPUN_load_from_GLB(rafgl_meshPUN_t *m, const char *glb_path);
+/* writes vertices in the layout rafgl_meshPUN_load_from_GLB uploads without conversion, 0 on success */
+int rafgl_vertexPUN_save_GLB(const char *glb_path, const rafgl_vertexPUN_t *vertices, unsigned int vertex_count, const char *name);
 void rafgl_meshPUN_load_cube(rafgl_meshPUN_t *m, float coord);
 void rafgl_meshPUN_load_terrain_from_heightmap(rafgl_meshPUN_t *m, float w, float h, const char *img_path, float height);
 
@@ -319,16 +447,33 @@ extern rafgl_pixel_rgb_t RAFGL_COLOUR_KEY;
 
 /* helpers function declarations end*/
 
+#include <rafgl_jobs.h>
+#include <rafgl_log.h>
+#include <rafgl_memory.h>
+#include <rafgl_vfs.h>
+
 
 #ifdef RAFGL_IMPLEMENTATION
 
+#ifdef RAFGL_MEMORY_TRACKING
+/* decoded images are accounted as rasters unless a loader says otherwise */
+static _Thread_local int __rafgl_image_tag = RAFGL_MEM_RASTER;
+#define STBI_MALLOC(size) rafgl_malloc(__rafgl_image_tag, size)
+#define STBI_REALLOC(memory, size) rafgl_realloc(__rafgl_image_tag, memory, size)
+#define STBI_FREE(memory) rafgl_free(memory)
+#endif // RAFGL_MEMORY_TRACKING
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 
+#include <sys/stat.h>
+
 /* rafgl core implementation */
 
+static void __rafgl_program_cache_init(void);
+
 rafgl_pixel_rgb_t RAFGL_COLOUR_KEY;
 
 static GLFWwindow *__window;
@@ -403,30 +548,7 @@ void __error_callback(int error, const char* description)
     fprintf(stderr, "Error: %s\n", description);
 }
 
-char *__log_level_names[RAFGL_LOG_LEVELS] = {"error", "warning", "info"};
-FILE *__log_files[RAFGL_LOG_LEVELS];
-
 static float __rafgl_time_from_init = 0;
-void rafgl_log(int level, const char *format, ...)
-{
-    va_list args;
-    va_start(args, format);
-    FILE* fd = __log_files[level];
-    if(level == RAFGL_ERROR)
-    {
-        fprintf(stderr, "%s: ", __log_level_names[level]);
-        vfprintf(stderr, format, args);
-
-    }
-    else
-    {
-        printf("%s : ", __log_level_names[level]);
-        vprintf(format, args);
-    }
-
-    vfprintf(fd, format, args);
-    va_end(args);
-}
 
 
 int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int window_height, int fullscreen)
@@ -435,13 +557,11 @@ int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int
     __done = 1;
 
 
-    int i;
-    char fnames[255];
-    for(i = 0; i < RAFGL_LOG_LEVELS; i++)
-    {
-        sprintf(fnames, "logs/%s.log", __log_level_names[i]);
-        __log_files[i] = fopen(fnames, "w");
-    }
+    rafgl_log_init("logs");
+
+    rafgl_jobs_init(-1);
+
+    rafgl_vfs_init(RAFGL_VFS_QUEUE_DEPTH);
 
     __window_width = window_width;
     __window_height = window_height;
@@ -493,6 +613,8 @@ int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int
         return -1;
     }
 
+    __rafgl_program_cache_init();
+
     game -> window = __window;
     game -> current_game_state = -1;
     game -> next_game_state = -1;
@@ -516,7 +638,7 @@ int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int
 
     if(!__raster_program)
     {
-        __raster_program = rafgl_program_create_from_source(__2D_raster_vertex_shader_source, __2D_raster_fragment_shader_source);
+        __raster_program = rafgl_program_create_from_source(__2D_raster_vertex_shader_source, __2D_raster_fragment_shader_source, NULL);
         glUniform1i(glGetUniformLocation(__raster_program, "raster"), 0);
         __flip = glGetUniformLocation(__raster_program, "uni_flip");
     }
@@ -605,7 +727,7 @@ int rafgl_raster_draw_string(rafgl_raster_t *fnaf_flashlight, const char *s, int
 
 int rafgl_raster_init(rafgl_raster_t *fnaf_flashlight, int width, int height)
 {
-    fnaf_flashlight->data = calloc(width * height, sizeof(rafgl_pixel_rgb_t));
+    fnaf_flashlight->data = rafgl_calloc(RAFGL_MEM_RASTER, width * height, sizeof(rafgl_pixel_rgb_t));
     fnaf_flashlight->width = width;
     fnaf_flashlight->height = height;
     return 0;
@@ -613,7 +735,8 @@ int rafgl_raster_init(rafgl_raster_t *fnaf_flashlight, int width, int height)
 
 int rafgl_raster_cleanup(rafgl_raster_t *fnaf_flashlight)
 {
-    free(fnaf_flashlight->data);
+    rafgl_free(fnaf_flashlight->data);
+    fnaf_flashlight->data = NULL;
     fnaf_flashlight->height = 0;
     fnaf_flashlight->width = 0;
     return 0;
@@ -684,13 +807,29 @@ int rafgl_raster_copy(rafgl_raster_t *raster_to, rafgl_raster_t *raster_from)
     return 0;
 }
 
-int rafgl_raster_load_from_image(rafgl_raster_t *fnaf_flashlight, const char *image_path)
+int rafgl_raster_load_from_memory(rafgl_raster_t *fnaf_flashlight, const unsigned char *file_data, size_t file_size)
 {
-    int width, height, channels;
-    fnaf_flashlight->data = (rafgl_pixel_rgb_t *) stbi_load(image_path, &width, &height, &channels, 4);
+    int width = 0, height = 0, channels;
+    fnaf_flashlight->data = (rafgl_pixel_rgb_t *) stbi_load_from_memory(file_data, file_size, &width, &height, &channels, 4);
     fnaf_flashlight->width = width;
     fnaf_flashlight->height = height;
-    return 0;
+    return fnaf_flashlight->data ? 0 : -1;
+}
+
+int rafgl_raster_load_from_image(rafgl_raster_t *fnaf_flashlight, const char *image_path)
+{
+    unsigned char *file_data;
+    size_t file_size;
+    if(rafgl_vfs_read_all(image_path, RAFGL_MEM_GENERAL, &file_data, &file_size) != 0)
+    {
+        fnaf_flashlight->data = NULL;
+        fnaf_flashlight->width = fnaf_flashlight->height = 0;
+        return -1;
+    }
+
+    int result = rafgl_raster_load_from_memory(fnaf_flashlight, file_data, file_size);
+    rafgl_free(file_data);
+    return result;
 }
 
 int rafgl_raster_save_to_png(rafgl_raster_t *fnaf_flashlight, const char *image_path)
@@ -828,7 +967,7 @@ void rafgl_raster_draw_line(rafgl_raster_t *fnaf_flashlight, int x0, int y0, int
     int outcode0 = __compute_outcode(x0, y0, fnaf_flashlight);
     int outcode1 = __compute_outcode(x1, y1, fnaf_flashlight);
     int accept = 0;
-    int xnew, ynew;
+    int xnew = 0, ynew = 0;
     int outside_outcode;
 
     while(1)
@@ -936,6 +1075,27 @@ void rafgl_raster_draw_rectangle(rafgl_raster_t *fnaf_flashlight, int x0, int y0
     rafgl_raster_draw_line(fnaf_flashlight, x0 + w, y0, x0 + w, y0 + h, colour);
 }
 
+void rafgl_raster_box_downsample(rafgl_raster_t *to, const rafgl_raster_t *from)
+{
+    int x, y, c;
+    for(y = 0; y < to->height; y++)
+    {
+        int y0 = y * 2 < from->height ? y * 2 : from->height - 1;
+        int y1 = y * 2 + 1 < from->height ? y * 2 + 1 : from->height - 1;
+        for(x = 0; x < to->width; x++)
+        {
+            int x0 = x * 2 < from->width ? x * 2 : from->width - 1;
+            int x1 = x * 2 + 1 < from->width ? x * 2 + 1 : from->width - 1;
+            for(c = 0; c < 4; c++)
+            {
+                int sum = from->data[y0 * from->width + x0].components[c] + from->data[y0 * from->width + x1].components[c] +
+                          from->data[y1 * from->width + x0].components[c] + from->data[y1 * from->width + x1].components[c];
+                to->data[y * to->width + x].components[c] = (uint8_t)((sum + 2) / 4);
+            }
+        }
+    }
+}
+
 void rafgl_raster_bilinear_upsample(rafgl_raster_t *to, rafgl_raster_t *from)
 {
     int x, y;
@@ -993,6 +1153,9 @@ void rafgl_game_start(rafgl_game_t *game, void *_args)
     game_data.keys_pressed = __keys_pressed;
 
     current_state->init(game->window, args, __window_width, __window_height);
+    /* load-time temporaries are done with */
+    rafgl_arena_free(rafgl_level_arena());
+    rafgl_log(RAFGL_INFO, "[memory] peak RSS after startup %.2f MiB\n", rafgl_memory_peak_rss() / (1024.0 * 1024.0));
 
 
     double current_frame, last_frame;
@@ -1006,6 +1169,8 @@ void rafgl_game_start(rafgl_game_t *game, void *_args)
 
     while(!glfwWindowShouldClose(game->window))
     {
+        rafgl_arena_reset(rafgl_frame_arena());
+
         for(i = 0; i < 400; i++)
         {
             __keys_pressed[i] = 0;
@@ -1073,17 +1238,28 @@ void rafgl_game_start(rafgl_game_t *game, void *_args)
             __game_state_change_request = -1;
 
             current_state->init(game->window, args, __window_width, __window_height);
+            rafgl_arena_free(rafgl_level_arena());
             last_frame = glfwGetTime();
 
         }
 
     }
 
-    for(i = 0; i < RAFGL_LOG_LEVELS; i++)
+    rafgl_vfs_shutdown();
+    rafgl_jobs_shutdown();
+
+    for(i = 0; i < RAFGL_FONT_COUNT; i++)
     {
-        fclose(__log_files[i]);
+        rafgl_raster_cleanup(&__mono_char_sheet[i].sheet);
     }
 
+    rafgl_program_variants_cleanup();
+
+    rafgl_memory_log_stats();
+    rafgl_arena_free(rafgl_frame_arena());
+    rafgl_arena_free(rafgl_level_arena());
+
+    rafgl_log_shutdown();
 
 }
 
@@ -1256,6 +1432,7 @@ void rafgl_texture_init(rafgl_texture_t *tex)
     tex->channels = 0;
     tex->width = 0;
     tex->height = 0;
+    tex->layers = 0;
     tex->tex_id = tx;
     tex->tex_type = 0;
 }
@@ -1315,11 +1492,231 @@ void rafgl_texture_cleanup(rafgl_texture_t *texture)
     texture->channels = 0;
     texture->height = 0;
     texture->width = 0;
+    texture->layers = 0;
     texture->tex_id = 0;
     texture->tex_type = 0;
     return;
 }
 
+void rafgl_texture_array_init(rafgl_texture_t *texture, int width, int height, int layers)
+{
+    glGenTextures(1, &texture->tex_id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture->tex_id);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, width, height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    texture->width = width;
+    texture->height = height;
+    texture->channels = 4;
+    texture->layers = layers;
+    texture->tex_type = GL_TEXTURE_2D_ARRAY;
+}
+
+int rafgl_texture_array_load_layer(rafgl_texture_t *texture, int layer, rafgl_raster_t *raster)
+{
+    if(layer < 0 || layer >= texture->layers || raster->width != texture->width || raster->height != texture->height)
+    {
+        rafgl_log(RAFGL_ERROR, "Raster %dx%d does not fit layer %d of a %dx%dx%d texture array\n",
+                  raster->width, raster->height, layer, texture->width, texture->height, texture->layers);
+        return -1;
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture->tex_id);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, raster->width, raster->height, 1, GL_RGBA, GL_UNSIGNED_BYTE, raster->data);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return 0;
+}
+
+static int __rafgl_mip_levels(int width, int height)
+{
+    int levels = 1, size = width > height ? width : height;
+    while(size > 1)
+    {
+        size >>= 1;
+        levels++;
+    }
+    return levels;
+}
+
+static size_t __rafgl_rgtc2_level_size(int width, int height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 16;
+}
+
+/* one BC4 block, endpoints are the block's extremes so the 6 interpolated values cover the range evenly */
+static void __rafgl_rgtc_encode_block(unsigned char *out, const unsigned char values[16])
+{
+    int i, lo = 255, hi = 0;
+    for(i = 0; i < 16; i++)
+    {
+        if(values[i] < lo) lo = values[i];
+        if(values[i] > hi) hi = values[i];
+    }
+
+    out[0] = hi;
+    out[1] = lo;
+
+    uint64_t bits = 0;
+    if(hi > lo)
+    {
+        for(i = 0; i < 16; i++)
+        {
+            /* t = 0 is hi, t = 7 is lo, palette entries 2..7 are the steps in between */
+            int t = ((hi - values[i]) * 7 + (hi - lo) / 2) / (hi - lo);
+            uint64_t index = t == 0 ? 0 : (t == 7 ? 1 : t + 1);
+            bits |= index << (3 * i);
+        }
+    }
+
+    for(i = 0; i < 6; i++)
+        out[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+static void __rafgl_rgtc2_encode_level(unsigned char *out, const unsigned char *rg, int width, int height)
+{
+    int bx, by, x, y, c;
+    unsigned char block[2][16];
+    for(by = 0; by < height; by += 4)
+    {
+        for(bx = 0; bx < width; bx += 4)
+        {
+            for(y = 0; y < 4; y++)
+            {
+                for(x = 0; x < 4; x++)
+                {
+                    /* blocks hanging over the edge of small levels repeat the last texel */
+                    int sx = bx + x < width ? bx + x : width - 1;
+                    int sy = by + y < height ? by + y : height - 1;
+                    for(c = 0; c < 2; c++)
+                        block[c][y * 4 + x] = rg[(sy * width + sx) * 2 + c];
+                }
+            }
+            __rafgl_rgtc_encode_block(out, block[0]);
+            __rafgl_rgtc_encode_block(out + 8, block[1]);
+            out += 16;
+        }
+    }
+}
+
+int rafgl_rgtc2_image_from_raster(rafgl_rgtc2_image_t *image, const rafgl_raster_t *raster, int red_channel, int green_channel)
+{
+    int width = raster->width, height = raster->height, level, i;
+
+    image->width = width;
+    image->height = height;
+    image->levels = __rafgl_mip_levels(width, height);
+    image->size = 0;
+    for(level = 0; level < image->levels; level++)
+        image->size += __rafgl_rgtc2_level_size(width >> level > 0 ? width >> level : 1, height >> level > 0 ? height >> level : 1);
+    image->data = rafgl_malloc(RAFGL_MEM_TEXTURE, image->size);
+
+    /* the two channels are pulled out once, every level is then filtered in place from the previous one */
+    unsigned char *rg = rafgl_malloc(RAFGL_MEM_RASTER, (size_t)width * height * 2);
+    for(i = 0; i < width * height; i++)
+    {
+        rg[i * 2 + 0] = raster->data[i].components[red_channel];
+        rg[i * 2 + 1] = raster->data[i].components[green_channel];
+    }
+
+    unsigned char *out = image->data;
+    for(level = 0; level < image->levels; level++)
+    {
+        __rafgl_rgtc2_encode_level(out, rg, width, height);
+        out += __rafgl_rgtc2_level_size(width, height);
+
+        int next_width = width > 1 ? width / 2 : 1;
+        int next_height = height > 1 ? height / 2 : 1;
+        int x, y, c;
+        for(y = 0; y < next_height; y++)
+        {
+            int y0 = y * 2 < height ? y * 2 : height - 1, y1 = y * 2 + 1 < height ? y * 2 + 1 : height - 1;
+            for(x = 0; x < next_width; x++)
+            {
+                int x0 = x * 2 < width ? x * 2 : width - 1, x1 = x * 2 + 1 < width ? x * 2 + 1 : width - 1;
+                for(c = 0; c < 2; c++)
+                {
+                    int sum = rg[(y0 * width + x0) * 2 + c] + rg[(y0 * width + x1) * 2 + c] +
+                              rg[(y1 * width + x0) * 2 + c] + rg[(y1 * width + x1) * 2 + c];
+                    rg[(y * next_width + x) * 2 + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+        width = next_width;
+        height = next_height;
+    }
+
+    rafgl_free(rg);
+    return 0;
+}
+
+void rafgl_rgtc2_image_cleanup(rafgl_rgtc2_image_t *image)
+{
+    rafgl_free(image->data);
+    image->data = NULL;
+    image->size = 0;
+    image->width = image->height = image->levels = 0;
+}
+
+void rafgl_texture_array_init_rgtc2(rafgl_texture_t *texture, int width, int height, int layers)
+{
+    int level, levels = __rafgl_mip_levels(width, height);
+
+    glGenTextures(1, &texture->tex_id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture->tex_id);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    for(level = 0; level < levels; level++)
+    {
+        int w = width >> level > 0 ? width >> level : 1;
+        int h = height >> level > 0 ? height >> level : 1;
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_COMPRESSED_RG_RGTC2, w, h, layers, 0, __rafgl_rgtc2_level_size(w, h) * layers, NULL);
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    texture->width = width;
+    texture->height = height;
+    texture->channels = 2;
+    texture->layers = layers;
+    texture->tex_type = GL_TEXTURE_2D_ARRAY;
+}
+
+int rafgl_texture_array_load_layer_rgtc2(rafgl_texture_t *texture, int layer, const rafgl_rgtc2_image_t *image)
+{
+    if(layer < 0 || layer >= texture->layers || image->width != texture->width || image->height != texture->height)
+    {
+        rafgl_log(RAFGL_ERROR, "RGTC2 image %dx%d does not fit layer %d of a %dx%dx%d texture array\n",
+                  image->width, image->height, layer, texture->width, texture->height, texture->layers);
+        return -1;
+    }
+
+    int level;
+    const unsigned char *data = image->data;
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture->tex_id);
+    for(level = 0; level < image->levels; level++)
+    {
+        int w = image->width >> level > 0 ? image->width >> level : 1;
+        int h = image->height >> level > 0 ? image->height >> level : 1;
+        size_t size = __rafgl_rgtc2_level_size(w, h);
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, w, h, 1, GL_COMPRESSED_RG_RGTC2, size, data);
+        data += size;
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return 0;
+}
+
 void rafgl_texture_load_cubemap_named(rafgl_texture_t *tex, const char *cubemap_name, const char *file_ext)
 {
     char cubemap_paths[6][128];
@@ -1345,16 +1742,29 @@ void rafgl_texture_load_cubemap(rafgl_texture_t *tex, const char *cubemap_paths[
     int width, height, channels;
     unsigned char *data;
     GLuint i;
+#ifdef RAFGL_MEMORY_TRACKING
+    __rafgl_image_tag = RAFGL_MEM_TEXTURE;
+#endif
     for(i = 0; i < 6; i++)
     {
-        data = stbi_load(cubemap_paths[i], &width, &height, &channels, 4);
+        unsigned char *file_data;
+        size_t file_size;
+        data = NULL;
+        if(rafgl_vfs_read_all(cubemap_paths[i], RAFGL_MEM_GENERAL, &file_data, &file_size) == 0)
+        {
+            data = stbi_load_from_memory(file_data, file_size, &width, &height, &channels, 4);
+            rafgl_free(file_data);
+        }
         if (!data)
         {
             rafgl_log(RAFGL_ERROR, "Failed to load texture at path [%s] intended for a cubemap!\n", cubemap_paths[i]);
         }
         glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        free(data);
+        stbi_image_free(data);
     }
+#ifdef RAFGL_MEMORY_TRACKING
+    __rafgl_image_tag = RAFGL_MEM_RASTER;
+#endif
 
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -1478,10 +1888,284 @@ void rafgl_meshPUN_init(rafgl_meshPUN_t *m)
     m->loaded = 0;
     m->triangle_count = 0;
     m->vertex_count = 0;
+    m->first_vertex = 0;
     m->vao_id = 0;
     memset(m->name, 0, sizeof(m->name));
 }
 
+static rafgl_mesh_buffer_t *__rafgl_bound_mesh_buffer = NULL;
+
+static void __rafgl_vertexPUN_attributes(void)
+{
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(3);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(rafgl_vertexPUN_t), (void*)0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(rafgl_vertexPUN_t), (void*)(3 * sizeof(float)));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(rafgl_vertexPUN_t), (void*)(5 * sizeof(float)));
+    glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(rafgl_vertexPUN_t), (void*)(8 * sizeof(float)));
+}
+
+/* octahedron encoding, both components snapped to signed 10 bit */
+static uint32_t __rafgl_tangent_pack(vec3_t t, float bitangent_sign)
+{
+    float l1 = fabsf(t.x) + fabsf(t.y) + fabsf(t.z);
+    float x = t.x / l1, y = t.y / l1;
+    if(t.z < 0.0f)
+    {
+        float fold_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float fold_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fold_x;
+        y = fold_y;
+    }
+
+    int32_t ix = (int32_t)lroundf(x * 511.0f);
+    int32_t iy = (int32_t)lroundf(y * 511.0f);
+    uint32_t w = bitangent_sign < 0.0f ? 3 : 1; /* -1 and 1 in two bits */
+    return ((uint32_t)ix & 0x3FF) | (((uint32_t)iy & 0x3FF) << 10) | (w << 30);
+}
+
+/* any unit vector perpendicular to n, for vertices whose UVs give no direction */
+static vec3_t __rafgl_any_perpendicular(vec3_t n)
+{
+    vec3_t axis = fabsf(n.x) < 0.9f ? vec3(1.0f, 0.0f, 0.0f) : vec3(0.0f, 1.0f, 0.0f);
+    return v3_norm(v3_sub(axis, v3_muls(n, v3_dot(n, axis))));
+}
+
+typedef struct _rafgl_tangent_accumulator_t
+{
+    vec3_t tangent, bitangent;
+} rafgl_tangent_accumulator_t;
+
+/* adds the UV gradients of triangle t to the sums of its corners, weighted by the corner angles. Degenerate UVs add nothing */
+static void __rafgl_triangle_accumulate_tangents(const rafgl_vertexPUN_t *t, rafgl_tangent_accumulator_t *sums[3])
+{
+    int corner;
+    vec3_t e1 = v3_sub(t[1].position, t[0].position);
+    vec3_t e2 = v3_sub(t[2].position, t[0].position);
+    float du1 = t[1].u - t[0].u, dv1 = t[1].v - t[0].v;
+    float du2 = t[2].u - t[0].u, dv2 = t[2].v - t[0].v;
+
+    float det = du1 * dv2 - du2 * dv1;
+    if(fabsf(det) < 1e-12f)
+        return;
+    float r = 1.0f / det;
+    vec3_t tangent = v3_muls(v3_sub(v3_muls(e1, dv2), v3_muls(e2, dv1)), r);
+    vec3_t bitangent = v3_muls(v3_sub(v3_muls(e2, du1), v3_muls(e1, du2)), r);
+
+    for(corner = 0; corner < 3; corner++)
+    {
+        vec3_t a = v3_sub(t[(corner + 1) % 3].position, t[corner].position);
+        vec3_t c = v3_sub(t[(corner + 2) % 3].position, t[corner].position);
+        float la = v3_length(a), lc = v3_length(c);
+        if(la < 1e-12f || lc < 1e-12f)
+            continue;
+        float cosine = v3_dot(a, c) / (la * lc);
+        float angle = acosf(cosine < -1.0f ? -1.0f : (cosine > 1.0f ? 1.0f : cosine));
+
+        rafgl_tangent_accumulator_t *sum = sums[corner];
+        sum->tangent = v3_add(sum->tangent, v3_muls(tangent, angle));
+        sum->bitangent = v3_add(sum->bitangent, v3_muls(bitangent, angle));
+    }
+}
+
+/* Gram-Schmidt of the summed tangent against the normal, handedness in the sign */
+static uint32_t __rafgl_tangent_finish(vec3_t normal, const rafgl_tangent_accumulator_t *sum)
+{
+    vec3_t n = v3_norm(normal);
+    vec3_t tangent = v3_sub(sum->tangent, v3_muls(n, v3_dot(n, sum->tangent)));
+    if(v3_length(tangent) < 1e-6f)
+        tangent = __rafgl_any_perpendicular(n);
+    else
+        tangent = v3_norm(tangent);
+
+    float sign = v3_dot(v3_cross(n, tangent), sum->bitangent) < 0.0f ? -1.0f : 1.0f;
+    return __rafgl_tangent_pack(tangent, sign);
+}
+
+/*
+ * Tangent frames for a triangle list, done once at import so the shaders only decode them. Follows the MikkTSpace
+ * recipe: per triangle tangents from the UV gradients, weighted by the corner angle and summed over every vertex
+ * with the same position, UV and normal, then Gram-Schmidt against the normal with the handedness in the sign.
+ * Unlike MikkTSpace vertices are not split where the summed tangents disagree.
+ */
+static void __rafgl_vertexPUN_generate_tangents(rafgl_arena_t *arena, rafgl_vertexPUN_t *vertices, int vertex_count)
+{
+    rafgl_arena_marker_t temporaries = rafgl_arena_marker(arena);
+
+    /* open addressing table of welded vertices, each slot holds the index of the first vertex with that key */
+    int table_size = 1;
+    while(table_size < vertex_count * 2)
+        table_size <<= 1;
+    int *table = rafgl_arena_alloc(arena, table_size * sizeof(int));
+    int *weld = rafgl_arena_alloc(arena, vertex_count * sizeof(int));
+    rafgl_tangent_accumulator_t *sums = rafgl_arena_alloc(arena, vertex_count * sizeof(rafgl_tangent_accumulator_t));
+    memset(table, 0xFF, table_size * sizeof(int));
+    memset(sums, 0, vertex_count * sizeof(rafgl_tangent_accumulator_t));
+
+    const size_t key_size = offsetof(rafgl_vertexPUN_t, tangent);
+    int i;
+    for(i = 0; i < vertex_count; i++)
+    {
+        const unsigned char *key = (const unsigned char*)&vertices[i];
+        uint32_t hash = 2166136261u;
+        size_t b;
+        for(b = 0; b < key_size; b++)
+            hash = (hash ^ key[b]) * 16777619u;
+
+        int slot = hash & (table_size - 1);
+        while(table[slot] >= 0 && memcmp(&vertices[table[slot]], key, key_size) != 0)
+            slot = (slot + 1) & (table_size - 1);
+        if(table[slot] < 0)
+            table[slot] = i;
+        weld[i] = table[slot];
+    }
+
+    for(i = 0; i + 2 < vertex_count; i += 3)
+    {
+        rafgl_tangent_accumulator_t *corners[3] = {&sums[weld[i]], &sums[weld[i + 1]], &sums[weld[i + 2]]};
+        __rafgl_triangle_accumulate_tangents(vertices + i, corners);
+    }
+
+    for(i = 0; i < vertex_count; i++)
+    {
+        vertices[i].tangent = __rafgl_tangent_finish(vertices[i].normal, &sums[weld[i]]);
+    }
+
+    rafgl_arena_rewind(arena, temporaries);
+}
+
+void rafgl_mesh_buffer_init(rafgl_mesh_buffer_t *buffer, unsigned int vertex_capacity)
+{
+    buffer->vertex_count = 0;
+    buffer->vertex_capacity = vertex_capacity > 0 ? vertex_capacity : 1;
+
+    glGenVertexArrays(1, &buffer->vao_id);
+    glGenBuffers(1, &buffer->vbo_id);
+
+    glBindVertexArray(buffer->vao_id);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo_id);
+    glBufferData(GL_ARRAY_BUFFER, buffer->vertex_capacity * sizeof(rafgl_vertexPUN_t), NULL, GL_STATIC_DRAW);
+    __rafgl_vertexPUN_attributes();
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void rafgl_mesh_buffer_cleanup(rafgl_mesh_buffer_t *buffer)
+{
+    if(__rafgl_bound_mesh_buffer == buffer)
+        __rafgl_bound_mesh_buffer = NULL;
+
+    glDeleteVertexArrays(1, &buffer->vao_id);
+    glDeleteBuffers(1, &buffer->vbo_id);
+    buffer->vao_id = buffer->vbo_id = 0;
+    buffer->vertex_count = buffer->vertex_capacity = 0;
+}
+
+void rafgl_mesh_buffer_bind(rafgl_mesh_buffer_t *buffer)
+{
+    __rafgl_bound_mesh_buffer = buffer;
+}
+
+/* the buffer object is replaced by a larger copy, the VAO stays so meshes already in the buffer keep working */
+static void __rafgl_mesh_buffer_grow(rafgl_mesh_buffer_t *buffer, unsigned int vertex_capacity)
+{
+    GLuint vbo;
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+    glBufferData(GL_COPY_WRITE_BUFFER, vertex_capacity * sizeof(rafgl_vertexPUN_t), NULL, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer->vbo_id);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, buffer->vertex_count * sizeof(rafgl_vertexPUN_t));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    glDeleteBuffers(1, &buffer->vbo_id);
+    buffer->vbo_id = vbo;
+    buffer->vertex_capacity = vertex_capacity;
+
+    glBindVertexArray(buffer->vao_id);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    __rafgl_vertexPUN_attributes();
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+unsigned int rafgl_mesh_buffer_reserve(rafgl_mesh_buffer_t *buffer, unsigned int vertex_count)
+{
+    if(buffer->vertex_count + vertex_count > buffer->vertex_capacity)
+        __rafgl_mesh_buffer_grow(buffer, buffer->vertex_count + vertex_count);
+
+    unsigned int first_vertex = buffer->vertex_count;
+    buffer->vertex_count += vertex_count;
+    return first_vertex;
+}
+
+void rafgl_mesh_buffer_write(rafgl_mesh_buffer_t *buffer, unsigned int first_vertex, const rafgl_vertexPUN_t *vertices, unsigned int vertex_count)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo_id);
+    glBufferSubData(GL_ARRAY_BUFFER, first_vertex * sizeof(rafgl_vertexPUN_t), vertex_count * sizeof(rafgl_vertexPUN_t), vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/* room for vertex_count vertices in the bound mesh buffer, or a VAO of its own when none is bound. Sets m->vao_id and
+ * m->first_vertex and returns the buffer object to fill, hand it to __rafgl_meshPUN_allocated once it is filled */
+static GLuint __rafgl_meshPUN_allocate(rafgl_meshPUN_t *m, unsigned int vertex_count)
+{
+    rafgl_mesh_buffer_t *buffer = __rafgl_bound_mesh_buffer;
+    if(buffer != NULL)
+    {
+        if(buffer->vertex_count + vertex_count > buffer->vertex_capacity)
+        {
+            unsigned int capacity = buffer->vertex_capacity * 2;
+            while(capacity < buffer->vertex_count + vertex_count)
+                capacity *= 2;
+            __rafgl_mesh_buffer_grow(buffer, capacity);
+        }
+
+        m->vao_id = buffer->vao_id;
+        m->first_vertex = buffer->vertex_count;
+        buffer->vertex_count += vertex_count;
+        return buffer->vbo_id;
+    }
+
+    GLuint vbo;
+    glGenVertexArrays(1, &m->vao_id);
+    glGenBuffers(1, &vbo);
+
+    glBindVertexArray(m->vao_id);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(rafgl_vertexPUN_t), NULL, GL_STATIC_DRAW);
+    __rafgl_vertexPUN_attributes();
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m->first_vertex = 0;
+    return vbo;
+}
+
+static void __rafgl_meshPUN_allocated(rafgl_meshPUN_t *m, GLuint vbo)
+{
+    /* a VAO of its own keeps the buffer alive */
+    if(__rafgl_bound_mesh_buffer == NULL || m->vao_id != __rafgl_bound_mesh_buffer->vao_id)
+        glDeleteBuffers(1, &vbo);
+}
+
+/* every loader ends here, the vertices get their own VAO unless a mesh buffer is bound */
+static void __rafgl_meshPUN_upload(rafgl_meshPUN_t *m, const void *vertices, unsigned int vertex_count)
+{
+    GLuint vbo = __rafgl_meshPUN_allocate(m, vertex_count);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, m->first_vertex * sizeof(rafgl_vertexPUN_t), vertex_count * sizeof(rafgl_vertexPUN_t), vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    __rafgl_meshPUN_allocated(m, vbo);
+}
+
 void rafgl_meshPUN_load_plane(rafgl_meshPUN_t *m, float w, float h, int wtiles, int htiles)
 {
     rafgl_meshPUN_load_plane_offset(m, w, h, wtiles, htiles, vec3(0.0f, 0.0f, 0.0f));
@@ -1493,7 +2177,8 @@ void rafgl_meshPUN_load_plane_offset(rafgl_meshPUN_t *m, float w, float h, int w
     float tilew = w / wtiles;
     float tileh = h / htiles;
 
-    rafgl_vertexPUN_t *data = malloc(num_vertices * sizeof(rafgl_vertexPUN_t));
+    rafgl_arena_marker_t temporaries = rafgl_arena_marker(rafgl_level_arena());
+    rafgl_vertexPUN_t *data = rafgl_arena_alloc(rafgl_level_arena(), num_vertices * sizeof(rafgl_vertexPUN_t));
 
     int vertex = 0, x, z;
 
@@ -1533,30 +2218,10 @@ void rafgl_meshPUN_load_plane_offset(rafgl_meshPUN_t *m, float w, float h, int w
         }
     }
 
-    glGenVertexArrays(1, &m->vao_id);
-    GLuint vbo;
-    glGenBuffers(1, &vbo);
-
-    glBindVertexArray(m->vao_id);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-    glBufferData(GL_ARRAY_BUFFER,num_vertices * sizeof(rafgl_vertexPUN_t), data, GL_STATIC_DRAW);
-
-    free(data);
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(3 * sizeof(float)));
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(5 * sizeof(float)));
-
+    __rafgl_vertexPUN_generate_tangents(rafgl_level_arena(), data, num_vertices);
+    __rafgl_meshPUN_upload(m, data, num_vertices);
 
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    glDeleteBuffers(1, &vbo);
+    rafgl_arena_rewind(rafgl_level_arena(), temporaries);
 
     m->loaded = 1;
     sprintf(m->name, "%d x %d plane", wtiles, htiles);
@@ -1590,7 +2255,8 @@ void rafgl_meshPUN_load_terrain_from_heightmap(rafgl_meshPUN_t *m, float w, floa
     float tilew = w / wtiles;
     float tileh = h / htiles;
 
-    rafgl_vertexPUN_t *data = malloc(num_vertices * sizeof(rafgl_vertexPUN_t));
+    rafgl_arena_marker_t temporaries = rafgl_arena_marker(rafgl_level_arena());
+    rafgl_vertexPUN_t *data = rafgl_arena_alloc(rafgl_level_arena(), num_vertices * sizeof(rafgl_vertexPUN_t));
 
     int vertex = 0, x, z;
     vec3_t direction, normal;
@@ -1638,30 +2304,12 @@ void rafgl_meshPUN_load_terrain_from_heightmap(rafgl_meshPUN_t *m, float w, floa
         }
     }
 
-    glGenVertexArrays(1, &m->vao_id);
-    GLuint vbo;
-    glGenBuffers(1, &vbo);
-
-    glBindVertexArray(m->vao_id);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-    glBufferData(GL_ARRAY_BUFFER,num_vertices * sizeof(rafgl_vertexPUN_t), data, GL_STATIC_DRAW);
-
-    free(data);
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(3 * sizeof(float)));
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(5 * sizeof(float)));
+    rafgl_raster_cleanup(&map_raster);
 
+    __rafgl_vertexPUN_generate_tangents(rafgl_level_arena(), data, num_vertices);
+    __rafgl_meshPUN_upload(m, data, num_vertices);
 
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    glDeleteBuffers(1, &vbo);
+    rafgl_arena_rewind(rafgl_level_arena(), temporaries);
 
     m->loaded = 1;
     sprintf(m->name, "%d x %d plane", wtiles, htiles);
@@ -1739,28 +2387,19 @@ void rafgl_meshPUN_load_cube(rafgl_meshPUN_t *m, float coord)
         -coord, -coord, -coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign * -1.0f,
     };
 
-    glGenVertexArrays(1, &m->vao_id);
-    GLuint vbo;
-    glGenBuffers(1, &vbo);
-
-    glBindVertexArray(m->vao_id);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-    glBufferData(GL_ARRAY_BUFFER, 6 * 2 * 3 * (3 + 2 + 3) * sizeof(GLfloat), cube_vertices, GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(3 * sizeof(float)));
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(5 * sizeof(float)));
-
-
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    rafgl_vertexPUN_t data[6 * 2 * 3];
+    int i;
+    for(i = 0; i < 6 * 2 * 3; i++)
+    {
+        const GLfloat *v = cube_vertices + i * 8;
+        data[i].position = vec3(v[0], v[1], v[2]);
+        data[i].u = v[3];
+        data[i].v = v[4];
+        data[i].normal = vec3(v[5], v[6], v[7]);
+    }
 
-    glDeleteBuffers(1, &vbo);
+    __rafgl_vertexPUN_generate_tangents(rafgl_level_arena(), data, 6 * 2 * 3);
+    __rafgl_meshPUN_upload(m, data, 6 * 2 * 3);
 
     m->loaded = 1;
     strcpy(m->name, "cube");
@@ -1770,311 +2409,1638 @@ void rafgl_meshPUN_load_cube(rafgl_meshPUN_t *m, float coord)
 
 }
 
-void rafgl_meshPUN_load_from_OBJ(rafgl_meshPUN_t *m, const char *obj_path)
+/* one distinct position/UV/normal index triple of an OBJ and the tangents summed over the faces using it */
+typedef struct
 {
-    rafgl_meshPUN_load_from_OBJ_offset(m, obj_path, vec3(0.0f, 0.0f, 0.0f));
+    int v, t, n;                /* zero based, v is -1 in empty slots */
+    rafgl_tangent_accumulator_t sum;
+} __rafgl_obj_corner_t;
+
+/* a newline aligned piece of the file, the counts of every kind of line in it become the indices of its first ones */
+typedef struct
+{
+    const unsigned char *begin, *end;
+    int positions, uvs, normals, faces;
+    const unsigned char *name;  /* first "o " line */
+    const unsigned char *error; /* first face that can't be used */
+    int fake_uvs;
+} __rafgl_obj_piece_t;
+
+/*
+ * An OBJ is read in three passes over a mapping of the file: the first counts the lines of every kind, the second
+ * parses the attributes and sums the tangents of every face, the third parses the faces again and hands on finished
+ * vertices a chunk at a time. Nothing the size of the expanded triangle list is ever allocated.
+ *
+ * Files of at least two RAFGL_OBJ_PIECE_BYTES pieces are split at newlines and the pieces are counted and parsed on
+ * the job system. Prefix sums of the counts tell every piece where its attributes go, its faces are kept as index
+ * triples so the tangents can still be summed in file order, which keeps the result byte for byte the same as the
+ * sequential passes. The third pass then builds the vertices of every chunk in parallel from the stored faces.
+ */
+typedef struct
+{
+    rafgl_vfs_map_t map;
+    rafgl_arena_t *arena;
+    rafgl_arena_marker_t temporaries;
+    const char *path;
+    vec3_t position_offset;
+
+    vec3_t *positions, *normals;
+    float *uvs;                 /* u and v pairs */
+    int position_count, uv_count, normal_count, face_count;
+
+    int piece_count;
+    __rafgl_obj_piece_t *pieces;
+    int *faces;                 /* v, t and n of three corners per face, only when the pieces were parsed in parallel */
+
+    /* open addressing table, kept at most half full */
+    __rafgl_obj_corner_t *corners;
+    int corner_count, corner_capacity;
+} __rafgl_obj_stream_t;
+
+/* copies the next line into line like fgets did, the rest of an overlong line is skipped, 0 at the end of the file */
+static int __rafgl_obj_next_line(const unsigned char **cursor, const unsigned char *end, char *line, int size)
+{
+    const unsigned char *p = *cursor;
+    if(p >= end)
+        return 0;
+
+    const unsigned char *eol = memchr(p, '\n', end - p);
+    if(eol == NULL)
+        eol = end;
+    size_t length = eol - p;
+    if(length > (size_t)size - 1)
+        length = size - 1;
+    memcpy(line, p, length);
+    line[length] = '\0';
+
+    *cursor = eol < end ? eol + 1 : end;
+    return 1;
 }
 
-/* TODO: create cache system */
-void rafgl_meshPUN_load_from_OBJ_offset(rafgl_meshPUN_t *m, const char *obj_path, vec3_t position_offset)
+/* reads "f v/t/n v/t/n v/t/n" or "f v//n v//n v//n" into zero based indices, 0 when the face can't be used */
+static int __rafgl_obj_parse_face(const __rafgl_obj_stream_t *s, const char *line, int v[3], int t[3], int n[3], int *fake_uvs)
 {
-    if(m->loaded)
+    int i;
+    int matches = sscanf(line + 2, "%d/%d/%d %d/%d/%d %d/%d/%d", &v[0], &t[0], &n[0], &v[1], &t[1], &n[1], &v[2], &t[2], &n[2]);
+    if(matches != 9)
     {
-        rafgl_log(RAFGL_WARNING, "Trying to load to already loaded mesh! Loading from [%s] to mesh taken by [%s]", obj_path, m->name);
-        return;
+        matches = sscanf(line + 2, "%d//%d %d//%d %d//%d", &v[0], &n[0], &v[1], &n[1], &v[2], &n[2]);
+        if(matches != 6)
+            return 0;
+        t[0] = t[1] = t[2] = 1;
+        *fake_uvs = 1;
     }
-    rafgl_list_t vertices, uv_coordinates, normals;
-    rafgl_list_init(&vertices, sizeof(vec3_t));
-    rafgl_list_init(&uv_coordinates, sizeof(vec3_t));
-    rafgl_list_init(&normals, sizeof(vec3_t));
-    vec3_t vectmp;
-
-    FILE *f = fopen(obj_path, "rt");
-    char line[256];
-
 
-    while(!feof(f))
+    for(i = 0; i < 3; i++)
     {
-        fgets(line, 256, f);
-
-
-        if(line[0] == 'o' && line[1] == ' ')
-		{
-			strcpy(m->name, line + 2);
-			m->name[strlen(m->name) - 1] = '\0';
-		}
-
-		if(line[0] == 'v' && line[1] == ' ')
-		{
-			sscanf(line + 2, "%f%f%f", &(vectmp.x), &(vectmp.y), &(vectmp.z));
-			vectmp = v3_add(vectmp, position_offset);
-			rafgl_list_append(&vertices, &vectmp);
-		}
-		else if (line[0] == 'v' && line[1] == 't')
-		{
-			sscanf(line + 3, "%f%f", &(vectmp.x), &(vectmp.y));
-			vectmp.z = 0;
-			rafgl_list_append(&uv_coordinates, &vectmp);
-		}
-		else if (line[0] == 'v' && line[1] == 'n')
-		{
-			sscanf(line + 3, "%f%f%f", &(vectmp.x), &(vectmp.y), &(vectmp.z));
-			rafgl_list_append(&normals, &vectmp);
-		}
-		else if (line[0] == 'f')
-		{
-			break;
-		}
-
+        v[i]--;
+        t[i]--;
+        n[i]--;
+        /* a file without texture coordinates still has the zero UV the fake ones point at */
+        if(v[i] < 0 || v[i] >= s->position_count || t[i] < 0 || t[i] >= (s->uv_count > 0 ? s->uv_count : 1) ||
+           n[i] < 0 || n[i] >= s->normal_count)
+            return 0;
     }
+    return 1;
+}
 
-    vec3_t *vertices_buffer, *uv_buffer, *normals_buffer;
+static rafgl_vertexPUN_t __rafgl_obj_vertex(const __rafgl_obj_stream_t *s, int v, int t, int n)
+{
+    rafgl_vertexPUN_t vertex;
+    vertex.position = s->positions[v];
+    vertex.u = s->uvs[2 * t];
+    vertex.v = 1.0f - s->uvs[2 * t + 1];
+    vertex.normal = s->normals[n];
+    vertex.tangent = 0;
+    return vertex;
+}
 
-    vertices_buffer = malloc(vertices.count * sizeof(vec3_t));
-    uv_buffer = malloc(uv_coordinates.count * sizeof(vec3_t));
-    normals_buffer = malloc(normals.count * sizeof(vec3_t));
+static uint32_t __rafgl_obj_corner_hash(int v, int t, int n)
+{
+    return ((uint32_t)v * 73856093u) ^ ((uint32_t)t * 19349663u) ^ ((uint32_t)n * 83492791u);
+}
 
-    vec3_t *vb1, *vb2, *vb3;
-    int o1 = 0, o2 = 0, o3 = 0;
-    while((vb1 = rafgl_list_get(&vertices, 0)) != NULL && (vb2 = rafgl_list_get(&uv_coordinates, 0)) != NULL && (vb3 = rafgl_list_get(&normals, 0)) != NULL)
+/* the slot of a corner, added when it is not in the table yet */
+static __rafgl_obj_corner_t* __rafgl_obj_corner(__rafgl_obj_stream_t *s, int v, int t, int n)
+{
+    int i;
+    if((s->corner_count + 1) * 2 > s->corner_capacity)
     {
-        vertices_buffer[o1++] = *vb1;
-        uv_buffer[o2++] = *vb2;
-        normals_buffer[o3++] = *vb3;
-        rafgl_list_remove(&vertices, 0);
-        rafgl_list_remove(&uv_coordinates, 0);
-        rafgl_list_remove(&normals, 0);
+        __rafgl_obj_corner_t *old = s->corners;
+        int old_capacity = s->corner_capacity;
+
+        s->corner_capacity = old_capacity * 2;
+        s->corners = rafgl_malloc(RAFGL_MEM_MESH, s->corner_capacity * sizeof(__rafgl_obj_corner_t));
+        for(i = 0; i < s->corner_capacity; i++)
+            s->corners[i].v = -1;
+        for(i = 0; i < old_capacity; i++)
+        {
+            if(old[i].v < 0)
+                continue;
+            uint32_t slot = __rafgl_obj_corner_hash(old[i].v, old[i].t, old[i].n) & (s->corner_capacity - 1);
+            while(s->corners[slot].v >= 0)
+                slot = (slot + 1) & (s->corner_capacity - 1);
+            s->corners[slot] = old[i];
+        }
+        rafgl_free(old);
     }
 
-    while((vb1 = rafgl_list_get(&vertices, 0)) != NULL)
+    uint32_t slot = __rafgl_obj_corner_hash(v, t, n) & (s->corner_capacity - 1);
+    while(s->corners[slot].v >= 0)
     {
-        vertices_buffer[o1++] = *vb1;
-        rafgl_list_remove(&vertices, 0);
+        __rafgl_obj_corner_t *corner = &s->corners[slot];
+        if(corner->v == v && corner->t == t && corner->n == n)
+            return corner;
+        slot = (slot + 1) & (s->corner_capacity - 1);
     }
 
-    while((vb1 = rafgl_list_get(&uv_coordinates, 0)) != NULL)
+    __rafgl_obj_corner_t *corner = &s->corners[slot];
+    corner->v = v;
+    corner->t = t;
+    corner->n = n;
+    memset(&corner->sum, 0, sizeof(corner->sum));
+    s->corner_count++;
+    return corner;
+}
+
+/* finished vertex of a corner that is in the table, never changes the table so workers may call it */
+static rafgl_vertexPUN_t __rafgl_obj_finished_vertex(const __rafgl_obj_stream_t *s, int v, int t, int n)
+{
+    rafgl_vertexPUN_t vertex = __rafgl_obj_vertex(s, v, t, n);
+    uint32_t slot = __rafgl_obj_corner_hash(v, t, n) & (s->corner_capacity - 1);
+    while(s->corners[slot].v != v || s->corners[slot].t != t || s->corners[slot].n != n)
+        slot = (slot + 1) & (s->corner_capacity - 1);
+    vertex.tangent = __rafgl_tangent_finish(vertex.normal, &s->corners[slot].sum);
+    return vertex;
+}
+
+static void __rafgl_obj_accumulate_face(__rafgl_obj_stream_t *s, const int v[3], const int t[3], const int n[3])
+{
+    rafgl_vertexPUN_t triangle[3];
+    rafgl_tangent_accumulator_t *sums[3];
+    int i;
+    /* adding a corner can grow the table and move the others, so the sums are looked up once all three are in */
+    for(i = 0; i < 3; i++)
     {
-        uv_buffer[o2++] = *vb1;
-        rafgl_list_remove(&uv_coordinates, 0);
+        triangle[i] = __rafgl_obj_vertex(s, v[i], t[i], n[i]);
+        __rafgl_obj_corner(s, v[i], t[i], n[i]);
     }
+    for(i = 0; i < 3; i++)
+        sums[i] = &__rafgl_obj_corner(s, v[i], t[i], n[i])->sum;
+    __rafgl_triangle_accumulate_tangents(triangle, sums);
+}
 
-    while((vb1 = rafgl_list_get(&normals, 0)) != NULL)
+static void __rafgl_obj_count_piece(__rafgl_obj_piece_t *piece)
+{
+    const unsigned char *cursor = piece->begin, *end = piece->end;
+    piece->positions = piece->uvs = piece->normals = piece->faces = 0;
+    piece->name = piece->error = NULL;
+    piece->fake_uvs = 0;
+    while(cursor < end)
     {
-        normals_buffer[o3++] = *vb1;
-        rafgl_list_remove(&normals, 0);
+        const unsigned char *eol = memchr(cursor, '\n', end - cursor);
+        if(eol == NULL)
+            eol = end;
+        if(cursor[0] == 'f')
+            piece->faces++;
+        else if(eol - cursor >= 2 && cursor[0] == 'v')
+        {
+            piece->positions += cursor[1] == ' ';
+            piece->uvs += cursor[1] == 't';
+            piece->normals += cursor[1] == 'n';
+        }
+        else if(eol - cursor >= 2 && cursor[0] == 'o' && cursor[1] == ' ' && piece->name == NULL)
+            piece->name = cursor;
+        cursor = eol < end ? eol + 1 : end;
     }
+}
 
-	int fake_uvs = 0;
-	rafgl_list_t vertex_indices, uv_indices, normal_indices;
-    rafgl_list_init(&vertex_indices, sizeof(int));
-    rafgl_list_init(&uv_indices, sizeof(int));
-    rafgl_list_init(&normal_indices, sizeof(int));
+/* parses the attributes of a counted piece into place, faces are stored when s->faces is set and summed otherwise */
+static void __rafgl_obj_parse_piece(__rafgl_obj_stream_t *s, __rafgl_obj_piece_t *piece)
+{
+    const unsigned char *cursor = piece->begin, *line_start;
+    int positions = piece->positions, uvs = piece->uvs, normals = piece->normals, faces = piece->faces;
+    int v[3], t[3], n[3];
+    char line[256];
 
-    int v1, v2, v3;
-    int n1, n2, n3;
-    int t1, t2, t3;
+    while(line_start = cursor, __rafgl_obj_next_line(&cursor, piece->end, line, sizeof(line)))
+    {
+        vec3_t vectmp = vec3(0.0f, 0.0f, 0.0f);
+        if(line[0] == 'v' && line[1] == ' ')
+        {
+            sscanf(line + 2, "%f%f%f", &(vectmp.x), &(vectmp.y), &(vectmp.z));
+            s->positions[positions++] = v3_add(vectmp, s->position_offset);
+        }
+        else if(line[0] == 'v' && line[1] == 't')
+        {
+            sscanf(line + 3, "%f%f", &(vectmp.x), &(vectmp.y));
+            s->uvs[2 * uvs] = vectmp.x;
+            s->uvs[2 * uvs + 1] = vectmp.y;
+            uvs++;
+        }
+        else if(line[0] == 'v' && line[1] == 'n')
+        {
+            sscanf(line + 3, "%f%f%f", &(vectmp.x), &(vectmp.y), &(vectmp.z));
+            s->normals[normals++] = vectmp;
+        }
+        else if(line[0] == 'f')
+        {
+            if(!__rafgl_obj_parse_face(s, line, v, t, n, &piece->fake_uvs))
+            {
+                piece->error = line_start;
+                return;
+            }
 
-    while(!feof(f))
-	{
-		while(line[0] != 'f' && !feof(f))
-		{
-			fgets(line, 256, f);
-		}
-
-
-
-		int matches = sscanf(line + 2, "%d/%d/%d %d/%d/%d %d/%d/%d", &v1, &t1, &n1, &v2, &t2, &n2, &v3, &t3, &n3);
-		if(matches != 9)
-		{
-			matches = sscanf(line + 2, "%d//%d %d//%d %d//%d", &v1, &n1, &v2, &n2, &v3, &n3);
-			if(matches != 6)
-			{
-				rafgl_log(RAFGL_WARNING, "File can't be read, try exporting with other options [matches = %d]", matches);
-				rafgl_log(RAFGL_WARNING, "error on: %s\n", line);
-				return;
-			}
-			else
-			{
-				t1 = t2 = t3 = 1;
-				if(!fake_uvs)
-				{
-				    fake_uvs = 1;
-                    rafgl_log(RAFGL_WARNING, "Using fake uvs for model on path [%s]\n", obj_path);
-				}
-			}
+            if(s->faces)
+            {
+                int *face = s->faces + 9 * faces;
+                memcpy(face, v, sizeof(v));
+                memcpy(face + 3, t, sizeof(t));
+                memcpy(face + 6, n, sizeof(n));
+            }
+            else
+            {
+                __rafgl_obj_accumulate_face(s, v, t, n);
+            }
+            faces++;
+        }
+    }
+}
 
+static void __rafgl_obj_count_range(int begin, int end, void *data)
+{
+    __rafgl_obj_stream_t *s = data;
+    int i;
+    for(i = begin; i < end; i++)
+        __rafgl_obj_count_piece(&s->pieces[i]);
+}
 
-		}
+static void __rafgl_obj_parse_range(int begin, int end, void *data)
+{
+    __rafgl_obj_stream_t *s = data;
+    int i;
+    for(i = begin; i < end; i++)
+        __rafgl_obj_parse_piece(s, &s->pieces[i]);
+}
 
-		rafgl_list_append(&vertex_indices, &v1);
-		rafgl_list_append(&vertex_indices, &v2);
-		rafgl_list_append(&vertex_indices, &v3);
+static void __rafgl_obj_stream_close(__rafgl_obj_stream_t *s)
+{
+    rafgl_free(s->corners);
+    s->corners = NULL;
+    if(s->arena)
+        rafgl_arena_rewind(s->arena, s->temporaries);
+    rafgl_vfs_unmap(&s->map);
+}
 
-		rafgl_list_append(&uv_indices, &t1);
-		rafgl_list_append(&uv_indices, &t2);
-		rafgl_list_append(&uv_indices, &t3);
+/* first two passes, returns the number of vertices the file expands to or -1 when it can't be read */
+static int __rafgl_obj_stream_open(__rafgl_obj_stream_t *s, rafgl_arena_t *arena, const char *obj_path, vec3_t position_offset, char *name)
+{
+    int i;
+    memset(s, 0, sizeof(*s));
+    s->path = obj_path;
+    s->position_offset = position_offset;
+    if(rafgl_vfs_map(obj_path, &s->map, RAFGL_VFS_SEQUENTIAL) != 0 || s->map.size == 0)
+    {
+        rafgl_log(RAFGL_WARNING, "Can't open [%s]\n", obj_path);
+        rafgl_vfs_unmap(&s->map);
+        return -1;
+    }
+    s->arena = arena;
+    s->temporaries = rafgl_arena_marker(arena);
 
-		rafgl_list_append(&normal_indices, &n1);
-		rafgl_list_append(&normal_indices, &n2);
-		rafgl_list_append(&normal_indices, &n3);
-		fgets(line, 256, f);
+    int parallel = rafgl_jobs_thread_count() > 1 && s->map.size >= 2 * RAFGL_OBJ_PIECE_BYTES;
+    s->piece_count = parallel ? (s->map.size + RAFGL_OBJ_PIECE_BYTES - 1) / RAFGL_OBJ_PIECE_BYTES : 1;
+    s->pieces = rafgl_arena_alloc(arena, s->piece_count * sizeof(__rafgl_obj_piece_t));
 
+    const unsigned char *end = s->map.data + s->map.size, *cursor = s->map.data;
+    for(i = 0; i < s->piece_count; i++)
+    {
+        const unsigned char *split = i + 1 < s->piece_count ? s->map.data + (i + 1) * RAFGL_OBJ_PIECE_BYTES : end;
+        if(split < cursor)
+            split = cursor;
+        else if(split < end)
+        {
+            split = memchr(split, '\n', end - split);
+            split = split ? split + 1 : end;
+        }
+        s->pieces[i].begin = cursor;
+        s->pieces[i].end = split;
+        cursor = split;
+    }
+    rafgl_jobs_parallel_for(s->piece_count, 1, __rafgl_obj_count_range, s);
 
+    /* counts become the index of every piece's first line of that kind */
+    for(i = 0; i < s->piece_count; i++)
+    {
+        __rafgl_obj_piece_t *piece = &s->pieces[i];
+        int positions = piece->positions, uvs = piece->uvs, normals = piece->normals, faces = piece->faces;
+        piece->positions = s->position_count;
+        piece->uvs = s->uv_count;
+        piece->normals = s->normal_count;
+        piece->faces = s->face_count;
+        s->position_count += positions;
+        s->uv_count += uvs;
+        s->normal_count += normals;
+        s->face_count += faces;
+
+        if(piece->name && name != NULL)
+        {
+            char line[256];
+            const unsigned char *name_line = piece->name;
+            __rafgl_obj_next_line(&name_line, end, line, sizeof(line));
+            strncpy(name, line + 2, 63);
+            name[63] = '\0';
+            name[strcspn(name, "\r\n")] = '\0';
+            name = NULL;
+        }
+    }
 
-	}
+    s->positions = rafgl_arena_alloc(arena, (s->position_count + 1) * sizeof(vec3_t));
+    s->normals = rafgl_arena_alloc(arena, (s->normal_count + 1) * sizeof(vec3_t));
+    s->uvs = rafgl_arena_alloc(arena, (s->uv_count + 1) * 2 * sizeof(float));
+    s->uvs[0] = s->uvs[1] = 0.0f;
+    if(parallel)
+        s->faces = rafgl_arena_alloc(arena, s->face_count * 9 * sizeof(int) + 1);
+
+    int larger = s->position_count > s->normal_count ? s->position_count : s->normal_count;
+    s->corner_capacity = 64;
+    while(s->corner_capacity < larger * 2)
+        s->corner_capacity <<= 1;
+    s->corners = rafgl_malloc(RAFGL_MEM_MESH, s->corner_capacity * sizeof(__rafgl_obj_corner_t));
+    for(i = 0; i < s->corner_capacity; i++)
+        s->corners[i].v = -1;
+
+    rafgl_jobs_parallel_for(s->piece_count, 1, __rafgl_obj_parse_range, s);
+
+    int fake_uvs = 0;
+    for(i = 0; i < s->piece_count; i++)
+    {
+        __rafgl_obj_piece_t *piece = &s->pieces[i];
+        fake_uvs |= piece->fake_uvs;
+        if(piece->error)
+        {
+            char line[256];
+            const unsigned char *error_line = piece->error;
+            __rafgl_obj_next_line(&error_line, end, line, sizeof(line));
+            rafgl_log(RAFGL_WARNING, "Can't read a face of [%s], try exporting with other options\n", obj_path);
+            rafgl_log(RAFGL_WARNING, "error on: %s\n", line);
+            __rafgl_obj_stream_close(s);
+            return -1;
+        }
+    }
+    if(fake_uvs)
+        rafgl_log(RAFGL_WARNING, "Using fake uvs for model on path [%s]\n", obj_path);
 
-	if(fake_uvs)
+    /* the sums are added up in file order whichever way the faces were parsed */
+    if(s->faces)
     {
-        vectmp = vec3(0.0f, 0.0f, 0.0f);
-        rafgl_list_append(&uv_coordinates, &vectmp);
+        for(i = 0; i < s->face_count; i++)
+        {
+            const int *face = s->faces + 9 * i;
+            __rafgl_obj_accumulate_face(s, face, face + 3, face + 6);
+        }
     }
 
-    rafgl_vertexPUN_t *vertex_buffer = malloc(vertex_indices.count * sizeof(rafgl_vertexPUN_t));
-    int i;
-    int vert_ind;
-    int uv_ind;
-    int norm_ind;
+    return s->face_count * 3;
+}
 
-    vec3_t vertex_data, uv_data, normal_data;
+typedef struct
+{
+    const __rafgl_obj_stream_t *stream;
+    rafgl_vertexPUN_t *chunk;
+    int first_face;
+} __rafgl_obj_chunk_build_t;
 
-    int vcount = vertex_indices.count;
-    for(i = 0; i < vcount; i++)
+static void __rafgl_obj_build_range(int begin, int end, void *data)
+{
+    __rafgl_obj_chunk_build_t *build = data;
+    int i, corner;
+    for(i = begin; i < end; i++)
     {
-        vert_ind = *((int*)rafgl_list_get(&vertex_indices, 0));
-		uv_ind = *((int*)rafgl_list_get(&uv_indices, 0));
-		norm_ind = *((int*)rafgl_list_get(&normal_indices, 0));
-
-		rafgl_list_remove(&vertex_indices, 0);
-		rafgl_list_remove(&uv_indices, 0);
-		rafgl_list_remove(&normal_indices, 0);
+        const int *face = build->stream->faces + 9 * (build->first_face + i);
+        for(corner = 0; corner < 3; corner++)
+            build->chunk[3 * i + corner] = __rafgl_obj_finished_vertex(build->stream, face[corner], face[3 + corner], face[6 + corner]);
+    }
+}
 
-		vertex_data = vertices_buffer[vert_ind - 1];
-		uv_data = uv_buffer[uv_ind - 1];
-		normal_data = normals_buffer[norm_ind - 1];
+/* third pass, hands on the finished vertices RAFGL_OBJ_CHUNK_VERTICES at a time */
+static void __rafgl_obj_stream_emit(__rafgl_obj_stream_t *s, void (*emit)(void *data, const rafgl_vertexPUN_t *vertices, unsigned int first, unsigned int count), void *data)
+{
+    rafgl_vertexPUN_t *chunk = rafgl_arena_alloc(s->arena, RAFGL_OBJ_CHUNK_VERTICES * sizeof(rafgl_vertexPUN_t));
+    unsigned int first = 0, filled = 0;
 
-		vertex_buffer[i].position = vertex_data;
-        vertex_buffer[i].normal = normal_data;
-        vertex_buffer[i].u = uv_data.x;
-        vertex_buffer[i].v = 1.0f - uv_data.y;
+    if(s->faces)
+    {
+        /* whole faces per chunk, so every chunk is built in parallel */
+        __rafgl_obj_chunk_build_t build;
+        int chunk_faces = RAFGL_OBJ_CHUNK_VERTICES / 3;
+        build.stream = s;
+        build.chunk = chunk;
+        for(build.first_face = 0; build.first_face < s->face_count; build.first_face += chunk_faces)
+        {
+            int faces = rafgl_min_m(chunk_faces, s->face_count - build.first_face);
+            rafgl_jobs_parallel_for(faces, 64, __rafgl_obj_build_range, &build);
+            emit(data, chunk, 3 * build.first_face, 3 * faces);
+        }
+        return;
+    }
 
+    const unsigned char *cursor = s->map.data, *end = s->map.data + s->map.size;
+    char line[256];
+    int v[3], t[3], n[3], i, fake_uvs;
 
+    while(__rafgl_obj_next_line(&cursor, end, line, sizeof(line)))
+    {
+        /* every face was checked by the second pass */
+        if(line[0] != 'f' || !__rafgl_obj_parse_face(s, line, v, t, n, &fake_uvs))
+            continue;
 
+        for(i = 0; i < 3; i++)
+        {
+            chunk[filled++] = __rafgl_obj_finished_vertex(s, v[i], t[i], n[i]);
+            if(filled == RAFGL_OBJ_CHUNK_VERTICES)
+            {
+                emit(data, chunk, first, filled);
+                first += filled;
+                filled = 0;
+            }
+        }
     }
+    if(filled > 0)
+        emit(data, chunk, first, filled);
+}
 
-    /* GL BUFFER DATA */
+static void __rafgl_obj_copy_chunk(void *data, const rafgl_vertexPUN_t *vertices, unsigned int first, unsigned int count)
+{
+    memcpy((rafgl_vertexPUN_t*)data + first, vertices, count * sizeof(rafgl_vertexPUN_t));
+}
 
-	int vao;
-	glGenVertexArrays(1, &vao);
+typedef struct
+{
+    unsigned int first_vertex;
+    int failed;
+} __rafgl_obj_upload_t;
 
-	m -> vao_id = vao;
-	m -> vertex_count = vcount;
-	m -> triangle_count = vcount / 3;
+/* the range was never drawn from, so it is mapped unsynchronized and only that range is invalidated */
+static void __rafgl_obj_upload_chunk(void *data, const rafgl_vertexPUN_t *vertices, unsigned int first, unsigned int count)
+{
+    __rafgl_obj_upload_t *upload = data;
+    void *mapped = glMapBufferRange(GL_ARRAY_BUFFER, (upload->first_vertex + first) * sizeof(rafgl_vertexPUN_t), count * sizeof(rafgl_vertexPUN_t),
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if(mapped == NULL)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, (upload->first_vertex + first) * sizeof(rafgl_vertexPUN_t), count * sizeof(rafgl_vertexPUN_t), vertices);
+        return;
+    }
+    memcpy(mapped, vertices, count * sizeof(rafgl_vertexPUN_t));
+    /* the store was lost (display mode change and such) */
+    if(glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE)
+        upload->failed = 1;
+}
 
-	glBindVertexArray(vao);
+rafgl_vertexPUN_t* rafgl_vertexPUN_load_OBJ(rafgl_arena_t *arena, const char *obj_path, vec3_t position_offset, unsigned int *vertex_count, char *name)
+{
+    __rafgl_obj_stream_t stream;
+    int count = __rafgl_obj_stream_open(&stream, arena, obj_path, position_offset, name);
+    if(count < 0)
+        return NULL;
 
-	int data_buffer;
-	glGenBuffers(1, &data_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, data_buffer);
-	glBufferData(GL_ARRAY_BUFFER, vcount * sizeof(rafgl_vertexPUN_t), vertex_buffer, GL_STATIC_DRAW);
+    rafgl_vertexPUN_t *vertex_buffer = rafgl_malloc(RAFGL_MEM_MESH, count * sizeof(rafgl_vertexPUN_t));
+    __rafgl_obj_stream_emit(&stream, __rafgl_obj_copy_chunk, vertex_buffer);
+    __rafgl_obj_stream_close(&stream);
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
+    *vertex_count = count;
+    return vertex_buffer;
+}
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(rafgl_vertexPUN_t), (void*)0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(rafgl_vertexPUN_t), (void*)(3 * sizeof(float)));
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(rafgl_vertexPUN_t), (void*)(5 * sizeof(float)));
+void rafgl_meshPUN_load_from_OBJ(rafgl_meshPUN_t *m, const char *obj_path)
+{
+    rafgl_meshPUN_load_from_OBJ_offset(m, obj_path, vec3(0.0f, 0.0f, 0.0f));
+}
+
+/* third pass of an opened stream into m's vertex buffer */
+static void __rafgl_obj_stream_upload(__rafgl_obj_stream_t *s, rafgl_meshPUN_t *m, int vcount)
+{
+    __rafgl_obj_upload_t upload;
+    GLuint vbo = __rafgl_meshPUN_allocate(m, vcount);
+    upload.first_vertex = m->first_vertex;
+    upload.failed = 0;
 
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    __rafgl_obj_stream_emit(s, __rafgl_obj_upload_chunk, &upload);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    __rafgl_meshPUN_allocated(m, vbo);
 
+    if(upload.failed)
+        rafgl_log(RAFGL_ERROR, "Vertex buffer contents were lost while uploading [%s]\n", s->path);
 
-    /* free RAM */
-	free(vertex_buffer);
+    m->vertex_count = vcount;
+    m->triangle_count = vcount / 3;
+    m->loaded = 1;
+}
 
-	rafgl_list_free(&vertices);
-	rafgl_list_free(&uv_coordinates);
-	rafgl_list_free(&normals);
+void rafgl_meshPUN_load_from_OBJ_offset(rafgl_meshPUN_t *m, const char *obj_path, vec3_t position_offset)
+{
+    if(m->loaded)
+    {
+        rafgl_log(RAFGL_WARNING, "Trying to load to already loaded mesh! Loading from [%s] to mesh taken by [%s]", obj_path, m->name);
+        return;
+    }
 
-	rafgl_list_free(&vertex_indices);
-	rafgl_list_free(&uv_indices);
-	rafgl_list_free(&normal_indices);
-	m->loaded = 1;
+    __rafgl_obj_stream_t stream;
+    int vcount = __rafgl_obj_stream_open(&stream, rafgl_level_arena(), obj_path, position_offset, m->name);
+    if(vcount < 0)
+        return;
 
-	free(vertices_buffer);
-	free(uv_buffer);
-	free(normals_buffer);
+    __rafgl_obj_stream_upload(&stream, m, vcount);
+    __rafgl_obj_stream_close(&stream);
+}
 
-    fclose(f);
+void rafgl_modelPUN_init(rafgl_modelPUN_t *model)
+{
+    rafgl_meshPUN_init(&model->mesh);
+    model->submesh_count = 0;
+    model->material_count = 0;
+    model->submeshes = NULL;
+    model->materials = NULL;
+}
 
+void rafgl_modelPUN_cleanup(rafgl_modelPUN_t *model)
+{
+    rafgl_free(model->submeshes);
+    rafgl_free(model->materials);
+    model->submeshes = NULL;
+    model->materials = NULL;
+    model->submesh_count = 0;
+    model->material_count = 0;
 }
 
+int rafgl_modelPUN_find_material(const rafgl_modelPUN_t *model, const char *name)
+{
+    int i;
+    for(i = 0; i < model->material_count; i++)
+        if(strcmp(model->materials[i].name, name) == 0)
+            return i;
+    return -1;
+}
 
-int rafgl_list_init(rafgl_list_t *list, int element_size)
+/* the rest of a keyword line without surrounding blanks, names and paths may contain spaces */
+static void __rafgl_obj_line_argument(const char *line, char *out, int size)
 {
-    list -> count = 0;
-    list -> element_size = element_size;
-    list -> head = NULL;
-    list -> tail = NULL;
-    return 0;
+    while(*line == ' ' || *line == '\t')
+        line++;
+    int length = strcspn(line, "\r\n");
+    while(length > 0 && (line[length - 1] == ' ' || line[length - 1] == '\t'))
+        length--;
+    if(length > size - 1)
+        length = size - 1;
+    memcpy(out, line, length);
+    out[length] = '\0';
 }
 
-int rafgl_list_append(rafgl_list_t *list, void *data)
+/* the material called name, added with defaults when the model has none yet */
+static int __rafgl_obj_material(rafgl_modelPUN_t *model, const char *name)
 {
-    return rafgl_list_append_sized(list, list -> element_size, data);
+    int index = rafgl_modelPUN_find_material(model, name);
+    if(index >= 0)
+        return index;
+
+    model->materials = rafgl_realloc(RAFGL_MEM_MESH, model->materials, (model->material_count + 1) * sizeof(rafgl_obj_material_t));
+    rafgl_obj_material_t *material = &model->materials[model->material_count];
+    memset(material, 0, sizeof(*material));
+    strncpy(material->name, name, sizeof(material->name) - 1);
+    material->diffuse = vec3(1.0f, 1.0f, 1.0f);
+    material->roughness = -1.0f;
+    material->metallic = -1.0f;
+    return model->material_count++;
 }
 
-int rafgl_list_append_sized(rafgl_list_t *list, int size, void *data)
+/* a map line: options like "-bm 0.5" or "-clamp on" come first, the rest is a path relative to directory */
+static void __rafgl_obj_map_path(const char *line, const char *directory, char *out, int size)
 {
-    if(list -> head == NULL && list -> tail == NULL)
+    char argument[256];
+    const char *p = line;
+    for(;;)
     {
-        list -> head = list -> tail = malloc(sizeof(void*) + size);
-        memcpy(list -> tail + sizeof(void*), data, size);
-        *((void**)list -> tail) = NULL;
-        list -> count++;
+        while(*p == ' ' || *p == '\t')
+            p++;
+        /* an option, a number, on/off or an -imfchan channel, so file names can't start with '-' or a digit */
+        int number = (p[0] >= '0' && p[0] <= '9') || (p[0] == '.' && p[1] >= '0' && p[1] <= '9');
+        int option = p[0] == '-' || number || strncmp(p, "on ", 3) == 0 || strncmp(p, "off ", 4) == 0 ||
+                     (p[0] != '\0' && p[1] == ' ');
+        if(!option)
+            break;
+        p += strcspn(p, " \t\r\n");
     }
+
+    __rafgl_obj_line_argument(p, argument, sizeof(argument));
+    char *slash;
+    for(slash = argument; *slash; slash++)
+        if(*slash == '\\')
+            *slash = '/';
+
+    if(argument[0] == '\0')
+        out[0] = '\0';
+    else if(argument[0] == '/')
+        snprintf(out, size, "%s", argument);
     else
-    {
-        *((void**)list -> tail) = malloc(sizeof(void*) + size);
-        list -> tail = *((void**)list -> tail);
-        memcpy(list -> tail + sizeof(void*), data, size);
-        *((void**)list -> tail) = NULL;
-        list -> count++;
-    }
-    return 0;
+        snprintf(out, size, "%s%s", directory, argument);
 }
 
-int rafgl_list_remove(rafgl_list_t *list, int index)
+/* reads the materials of a .mtl named relative to the OBJ into the model */
+static void __rafgl_obj_load_mtl(rafgl_modelPUN_t *model, const char *obj_path, const char *mtl_name)
 {
-    void *target, *i = list -> head;
-    if(index >= list -> count) return -1;
-    if(index < 0) index = list -> count + index;
-    if(index < 0) return -1;
+    char directory[256], path[512], line[512];
+    const char *slash = strrchr(obj_path, '/');
+    int length = slash ? (int)(slash - obj_path) + 1 : 0;
+    if(length > (int)sizeof(directory) - 1)
+        length = sizeof(directory) - 1;
+    memcpy(directory, obj_path, length);
+    directory[length] = '\0';
+    snprintf(path, sizeof(path), "%s%s", directory, mtl_name);
+
+    /* the maps are relative to the .mtl, which may be in a directory of its own */
+    slash = strrchr(path, '/');
+    length = slash ? (int)(slash - path) + 1 : 0;
+    if(length > (int)sizeof(directory) - 1)
+        length = sizeof(directory) - 1;
+    memcpy(directory, path, length);
+    directory[length] = '\0';
 
-    if(index == 0)
+    unsigned char *data;
+    size_t size;
+    if(rafgl_vfs_read_all(path, RAFGL_MEM_MESH, &data, &size) != 0)
     {
-        target = list -> head;
-        list -> head = *((void**) list -> head);
+        rafgl_log(RAFGL_WARNING, "Can't open material library [%s]\n", path);
+        return;
     }
-    else
+
+    const unsigned char *cursor = data;
+    rafgl_obj_material_t *material = NULL;
+    while(__rafgl_obj_next_line(&cursor, data + size, line, sizeof(line)))
     {
-        index--;
-        while(index--)
+        const char *p = line + strspn(line, " \t");
+        char keyword[32];
+        int keyword_length = strcspn(p, " \t\r\n");
+        if(keyword_length == 0 || keyword_length >= (int)sizeof(keyword) || p[0] == '#')
+            continue;
+        memcpy(keyword, p, keyword_length);
+        keyword[keyword_length] = '\0';
+        p += keyword_length;
+
+        if(strcmp(keyword, "newmtl") == 0)
         {
-            i = *((void**)i);
+            char name[64];
+            __rafgl_obj_line_argument(p, name, sizeof(name));
+            int index = __rafgl_obj_material(model, name);
+            material = &model->materials[index];
         }
-        target = *((void**)i);
-        *((void**)i) = *((void**)(*((void**)i)));
-
+        else if(material == NULL)
+            continue;
+        else if(strcmp(keyword, "Kd") == 0)
+            sscanf(p, "%f%f%f", &material->diffuse.x, &material->diffuse.y, &material->diffuse.z);
+        else if(strcmp(keyword, "Pr") == 0)
+            sscanf(p, "%f", &material->roughness);
+        else if(strcmp(keyword, "Pm") == 0)
+            sscanf(p, "%f", &material->metallic);
+        else if(strcmp(keyword, "map_Kd") == 0)
+            __rafgl_obj_map_path(p, directory, material->diffuse_map, sizeof(material->diffuse_map));
+        else if(strcmp(keyword, "norm") == 0 || strcmp(keyword, "map_Bump") == 0 || strcmp(keyword, "map_bump") == 0 || strcmp(keyword, "bump") == 0)
+            __rafgl_obj_map_path(p, directory, material->normal_map, sizeof(material->normal_map));
+        else if(strcmp(keyword, "map_Ks") == 0)
+            __rafgl_obj_map_path(p, directory, material->specular_map, sizeof(material->specular_map));
+        else if(strcmp(keyword, "map_Pr") == 0)
+            __rafgl_obj_map_path(p, directory, material->roughness_map, sizeof(material->roughness_map));
+        else if(strcmp(keyword, "map_Pm") == 0)
+            __rafgl_obj_map_path(p, directory, material->metallic_map, sizeof(material->metallic_map));
     }
-    list -> count--;
-    free(target);
-    return 0;
+    rafgl_free(data);
 }
 
-void* rafgl_list_get(rafgl_list_t *list, int index)
+/*
+ * Splits the faces into submeshes at every "o", "g" and "usemtl" that changes the object or material, a run without
+ * faces is renamed rather than kept. Faces are emitted in file order, so every submesh is one range of the mesh. The
+ * "s" smoothing groups carry nothing for a loader that takes the normals from the file and are skipped.
+ */
+static void __rafgl_obj_scan_groups(__rafgl_obj_stream_t *s, rafgl_modelPUN_t *model)
 {
-    void *i = list -> head;
+    const unsigned char *cursor = s->map.data, *end = s->map.data + s->map.size;
+    char line[256], argument[256];
+    int capacity = 8;
+    rafgl_submeshPUN_t *current;
+
+    model->submeshes = rafgl_malloc(RAFGL_MEM_MESH, capacity * sizeof(rafgl_submeshPUN_t));
+    model->submesh_count = 1;
+    current = &model->submeshes[0];
+    memset(current, 0, sizeof(*current));
+    current->material = -1;
+
+    while(cursor < end)
+    {
+        const unsigned char *eol = memchr(cursor, '\n', end - cursor);
+        const unsigned char *next = eol ? eol + 1 : end;
+
+        /* same test as the counting pass, the face count has to match the emitted vertices */
+        if(cursor[0] == 'f')
+        {
+            current->vertex_count += 3;
+            cursor = next;
+            continue;
+        }
+        if(cursor[0] != 'o' && cursor[0] != 'g' && cursor[0] != 'u' && cursor[0] != 'm')
+        {
+            cursor = next;
+            continue;
+        }
+
+        __rafgl_obj_next_line(&cursor, end, line, sizeof(line));
+        int object = (line[0] == 'o' || line[0] == 'g') && (line[1] == ' ' || line[1] == '\t');
+        int usemtl = strncmp(line, "usemtl", 6) == 0 && (line[6] == ' ' || line[6] == '\t');
+        if(strncmp(line, "mtllib", 6) == 0 && (line[6] == ' ' || line[6] == '\t'))
+        {
+            /* file names usually have no spaces but these assets' directories do, so the line is one name */
+            __rafgl_obj_line_argument(line + 6, argument, sizeof(argument));
+            __rafgl_obj_load_mtl(model, s->path, argument);
+            continue;
+        }
+        if(!object && !usemtl)
+            continue;
+
+        __rafgl_obj_line_argument(line + (object ? 1 : 6), argument, sizeof(argument));
+        int material = usemtl ? __rafgl_obj_material(model, argument) : current->material;
+        if(object ? strncmp(current->name, argument, sizeof(current->name) - 1) == 0 : material == current->material)
+            continue;
+
+        if(current->vertex_count > 0)
+        {
+            if(model->submesh_count == capacity)
+            {
+                capacity *= 2;
+                model->submeshes = rafgl_realloc(RAFGL_MEM_MESH, model->submeshes, capacity * sizeof(rafgl_submeshPUN_t));
+            }
+            rafgl_submeshPUN_t *previous = &model->submeshes[model->submesh_count - 1];
+            current = &model->submeshes[model->submesh_count++];
+            *current = *previous;
+            current->first_vertex = previous->first_vertex + previous->vertex_count;
+            current->vertex_count = 0;
+        }
+        if(object)
+        {
+            strncpy(current->name, argument, sizeof(current->name) - 1);
+            current->name[sizeof(current->name) - 1] = '\0';
+        }
+        current->material = material;
+    }
+
+    /* trailing groups without faces */
+    if(model->submesh_count > 1 && current->vertex_count == 0)
+        model->submesh_count--;
+}
+
+void rafgl_modelPUN_load_from_OBJ(rafgl_modelPUN_t *model, const char *obj_path)
+{
+    if(model->mesh.loaded)
+    {
+        rafgl_log(RAFGL_WARNING, "Trying to load to already loaded model! Loading from [%s] to model taken by [%s]", obj_path, model->mesh.name);
+        return;
+    }
+
+    __rafgl_obj_stream_t stream;
+    int vcount = __rafgl_obj_stream_open(&stream, rafgl_level_arena(), obj_path, vec3(0.0f, 0.0f, 0.0f), model->mesh.name);
+    if(vcount < 0)
+        return;
+
+    __rafgl_obj_scan_groups(&stream, model);
+    __rafgl_obj_stream_upload(&stream, &model->mesh, vcount);
+    __rafgl_obj_stream_close(&stream);
+
+    int i;
+    for(i = 0; i < model->submesh_count; i++)
+        model->submeshes[i].first_vertex += model->mesh.first_vertex;
+}
+
+/* a JSON value, strings without their quotes */
+typedef struct
+{
+    int type;                   /* one of the __RAFGL_JSON_ values */
+    int start, end;             /* bytes of the value in the text */
+    int size;                   /* members of an object, elements of an array */
+    int next;                   /* token after the value and everything in it */
+} __rafgl_json_token_t;
+
+enum { __RAFGL_JSON_OBJECT, __RAFGL_JSON_ARRAY, __RAFGL_JSON_STRING, __RAFGL_JSON_PRIMITIVE };
+
+typedef struct
+{
+    const char *text;
+    int length, position;
+    __rafgl_json_token_t *tokens;
+    int count, capacity;
+} __rafgl_json_t;
+
+static void __rafgl_json_skip_blanks(__rafgl_json_t *json)
+{
+    while(json->position < json->length)
+    {
+        char c = json->text[json->position];
+        if(c != ' ' && c != '\t' && c != '\r' && c != '\n')
+            break;
+        json->position++;
+    }
+}
+
+/* tokens are added in document order, a container before everything in it, returns the token or -1 */
+static int __rafgl_json_parse_value(__rafgl_json_t *json, int depth)
+{
+    __rafgl_json_skip_blanks(json);
+    if(json->position >= json->length || json->count == json->capacity || depth > 64)
+        return -1;
+
+    int index = json->count++;
+    __rafgl_json_token_t *token = &json->tokens[index];
+    char c = json->text[json->position];
+    token->size = 0;
+
+    if(c == '{' || c == '[')
+    {
+        char close = c == '{' ? '}' : ']';
+        token->type = c == '{' ? __RAFGL_JSON_OBJECT : __RAFGL_JSON_ARRAY;
+        token->start = json->position++;
+        for(;;)
+        {
+            __rafgl_json_skip_blanks(json);
+            if(json->position < json->length && json->text[json->position] == close && json->tokens[index].size == 0)
+                break;
+            if(close == '}')
+            {
+                int key = __rafgl_json_parse_value(json, depth + 1);
+                if(key < 0 || json->tokens[key].type != __RAFGL_JSON_STRING)
+                    return -1;
+                __rafgl_json_skip_blanks(json);
+                if(json->position >= json->length || json->text[json->position] != ':')
+                    return -1;
+                json->position++;
+            }
+            if(__rafgl_json_parse_value(json, depth + 1) < 0)
+                return -1;
+            json->tokens[index].size++;
+
+            __rafgl_json_skip_blanks(json);
+            if(json->position < json->length && json->text[json->position] == ',')
+                json->position++;
+            else if(json->position < json->length && json->text[json->position] == close)
+                break;
+            else
+                return -1;
+        }
+        json->position++;
+        token = &json->tokens[index];
+        token->end = json->position;
+    }
+    else if(c == '"')
+    {
+        token->type = __RAFGL_JSON_STRING;
+        token->start = ++json->position;
+        while(json->position < json->length && json->text[json->position] != '"')
+            json->position += json->text[json->position] == '\\' ? 2 : 1;
+        if(json->position >= json->length)
+            return -1;
+        token->end = json->position++;
+    }
+    else
+    {
+        token->type = __RAFGL_JSON_PRIMITIVE;
+        token->start = json->position;
+        while(json->position < json->length && !strchr(",]} \t\r\n", json->text[json->position]))
+            json->position++;
+        token->end = json->position;
+        if(token->end == token->start)
+            return -1;
+    }
+
+    json->tokens[index].next = json->count;
+    return index;
+}
+
+/* the value of key in object, -1 when object is no object or has no such key */
+static int __rafgl_json_member(const __rafgl_json_t *json, int object, const char *key)
+{
+    int i, token, length = strlen(key);
+    if(object < 0 || json->tokens[object].type != __RAFGL_JSON_OBJECT)
+        return -1;
+    for(i = 0, token = object + 1; i < json->tokens[object].size; i++)
+    {
+        const __rafgl_json_token_t *name = &json->tokens[token];
+        int value = token + 1;
+        if(name->end - name->start == length && memcmp(json->text + name->start, key, length) == 0)
+            return value;
+        token = json->tokens[value].next;
+    }
+    return -1;
+}
+
+/* element i of array, -1 when out of range */
+static int __rafgl_json_element(const __rafgl_json_t *json, int array, int i)
+{
+    int token;
+    if(array < 0 || json->tokens[array].type != __RAFGL_JSON_ARRAY || i < 0 || i >= json->tokens[array].size)
+        return -1;
+    for(token = array + 1; i > 0; i--)
+        token = json->tokens[token].next;
+    return token;
+}
+
+static double __rafgl_json_number(const __rafgl_json_t *json, int token, double fallback)
+{
+    char number[64];
+    if(token < 0 || json->tokens[token].type != __RAFGL_JSON_PRIMITIVE)
+        return fallback;
+    int length = rafgl_min_m(json->tokens[token].end - json->tokens[token].start, (int)sizeof(number) - 1);
+    memcpy(number, json->text + json->tokens[token].start, length);
+    number[length] = '\0';
+
+    char *end;
+    double value = strtod(number, &end);
+    return end == number ? fallback : value;
+}
+
+static int __rafgl_json_int(const __rafgl_json_t *json, int object, const char *key, int fallback)
+{
+    return (int)__rafgl_json_number(json, __rafgl_json_member(json, object, key), fallback);
+}
+
+/* copies a string value with its escapes and the %XX of a URI decoded, 0 when token is no string */
+static int __rafgl_json_string(const __rafgl_json_t *json, int token, char *out, int size, int uri)
+{
+    int i, length = 0;
+    if(token < 0 || json->tokens[token].type != __RAFGL_JSON_STRING)
+        return 0;
+    for(i = json->tokens[token].start; i < json->tokens[token].end && length < size - 1; i++)
+    {
+        char c = json->text[i];
+        if(c == '\\' && i + 1 < json->tokens[token].end)
+        {
+            c = json->text[++i];
+            c = c == 'n' ? '\n' : c == 't' ? '\t' : c;
+        }
+        else if(uri && c == '%' && i + 2 < json->tokens[token].end)
+        {
+            char hex[3] = {json->text[i + 1], json->text[i + 2], '\0'};
+            c = (char)strtol(hex, NULL, 16);
+            i += 2;
+        }
+        out[length++] = c;
+    }
+    out[length] = '\0';
+    return 1;
+}
+
+#define __RAFGL_GLB_MAGIC 0x46546C67u       /* "glTF" */
+#define __RAFGL_GLB_JSON 0x4E4F534Au
+#define __RAFGL_GLB_BIN 0x004E4942u
+
+#define __RAFGL_GLTF_UNSIGNED_BYTE 5121
+#define __RAFGL_GLTF_UNSIGNED_SHORT 5123
+#define __RAFGL_GLTF_UNSIGNED_INT 5125
+#define __RAFGL_GLTF_FLOAT 5126
+
+/* an accessor resolved into the BIN chunk */
+typedef struct
+{
+    const unsigned char *data;  /* first element */
+    int count, components, component_type, normalized;
+    int stride;                 /* bytes from one element to the next */
+    int view, offset;           /* bufferView and the byte offset of the accessor in it */
+} __rafgl_glb_accessor_t;
+
+/* a mapped .glb with its JSON chunk parsed, everything but the tokens points into the mapping */
+typedef struct
+{
+    rafgl_vfs_map_t map;
+    const char *path;
+    __rafgl_json_t json;
+    const unsigned char *bin;
+    uint32_t bin_size;
+    int root;
+} __rafgl_glb_t;
+
+static uint32_t __rafgl_glb_u32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void __rafgl_glb_close(__rafgl_glb_t *g)
+{
+    rafgl_free(g->json.tokens);
+    g->json.tokens = NULL;
+    rafgl_vfs_unmap(&g->map);
+}
+
+/* maps the file and parses its JSON chunk, 0 on success, logs and returns -1 otherwise */
+static int __rafgl_glb_open(__rafgl_glb_t *g, const char *glb_path)
+{
+    memset(g, 0, sizeof(*g));
+    g->path = glb_path;
+    if(rafgl_vfs_map(glb_path, &g->map, RAFGL_VFS_RANDOM) != 0)
+    {
+        rafgl_log(RAFGL_WARNING, "Can't open [%s]\n", glb_path);
+        return -1;
+    }
+
+    const unsigned char *data = g->map.data;
+    size_t size = g->map.size;
+    if(size < 20 || __rafgl_glb_u32(data) != __RAFGL_GLB_MAGIC || __rafgl_glb_u32(data + 4) != 2 ||
+       __rafgl_glb_u32(data + 8) > size || __rafgl_glb_u32(data + 16) != __RAFGL_GLB_JSON ||
+       __rafgl_glb_u32(data + 12) > size - 20)
+    {
+        rafgl_log(RAFGL_WARNING, "[%s] is not a binary glTF 2.0 file\n", glb_path);
+        __rafgl_glb_close(g);
+        return -1;
+    }
+
+    uint32_t json_size = __rafgl_glb_u32(data + 12);
+    size_t bin_header = 20 + ((json_size + 3) & ~3u);
+    if(bin_header + 8 <= size && __rafgl_glb_u32(data + bin_header + 4) == __RAFGL_GLB_BIN &&
+       __rafgl_glb_u32(data + bin_header) <= size - bin_header - 8)
+    {
+        g->bin = data + bin_header + 8;
+        g->bin_size = __rafgl_glb_u32(data + bin_header);
+    }
+
+    /* no value is shorter than two bytes with its separator, so this many tokens always do */
+    g->json.text = (const char*)data + 20;
+    g->json.length = json_size;
+    g->json.capacity = json_size / 2 + 2;
+    g->json.tokens = rafgl_malloc(RAFGL_MEM_MESH, g->json.capacity * sizeof(__rafgl_json_token_t));
+    g->root = __rafgl_json_parse_value(&g->json, 0);
+    if(g->root < 0 || g->json.tokens[g->root].type != __RAFGL_JSON_OBJECT)
+    {
+        rafgl_log(RAFGL_WARNING, "Can't parse the JSON chunk of [%s]\n", glb_path);
+        __rafgl_glb_close(g);
+        return -1;
+    }
+    return 0;
+}
+
+/* bytes of bufferView view inside the BIN chunk, NULL when it is elsewhere or out of bounds */
+static const unsigned char* __rafgl_glb_view(const __rafgl_glb_t *g, int view, uint32_t *length, int *stride)
+{
+    const __rafgl_json_t *json = &g->json;
+    int token = __rafgl_json_element(json, __rafgl_json_member(json, g->root, "bufferViews"), view);
+    if(token < 0 || g->bin == NULL)
+        return NULL;
+
+    /* only the BIN chunk, buffer 0 without a uri, is read */
+    int buffer = __rafgl_json_int(json, token, "buffer", -1);
+    int buffer_token = __rafgl_json_element(json, __rafgl_json_member(json, g->root, "buffers"), buffer);
+    if(buffer != 0 || __rafgl_json_member(json, buffer_token, "uri") >= 0)
+        return NULL;
+
+    double offset = __rafgl_json_number(json, __rafgl_json_member(json, token, "byteOffset"), 0);
+    double size = __rafgl_json_number(json, __rafgl_json_member(json, token, "byteLength"), -1);
+    if(offset < 0 || size < 0 || offset + size > g->bin_size)
+        return NULL;
+
+    *length = (uint32_t)size;
+    if(stride)
+        *stride = __rafgl_json_int(json, token, "byteStride", 0);
+    return g->bin + (uint32_t)offset;
+}
+
+static int __rafgl_glb_accessor(const __rafgl_glb_t *g, int index, __rafgl_glb_accessor_t *a)
+{
+    static const char *types[] = {"SCALAR", "VEC2", "VEC3", "VEC4"};
+    const __rafgl_json_t *json = &g->json;
+    int token = __rafgl_json_element(json, __rafgl_json_member(json, g->root, "accessors"), index);
+    char type[16];
+    int i;
+    uint32_t view_length;
+
+    if(token < 0 || __rafgl_json_member(json, token, "sparse") >= 0 ||
+       !__rafgl_json_string(json, __rafgl_json_member(json, token, "type"), type, sizeof(type), 0))
+        return 0;
+
+    a->components = 0;
+    for(i = 0; i < 4; i++)
+        if(strcmp(type, types[i]) == 0)
+            a->components = i + 1;
+    a->count = __rafgl_json_int(json, token, "count", -1);
+    a->component_type = __rafgl_json_int(json, token, "componentType", 0);
+    int normalized = __rafgl_json_member(json, token, "normalized");
+    a->normalized = normalized >= 0 && json->text[json->tokens[normalized].start] == 't';
+    a->view = __rafgl_json_int(json, token, "bufferView", -1);
+    a->offset = __rafgl_json_int(json, token, "byteOffset", 0);
+
+    int component_size = a->component_type == __RAFGL_GLTF_FLOAT || a->component_type == __RAFGL_GLTF_UNSIGNED_INT ? 4 :
+                         a->component_type == __RAFGL_GLTF_UNSIGNED_SHORT || a->component_type == 5122 ? 2 :
+                         a->component_type == __RAFGL_GLTF_UNSIGNED_BYTE || a->component_type == 5120 ? 1 : 0;
+    const unsigned char *view = __rafgl_glb_view(g, a->view, &view_length, &a->stride);
+    if(view == NULL || a->components == 0 || component_size == 0 || a->count < 0 || a->offset < 0)
+        return 0;
+    if(a->stride == 0)
+        a->stride = a->components * component_size;
+
+    /* every element has to lie inside the view */
+    if(a->count > 0 && (uint64_t)a->offset + (uint64_t)a->stride * (a->count - 1) + a->components * component_size > view_length)
+        return 0;
+    a->data = view + a->offset;
+    return 1;
+}
+
+/* component c of element i as a float, normalized integers map to [0, 1] or [-1, 1] */
+static float __rafgl_glb_float(const __rafgl_glb_accessor_t *a, int i, int c)
+{
+    const unsigned char *p = a->data + (size_t)i * a->stride;
+    float value;
+    switch(a->component_type)
+    {
+    case __RAFGL_GLTF_FLOAT:
+        memcpy(&value, p + 4 * c, 4);
+        return value;
+    case __RAFGL_GLTF_UNSIGNED_SHORT:
+        return (p[2 * c] | (p[2 * c + 1] << 8)) / (a->normalized ? 65535.0f : 1.0f);
+    case __RAFGL_GLTF_UNSIGNED_BYTE:
+        return p[c] / (a->normalized ? 255.0f : 1.0f);
+    case 5122:
+        value = (int16_t)(p[2 * c] | (p[2 * c + 1] << 8));
+        return a->normalized ? rafgl_max_m(value / 32767.0f, -1.0f) : value;
+    case 5120:
+        value = (int8_t)p[c];
+        return a->normalized ? rafgl_max_m(value / 127.0f, -1.0f) : value;
+    }
+    return 0.0f;
+}
+
+static uint32_t __rafgl_glb_index(const __rafgl_glb_accessor_t *a, int i)
+{
+    const unsigned char *p = a->data + (size_t)i * a->stride;
+    if(a->component_type == __RAFGL_GLTF_UNSIGNED_INT)
+        return __rafgl_glb_u32(p);
+    if(a->component_type == __RAFGL_GLTF_UNSIGNED_SHORT)
+        return p[0] | (p[1] << 8);
+    return p[0];
+}
+
+/* one triangle primitive, accessors without data have a count of 0 */
+typedef struct
+{
+    __rafgl_glb_accessor_t position, uv, normal, tangent, packed_tangent, indices;
+    int vertex_count;           /* after expanding the indices */
+    int direct;                 /* interleaved exactly like rafgl_vertexPUN_t and not indexed */
+} __rafgl_glb_primitive_t;
+
+static int __rafgl_glb_attribute(const __rafgl_glb_t *g, int attributes, const char *name, __rafgl_glb_accessor_t *a)
+{
+    int index = __rafgl_json_int(&g->json, attributes, name, -1);
+    a->count = 0;
+    return index < 0 || __rafgl_glb_accessor(g, index, a);
+}
+
+static int __rafgl_glb_primitive(const __rafgl_glb_t *g, int token, __rafgl_glb_primitive_t *p)
+{
+    const __rafgl_json_t *json = &g->json;
+    int attributes = __rafgl_json_member(json, token, "attributes");
+    int indices = __rafgl_json_int(json, token, "indices", -1);
+    int mode = __rafgl_json_int(json, token, "mode", 4);
+    memset(p, 0, sizeof(*p));
+
+    /* points and lines have nothing to draw in a triangle list */
+    if(mode != 4)
+        return 0;
+    if(!__rafgl_glb_attribute(g, attributes, "POSITION", &p->position) || p->position.count == 0 ||
+       p->position.component_type != __RAFGL_GLTF_FLOAT || p->position.components != 3 ||
+       !__rafgl_glb_attribute(g, attributes, "TEXCOORD_0", &p->uv) || (p->uv.count && p->uv.components != 2) ||
+       !__rafgl_glb_attribute(g, attributes, "NORMAL", &p->normal) || (p->normal.count && p->normal.components != 3) ||
+       !__rafgl_glb_attribute(g, attributes, "TANGENT", &p->tangent) || (p->tangent.count && p->tangent.components != 4) ||
+       !__rafgl_glb_attribute(g, attributes, "_RAFGL_TANGENT", &p->packed_tangent) ||
+       (p->packed_tangent.count && p->packed_tangent.component_type != __RAFGL_GLTF_UNSIGNED_INT) ||
+       (indices >= 0 && (!__rafgl_glb_accessor(g, indices, &p->indices) || p->indices.components != 1)))
+    {
+        rafgl_log(RAFGL_WARNING, "Skipping a primitive of [%s] with accessors that can't be read\n", g->path);
+        return 0;
+    }
+
+    /* attributes shorter than POSITION are ignored rather than read past */
+    if(p->uv.count < p->position.count)
+        p->uv.count = 0;
+    if(p->normal.count < p->position.count)
+        p->normal.count = 0;
+    if(p->tangent.count < p->position.count)
+        p->tangent.count = 0;
+    if(p->packed_tangent.count < p->position.count)
+        p->packed_tangent.count = 0;
+
+    p->vertex_count = (indices >= 0 ? p->indices.count : p->position.count) / 3 * 3;
+
+    const __rafgl_glb_accessor_t *a = &p->position;
+    p->direct = indices < 0 && a->stride == sizeof(rafgl_vertexPUN_t) &&
+                p->uv.count && p->uv.view == a->view && p->uv.offset == a->offset + (int)offsetof(rafgl_vertexPUN_t, u) &&
+                p->uv.component_type == __RAFGL_GLTF_FLOAT && p->uv.stride == a->stride &&
+                p->normal.count && p->normal.view == a->view && p->normal.offset == a->offset + (int)offsetof(rafgl_vertexPUN_t, normal) &&
+                p->normal.component_type == __RAFGL_GLTF_FLOAT && p->normal.stride == a->stride &&
+                p->packed_tangent.count && p->packed_tangent.view == a->view &&
+                p->packed_tangent.offset == a->offset + (int)offsetof(rafgl_vertexPUN_t, tangent) && p->packed_tangent.stride == a->stride;
+    return 1;
+}
+
+/* calls fn for every triangle primitive of every mesh, in file order, returns how many there were */
+static int __rafgl_glb_primitives(const __rafgl_glb_t *g, void (*fn)(const __rafgl_glb_t *g, __rafgl_glb_primitive_t *p, void *data), void *data)
+{
+    const __rafgl_json_t *json = &g->json;
+    int meshes = __rafgl_json_member(json, g->root, "meshes");
+    int i, j, count = 0;
+    for(i = 0; meshes >= 0 && i < json->tokens[meshes].size; i++)
+    {
+        int primitives = __rafgl_json_member(json, __rafgl_json_element(json, meshes, i), "primitives");
+        for(j = 0; primitives >= 0 && j < json->tokens[primitives].size; j++)
+        {
+            __rafgl_glb_primitive_t p;
+            if(!__rafgl_glb_primitive(g, __rafgl_json_element(json, primitives, j), &p) || p.vertex_count == 0)
+                continue;
+            fn(g, &p, data);
+            count++;
+        }
+    }
+    return count;
+}
+
+static void __rafgl_glb_count(const __rafgl_glb_t *g, __rafgl_glb_primitive_t *p, void *data)
+{
+    *(int*)data += p->vertex_count;
+}
+
+typedef struct
+{
+    rafgl_arena_t *arena;
+    void (*emit)(void *data, const rafgl_vertexPUN_t *vertices, unsigned int first, unsigned int count);
+    void *data;
+    unsigned int first;
+    int failed;
+} __rafgl_glb_emit_t;
+
+static rafgl_vertexPUN_t __rafgl_glb_vertex(const __rafgl_glb_primitive_t *p, uint32_t i)
+{
+    rafgl_vertexPUN_t vertex;
+    vertex.position = vec3(__rafgl_glb_float(&p->position, i, 0), __rafgl_glb_float(&p->position, i, 1), __rafgl_glb_float(&p->position, i, 2));
+    vertex.u = p->uv.count ? __rafgl_glb_float(&p->uv, i, 0) : 0.0f;
+    vertex.v = p->uv.count ? __rafgl_glb_float(&p->uv, i, 1) : 0.0f;
+    vertex.normal = p->normal.count ? vec3(__rafgl_glb_float(&p->normal, i, 0), __rafgl_glb_float(&p->normal, i, 1), __rafgl_glb_float(&p->normal, i, 2))
+                                    : vec3(0.0f, 0.0f, 0.0f);
+    vertex.tangent = 0;
+    return vertex;
+}
+
+/* hands on the vertices of a primitive, straight from the mapping when its layout matches, a chunk at a time otherwise */
+static void __rafgl_glb_emit_primitive(const __rafgl_glb_t *g, __rafgl_glb_primitive_t *p, void *data)
+{
+    __rafgl_glb_emit_t *e = data;
+    if(p->direct)
+    {
+        e->emit(e->data, (const rafgl_vertexPUN_t*)p->position.data, e->first, p->vertex_count);
+        e->first += p->vertex_count;
+        return;
+    }
+
+    rafgl_arena_marker_t marker = rafgl_arena_marker(e->arena);
+    rafgl_vertexPUN_t *chunk = rafgl_arena_alloc(e->arena, RAFGL_OBJ_CHUNK_VERTICES * sizeof(rafgl_vertexPUN_t));
+    rafgl_tangent_accumulator_t *sums = NULL;
+    int i, corner, filled = 0;
+
+    /* without tangents in the file they are summed per vertex like the OBJ loader sums them per corner */
+    if(!p->tangent.count && !p->packed_tangent.count && p->uv.count)
+    {
+        sums = rafgl_arena_calloc(e->arena, p->position.count, sizeof(rafgl_tangent_accumulator_t));
+        for(i = 0; i < p->vertex_count; i += 3)
+        {
+            rafgl_vertexPUN_t triangle[3];
+            rafgl_tangent_accumulator_t *corners[3];
+            for(corner = 0; corner < 3; corner++)
+            {
+                uint32_t index = p->indices.count ? __rafgl_glb_index(&p->indices, i + corner) : (uint32_t)(i + corner);
+                if(index >= (uint32_t)p->position.count)
+                    index = 0;
+                triangle[corner] = __rafgl_glb_vertex(p, index);
+                corners[corner] = &sums[index];
+            }
+            __rafgl_triangle_accumulate_tangents(triangle, corners);
+        }
+    }
+
+    for(i = 0; i < p->vertex_count; i += 3)
+    {
+        rafgl_vertexPUN_t *triangle = chunk + filled;
+        for(corner = 0; corner < 3; corner++)
+        {
+            uint32_t index = p->indices.count ? __rafgl_glb_index(&p->indices, i + corner) : (uint32_t)(i + corner);
+            if(index >= (uint32_t)p->position.count)
+            {
+                index = 0;
+                e->failed = 1;
+            }
+            triangle[corner] = __rafgl_glb_vertex(p, index);
+            if(p->packed_tangent.count)
+                triangle[corner].tangent = __rafgl_glb_u32(p->packed_tangent.data + (size_t)index * p->packed_tangent.stride);
+            else if(p->tangent.count)
+            {
+                /* glTF's bitangent points up the texture, this tree's UVs grow down it, so the handedness flips */
+                vec3_t tangent = vec3(__rafgl_glb_float(&p->tangent, index, 0), __rafgl_glb_float(&p->tangent, index, 1), __rafgl_glb_float(&p->tangent, index, 2));
+                triangle[corner].tangent = __rafgl_tangent_pack(tangent, -__rafgl_glb_float(&p->tangent, index, 3));
+            }
+        }
+
+        /* a file without normals wants flat shading */
+        if(!p->normal.count)
+        {
+            vec3_t normal = v3_norm(v3_cross(v3_sub(triangle[1].position, triangle[0].position), v3_sub(triangle[2].position, triangle[0].position)));
+            for(corner = 0; corner < 3; corner++)
+                triangle[corner].normal = normal;
+        }
+        for(corner = 0; corner < 3 && !p->tangent.count && !p->packed_tangent.count; corner++)
+        {
+            rafgl_tangent_accumulator_t none;
+            memset(&none, 0, sizeof(none));
+            uint32_t index = p->indices.count ? __rafgl_glb_index(&p->indices, i + corner) : (uint32_t)(i + corner);
+            triangle[corner].tangent = __rafgl_tangent_finish(triangle[corner].normal,
+                                                              sums && index < (uint32_t)p->position.count ? &sums[index] : &none);
+        }
+
+        filled += 3;
+        if(filled + 3 > RAFGL_OBJ_CHUNK_VERTICES || i + 3 >= p->vertex_count)
+        {
+            e->emit(e->data, chunk, e->first, filled);
+            e->first += filled;
+            filled = 0;
+        }
+    }
+    rafgl_arena_rewind(e->arena, marker);
+}
+
+rafgl_vertexPUN_t* rafgl_vertexPUN_load_GLB(rafgl_arena_t *arena, const char *glb_path, unsigned int *vertex_count)
+{
+    __rafgl_glb_t g;
+    int count = 0;
+    if(__rafgl_glb_open(&g, glb_path) != 0)
+        return NULL;
+    if(__rafgl_glb_primitives(&g, __rafgl_glb_count, &count) == 0)
+    {
+        rafgl_log(RAFGL_WARNING, "[%s] has no triangles\n", glb_path);
+        __rafgl_glb_close(&g);
+        return NULL;
+    }
+
+    rafgl_vertexPUN_t *vertex_buffer = rafgl_malloc(RAFGL_MEM_MESH, count * sizeof(rafgl_vertexPUN_t));
+    __rafgl_glb_emit_t e = {arena, __rafgl_obj_copy_chunk, vertex_buffer, 0, 0};
+    __rafgl_glb_primitives(&g, __rafgl_glb_emit_primitive, &e);
+    __rafgl_glb_close(&g);
+    if(e.failed)
+        rafgl_log(RAFGL_WARNING, "Index out of range in [%s]\n", glb_path);
+
+    *vertex_count = count;
+    return vertex_buffer;
+}
+
+void rafgl_meshPUN_load_from_GLB(rafgl_meshPUN_t *m, const char *glb_path)
+{
+    __rafgl_glb_t g;
+    int count = 0;
+    if(m->loaded)
+    {
+        rafgl_log(RAFGL_WARNING, "Trying to load to already loaded mesh! Loading from [%s] to mesh taken by [%s]", glb_path, m->name);
+        return;
+    }
+    if(__rafgl_glb_open(&g, glb_path) != 0)
+        return;
+    if(__rafgl_glb_primitives(&g, __rafgl_glb_count, &count) == 0)
+    {
+        rafgl_log(RAFGL_WARNING, "[%s] has no triangles\n", glb_path);
+        __rafgl_glb_close(&g);
+        return;
+    }
+
+    int mesh = __rafgl_json_element(&g.json, __rafgl_json_member(&g.json, g.root, "meshes"), 0);
+    if(!__rafgl_json_string(&g.json, __rafgl_json_member(&g.json, mesh, "name"), m->name, sizeof(m->name), 0))
+        m->name[0] = '\0';
+
+    __rafgl_obj_upload_t upload;
+    GLuint vbo = __rafgl_meshPUN_allocate(m, count);
+    upload.first_vertex = m->first_vertex;
+    upload.failed = 0;
+    __rafgl_glb_emit_t e = {rafgl_level_arena(), __rafgl_obj_upload_chunk, &upload, 0, 0};
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    __rafgl_glb_primitives(&g, __rafgl_glb_emit_primitive, &e);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    __rafgl_meshPUN_allocated(m, vbo);
+    __rafgl_glb_close(&g);
+
+    if(e.failed)
+        rafgl_log(RAFGL_WARNING, "Index out of range in [%s]\n", glb_path);
+    if(upload.failed)
+        rafgl_log(RAFGL_ERROR, "Vertex buffer contents were lost while uploading [%s]\n", glb_path);
+
+    m->vertex_count = count;
+    m->triangle_count = count / 3;
+    m->loaded = 1;
+}
+
+int rafgl_raster_load_from_GLB(rafgl_raster_t *raster, const char *glb_path, int material, const char *texture)
+{
+    __rafgl_glb_t g;
+    raster->data = NULL;
+    raster->width = raster->height = 0;
+    if(__rafgl_glb_open(&g, glb_path) != 0)
+        return -1;
+
+    const __rafgl_json_t *json = &g.json;
+    int material_token = __rafgl_json_element(json, __rafgl_json_member(json, g.root, "materials"), material);
+    int info = __rafgl_json_member(json, material_token, texture);
+    if(info < 0)
+        info = __rafgl_json_member(json, __rafgl_json_member(json, material_token, "pbrMetallicRoughness"), texture);
+    int texture_token = __rafgl_json_element(json, __rafgl_json_member(json, g.root, "textures"), __rafgl_json_int(json, info, "index", -1));
+    int image = __rafgl_json_element(json, __rafgl_json_member(json, g.root, "images"), __rafgl_json_int(json, texture_token, "source", -1));
+
+    int result = -1;
+    char uri[256];
+    if(image >= 0 && __rafgl_json_member(json, image, "bufferView") >= 0)
+    {
+        /* embedded, decoded straight from the mapping */
+        uint32_t length;
+        const unsigned char *bytes = __rafgl_glb_view(&g, __rafgl_json_int(json, image, "bufferView", -1), &length, NULL);
+        if(bytes)
+            result = rafgl_raster_load_from_memory(raster, bytes, length);
+    }
+    else if(image >= 0 && __rafgl_json_string(json, __rafgl_json_member(json, image, "uri"), uri, sizeof(uri), 1) &&
+            strncmp(uri, "data:", 5) != 0)
+    {
+        /* external, next to the .glb */
+        char path[512];
+        const char *slash = strrchr(glb_path, '/');
+        snprintf(path, sizeof(path), "%.*s%s", slash ? (int)(slash - glb_path) + 1 : 0, glb_path, uri);
+        result = rafgl_raster_load_from_image(raster, path);
+    }
+
+    if(result != 0)
+        rafgl_log(RAFGL_WARNING, "No %s for material %d in [%s]\n", texture, material, glb_path);
+    __rafgl_glb_close(&g);
+    return result;
+}
+
+int rafgl_vertexPUN_save_GLB(const char *glb_path, const rafgl_vertexPUN_t *vertices, unsigned int vertex_count, const char *name)
+{
+    char json[2048], escaped[128];
+    int length = 0;
+    vec3_t lo = vec3(0.0f, 0.0f, 0.0f), hi = lo;
+    unsigned int i;
+    for(i = 0; i < vertex_count; i++)
+    {
+        vec3_t p = vertices[i].position;
+        lo = i ? vec3(rafgl_min_m(lo.x, p.x), rafgl_min_m(lo.y, p.y), rafgl_min_m(lo.z, p.z)) : p;
+        hi = i ? vec3(rafgl_max_m(hi.x, p.x), rafgl_max_m(hi.y, p.y), rafgl_max_m(hi.z, p.z)) : p;
+    }
+
+    for(; name && *name && length < (int)sizeof(escaped) - 2; name++)
+    {
+        if(*name == '"' || *name == '\\')
+            escaped[length++] = '\\';
+        escaped[length++] = *name;
+    }
+    escaped[length] = '\0';
+
+    /* one interleaved view the loader can upload as it is, the tangent keeps its packed form in an attribute of its own */
+    uint32_t bin_size = vertex_count * sizeof(rafgl_vertexPUN_t);
+    int stride = sizeof(rafgl_vertexPUN_t);
+    int json_size = snprintf(json, sizeof(json),
+        "{\"asset\":{\"version\":\"2.0\",\"generator\":\"rafgl\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],"
+        "\"nodes\":[{\"mesh\":0}],\"meshes\":[{\"name\":\"%s\",\"primitives\":[{\"attributes\":"
+        "{\"POSITION\":0,\"TEXCOORD_0\":1,\"NORMAL\":2,\"_RAFGL_TANGENT\":3},\"mode\":4}]}],"
+        "\"buffers\":[{\"byteLength\":%u}],"
+        "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%u,\"byteStride\":%d,\"target\":34962}],"
+        "\"accessors\":["
+        "{\"bufferView\":0,\"byteOffset\":%d,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\",\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]},"
+        "{\"bufferView\":0,\"byteOffset\":%d,\"componentType\":5126,\"count\":%u,\"type\":\"VEC2\"},"
+        "{\"bufferView\":0,\"byteOffset\":%d,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\"},"
+        "{\"bufferView\":0,\"byteOffset\":%d,\"componentType\":5125,\"count\":%u,\"type\":\"SCALAR\"}]}",
+        escaped, bin_size, bin_size, stride,
+        (int)offsetof(rafgl_vertexPUN_t, position), vertex_count, lo.x, lo.y, lo.z, hi.x, hi.y, hi.z,
+        (int)offsetof(rafgl_vertexPUN_t, u), vertex_count,
+        (int)offsetof(rafgl_vertexPUN_t, normal), vertex_count,
+        (int)offsetof(rafgl_vertexPUN_t, tangent), vertex_count);
+    if(json_size <= 0 || json_size >= (int)sizeof(json) - 4)
+        return -1;
+    while(json_size % 4)
+        json[json_size++] = ' ';
+
+    FILE *file = fopen(glb_path, "wb");
+    if(file == NULL)
+    {
+        rafgl_log(RAFGL_WARNING, "Can't write [%s]\n", glb_path);
+        return -1;
+    }
+
+    /* glTF is little endian like every host this runs on */
+    uint32_t header[5] = {__RAFGL_GLB_MAGIC, 2, 12 + 8 + json_size + 8 + bin_size, json_size, __RAFGL_GLB_JSON};
+    uint32_t bin_header[2] = {bin_size, __RAFGL_GLB_BIN};
+    int ok = fwrite(header, sizeof(header), 1, file) == 1 && fwrite(json, json_size, 1, file) == 1 &&
+             fwrite(bin_header, sizeof(bin_header), 1, file) == 1 && (bin_size == 0 || fwrite(vertices, bin_size, 1, file) == 1);
+    ok = fclose(file) == 0 && ok;
+    return ok ? 0 : -1;
+}
+
+int rafgl_list_init(rafgl_list_t *list, int element_size)
+{
+    list -> count = 0;
+    list -> element_size = element_size;
+    list -> head = NULL;
+    list -> tail = NULL;
+    list -> pool = NULL;
+    return 0;
+}
+
+int rafgl_list_init_pooled(rafgl_list_t *list, int element_size, struct _rafgl_pool_t *pool)
+{
+    rafgl_list_init(list, element_size);
+    list -> pool = pool;
+    return 0;
+}
+
+static void* __rafgl_list_new_node(rafgl_list_t *list, int size)
+{
+    if(list -> pool == NULL)
+        return rafgl_malloc(RAFGL_MEM_LIST, sizeof(void*) + size);
+    if(sizeof(void*) + size > list -> pool -> element_size)
+        return NULL;
+    return rafgl_pool_alloc(list -> pool);
+}
+
+static void __rafgl_list_free_node(rafgl_list_t *list, void *node)
+{
+    if(list -> pool == NULL)
+        rafgl_free(node);
+    else
+        rafgl_pool_release(list -> pool, node);
+}
+
+int rafgl_list_append(rafgl_list_t *list, void *data)
+{
+    return rafgl_list_append_sized(list, list -> element_size, data);
+}
+
+int rafgl_list_append_sized(rafgl_list_t *list, int size, void *data)
+{
+    void *node = __rafgl_list_new_node(list, size);
+    if(node == NULL) return -1;
+
+    if(list -> head == NULL && list -> tail == NULL)
+    {
+        list -> head = list -> tail = node;
+        memcpy(list -> tail + sizeof(void*), data, size);
+        *((void**)list -> tail) = NULL;
+        list -> count++;
+    }
+    else
+    {
+        *((void**)list -> tail) = node;
+        list -> tail = *((void**)list -> tail);
+        memcpy(list -> tail + sizeof(void*), data, size);
+        *((void**)list -> tail) = NULL;
+        list -> count++;
+    }
+    return 0;
+}
+
+int rafgl_list_remove(rafgl_list_t *list, int index)
+{
+    void *target, *i = list -> head;
+    if(index >= list -> count) return -1;
+    if(index < 0) index = list -> count + index;
+    if(index < 0) return -1;
+
+    if(index == 0)
+    {
+        target = list -> head;
+        list -> head = *((void**) list -> head);
+    }
+    else
+    {
+        index--;
+        while(index--)
+        {
+            i = *((void**)i);
+        }
+        target = *((void**)i);
+        *((void**)i) = *((void**)(*((void**)i)));
+        if(target == list -> tail) list -> tail = i;
+
+    }
+    list -> count--;
+    if(list -> count == 0) list -> head = list -> tail = NULL;
+    __rafgl_list_free_node(list, target);
+    return 0;
+}
+
+void* rafgl_list_get(rafgl_list_t *list, int index)
+{
+    void *i = list -> head;
 
     if(index >= list -> count) return NULL;
     if(index < 0) index = list -> count + index;
@@ -2096,7 +4062,7 @@ int rafgl_list_free(rafgl_list_t *list)
     {
         curr = i;
         i = *i;
-        free(curr);
+        __rafgl_list_free_node(list, curr);
     }
     return 0;
 }
@@ -2116,104 +4082,396 @@ int rafgl_list_show(rafgl_list_t *list, void (*fun)(void*, int))
 
 int rafgl_file_size(const char *filepath)
 {
-    int size = 0;
-    FILE *f = fopen(filepath, "rt");
+    struct stat st;
+    if(stat(filepath, &st) != 0) return -1;
+    return st.st_size;
+}
 
-    fseek(f, 0L, SEEK_END);
+char* rafgl_file_read_content(const char *filepath)
+{
+    unsigned char *content;             /* This must later be freed with rafgl_free */
+    size_t size;
+    int error = rafgl_vfs_read_all(filepath, RAFGL_MEM_SHADER, &content, &size);
+    if(error)
+    {
+        rafgl_log(RAFGL_ERROR, "Can't read [%s]: %s\n", filepath, strerror(error));
+        content = rafgl_calloc(RAFGL_MEM_SHADER, 1, 1);
+    }
+    return (char*)content;
+}
 
-    size = ftell(f);
+#define RAFGL_PROGRAM_MAX_DEFINES 16
+#define RAFGL_PROGRAM_DEFINES_LENGTH 256
+#define RAFGL_PROGRAM_VARIANTS_MAX 64
 
-    fclose(f);
 
-    return size;
+static int __rafgl_define_compare(const void *a, const void *b)
+{
+    return strcmp(*(const char**)a, *(const char**)b);
 }
 
-char* rafgl_file_read_content(const char *filepath)
+/* splits "B|A=1" into sorted entries, writes "A=1|B" to key and "#define A 1\n#define B\n" to block */
+static void __rafgl_program_parse_defines(const char *defines, char *key, char *block, int size)
 {
-    int fsize = rafgl_file_size(filepath);
-    FILE *f = fopen(filepath, "rt");
+    char copy[RAFGL_PROGRAM_DEFINES_LENGTH];
+    char *entries[RAFGL_PROGRAM_MAX_DEFINES];
+    int count = 0, i;
 
-    fseek(f, 0, SEEK_SET);
+    key[0] = 0;
+    block[0] = 0;
+    if(defines == NULL)
+        return;
 
-    char *content = calloc(sizeof(char), fsize + 10);          /* This must later be freed */
+    snprintf(copy, sizeof(copy), "%s", defines);
+    char *entry = strtok(copy, "|");
+    while(entry != NULL && count < RAFGL_PROGRAM_MAX_DEFINES)
+    {
+        while(*entry == ' ') entry++;
+        if(*entry)
+            entries[count++] = entry;
+        entry = strtok(NULL, "|");
+    }
+    qsort(entries, count, sizeof(char*), __rafgl_define_compare);
 
-    fread(content, 1, fsize, f);
+    int key_used = 0, block_used = 0;
+    for(i = 0; i < count; i++)
+    {
+        key_used += snprintf(key + key_used, key_used < size ? size - key_used : 0, "%s%s", i ? "|" : "", entries[i]);
 
-    fclose(f);
+        char *value = strchr(entries[i], '=');
+        if(value != NULL)
+            *value++ = 0;
+        block_used += snprintf(block + block_used, block_used < size * 2 ? size * 2 - block_used : 0, "#define %s %s\n", entries[i], value ? value : "");
+    }
+}
 
-    *(content + fsize) = 0;
-    return content;
+static GLuint __rafgl_shader_compile(GLenum type, const char *source, const char *define_block)
+{
+    /* the defines go right after #version, which has to stay the first directive, and #line keeps
+       the line numbers in compiler errors pointing at the file */
+    const char *parts[3];
+    GLint lengths[3];
+    char define_lines[RAFGL_PROGRAM_DEFINES_LENGTH * 2 + 32];
+
+    const char *body = source;
+    const char *version = strstr(source, "#version");
+    if(version != NULL)
+    {
+        const char *line_end = strchr(version, '\n');
+        body = line_end ? line_end + 1 : version + strlen(version);
+    }
+
+    int line = 1;
+    const char *c;
+    for(c = source; c < body; c++)
+        if(*c == '\n') line++;
+
+    snprintf(define_lines, sizeof(define_lines), "%s#line %d\n", define_block, line);
+
+    parts[0] = source;
+    lengths[0] = body - source;
+    parts[1] = define_lines;
+    lengths[1] = strlen(define_lines);
+    parts[2] = body;
+    lengths[2] = strlen(body);
+
+    /* the status is only read once the program links, reading it here would wait for a parallel compile */
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 3, parts, lengths);
+    glCompileShader(shader);
+    return shader;
 }
 
-GLuint rafgl_program_create_from_source(const char *vertex_source, const char *fragment_source)
+static void __rafgl_shader_report(GLuint shader, const char *stage, const char *defines)
 {
-    GLuint vert, frag, program;
     int success;
     char info_log[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if(!success)
+    {
+        glGetShaderInfoLog(shader, 512, NULL, info_log);
+        fprintf(stderr, "ERROR::SHADER::%s::COMPILE_FAILED\n[%s]\n%s\n", stage, defines, info_log);
+    }
+}
 
-    vert = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vert, 1, &vertex_source, NULL);
-    glCompileShader(vert);
+/* GL_ARB_get_program_binary and GL_KHR_parallel_shader_compile are not part of the 3.3 glad loader,
+   their entry points are looked up when the window is created */
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRYP __rafgl_get_program_binary_proc)(GLuint, GLsizei, GLsizei*, GLenum*, void*);
+typedef void (APIENTRYP __rafgl_program_binary_proc)(GLuint, GLenum, const void*, GLsizei);
+typedef void (APIENTRYP __rafgl_program_parameteri_proc)(GLuint, GLenum, GLint);
+typedef void (APIENTRYP __rafgl_max_shader_compiler_threads_proc)(GLuint);
+
+static __rafgl_get_program_binary_proc __rafgl_glGetProgramBinary = NULL;
+static __rafgl_program_binary_proc __rafgl_glProgramBinary = NULL;
+static __rafgl_program_parameteri_proc __rafgl_glProgramParameteri = NULL;
+static int __rafgl_program_binary_enabled = 0;
+static int __rafgl_parallel_compile_enabled = 0;
+
+/* hashed into every cache key, a new driver or GPU can not load the old binaries */
+static char __rafgl_driver_id[512];
+
+#define RAFGL_PROGRAM_BINARY_MAGIC 0x42504752u   /* "RGPB" */
+
+typedef struct
+{
+    unsigned int magic;
+    unsigned int format;
+    unsigned int length;
+    unsigned int reserved;
+    unsigned long long key;
+} __rafgl_program_binary_header_t;
+
+static int __rafgl_gl_extension_supported(const char *name)
+{
+    GLint count = 0, i;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for(i = 0; i < count; i++)
+    {
+        const char *extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if(extension != NULL && strcmp(extension, name) == 0)
+            return 1;
+    }
+    return 0;
+}
 
-    glGetShaderiv(vert, GL_COMPILE_STATUS, &success);
+static void __rafgl_program_cache_init(void)
+{
+    const char *vendor = (const char*)glGetString(GL_VENDOR);
+    const char *renderer = (const char*)glGetString(GL_RENDERER);
+    const char *version = (const char*)glGetString(GL_VERSION);
+    snprintf(__rafgl_driver_id, sizeof(__rafgl_driver_id), "%s|%s|%s",
+             vendor ? vendor : "", renderer ? renderer : "", version ? version : "");
+
+    GLint major = 0, minor = 0, formats = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if(major * 10 + minor >= 41 || __rafgl_gl_extension_supported("GL_ARB_get_program_binary"))
+    {
+        __rafgl_glGetProgramBinary = (__rafgl_get_program_binary_proc)glfwGetProcAddress("glGetProgramBinary");
+        __rafgl_glProgramBinary = (__rafgl_program_binary_proc)glfwGetProcAddress("glProgramBinary");
+        __rafgl_glProgramParameteri = (__rafgl_program_parameteri_proc)glfwGetProcAddress("glProgramParameteri");
+        /* a driver may expose the entry points but no format to store */
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    }
+    __rafgl_program_binary_enabled = __rafgl_glGetProgramBinary && __rafgl_glProgramBinary &&
+                                     __rafgl_glProgramParameteri && formats > 0;
+
+    __rafgl_max_shader_compiler_threads_proc max_threads = NULL;
+    if(__rafgl_gl_extension_supported("GL_KHR_parallel_shader_compile"))
+        max_threads = (__rafgl_max_shader_compiler_threads_proc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    else if(__rafgl_gl_extension_supported("GL_ARB_parallel_shader_compile"))
+        max_threads = (__rafgl_max_shader_compiler_threads_proc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+    if(max_threads != NULL)
+    {
+        /* 0xFFFFFFFF lets the driver pick the thread count */
+        max_threads(0xFFFFFFFFu);
+        __rafgl_parallel_compile_enabled = 1;
+    }
 
-    if(!success)
+    if(__rafgl_program_binary_enabled)
     {
-        glGetShaderInfoLog(vert, 512, NULL, info_log);
-        fprintf(stderr, "ERROR::SHADER::VERTEX::COMPILE_FAILED\n%s\n", info_log);
+        mkdir("cache", 0755);
+        mkdir(RAFGL_PROGRAM_CACHE_DIRECTORY, 0755);
     }
 
-    frag = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(frag, 1, &fragment_source, NULL);
-    glCompileShader(frag);
+    rafgl_log(RAFGL_INFO, "Program binary cache %s, parallel shader compile %s\n",
+              __rafgl_program_binary_enabled ? "enabled" : "unavailable",
+              __rafgl_parallel_compile_enabled ? "enabled" : "unavailable");
+}
 
-    glGetShaderiv(frag, GL_COMPILE_STATUS, &success);
+/* FNV-1a over the driver, the define key and both sources, including the terminators so
+   moving text between the parts changes the key */
+static unsigned long long __rafgl_program_key(const char *defines, const char *vertex_source, const char *fragment_source)
+{
+    const char *parts[4] = {__rafgl_driver_id, defines, vertex_source, fragment_source};
+    unsigned long long hash = 14695981039346656037ull;
+    int i;
+    for(i = 0; i < 4; i++)
+    {
+        const unsigned char *c = (const unsigned char*)parts[i];
+        do
+        {
+            hash ^= *c;
+            hash *= 1099511628211ull;
+        } while(*c++);
+    }
+    return hash;
+}
 
-    if(!success)
+static void __rafgl_program_binary_path(char *path, int size, unsigned long long key)
+{
+    snprintf(path, size, "%s" SYSTEM_SEPARATOR "%016llx.bin", RAFGL_PROGRAM_CACHE_DIRECTORY, key);
+}
+
+/* returns 1 if program was linked from a cached binary */
+static int __rafgl_program_binary_load(GLuint program, unsigned long long key)
+{
+    if(!__rafgl_program_binary_enabled)
+        return 0;
+
+    char path[256];
+    __rafgl_program_binary_path(path, sizeof(path), key);
+    FILE *f = fopen(path, "rb");
+    if(f == NULL)
+        return 0;
+
+    __rafgl_program_binary_header_t header;
+    int linked = 0;
+    if(fread(&header, sizeof(header), 1, f) == 1 && header.magic == RAFGL_PROGRAM_BINARY_MAGIC && header.key == key)
     {
-        glGetShaderInfoLog(frag, 512, NULL, info_log);
-        fprintf(stderr, "ERROR::SHADER::FRAGMENT::COMPILE_FAILED\n%s\n", info_log);
+        void *binary = rafgl_malloc(RAFGL_MEM_SHADER, header.length);
+        if(fread(binary, 1, header.length, f) == header.length)
+        {
+            __rafgl_glProgramBinary(program, header.format, binary, header.length);
+            /* drivers reject binaries from other versions here, the caller then compiles from source */
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        }
+        rafgl_free(binary);
     }
+    fclose(f);
+    return linked;
+}
 
+static void __rafgl_program_binary_save(GLuint program, unsigned long long key)
+{
+    if(!__rafgl_program_binary_enabled)
+        return;
 
-    program = glCreateProgram();
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        return;
 
-    glAttachShader(program, vert);
-    glAttachShader(program, frag);
+    __rafgl_program_binary_header_t header = {RAFGL_PROGRAM_BINARY_MAGIC, 0, 0, 0, key};
+    void *binary = rafgl_malloc(RAFGL_MEM_SHADER, length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    __rafgl_glGetProgramBinary(program, length, &written, &format, binary);
+    header.format = format;
+    header.length = written;
+
+    /* written under a temporary name and renamed, so a crash never leaves a truncated binary behind */
+    char path[256], temp_path[264];
+    __rafgl_program_binary_path(path, sizeof(path), key);
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE *f = fopen(temp_path, "wb");
+    if(f != NULL)
+    {
+        int ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(binary, 1, written, f) == (size_t)written;
+        ok = fclose(f) == 0 && ok;
+        if(!ok || rename(temp_path, path) != 0)
+            remove(temp_path);
+    }
+    rafgl_free(binary);
+}
 
-    glLinkProgram(program);
+/* a program that was started but possibly not finished compiling */
+typedef struct
+{
+    GLuint program;
+    GLuint vert, frag;              /* 0 when the program came from the binary cache */
+    unsigned long long key;
+    char defines[RAFGL_PROGRAM_DEFINES_LENGTH];
+} __rafgl_program_build_t;
 
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
+typedef struct
+{
+    char name[64];
+    __rafgl_program_build_t build;  /* build.defines is sorted, so equal sets compare equal */
+} __rafgl_program_variant_t;
+
+static __rafgl_program_variant_t __rafgl_program_variants[RAFGL_PROGRAM_VARIANTS_MAX];
+static int __rafgl_program_variant_count = 0;
+
+/* issues the compile and link without reading any status back */
+static void __rafgl_program_build_begin(__rafgl_program_build_t *build, const char *vertex_source, const char *fragment_source, const char *defines)
+{
+    char define_block[RAFGL_PROGRAM_DEFINES_LENGTH * 2];
+    __rafgl_program_parse_defines(defines, build->defines, define_block, RAFGL_PROGRAM_DEFINES_LENGTH);
+
+    build->program = glCreateProgram();
+    build->vert = build->frag = 0;
+    build->key = __rafgl_program_key(build->defines, vertex_source, fragment_source);
+    if(__rafgl_program_binary_load(build->program, build->key))
+        return;
+
+    build->vert = __rafgl_shader_compile(GL_VERTEX_SHADER, vertex_source, define_block);
+    build->frag = __rafgl_shader_compile(GL_FRAGMENT_SHADER, fragment_source, define_block);
+
+    glAttachShader(build->program, build->vert);
+    glAttachShader(build->program, build->frag);
+    if(__rafgl_program_binary_enabled)
+        __rafgl_glProgramParameteri(build->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    glLinkProgram(build->program);
+}
+
+/* waits for the link, reports errors and stores the binary of a freshly linked program */
+static GLuint __rafgl_program_build_end(__rafgl_program_build_t *build)
+{
+    if(build->vert == 0)
+        return build->program;
+
+    int success;
+    char info_log[512];
+    glGetProgramiv(build->program, GL_LINK_STATUS, &success);
     if(!success)
     {
-        glGetProgramInfoLog(program, 512, NULL, info_log);
+        __rafgl_shader_report(build->vert, "VERTEX", build->defines);
+        __rafgl_shader_report(build->frag, "FRAGMENT", build->defines);
+        glGetProgramInfoLog(build->program, 512, NULL, info_log);
         fprintf(stderr, "ERROR::SHADER::PROGRAM::LINKING_FAILED\n%s\n", info_log);
     }
+    else
+    {
+        __rafgl_program_binary_save(build->program, build->key);
+    }
 
+    glDetachShader(build->program, build->vert);
+    glDetachShader(build->program, build->frag);
+    glDeleteShader(build->vert);
+    glDeleteShader(build->frag);
+    build->vert = build->frag = 0;
 
-    glDeleteShader(vert);
-    glDeleteShader(frag);
-
-    return program;
+    return build->program;
 }
 
-GLuint rafgl_program_create(const char *vertex_source_filepath, const char *fragment_source_filepath)
+GLuint rafgl_program_create_from_source(const char *vertex_source, const char *fragment_source, const char *defines)
 {
-    GLuint program;
+    __rafgl_program_build_t build;
+    __rafgl_program_build_begin(&build, vertex_source, fragment_source, defines);
+    return __rafgl_program_build_end(&build);
+}
 
+static void __rafgl_program_build_begin_files(__rafgl_program_build_t *build, const char *vertex_source_filepath, const char *fragment_source_filepath, const char *defines)
+{
     char *vert_source = rafgl_file_read_content(vertex_source_filepath);
     char *frag_source = rafgl_file_read_content(fragment_source_filepath);
 
 
-    program = rafgl_program_create_from_source(vert_source, frag_source);
+    __rafgl_program_build_begin(build, vert_source, frag_source, defines);
 
-    free(vert_source);
-    free(frag_source);
+    rafgl_free(vert_source);
+    rafgl_free(frag_source);
+}
 
-    return program;
+GLuint rafgl_program_create(const char *vertex_source_filepath, const char *fragment_source_filepath)
+{
+    __rafgl_program_build_t build;
+    __rafgl_program_build_begin_files(&build, vertex_source_filepath, fragment_source_filepath, NULL);
+    return __rafgl_program_build_end(&build);
 }
 
-GLuint rafgl_program_create_from_name(const char *program_name)
+static void __rafgl_program_build_begin_name(__rafgl_program_build_t *build, const char *program_name, const char *defines)
 {
     char v[255], f[255];
     v[0] = 0;
@@ -2227,7 +4485,130 @@ GLuint rafgl_program_create_from_name(const char *program_name)
     strcat(f, program_name);
     strcat(f, SYSTEM_SEPARATOR "frag.glsl");
 
-    return rafgl_program_create(v, f);
+    __rafgl_program_build_begin_files(build, v, f, defines);
+}
+
+GLuint rafgl_program_create_from_name(const char *program_name)
+{
+    __rafgl_program_build_t build;
+    __rafgl_program_build_begin_name(&build, program_name, NULL);
+    return __rafgl_program_build_end(&build);
+}
+
+GLuint rafgl_program_create_feedback(const char *program_name, const char **varyings, int varying_count)
+{
+    char v[255], g[255];
+    snprintf(v, sizeof(v), "res" SYSTEM_SEPARATOR "shaders" SYSTEM_SEPARATOR "%s" SYSTEM_SEPARATOR "vert.glsl", program_name);
+    snprintf(g, sizeof(g), "res" SYSTEM_SEPARATOR "shaders" SYSTEM_SEPARATOR "%s" SYSTEM_SEPARATOR "geom.glsl", program_name);
+    char *vert_source = rafgl_file_read_content(v);
+    char *geom_source = rafgl_file_read_content(g);
+
+    /* the varyings are part of the link, so these programs skip the binary cache */
+    GLuint program = glCreateProgram();
+    GLuint vert = __rafgl_shader_compile(GL_VERTEX_SHADER, vert_source, "");
+    GLuint geom = __rafgl_shader_compile(GL_GEOMETRY_SHADER, geom_source, "");
+    glAttachShader(program, vert);
+    glAttachShader(program, geom);
+    glTransformFeedbackVaryings(program, varying_count, varyings, GL_INTERLEAVED_ATTRIBS);
+    glLinkProgram(program);
+
+    int success;
+    char info_log[512];
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if(!success)
+    {
+        __rafgl_shader_report(vert, "VERTEX", program_name);
+        __rafgl_shader_report(geom, "GEOMETRY", program_name);
+        glGetProgramInfoLog(program, 512, NULL, info_log);
+        fprintf(stderr, "ERROR::SHADER::PROGRAM::LINKING_FAILED\n%s\n", info_log);
+    }
+
+    glDetachShader(program, vert);
+    glDetachShader(program, geom);
+    glDeleteShader(vert);
+    glDeleteShader(geom);
+    rafgl_free(vert_source);
+    rafgl_free(geom_source);
+    return program;
+}
+
+static __rafgl_program_variant_t* __rafgl_program_variant_find(const char *program_name, const char *defines)
+{
+    char key[RAFGL_PROGRAM_DEFINES_LENGTH], define_block[RAFGL_PROGRAM_DEFINES_LENGTH * 2];
+    __rafgl_program_parse_defines(defines, key, define_block, RAFGL_PROGRAM_DEFINES_LENGTH);
+
+    int i;
+    for(i = 0; i < __rafgl_program_variant_count; i++)
+    {
+        __rafgl_program_variant_t *variant = &__rafgl_program_variants[i];
+        if(strcmp(variant->name, program_name) == 0 && strcmp(variant->build.defines, key) == 0)
+            return variant;
+    }
+
+    if(__rafgl_program_variant_count == RAFGL_PROGRAM_VARIANTS_MAX)
+        return NULL;
+
+    __rafgl_program_variant_t *variant = &__rafgl_program_variants[__rafgl_program_variant_count++];
+    snprintf(variant->name, sizeof(variant->name), "%s", program_name);
+    __rafgl_program_build_begin_name(&variant->build, program_name, key);
+    return variant;
+}
+
+void rafgl_program_variant_request(const char *program_name, const char *defines)
+{
+    if(__rafgl_program_variant_find(program_name, defines) == NULL)
+        rafgl_log(RAFGL_WARNING, "Program variant cache is full, [%s] with [%s] is not requested\n", program_name, defines ? defines : "");
+}
+
+GLuint rafgl_program_variant(const char *program_name, const char *defines)
+{
+    __rafgl_program_variant_t *variant = __rafgl_program_variant_find(program_name, defines);
+    if(variant == NULL)
+    {
+        rafgl_log(RAFGL_WARNING, "Program variant cache is full, [%s] with [%s] is not cached\n", program_name, defines ? defines : "");
+        __rafgl_program_build_t build;
+        __rafgl_program_build_begin_name(&build, program_name, defines);
+        return __rafgl_program_build_end(&build);
+    }
+    return __rafgl_program_build_end(&variant->build);
+}
+
+void rafgl_program_variants_finish(void)
+{
+    int i;
+    for(i = 0; i < __rafgl_program_variant_count; i++)
+        __rafgl_program_build_end(&__rafgl_program_variants[i].build);
+}
+
+void rafgl_program_variants_cleanup(void)
+{
+    int i;
+    for(i = 0; i < __rafgl_program_variant_count; i++)
+    {
+        __rafgl_program_build_end(&__rafgl_program_variants[i].build);
+        glDeleteProgram(__rafgl_program_variants[i].build.program);
+    }
+    __rafgl_program_variant_count = 0;
+}
+
+void rafgl_program_warm_up(GLuint program, GLuint vao, int vertex_count)
+{
+    /* one draw clipped to a single pixel, the driver finishes its deferred compile for the bound
+       vertex layout and framebuffer formats */
+    GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+    GLint box[4];
+    glGetIntegerv(GL_SCISSOR_BOX, box);
+
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(0, 0, 1, 1);
+    glUseProgram(program);
+    glBindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLES, 0, vertex_count < 3 ? vertex_count : 3);
+    glBindVertexArray(0);
+
+    glScissor(box[0], box[1], box[2], box[3]);
+    if(!scissor)
+        glDisable(GL_SCISSOR_TEST);
 }
 
 /*
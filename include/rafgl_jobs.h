@@ -0,0 +1,609 @@
+#ifndef RAFGL_JOBS_H_INCLUDED
+#define RAFGL_JOBS_H_INCLUDED
+
+#include <stdatomic.h>
+
+/*
+    rafgl_jobs - work-stealing job system
+
+    Every thread (the main thread included) owns a Chase-Lev deque. A thread pushes and pops
+    jobs at the bottom of its own deque, idle threads steal from the top of the others.
+    Jobs are grouped under counters: running a batch adds its size to the counter, every
+    finished job subtracts one, and a counter at zero means the whole batch is done.
+
+    Waiting on a counter never blocks the calling thread, it keeps executing queued jobs
+    until the counter drops to zero, so the main thread contributes while it waits.
+
+    Threads that are not part of the job system (loader or I/O threads) may queue jobs too,
+    those go through a small locked injection queue that the workers poll after their deques.
+
+    Job records passed to rafgl_jobs_run must stay alive until their counter reaches zero.
+    When the job system is not initialised every call runs the jobs inline.
+*/
+
+#define RAFGL_JOBS_MAX_THREADS 64
+#define RAFGL_JOBS_DEQUE_SIZE 4096
+
+struct _rafgl_jobs_pending_t;
+
+typedef struct _rafgl_jobs_counter_t
+{
+    atomic_int value;
+    /* raises from zero whose last job has not let go of the counter yet, a waiter only
+       returns once this is zero too, the counter may go out of scope right after */
+    atomic_int releasing;
+    atomic_flag lock;
+    struct _rafgl_jobs_pending_t *pending;
+} rafgl_jobs_counter_t;
+
+typedef struct _rafgl_job_t
+{
+    void (*function)(void *data);
+    void *data;
+    rafgl_jobs_counter_t *counter;
+} rafgl_job_t;
+
+/* starts the worker threads, a negative num_workers uses one worker per core besides the main thread, 0 runs everything on the main thread */
+int rafgl_jobs_init(int num_workers);
+/* waits for the workers to finish their current jobs and joins them */
+void rafgl_jobs_shutdown(void);
+/* number of threads executing jobs, including the main thread */
+int rafgl_jobs_thread_count(void);
+/* index of the calling thread in [0, rafgl_jobs_thread_count()), 0 is the main thread and -1 a thread the job system does not own */
+int rafgl_jobs_thread_index(void);
+
+/* resets a counter before its first use (a zero initialised counter is valid too) */
+void rafgl_jobs_counter_init(rafgl_jobs_counter_t *counter);
+/* non zero while jobs attached to the counter are still running */
+int rafgl_jobs_counter_busy(rafgl_jobs_counter_t *counter);
+/* work that is not a job (an I/O request) raises a counter by count before it starts and calls
+   rafgl_jobs_counter_done once per unit when it is finished, from any thread, which also
+   releases the jobs queued with rafgl_jobs_run_after on that counter */
+void rafgl_jobs_counter_add(rafgl_jobs_counter_t *counter, int count);
+void rafgl_jobs_counter_done(rafgl_jobs_counter_t *counter);
+
+/* queues count jobs, the counter (may be NULL) is raised by count and lowered as jobs finish */
+void rafgl_jobs_run(rafgl_job_t *jobs, int count, rafgl_jobs_counter_t *counter);
+/* same as rafgl_jobs_run, but the jobs are only queued once the dependency counter reaches zero */
+void rafgl_jobs_run_after(rafgl_jobs_counter_t *dependency, rafgl_job_t *jobs, int count, rafgl_jobs_counter_t *counter);
+/* executes queued jobs on the calling thread until the counter reaches zero */
+void rafgl_jobs_wait(rafgl_jobs_counter_t *counter);
+
+/* splits [0, count) into ranges of at least grain indices and runs fn over them in parallel, returns when all ranges are done (grain <= 0 picks one automatically) */
+void rafgl_jobs_parallel_for(int count, int grain, void (*fn)(int begin, int end, void *data), void *data);
+
+
+#ifdef RAFGL_IMPLEMENTATION
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+typedef struct _rafgl_jobs_pending_t
+{
+    rafgl_job_t *jobs;
+    int count;
+    struct _rafgl_jobs_pending_t *next;
+} rafgl_jobs_pending_t;
+
+typedef struct _rafgl_jobs_deque_t
+{
+    atomic_long top;
+    char __pad0[64 - sizeof(atomic_long)];
+    atomic_long bottom;
+    char __pad1[64 - sizeof(atomic_long)];
+    _Atomic(rafgl_job_t *) slots[RAFGL_JOBS_DEQUE_SIZE];
+} rafgl_jobs_deque_t;
+
+static rafgl_jobs_deque_t *__jobs_deques = NULL;
+static pthread_t __jobs_threads[RAFGL_JOBS_MAX_THREADS];
+static int __jobs_thread_count = 0;
+static atomic_int __jobs_running = 0;
+
+/* parking of idle workers, see __jobs_wake and __jobs_worker_main */
+static atomic_int __jobs_queued = 0;
+static atomic_int __jobs_sleeping = 0;
+static pthread_mutex_t __jobs_sleep_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t __jobs_sleep_cond = PTHREAD_COND_INITIALIZER;
+
+/* jobs queued by threads that own no deque */
+static rafgl_job_t *__jobs_inject[RAFGL_JOBS_DEQUE_SIZE];
+static int __jobs_inject_head = 0, __jobs_inject_count = 0;
+static atomic_int __jobs_inject_pending = 0;
+static pthread_mutex_t __jobs_inject_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static _Thread_local int __jobs_thread_index = -1;
+static _Thread_local unsigned int __jobs_steal_seed = 0x9e3779b9u;
+
+static int __jobs_deque_push(rafgl_jobs_deque_t *dq, rafgl_job_t *job)
+{
+    long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&dq->top, memory_order_acquire);
+    if(b - t >= RAFGL_JOBS_DEQUE_SIZE) return 0;
+
+    atomic_store_explicit(&dq->slots[b & (RAFGL_JOBS_DEQUE_SIZE - 1)], job, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+    return 1;
+}
+
+static rafgl_job_t* __jobs_deque_pop(rafgl_jobs_deque_t *dq)
+{
+    long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&dq->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&dq->top, memory_order_relaxed);
+
+    rafgl_job_t *job = NULL;
+    if(t <= b)
+    {
+        job = atomic_load_explicit(&dq->slots[b & (RAFGL_JOBS_DEQUE_SIZE - 1)], memory_order_relaxed);
+        if(t == b)
+        {
+            /* last element, race the stealers for it */
+            if(!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+                job = NULL;
+            atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+        }
+    }
+    else
+    {
+        atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+    }
+    return job;
+}
+
+static rafgl_job_t* __jobs_deque_steal(rafgl_jobs_deque_t *dq)
+{
+    long t = atomic_load_explicit(&dq->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&dq->bottom, memory_order_acquire);
+
+    if(t >= b) return NULL;
+
+    rafgl_job_t *job = atomic_load_explicit(&dq->slots[t & (RAFGL_JOBS_DEQUE_SIZE - 1)], memory_order_relaxed);
+    if(!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+        return NULL;
+    return job;
+}
+
+static void __jobs_lock(rafgl_jobs_counter_t *counter)
+{
+    while(atomic_flag_test_and_set_explicit(&counter->lock, memory_order_acquire))
+        sched_yield();
+}
+
+static void __jobs_unlock(rafgl_jobs_counter_t *counter)
+{
+    atomic_flag_clear_explicit(&counter->lock, memory_order_release);
+}
+
+static void __jobs_wake(int count)
+{
+    if(atomic_load(&__jobs_sleeping) == 0) return;
+    pthread_mutex_lock(&__jobs_sleep_mutex);
+    if(count > 1)
+        pthread_cond_broadcast(&__jobs_sleep_cond);
+    else
+        pthread_cond_signal(&__jobs_sleep_cond);
+    pthread_mutex_unlock(&__jobs_sleep_mutex);
+}
+
+static void __jobs_execute(rafgl_job_t *job);
+
+static int __jobs_inject_push(rafgl_job_t *job)
+{
+    int ok = 0;
+    pthread_mutex_lock(&__jobs_inject_mutex);
+    if(__jobs_inject_count < RAFGL_JOBS_DEQUE_SIZE)
+    {
+        __jobs_inject[(__jobs_inject_head + __jobs_inject_count) & (RAFGL_JOBS_DEQUE_SIZE - 1)] = job;
+        __jobs_inject_count++;
+        atomic_fetch_add(&__jobs_inject_pending, 1);
+        ok = 1;
+    }
+    pthread_mutex_unlock(&__jobs_inject_mutex);
+    return ok;
+}
+
+static rafgl_job_t* __jobs_inject_pop(void)
+{
+    rafgl_job_t *job = NULL;
+    if(atomic_load_explicit(&__jobs_inject_pending, memory_order_relaxed) == 0) return NULL;
+
+    pthread_mutex_lock(&__jobs_inject_mutex);
+    if(__jobs_inject_count > 0)
+    {
+        job = __jobs_inject[__jobs_inject_head];
+        __jobs_inject_head = (__jobs_inject_head + 1) & (RAFGL_JOBS_DEQUE_SIZE - 1);
+        __jobs_inject_count--;
+        atomic_fetch_sub(&__jobs_inject_pending, 1);
+    }
+    pthread_mutex_unlock(&__jobs_inject_mutex);
+    return job;
+}
+
+static void __jobs_push_batch(rafgl_job_t *jobs, int count)
+{
+    int self = __jobs_thread_index;
+    int i, pushed = 0;
+    for(i = 0; i < count; i++)
+    {
+        atomic_fetch_add(&__jobs_queued, 1);
+        if(self >= 0 ? __jobs_deque_push(&__jobs_deques[self], &jobs[i]) : __jobs_inject_push(&jobs[i]))
+        {
+            pushed++;
+        }
+        else
+        {
+            /* queue is full, run the job right here */
+            atomic_fetch_sub(&__jobs_queued, 1);
+            __jobs_execute(&jobs[i]);
+        }
+    }
+    if(pushed) __jobs_wake(pushed);
+}
+
+static void __jobs_raise(rafgl_jobs_counter_t *counter, int count)
+{
+    /* held before the value goes up so a finish racing the raise can not drop releasing to
+       zero first, and kept only by the raise that lifts the counter off zero */
+    atomic_fetch_add(&counter->releasing, 1);
+    if(atomic_fetch_add(&counter->value, count) != 0)
+        atomic_fetch_sub(&counter->releasing, 1);
+}
+
+static void __jobs_finish(rafgl_jobs_counter_t *counter)
+{
+    if(counter == NULL) return;
+    if(atomic_fetch_sub(&counter->value, 1) != 1) return;
+
+    /* the counter reached zero, release everything that waited for it */
+    __jobs_lock(counter);
+    rafgl_jobs_pending_t *pending = counter->pending;
+    counter->pending = NULL;
+    __jobs_unlock(counter);
+
+    /* the last access, a waiter may free the counter as soon as it sees this */
+    atomic_fetch_sub_explicit(&counter->releasing, 1, memory_order_release);
+
+    while(pending)
+    {
+        rafgl_jobs_pending_t *next = pending->next;
+        if(__jobs_deques)
+            __jobs_push_batch(pending->jobs, pending->count);
+        else
+        {
+            int i;
+            for(i = 0; i < pending->count; i++) __jobs_execute(&pending->jobs[i]);
+        }
+        free(pending);
+        pending = next;
+    }
+}
+
+static void __jobs_execute(rafgl_job_t *job)
+{
+    rafgl_jobs_counter_t *counter = job->counter;
+    job->function(job->data);
+    __jobs_finish(counter);
+}
+
+static rafgl_job_t* __jobs_find(void)
+{
+    int self = __jobs_thread_index;
+    rafgl_job_t *job;
+    if(self >= 0)
+    {
+        job = __jobs_deque_pop(&__jobs_deques[self]);
+        if(job) return job;
+    }
+
+    job = __jobs_inject_pop();
+    if(job) return job;
+
+    int i, n = __jobs_thread_count;
+    unsigned int seed = __jobs_steal_seed;
+    seed = seed * 1664525u + 1013904223u;
+    __jobs_steal_seed = seed;
+
+    int start = (seed >> 8) % n;
+    for(i = 0; i < n; i++)
+    {
+        int victim = (start + i) % n;
+        if(victim == self) continue;
+        job = __jobs_deque_steal(&__jobs_deques[victim]);
+        if(job) return job;
+    }
+    return NULL;
+}
+
+static int __jobs_try_run_one(void)
+{
+    rafgl_job_t *job = __jobs_find();
+    if(!job) return 0;
+    atomic_fetch_sub(&__jobs_queued, 1);
+    __jobs_execute(job);
+    return 1;
+}
+
+static void* __jobs_worker_main(void *arg)
+{
+    __jobs_thread_index = (int)(intptr_t)arg;
+    __jobs_steal_seed ^= (unsigned int)__jobs_thread_index * 2654435761u;
+
+    int idle_spins = 0;
+    while(atomic_load(&__jobs_running))
+    {
+        if(__jobs_try_run_one())
+        {
+            idle_spins = 0;
+            continue;
+        }
+
+        if(++idle_spins < 64)
+        {
+            sched_yield();
+            continue;
+        }
+
+        /* nothing to steal for a while, park until someone queues work */
+        pthread_mutex_lock(&__jobs_sleep_mutex);
+        atomic_fetch_add(&__jobs_sleeping, 1);
+        while(atomic_load(&__jobs_queued) == 0 && atomic_load(&__jobs_running))
+            pthread_cond_wait(&__jobs_sleep_cond, &__jobs_sleep_mutex);
+        atomic_fetch_sub(&__jobs_sleeping, 1);
+        pthread_mutex_unlock(&__jobs_sleep_mutex);
+        idle_spins = 0;
+    }
+    return NULL;
+}
+
+int rafgl_jobs_init(int num_workers)
+{
+    if(__jobs_deques) return 0;
+
+    if(num_workers < 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = cores > 1 ? (int)cores - 1 : 0;
+    }
+    if(num_workers > RAFGL_JOBS_MAX_THREADS - 1) num_workers = RAFGL_JOBS_MAX_THREADS - 1;
+
+    __jobs_thread_count = num_workers + 1;
+    __jobs_deques = aligned_alloc(64, __jobs_thread_count * sizeof(rafgl_jobs_deque_t));
+    if(__jobs_deques == NULL)
+    {
+        __jobs_thread_count = 0;
+        return -1;
+    }
+
+    int i;
+    for(i = 0; i < __jobs_thread_count; i++)
+    {
+        atomic_init(&__jobs_deques[i].top, 0);
+        atomic_init(&__jobs_deques[i].bottom, 0);
+    }
+
+    __jobs_thread_index = 0;
+    __jobs_inject_head = __jobs_inject_count = 0;
+    atomic_store(&__jobs_inject_pending, 0);
+    atomic_store(&__jobs_queued, 0);
+    atomic_store(&__jobs_running, 1);
+
+    for(i = 1; i < __jobs_thread_count; i++)
+    {
+        if(pthread_create(&__jobs_threads[i], NULL, __jobs_worker_main, (void*)(intptr_t)i) != 0)
+        {
+            /* keep whatever started, the main thread can always carry the load */
+            __jobs_thread_count = i;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+void rafgl_jobs_shutdown(void)
+{
+    if(!__jobs_deques) return;
+
+    /* drain whatever is still queued before the workers go away */
+    while(atomic_load(&__jobs_queued) > 0)
+    {
+        if(!__jobs_try_run_one()) sched_yield();
+    }
+
+    atomic_store(&__jobs_running, 0);
+    pthread_mutex_lock(&__jobs_sleep_mutex);
+    pthread_cond_broadcast(&__jobs_sleep_cond);
+    pthread_mutex_unlock(&__jobs_sleep_mutex);
+
+    int i;
+    for(i = 1; i < __jobs_thread_count; i++)
+    {
+        pthread_join(__jobs_threads[i], NULL);
+    }
+
+    free(__jobs_deques);
+    __jobs_deques = NULL;
+    __jobs_thread_count = 0;
+}
+
+int rafgl_jobs_thread_count(void)
+{
+    return __jobs_deques ? __jobs_thread_count : 1;
+}
+
+int rafgl_jobs_thread_index(void)
+{
+    return __jobs_deques ? __jobs_thread_index : 0;
+}
+
+void rafgl_jobs_counter_init(rafgl_jobs_counter_t *counter)
+{
+    atomic_init(&counter->value, 0);
+    atomic_init(&counter->releasing, 0);
+    atomic_flag_clear(&counter->lock);
+    counter->pending = NULL;
+}
+
+int rafgl_jobs_counter_busy(rafgl_jobs_counter_t *counter)
+{
+    return atomic_load(&counter->value) > 0 || atomic_load_explicit(&counter->releasing, memory_order_acquire) > 0;
+}
+
+void rafgl_jobs_counter_add(rafgl_jobs_counter_t *counter, int count)
+{
+    if(counter) __jobs_raise(counter, count);
+}
+
+void rafgl_jobs_counter_done(rafgl_jobs_counter_t *counter)
+{
+    __jobs_finish(counter);
+}
+
+void rafgl_jobs_run(rafgl_job_t *jobs, int count, rafgl_jobs_counter_t *counter)
+{
+    int i;
+    if(count <= 0) return;
+
+    for(i = 0; i < count; i++)
+    {
+        jobs[i].counter = counter;
+    }
+    if(counter) __jobs_raise(counter, count);
+
+    if(!__jobs_deques)
+    {
+        for(i = 0; i < count; i++) __jobs_execute(&jobs[i]);
+        return;
+    }
+
+    __jobs_push_batch(jobs, count);
+}
+
+void rafgl_jobs_run_after(rafgl_jobs_counter_t *dependency, rafgl_job_t *jobs, int count, rafgl_jobs_counter_t *counter)
+{
+    int i;
+    if(count <= 0) return;
+    if(dependency == NULL)
+    {
+        rafgl_jobs_run(jobs, count, counter);
+        return;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        jobs[i].counter = counter;
+    }
+    /* raise the counter right away so waiting on it also covers the deferred jobs */
+    if(counter) __jobs_raise(counter, count);
+
+    __jobs_lock(dependency);
+    if(atomic_load(&dependency->value) > 0)
+    {
+        rafgl_jobs_pending_t *pending = malloc(sizeof(rafgl_jobs_pending_t));
+        pending->jobs = jobs;
+        pending->count = count;
+        pending->next = dependency->pending;
+        dependency->pending = pending;
+        __jobs_unlock(dependency);
+        return;
+    }
+    __jobs_unlock(dependency);
+
+    if(!__jobs_deques)
+    {
+        for(i = 0; i < count; i++) __jobs_execute(&jobs[i]);
+        return;
+    }
+    __jobs_push_batch(jobs, count);
+}
+
+void rafgl_jobs_wait(rafgl_jobs_counter_t *counter)
+{
+    if(counter == NULL) return;
+
+    int idle_spins = 0;
+    while(rafgl_jobs_counter_busy(counter))
+    {
+        if(__jobs_deques && __jobs_try_run_one())
+        {
+            idle_spins = 0;
+            continue;
+        }
+        /* the remaining jobs are running on other threads */
+        if(++idle_spins > 16) sched_yield();
+    }
+}
+
+typedef struct _rafgl_jobs_range_t
+{
+    void (*fn)(int begin, int end, void *data);
+    void *data;
+    int begin, end;
+} rafgl_jobs_range_t;
+
+static void __jobs_range_entry(void *data)
+{
+    rafgl_jobs_range_t *range = data;
+    range->fn(range->begin, range->end, range->data);
+}
+
+void rafgl_jobs_parallel_for(int count, int grain, void (*fn)(int begin, int end, void *data), void *data)
+{
+    if(count <= 0) return;
+
+    int threads = rafgl_jobs_thread_count();
+    if(grain <= 0)
+    {
+        /* a few ranges per thread leave room for stealing when ranges are uneven */
+        grain = count / (threads * 4);
+        if(grain < 1) grain = 1;
+    }
+
+    int num_ranges = (count + grain - 1) / grain;
+    if(num_ranges == 1 || threads == 1)
+    {
+        fn(0, count, data);
+        return;
+    }
+
+    rafgl_jobs_range_t ranges_local[64];
+    rafgl_job_t jobs_local[64];
+    rafgl_jobs_range_t *ranges = ranges_local;
+    rafgl_job_t *jobs = jobs_local;
+    if(num_ranges > 64)
+    {
+        ranges = malloc(num_ranges * sizeof(rafgl_jobs_range_t));
+        jobs = malloc(num_ranges * sizeof(rafgl_job_t));
+    }
+
+    int i;
+    for(i = 0; i < num_ranges; i++)
+    {
+        ranges[i].fn = fn;
+        ranges[i].data = data;
+        ranges[i].begin = i * grain;
+        ranges[i].end = rafgl_min_m((i + 1) * grain, count);
+        jobs[i].function = __jobs_range_entry;
+        jobs[i].data = &ranges[i];
+    }
+
+    rafgl_jobs_counter_t counter;
+    rafgl_jobs_counter_init(&counter);
+    rafgl_jobs_run(jobs, num_ranges, &counter);
+    rafgl_jobs_wait(&counter);
+
+    if(ranges != ranges_local)
+    {
+        free(ranges);
+        free(jobs);
+    }
+}
+
+#endif // RAFGL_IMPLEMENTATION
+#endif // RAFGL_JOBS_H_INCLUDED
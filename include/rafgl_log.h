@@ -0,0 +1,821 @@
+#ifndef RAFGL_LOG_H_INCLUDED
+#define RAFGL_LOG_H_INCLUDED
+
+#include <stdarg.h>
+
+/*
+    rafgl_log - asynchronous logger
+
+    rafgl_log does not format or write anything on the calling thread. It copies the format
+    pointer and the raw arguments into a record of a lock-free multi-producer ring buffer,
+    strings are copied into the record so the caller may free them right away. A background
+    thread formats the records and writes them to the console and to logs/<level>.log.
+
+    Messages of a disabled level are rejected before anything is copied. Every call site
+    (identified by its format pointer) may log RAFGL_LOG_RATE_LIMIT messages per second, the
+    rest is counted and reported as one line when the next second starts.
+
+    When the ring is full info and warning messages are dropped and counted, errors wait for
+    room. rafgl_log_shutdown drains the ring at exit. The handlers of fatal signals write out
+    what is left with write(2) and a formatter of their own, since stdio and locks are off
+    limits there, so a crash still leaves the last messages in the log files.
+
+    Before rafgl_log_init (and after rafgl_log_shutdown) messages are written synchronously.
+    Format strings must stay alive for the whole run, string literals always do. Conversions
+    the record format does not cover (%n, %ls, %Lf and such) are formatted on the calling
+    thread instead.
+*/
+
+#define RAFGL_LOG_QUEUE_SIZE 1024       /* records, power of two */
+#define RAFGL_LOG_PAYLOAD_SIZE 480      /* argument bytes per record */
+#define RAFGL_LOG_RATE_LIMIT 20         /* messages per call site per second */
+#define RAFGL_LOG_LINE_SIZE 1024
+
+/* opens the log files in log_directory and starts the flush thread */
+int rafgl_log_init(const char *log_directory);
+/* writes out everything queued, stops the flush thread and closes the log files */
+void rafgl_log_shutdown(void);
+/* blocks until every record queued so far has been written */
+void rafgl_log_flush(void);
+
+void rafgl_log_set_level_enabled(int level, int enabled);
+int rafgl_log_level_enabled(int level);
+
+
+#ifdef RAFGL_IMPLEMENTATION
+
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define __RAFGL_LOG_RECORD_FORMAT       0   /* payload holds the arguments of format */
+#define __RAFGL_LOG_RECORD_TEXT         1   /* payload holds the formatted message */
+#define __RAFGL_LOG_RECORD_SUPPRESSED   2   /* payload holds the number of suppressed messages of format */
+
+#define __RAFGL_LOG_RATE_SLOTS 64
+
+typedef struct
+{
+    atomic_size_t sequence;
+    int level;
+    int kind;
+    const char *format;
+    int payload_size;
+    _Alignas(8) unsigned char payload[RAFGL_LOG_PAYLOAD_SIZE];
+} __rafgl_log_record_t;
+
+typedef struct
+{
+    _Atomic(const char*) format;
+    atomic_long second;
+    atomic_int count;
+    atomic_int suppressed;
+} __rafgl_log_rate_t;
+
+/* how a conversion reads its argument */
+#define __RAFGL_LOG_ARG_NONE        0
+#define __RAFGL_LOG_ARG_INT         1
+#define __RAFGL_LOG_ARG_LONG        2
+#define __RAFGL_LOG_ARG_LLONG       3
+#define __RAFGL_LOG_ARG_SIZE        4
+#define __RAFGL_LOG_ARG_INTMAX      5
+#define __RAFGL_LOG_ARG_PTRDIFF     6
+#define __RAFGL_LOG_ARG_DOUBLE      7
+#define __RAFGL_LOG_ARG_STRING      8
+#define __RAFGL_LOG_ARG_POINTER     9
+#define __RAFGL_LOG_ARG_UNSUPPORTED 10
+
+typedef struct
+{
+    const char *start;      /* the '%' */
+    int length;             /* of the whole conversion */
+    int stars;              /* '*' widths and precisions, each takes an int argument */
+    int arg;
+} __rafgl_log_spec_t;
+
+static __rafgl_log_record_t __rafgl_log_queue[RAFGL_LOG_QUEUE_SIZE];
+static atomic_size_t __rafgl_log_enqueue_pos;
+static size_t __rafgl_log_dequeue_pos;
+static atomic_flag __rafgl_log_consuming = ATOMIC_FLAG_INIT;
+
+static __rafgl_log_rate_t __rafgl_log_rates[__RAFGL_LOG_RATE_SLOTS];
+static atomic_int __rafgl_log_level_mask = (1 << RAFGL_LOG_LEVELS) - 1;
+static atomic_int __rafgl_log_dropped;
+static atomic_int __rafgl_log_running;
+
+static pthread_t __rafgl_log_thread;
+static const char *__rafgl_log_level_names[RAFGL_LOG_LEVELS] = {"error", "warning", "info"};
+/* the files are only written and closed under the mutex, a closed file is NULL */
+static FILE *__rafgl_log_files[RAFGL_LOG_LEVELS];
+static pthread_mutex_t __rafgl_log_files_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* descriptors of the files for the crash handler, -1 once closed */
+static atomic_int __rafgl_log_fds[RAFGL_LOG_LEVELS] = {-1, -1, -1};
+static char __rafgl_log_crash_line[RAFGL_LOG_LINE_SIZE];
+
+static const char* __rafgl_log_next_spec(const char *format, __rafgl_log_spec_t *spec)
+{
+    const char *p = strchr(format, '%');
+    if(p == NULL)
+        return NULL;
+
+    spec->start = p++;
+    spec->stars = 0;
+    spec->arg = __RAFGL_LOG_ARG_UNSUPPORTED;
+
+    if(*p == '%')
+    {
+        spec->length = 2;
+        spec->arg = __RAFGL_LOG_ARG_NONE;
+        return p + 1;
+    }
+
+    while(*p && strchr("-+ #0'", *p)) p++;
+    if(*p == '*') { spec->stars++; p++; }
+    while(*p >= '0' && *p <= '9') p++;
+    if(*p == '.')
+    {
+        p++;
+        if(*p == '*') { spec->stars++; p++; }
+        while(*p >= '0' && *p <= '9') p++;
+    }
+
+    int integer = __RAFGL_LOG_ARG_INT;
+    int wide = 0;
+    if(p[0] == 'h') { p += p[1] == 'h' ? 2 : 1; }
+    else if(p[0] == 'l' && p[1] == 'l') { integer = __RAFGL_LOG_ARG_LLONG; p += 2; }
+    else if(p[0] == 'l') { integer = __RAFGL_LOG_ARG_LONG; wide = 1; p++; }
+    else if(p[0] == 'z') { integer = __RAFGL_LOG_ARG_SIZE; p++; }
+    else if(p[0] == 'j') { integer = __RAFGL_LOG_ARG_INTMAX; p++; }
+    else if(p[0] == 't') { integer = __RAFGL_LOG_ARG_PTRDIFF; p++; }
+    else if(p[0] == 'L') { wide = 2; p++; }
+
+    switch(*p)
+    {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+            if(wide != 2) spec->arg = integer;
+            break;
+        case 'c':
+            if(!wide) spec->arg = __RAFGL_LOG_ARG_INT;
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            if(wide != 2) spec->arg = __RAFGL_LOG_ARG_DOUBLE;
+            break;
+        case 's':
+            if(!wide) spec->arg = __RAFGL_LOG_ARG_STRING;
+            break;
+        case 'p':
+            spec->arg = __RAFGL_LOG_ARG_POINTER;
+            break;
+    }
+
+    if(*p) p++;
+    spec->length = p - spec->start;
+    return p;
+}
+
+/* copies the arguments of format into the payload, returns the payload size or -1 if they do not fit */
+static int __rafgl_log_encode(unsigned char *payload, const char *format, va_list args)
+{
+    __rafgl_log_spec_t spec;
+    int size = 0, i;
+
+    while((format = __rafgl_log_next_spec(format, &spec)) != NULL)
+    {
+        if(spec.arg == __RAFGL_LOG_ARG_UNSUPPORTED)
+            return -1;
+
+        for(i = 0; i < spec.stars; i++)
+        {
+            if(size + 8 > RAFGL_LOG_PAYLOAD_SIZE)
+                return -1;
+            *(long long*)(payload + size) = va_arg(args, int);
+            size += 8;
+        }
+
+        if(spec.arg == __RAFGL_LOG_ARG_NONE)
+            continue;
+
+        if(spec.arg == __RAFGL_LOG_ARG_STRING)
+        {
+            const char *s = va_arg(args, const char*);
+            if(s == NULL)
+                s = "(null)";
+            int length = strlen(s) + 1;
+            if(size + 8 + length > RAFGL_LOG_PAYLOAD_SIZE)
+                return -1;
+            *(long long*)(payload + size) = length;
+            memcpy(payload + size + 8, s, length);
+            size += 8 + ((length + 7) & ~7);
+            continue;
+        }
+
+        if(size + 8 > RAFGL_LOG_PAYLOAD_SIZE)
+            return -1;
+
+        switch(spec.arg)
+        {
+            case __RAFGL_LOG_ARG_INT:     *(long long*)(payload + size) = va_arg(args, int); break;
+            case __RAFGL_LOG_ARG_LONG:    *(long long*)(payload + size) = va_arg(args, long); break;
+            case __RAFGL_LOG_ARG_LLONG:   *(long long*)(payload + size) = va_arg(args, long long); break;
+            case __RAFGL_LOG_ARG_SIZE:    *(long long*)(payload + size) = va_arg(args, size_t); break;
+            case __RAFGL_LOG_ARG_INTMAX:  *(long long*)(payload + size) = va_arg(args, intmax_t); break;
+            case __RAFGL_LOG_ARG_PTRDIFF: *(long long*)(payload + size) = va_arg(args, ptrdiff_t); break;
+            case __RAFGL_LOG_ARG_DOUBLE:  *(double*)(payload + size) = va_arg(args, double); break;
+            case __RAFGL_LOG_ARG_POINTER: *(void**)(payload + size) = va_arg(args, void*); break;
+        }
+        size += 8;
+    }
+
+    return size;
+}
+
+/* the inverse of __rafgl_log_encode, writes the message into line */
+static void __rafgl_log_decode(char *line, int line_size, const char *format, const unsigned char *payload)
+{
+    __rafgl_log_spec_t spec;
+    char conversion[64];
+    int used = 0, offset = 0;
+    const char *next;
+
+#define __RAFGL_LOG_ROOM (used < line_size ? line_size - used : 0)
+#define __RAFGL_LOG_EMIT(value) \
+    (spec.stars == 0 ? snprintf(line + used, __RAFGL_LOG_ROOM, conversion, value) : \
+     spec.stars == 1 ? snprintf(line + used, __RAFGL_LOG_ROOM, conversion, star[0], value) : \
+                       snprintf(line + used, __RAFGL_LOG_ROOM, conversion, star[0], star[1], value))
+
+    while((next = __rafgl_log_next_spec(format, &spec)) != NULL)
+    {
+        used += snprintf(line + used, __RAFGL_LOG_ROOM, "%.*s", (int)(spec.start - format), format);
+        format = next;
+
+        if(spec.arg == __RAFGL_LOG_ARG_NONE)
+        {
+            used += snprintf(line + used, __RAFGL_LOG_ROOM, "%%");
+            continue;
+        }
+
+        int star[2] = {0, 0}, i;
+        for(i = 0; i < spec.stars; i++, offset += 8)
+            star[i] = *(const long long*)(payload + offset);
+
+        int length = spec.length < (int)sizeof(conversion) ? spec.length : (int)sizeof(conversion) - 1;
+        memcpy(conversion, spec.start, length);
+        conversion[length] = 0;
+
+        long long integer = *(const long long*)(payload + offset);
+        switch(spec.arg)
+        {
+            case __RAFGL_LOG_ARG_INT:     used += __RAFGL_LOG_EMIT((int)integer); break;
+            case __RAFGL_LOG_ARG_LONG:    used += __RAFGL_LOG_EMIT((long)integer); break;
+            case __RAFGL_LOG_ARG_LLONG:   used += __RAFGL_LOG_EMIT(integer); break;
+            case __RAFGL_LOG_ARG_SIZE:    used += __RAFGL_LOG_EMIT((size_t)integer); break;
+            case __RAFGL_LOG_ARG_INTMAX:  used += __RAFGL_LOG_EMIT((intmax_t)integer); break;
+            case __RAFGL_LOG_ARG_PTRDIFF: used += __RAFGL_LOG_EMIT((ptrdiff_t)integer); break;
+            case __RAFGL_LOG_ARG_DOUBLE:  used += __RAFGL_LOG_EMIT(*(const double*)(payload + offset)); break;
+            case __RAFGL_LOG_ARG_POINTER: used += __RAFGL_LOG_EMIT(*(void* const*)(payload + offset)); break;
+            case __RAFGL_LOG_ARG_STRING:
+                used += __RAFGL_LOG_EMIT((const char*)(payload + offset + 8));
+                offset += (integer + 7) & ~7;
+                break;
+        }
+        offset += 8;
+    }
+
+    snprintf(line + used, __RAFGL_LOG_ROOM, "%s", format);
+
+#undef __RAFGL_LOG_EMIT
+#undef __RAFGL_LOG_ROOM
+}
+
+static void __rafgl_log_write(int level, const char *message)
+{
+    if(level == RAFGL_ERROR)
+        fprintf(stderr, "%s: %s", __rafgl_log_level_names[level], message);
+    else
+        printf("%s : %s", __rafgl_log_level_names[level], message);
+
+    pthread_mutex_lock(&__rafgl_log_files_mutex);
+    if(__rafgl_log_files[level] != NULL)
+        fputs(message, __rafgl_log_files[level]);
+    pthread_mutex_unlock(&__rafgl_log_files_mutex);
+}
+
+/* length of the first line of format, at most 40 characters, for quoting it */
+static int __rafgl_log_excerpt(const char *format)
+{
+    int length = strcspn(format, "\n");
+    return length < 40 ? length : 40;
+}
+
+static void __rafgl_log_write_record(__rafgl_log_record_t *record)
+{
+    char line[RAFGL_LOG_LINE_SIZE];
+
+    switch(record->kind)
+    {
+        case __RAFGL_LOG_RECORD_FORMAT:
+            __rafgl_log_decode(line, sizeof(line), record->format, record->payload);
+            break;
+        case __RAFGL_LOG_RECORD_TEXT:
+            snprintf(line, sizeof(line), "%s", (const char*)record->payload);
+            break;
+        case __RAFGL_LOG_RECORD_SUPPRESSED:
+            snprintf(line, sizeof(line), "(%d more messages like \"%.*s\" suppressed)\n", *(const int*)record->payload,
+                     __rafgl_log_excerpt(record->format), record->format);
+            break;
+    }
+
+    __rafgl_log_write(record->level, line);
+}
+
+/* single consumer, the caller holds __rafgl_log_consuming; returns how many records were written */
+static int __rafgl_log_drain(void)
+{
+    int written = 0;
+    for(;;)
+    {
+        __rafgl_log_record_t *record = &__rafgl_log_queue[__rafgl_log_dequeue_pos & (RAFGL_LOG_QUEUE_SIZE - 1)];
+        if(atomic_load_explicit(&record->sequence, memory_order_acquire) != __rafgl_log_dequeue_pos + 1)
+            break;
+
+        __rafgl_log_write_record(record);
+        atomic_store_explicit(&record->sequence, __rafgl_log_dequeue_pos + RAFGL_LOG_QUEUE_SIZE, memory_order_release);
+        __rafgl_log_dequeue_pos++;
+        written++;
+    }
+
+    int dropped = atomic_exchange(&__rafgl_log_dropped, 0);
+    if(dropped > 0)
+    {
+        char line[128];
+        snprintf(line, sizeof(line), "(log queue full, %d messages dropped)\n", dropped);
+        __rafgl_log_write(RAFGL_WARNING, line);
+    }
+
+    if(written > 0 || dropped > 0)
+    {
+        int i;
+        fflush(stdout);
+        pthread_mutex_lock(&__rafgl_log_files_mutex);
+        for(i = 0; i < RAFGL_LOG_LEVELS; i++)
+            if(__rafgl_log_files[i] != NULL)
+                fflush(__rafgl_log_files[i]);
+        pthread_mutex_unlock(&__rafgl_log_files_mutex);
+    }
+    return written;
+}
+
+static void* __rafgl_log_thread_main(void *unused)
+{
+    struct timespec idle = {0, 2 * 1000 * 1000};
+    while(atomic_load(&__rafgl_log_running))
+    {
+        int written = 0;
+        if(!atomic_flag_test_and_set(&__rafgl_log_consuming))
+        {
+            written = __rafgl_log_drain();
+            atomic_flag_clear(&__rafgl_log_consuming);
+        }
+        if(written == 0)
+            nanosleep(&idle, NULL);
+    }
+    return NULL;
+}
+
+/* claims the next free record, NULL if the ring is full */
+static __rafgl_log_record_t* __rafgl_log_claim(void)
+{
+    size_t pos = atomic_load_explicit(&__rafgl_log_enqueue_pos, memory_order_relaxed);
+    for(;;)
+    {
+        __rafgl_log_record_t *record = &__rafgl_log_queue[pos & (RAFGL_LOG_QUEUE_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)pos;
+
+        if(difference == 0)
+        {
+            if(atomic_compare_exchange_weak_explicit(&__rafgl_log_enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                return record;
+        }
+        else if(difference < 0)
+            return NULL;
+        else
+            pos = atomic_load_explicit(&__rafgl_log_enqueue_pos, memory_order_relaxed);
+    }
+}
+
+static void __rafgl_log_publish(__rafgl_log_record_t *record)
+{
+    size_t pos = atomic_load_explicit(&record->sequence, memory_order_relaxed);
+    atomic_store_explicit(&record->sequence, pos + 1, memory_order_release);
+}
+
+static __rafgl_log_record_t* __rafgl_log_claim_for(int level)
+{
+    __rafgl_log_record_t *record;
+    while((record = __rafgl_log_claim()) == NULL)
+    {
+        if(level != RAFGL_ERROR)
+        {
+            atomic_fetch_add(&__rafgl_log_dropped, 1);
+            return NULL;
+        }
+        sched_yield();
+    }
+    record->level = level;
+    return record;
+}
+
+static void __rafgl_log_push_suppressed(int level, const char *format, int suppressed)
+{
+    __rafgl_log_record_t *record = __rafgl_log_claim_for(level);
+    if(record == NULL)
+        return;
+    record->kind = __RAFGL_LOG_RECORD_SUPPRESSED;
+    record->format = format;
+    *(int*)record->payload = suppressed;
+    __rafgl_log_publish(record);
+}
+
+/* returns 0 if the call site already used up its messages for this second */
+static int __rafgl_log_rate_check(int level, const char *format)
+{
+    __rafgl_log_rate_t *rate = &__rafgl_log_rates[((uintptr_t)format >> 3) % __RAFGL_LOG_RATE_SLOTS];
+
+    const char *owner = atomic_load_explicit(&rate->format, memory_order_relaxed);
+    if(owner != format)
+    {
+        /* a slot taken by another call site leaves this one unlimited */
+        if(owner != NULL || !atomic_compare_exchange_strong(&rate->format, &owner, format))
+            return atomic_load(&rate->format) == format ? __rafgl_log_rate_check(level, format) : 1;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    long second = now.tv_sec;
+    long window = atomic_load_explicit(&rate->second, memory_order_relaxed);
+    if(window != second && atomic_compare_exchange_strong(&rate->second, &window, second))
+    {
+        atomic_store(&rate->count, 0);
+        int suppressed = atomic_exchange(&rate->suppressed, 0);
+        if(suppressed > 0)
+            __rafgl_log_push_suppressed(level, format, suppressed);
+    }
+
+    if(atomic_fetch_add_explicit(&rate->count, 1, memory_order_relaxed) < RAFGL_LOG_RATE_LIMIT)
+        return 1;
+
+    atomic_fetch_add_explicit(&rate->suppressed, 1, memory_order_relaxed);
+    return 0;
+}
+
+void rafgl_log(int level, const char *format, ...)
+{
+    if(level < 0 || level >= RAFGL_LOG_LEVELS || !(atomic_load_explicit(&__rafgl_log_level_mask, memory_order_relaxed) & (1 << level)))
+        return;
+
+    va_list args;
+    va_start(args, format);
+
+    if(!atomic_load_explicit(&__rafgl_log_running, memory_order_acquire))
+    {
+        char line[RAFGL_LOG_LINE_SIZE];
+        vsnprintf(line, sizeof(line), format, args);
+        __rafgl_log_write(level, line);
+        va_end(args);
+        return;
+    }
+
+    if(!__rafgl_log_rate_check(level, format))
+    {
+        va_end(args);
+        return;
+    }
+
+    __rafgl_log_record_t *record = __rafgl_log_claim_for(level);
+    if(record != NULL)
+    {
+        va_list copy;
+        va_copy(copy, args);
+
+        record->kind = __RAFGL_LOG_RECORD_FORMAT;
+        record->format = format;
+        record->payload_size = __rafgl_log_encode(record->payload, format, copy);
+        if(record->payload_size < 0)
+        {
+            record->kind = __RAFGL_LOG_RECORD_TEXT;
+            vsnprintf((char*)record->payload, RAFGL_LOG_PAYLOAD_SIZE, format, args);
+        }
+        __rafgl_log_publish(record);
+
+        va_end(copy);
+    }
+
+    va_end(args);
+}
+
+static void __rafgl_log_report_suppressed(void)
+{
+    int i;
+    for(i = 0; i < __RAFGL_LOG_RATE_SLOTS; i++)
+    {
+        int suppressed = atomic_exchange(&__rafgl_log_rates[i].suppressed, 0);
+        if(suppressed > 0)
+        {
+            char line[128];
+            const char *format = atomic_load(&__rafgl_log_rates[i].format);
+            snprintf(line, sizeof(line), "(%d more messages like \"%.*s\" suppressed)\n", suppressed, __rafgl_log_excerpt(format), format);
+            __rafgl_log_write(RAFGL_INFO, line);
+        }
+    }
+}
+
+/* async-signal-safe stand-ins for stdio in the crash handler, they append at most length
+   characters to line, never past size, and return the new length (line is not terminated) */
+static int __rafgl_log_safe_text(char *line, int size, int used, const char *text, int length)
+{
+    while(length-- > 0 && *text && used < size)
+        line[used++] = *text++;
+    return used;
+}
+
+static int __rafgl_log_safe_number(char *line, int size, int used, unsigned long long value, int base)
+{
+    char digits[24];
+    int count = 0;
+    do
+    {
+        digits[count++] = "0123456789abcdef"[value % base];
+        value /= base;
+    } while(value);
+    while(count > 0 && used < size)
+        line[used++] = digits[--count];
+    return used;
+}
+
+/* __rafgl_log_decode without snprintf: flags, widths and precisions are ignored, doubles get three decimals */
+static int __rafgl_log_safe_decode(char *line, int size, const char *format, const unsigned char *payload)
+{
+    __rafgl_log_spec_t spec;
+    int used = 0, offset = 0;
+    const char *next;
+
+    while((next = __rafgl_log_next_spec(format, &spec)) != NULL)
+    {
+        used = __rafgl_log_safe_text(line, size, used, format, spec.start - format);
+        format = next;
+
+        if(spec.arg == __RAFGL_LOG_ARG_NONE)
+        {
+            used = __rafgl_log_safe_text(line, size, used, "%", 1);
+            continue;
+        }
+
+        offset += 8 * spec.stars;
+        long long integer = *(const long long*)(payload + offset);
+        char conversion = spec.start[spec.length - 1];
+        int base = conversion == 'x' || conversion == 'X' ? 16 : conversion == 'o' ? 8 : 10;
+        switch(spec.arg)
+        {
+            case __RAFGL_LOG_ARG_STRING:
+                used = __rafgl_log_safe_text(line, size, used, (const char*)(payload + offset + 8), integer);
+                offset += (integer + 7) & ~7;
+                break;
+            case __RAFGL_LOG_ARG_POINTER:
+                used = __rafgl_log_safe_text(line, size, used, "0x", 2);
+                used = __rafgl_log_safe_number(line, size, used, (uintptr_t)*(void* const*)(payload + offset), 16);
+                break;
+            case __RAFGL_LOG_ARG_DOUBLE:
+            {
+                double value = *(const double*)(payload + offset);
+                if(value < 0.0)
+                {
+                    used = __rafgl_log_safe_text(line, size, used, "-", 1);
+                    value = -value;
+                }
+                if(!(value < 1e18))
+                {
+                    used = __rafgl_log_safe_text(line, size, used, "?", 1);
+                    break;
+                }
+                unsigned long long whole = (unsigned long long)value;
+                unsigned int thousandths = (unsigned int)((value - whole) * 1000.0);
+                used = __rafgl_log_safe_number(line, size, used, whole, 10);
+                used = __rafgl_log_safe_text(line, size, used, ".00", thousandths < 10 ? 3 : thousandths < 100 ? 2 : 1);
+                used = __rafgl_log_safe_number(line, size, used, thousandths, 10);
+                break;
+            }
+            default:
+                if(conversion == 'c')
+                {
+                    char c = (char)integer;
+                    used = __rafgl_log_safe_text(line, size, used, &c, 1);
+                }
+                else if(conversion == 'd' || conversion == 'i')
+                {
+                    if(integer < 0)
+                        used = __rafgl_log_safe_text(line, size, used, "-", 1);
+                    used = __rafgl_log_safe_number(line, size, used, integer < 0 ? -(unsigned long long)integer : (unsigned long long)integer, 10);
+                }
+                else
+                {
+                    unsigned long long value = integer;
+                    if(spec.arg == __RAFGL_LOG_ARG_INT)
+                        value = (unsigned int)integer;
+                    used = __rafgl_log_safe_number(line, size, used, value, base);
+                }
+                break;
+        }
+        offset += 8;
+    }
+
+    return __rafgl_log_safe_text(line, size, used, format, size);
+}
+
+static int __rafgl_log_safe_suppressed(char *line, int size, int suppressed, const char *format)
+{
+    int used = __rafgl_log_safe_text(line, size, 0, "(", 1);
+    used = __rafgl_log_safe_number(line, size, used, suppressed, 10);
+    used = __rafgl_log_safe_text(line, size, used, " more messages like \"", size);
+    used = __rafgl_log_safe_text(line, size, used, format, __rafgl_log_excerpt(format));
+    return __rafgl_log_safe_text(line, size, used, "\" suppressed)\n", size);
+}
+
+static void __rafgl_log_safe_write(int level, const char *line, int length)
+{
+    int console = level == RAFGL_ERROR ? STDERR_FILENO : STDOUT_FILENO;
+    const char *name = __rafgl_log_level_names[level];
+    const char *separator = level == RAFGL_ERROR ? ": " : " : ";
+
+    /* nothing sensible is left to do about a failed write in a crash handler */
+    if(write(console, name, strlen(name)) < 0 || write(console, separator, strlen(separator)) < 0 ||
+       write(console, line, length) < 0)
+        return;
+    int fd = atomic_load(&__rafgl_log_fds[level]);
+    if(fd >= 0 && write(fd, line, length) < 0)
+        return;
+}
+
+static void __rafgl_log_crash_handler(int signal_number)
+{
+    /* give the flush thread a moment to finish its batch, then write out the rest ourselves */
+    int tries;
+    for(tries = 0; tries < 1000 && atomic_flag_test_and_set(&__rafgl_log_consuming); tries++)
+        sched_yield();
+
+    char *line = __rafgl_log_crash_line;
+    int size = sizeof(__rafgl_log_crash_line), length = 0;
+    for(;;)
+    {
+        __rafgl_log_record_t *record = &__rafgl_log_queue[__rafgl_log_dequeue_pos & (RAFGL_LOG_QUEUE_SIZE - 1)];
+        if(atomic_load_explicit(&record->sequence, memory_order_acquire) != __rafgl_log_dequeue_pos + 1)
+            break;
+
+        switch(record->kind)
+        {
+            case __RAFGL_LOG_RECORD_FORMAT:
+                length = __rafgl_log_safe_decode(line, size, record->format, record->payload);
+                break;
+            case __RAFGL_LOG_RECORD_TEXT:
+                length = __rafgl_log_safe_text(line, size, 0, (const char*)record->payload, RAFGL_LOG_PAYLOAD_SIZE);
+                break;
+            case __RAFGL_LOG_RECORD_SUPPRESSED:
+                length = __rafgl_log_safe_suppressed(line, size, *(const int*)record->payload, record->format);
+                break;
+        }
+        __rafgl_log_safe_write(record->level, line, length);
+        __rafgl_log_dequeue_pos++;
+    }
+
+    int i;
+    for(i = 0; i < __RAFGL_LOG_RATE_SLOTS; i++)
+    {
+        int suppressed = atomic_exchange(&__rafgl_log_rates[i].suppressed, 0);
+        if(suppressed > 0)
+        {
+            length = __rafgl_log_safe_suppressed(line, size, suppressed, atomic_load(&__rafgl_log_rates[i].format));
+            __rafgl_log_safe_write(RAFGL_INFO, line, length);
+        }
+    }
+
+    signal(signal_number, SIG_DFL);
+    raise(signal_number);
+}
+
+int rafgl_log_init(const char *log_directory)
+{
+    if(atomic_load(&__rafgl_log_running))
+        return 0;
+
+    int i;
+    char path[256];
+    pthread_mutex_lock(&__rafgl_log_files_mutex);
+    for(i = 0; i < RAFGL_LOG_LEVELS; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s.log", log_directory, __rafgl_log_level_names[i]);
+        __rafgl_log_files[i] = fopen(path, "w");
+        atomic_store(&__rafgl_log_fds[i], __rafgl_log_files[i] != NULL ? fileno(__rafgl_log_files[i]) : -1);
+    }
+    pthread_mutex_unlock(&__rafgl_log_files_mutex);
+
+    for(i = 0; i < RAFGL_LOG_QUEUE_SIZE; i++)
+        atomic_store_explicit(&__rafgl_log_queue[i].sequence, i, memory_order_relaxed);
+    atomic_store(&__rafgl_log_enqueue_pos, 0);
+    __rafgl_log_dequeue_pos = 0;
+
+    atomic_store(&__rafgl_log_running, 1);
+    if(pthread_create(&__rafgl_log_thread, NULL, __rafgl_log_thread_main, NULL) != 0)
+    {
+        atomic_store(&__rafgl_log_running, 0);
+        return -1;
+    }
+
+    static int handlers_installed = 0;
+    if(!handlers_installed)
+    {
+        int fatal[] = {SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL};
+        for(i = 0; i < (int)(sizeof(fatal) / sizeof(fatal[0])); i++)
+            signal(fatal[i], __rafgl_log_crash_handler);
+        atexit(rafgl_log_shutdown);
+        handlers_installed = 1;
+    }
+
+    return 0;
+}
+
+void rafgl_log_flush(void)
+{
+    if(!atomic_load(&__rafgl_log_running))
+        return;
+
+    size_t target = atomic_load(&__rafgl_log_enqueue_pos);
+    struct timespec wait = {0, 100 * 1000};
+    for(;;)
+    {
+        /* the flush thread only moves dequeue_pos while it holds the flag */
+        while(atomic_flag_test_and_set(&__rafgl_log_consuming))
+            nanosleep(&wait, NULL);
+        int done = (intptr_t)(__rafgl_log_dequeue_pos - target) >= 0;
+        if(!done)
+            __rafgl_log_drain();
+        atomic_flag_clear(&__rafgl_log_consuming);
+        if(done)
+            return;
+        /* a producer claimed a record but has not published it yet */
+        nanosleep(&wait, NULL);
+    }
+}
+
+void rafgl_log_shutdown(void)
+{
+    if(!atomic_exchange(&__rafgl_log_running, 0))
+        return;
+
+    pthread_join(__rafgl_log_thread, NULL);
+
+    /* producers that saw running == 1 may still publish, everything else goes out synchronously */
+    while(atomic_flag_test_and_set(&__rafgl_log_consuming))
+        sched_yield();
+    __rafgl_log_drain();
+    __rafgl_log_report_suppressed();
+
+    /* synchronous writers find the files closed from here on and only write to the console */
+    int i;
+    pthread_mutex_lock(&__rafgl_log_files_mutex);
+    for(i = 0; i < RAFGL_LOG_LEVELS; i++)
+    {
+        atomic_store(&__rafgl_log_fds[i], -1);
+        if(__rafgl_log_files[i] != NULL)
+            fclose(__rafgl_log_files[i]);
+        __rafgl_log_files[i] = NULL;
+    }
+    pthread_mutex_unlock(&__rafgl_log_files_mutex);
+    atomic_flag_clear(&__rafgl_log_consuming);
+    fflush(stdout);
+}
+
+void rafgl_log_set_level_enabled(int level, int enabled)
+{
+    if(level < 0 || level >= RAFGL_LOG_LEVELS)
+        return;
+    if(enabled)
+        atomic_fetch_or(&__rafgl_log_level_mask, 1 << level);
+    else
+        atomic_fetch_and(&__rafgl_log_level_mask, ~(1 << level));
+}
+
+int rafgl_log_level_enabled(int level)
+{
+    return level >= 0 && level < RAFGL_LOG_LEVELS && (atomic_load(&__rafgl_log_level_mask) & (1 << level));
+}
+
+#endif // RAFGL_IMPLEMENTATION
+#endif // RAFGL_LOG_H_INCLUDED
@@ -0,0 +1,543 @@
+#ifndef RAFGL_MEMORY_H_INCLUDED
+#define RAFGL_MEMORY_H_INCLUDED
+
+#include <stddef.h>
+
+/*
+    rafgl_memory - arena and pool allocators
+
+    An arena hands out memory by bumping an offset inside large blocks and frees everything
+    at once. Two global arenas are provided:
+        the frame arena is reset by rafgl_game_start at the start of every frame, use it for
+        scratch data that does not outlive the frame,
+        the level arena holds load-time temporaries and is released as one block after a
+        game state finished its init.
+    Markers rewind an arena to an earlier point, so a loader can give its temporaries back
+    as soon as it is done with them.
+
+    A pool hands out fixed size elements from large blocks and keeps released elements on a
+    free list, it replaces many small mallocs and frees of one size.
+
+    Every allocator tracks its high-water mark, rafgl_memory_log_stats writes them to the log.
+    Neither arenas nor pools are thread safe, the global arenas belong to the main thread.
+
+    rafgl_malloc, rafgl_calloc, rafgl_realloc, rafgl_aligned_alloc and rafgl_free account every
+    allocation under a subsystem tag: current, peak and lifetime bytes plus the number of
+    allocations. Arena and pool blocks are accounted under the tag they were created with.
+    The counters are atomic, so workers of the job system may allocate too.
+    A snapshot taken when a game state starts lets its cleanup report what it failed to free.
+    Defining NDEBUG compiles the tracking out, the calls then map straight to the C library.
+*/
+
+#if !defined(NDEBUG)
+#define RAFGL_MEMORY_TRACKING
+#endif
+
+#define RAFGL_MEM_GENERAL   0
+#define RAFGL_MEM_MESH      1
+#define RAFGL_MEM_TEXTURE   2
+#define RAFGL_MEM_RASTER    3
+#define RAFGL_MEM_LIST      4
+#define RAFGL_MEM_SHADER    5
+#define RAFGL_MEM_SCENE     6
+#define RAFGL_MEM_TAG_COUNT 7
+
+#define RAFGL_ARENA_ALIGNMENT 16
+#define RAFGL_FRAME_ARENA_BLOCK (1 << 20)
+#define RAFGL_LEVEL_ARENA_BLOCK (16 << 20)
+
+struct _rafgl_arena_block_t;
+struct _rafgl_pool_block_t;
+
+typedef struct _rafgl_arena_t
+{
+    const char *name;
+    int tag;                /* blocks are accounted under this RAFGL_MEM_ tag */
+    struct _rafgl_arena_block_t *blocks;    /* newest first */
+    size_t block_size;
+    size_t used;            /* bytes handed out since the last reset */
+    size_t reserved;        /* bytes held in blocks */
+    size_t high_water;      /* largest used ever seen */
+} rafgl_arena_t;
+
+typedef struct _rafgl_arena_marker_t
+{
+    struct _rafgl_arena_block_t *block;
+    size_t block_used;
+    size_t used;
+} rafgl_arena_marker_t;
+
+typedef struct _rafgl_pool_t
+{
+    const char *name;
+    int tag;
+    struct _rafgl_pool_block_t *blocks;
+    void *free_list;
+    size_t element_size;
+    int elements_per_block;
+    int live;               /* elements currently handed out */
+    int capacity;           /* elements held in blocks */
+    int high_water;         /* largest live ever seen */
+} rafgl_pool_t;
+
+typedef struct _rafgl_memory_snapshot_t
+{
+    size_t bytes[RAFGL_MEM_TAG_COUNT];
+    int allocations[RAFGL_MEM_TAG_COUNT];
+} rafgl_memory_snapshot_t;
+
+/* block_size is the minimum size of each block, larger requests get a block of their own */
+void rafgl_arena_init(rafgl_arena_t *arena, const char *name, int tag, size_t block_size);
+/* returns RAFGL_ARENA_ALIGNMENT aligned memory, never NULL unless the system is out of memory */
+void *rafgl_arena_alloc(rafgl_arena_t *arena, size_t size);
+void *rafgl_arena_calloc(rafgl_arena_t *arena, size_t count, size_t size);
+rafgl_arena_marker_t rafgl_arena_marker(rafgl_arena_t *arena);
+/* gives back everything allocated after the marker was taken */
+void rafgl_arena_rewind(rafgl_arena_t *arena, rafgl_arena_marker_t marker);
+/* gives back everything, the memory is kept (merged into one block) for reuse */
+void rafgl_arena_reset(rafgl_arena_t *arena);
+/* returns all blocks to the system */
+void rafgl_arena_free(rafgl_arena_t *arena);
+
+void rafgl_pool_init(rafgl_pool_t *pool, const char *name, int tag, size_t element_size, int elements_per_block);
+void *rafgl_pool_alloc(rafgl_pool_t *pool);
+void rafgl_pool_release(rafgl_pool_t *pool, void *element);
+void rafgl_pool_free(rafgl_pool_t *pool);
+
+rafgl_arena_t *rafgl_frame_arena(void);
+rafgl_arena_t *rafgl_level_arena(void);
+void rafgl_memory_log_stats(void);
+/* the largest resident set the process had so far, in bytes, including what the driver and the C library hold */
+size_t rafgl_memory_peak_rss(void);
+
+#ifdef RAFGL_MEMORY_TRACKING
+
+void *rafgl_malloc(int tag, size_t size);
+void *rafgl_calloc(int tag, size_t count, size_t size);
+void *rafgl_realloc(int tag, void *memory, size_t size);
+/* alignment must be a power of two */
+void *rafgl_aligned_alloc(int tag, size_t alignment, size_t size);
+/* memory must come from one of the above, the tag is remembered */
+void rafgl_free(void *memory);
+
+/* bytes held by the global arenas are left out, they belong to rafgl_game_start */
+void rafgl_memory_snapshot(rafgl_memory_snapshot_t *snapshot);
+/* logs every tag holding more memory than in the snapshot, returns the leaked bytes */
+size_t rafgl_memory_report_leaks(const rafgl_memory_snapshot_t *since, const char *owner);
+
+#else
+
+#include <stdlib.h>
+
+#define rafgl_malloc(tag, size) malloc(size)
+#define rafgl_calloc(tag, count, size) calloc((count), (size))
+#define rafgl_realloc(tag, memory, size) realloc((memory), (size))
+#define rafgl_aligned_alloc(tag, alignment, size) aligned_alloc((alignment), (size))
+#define rafgl_free(memory) free(memory)
+
+#define rafgl_memory_snapshot(snapshot) ((void)(snapshot))
+/* a function rather than a macro so callers may drop the result without a warning */
+static inline size_t rafgl_memory_report_leaks(const rafgl_memory_snapshot_t *since, const char *owner)
+{
+    (void)since;
+    (void)owner;
+    return 0;
+}
+
+#endif // RAFGL_MEMORY_TRACKING
+
+
+#ifdef RAFGL_IMPLEMENTATION
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+typedef struct _rafgl_arena_block_t
+{
+    struct _rafgl_arena_block_t *next;
+    size_t size;
+    size_t used;
+    size_t pad;             /* keeps data aligned */
+    unsigned char data[];
+} __rafgl_arena_block_t;
+
+typedef struct _rafgl_pool_block_t
+{
+    struct _rafgl_pool_block_t *next;
+    size_t pad;
+    unsigned char data[];
+} __rafgl_pool_block_t;
+
+/* the level arena only serves the mesh loaders so far */
+static rafgl_arena_t __rafgl_frame_arena = {"frame", RAFGL_MEM_GENERAL, NULL, RAFGL_FRAME_ARENA_BLOCK, 0, 0, 0};
+static rafgl_arena_t __rafgl_level_arena = {"level", RAFGL_MEM_MESH, NULL, RAFGL_LEVEL_ARENA_BLOCK, 0, 0, 0};
+
+#ifdef RAFGL_MEMORY_TRACKING
+
+#include <stdatomic.h>
+
+typedef struct
+{
+    atomic_size_t current;
+    atomic_size_t peak;
+    atomic_size_t lifetime;
+    atomic_int live;
+    atomic_int allocations;
+} __rafgl_memory_tag_stats_t;
+
+/* sits right in front of every tracked allocation */
+typedef struct
+{
+    size_t size;
+    unsigned int tag;
+    unsigned int offset;    /* from the start of the system allocation */
+} __rafgl_memory_header_t;
+
+static const char *__rafgl_memory_tag_names[RAFGL_MEM_TAG_COUNT] = {"general", "mesh", "texture", "raster", "list", "shader", "scene"};
+static __rafgl_memory_tag_stats_t __rafgl_memory_stats[RAFGL_MEM_TAG_COUNT];
+
+static void __rafgl_memory_track(int tag, size_t size)
+{
+    __rafgl_memory_tag_stats_t *stats = &__rafgl_memory_stats[tag];
+    size_t current = atomic_fetch_add_explicit(&stats->current, size, memory_order_relaxed) + size;
+    size_t peak = atomic_load_explicit(&stats->peak, memory_order_relaxed);
+    while(current > peak && !atomic_compare_exchange_weak_explicit(&stats->peak, &peak, current, memory_order_relaxed, memory_order_relaxed));
+
+    atomic_fetch_add_explicit(&stats->lifetime, size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->live, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->allocations, 1, memory_order_relaxed);
+}
+
+void *rafgl_aligned_alloc(int tag, size_t alignment, size_t size)
+{
+    if(tag < 0 || tag >= RAFGL_MEM_TAG_COUNT)
+        tag = RAFGL_MEM_GENERAL;
+    if(alignment < sizeof(__rafgl_memory_header_t))
+        alignment = sizeof(__rafgl_memory_header_t);
+
+    unsigned char *raw = malloc(sizeof(__rafgl_memory_header_t) + alignment - 1 + size);
+    if(raw == NULL)
+        return NULL;
+
+    uintptr_t address = ((uintptr_t)(raw + sizeof(__rafgl_memory_header_t)) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    unsigned char *memory = (unsigned char*)address;
+    __rafgl_memory_header_t *header = (__rafgl_memory_header_t*)memory - 1;
+    header->size = size;
+    header->tag = tag;
+    header->offset = memory - raw;
+
+    __rafgl_memory_track(tag, size);
+    return memory;
+}
+
+void *rafgl_malloc(int tag, size_t size)
+{
+    return rafgl_aligned_alloc(tag, RAFGL_ARENA_ALIGNMENT, size);
+}
+
+void *rafgl_calloc(int tag, size_t count, size_t size)
+{
+    void *memory = rafgl_aligned_alloc(tag, RAFGL_ARENA_ALIGNMENT, count * size);
+    if(memory != NULL)
+        memset(memory, 0, count * size);
+    return memory;
+}
+
+void rafgl_free(void *memory)
+{
+    if(memory == NULL)
+        return;
+
+    __rafgl_memory_header_t *header = (__rafgl_memory_header_t*)memory - 1;
+    __rafgl_memory_tag_stats_t *stats = &__rafgl_memory_stats[header->tag];
+    atomic_fetch_sub_explicit(&stats->current, header->size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&stats->live, 1, memory_order_relaxed);
+
+    free((unsigned char*)memory - header->offset);
+}
+
+void *rafgl_realloc(int tag, void *memory, size_t size)
+{
+    if(memory == NULL)
+        return rafgl_malloc(tag, size);
+
+    /* the header may sit at a different offset after a system realloc, copying keeps it simple */
+    void *resized = rafgl_malloc(tag, size);
+    if(resized == NULL)
+        return NULL;
+
+    size_t old_size = ((__rafgl_memory_header_t*)memory - 1)->size;
+    memcpy(resized, memory, old_size < size ? old_size : size);
+    rafgl_free(memory);
+    return resized;
+}
+
+#endif // RAFGL_MEMORY_TRACKING
+
+static size_t __rafgl_align(size_t size)
+{
+    return (size + RAFGL_ARENA_ALIGNMENT - 1) & ~(size_t)(RAFGL_ARENA_ALIGNMENT - 1);
+}
+
+void rafgl_arena_init(rafgl_arena_t *arena, const char *name, int tag, size_t block_size)
+{
+    memset(arena, 0, sizeof(rafgl_arena_t));
+    arena->name = name;
+    arena->tag = tag;
+    arena->block_size = block_size;
+}
+
+static __rafgl_arena_block_t* __rafgl_arena_new_block(rafgl_arena_t *arena, size_t size)
+{
+    __rafgl_arena_block_t *block = rafgl_aligned_alloc(arena->tag, RAFGL_ARENA_ALIGNMENT, sizeof(__rafgl_arena_block_t) + size);
+    if(block == NULL)
+        return NULL;
+
+    block->size = size;
+    block->used = 0;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->reserved += size;
+    return block;
+}
+
+void *rafgl_arena_alloc(rafgl_arena_t *arena, size_t size)
+{
+    size = __rafgl_align(size ? size : 1);
+
+    __rafgl_arena_block_t *block = arena->blocks;
+    if(block == NULL || block->size - block->used < size)
+    {
+        block = __rafgl_arena_new_block(arena, size > arena->block_size ? size : arena->block_size);
+        if(block == NULL)
+            return NULL;
+    }
+
+    void *memory = block->data + block->used;
+    block->used += size;
+    arena->used += size;
+    if(arena->used > arena->high_water)
+        arena->high_water = arena->used;
+    return memory;
+}
+
+void *rafgl_arena_calloc(rafgl_arena_t *arena, size_t count, size_t size)
+{
+    void *memory = rafgl_arena_alloc(arena, count * size);
+    if(memory != NULL)
+        memset(memory, 0, count * size);
+    return memory;
+}
+
+rafgl_arena_marker_t rafgl_arena_marker(rafgl_arena_t *arena)
+{
+    rafgl_arena_marker_t marker;
+    marker.block = arena->blocks;
+    marker.block_used = arena->blocks ? arena->blocks->used : 0;
+    marker.used = arena->used;
+    return marker;
+}
+
+void rafgl_arena_rewind(rafgl_arena_t *arena, rafgl_arena_marker_t marker)
+{
+    /* blocks added after the marker only hold memory allocated after it */
+    while(arena->blocks != marker.block)
+    {
+        __rafgl_arena_block_t *block = arena->blocks;
+
+        /* rewinding an arena to empty keeps its first block around for the next user */
+        if(marker.block == NULL && block->next == NULL)
+        {
+            block->used = 0;
+            arena->used = 0;
+            return;
+        }
+
+        arena->blocks = block->next;
+        arena->reserved -= block->size;
+        rafgl_free(block);
+    }
+
+    if(arena->blocks != NULL)
+        arena->blocks->used = marker.block_used;
+    arena->used = marker.used;
+}
+
+void rafgl_arena_reset(rafgl_arena_t *arena)
+{
+    /* more than one block means the arena outgrew its block size, replace the chain with
+       one block that fits everything so the next round does not have to chain again */
+    if(arena->blocks != NULL && arena->blocks->next != NULL)
+    {
+        size_t size = arena->reserved;
+        rafgl_arena_free(arena);
+        __rafgl_arena_new_block(arena, size);
+    }
+
+    if(arena->blocks != NULL)
+        arena->blocks->used = 0;
+    arena->used = 0;
+}
+
+void rafgl_arena_free(rafgl_arena_t *arena)
+{
+    while(arena->blocks != NULL)
+    {
+        __rafgl_arena_block_t *block = arena->blocks;
+        arena->blocks = block->next;
+        rafgl_free(block);
+    }
+    arena->used = 0;
+    arena->reserved = 0;
+}
+
+void rafgl_pool_init(rafgl_pool_t *pool, const char *name, int tag, size_t element_size, int elements_per_block)
+{
+    memset(pool, 0, sizeof(rafgl_pool_t));
+    pool->name = name;
+    pool->tag = tag;
+    /* released elements hold the free list link */
+    if(element_size < sizeof(void*))
+        element_size = sizeof(void*);
+    pool->element_size = (element_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    pool->elements_per_block = elements_per_block > 0 ? elements_per_block : 1024;
+}
+
+void *rafgl_pool_alloc(rafgl_pool_t *pool)
+{
+    if(pool->free_list == NULL)
+    {
+        __rafgl_pool_block_t *block = rafgl_malloc(pool->tag, sizeof(__rafgl_pool_block_t) + pool->element_size * pool->elements_per_block);
+        if(block == NULL)
+            return NULL;
+        block->next = pool->blocks;
+        pool->blocks = block;
+        pool->capacity += pool->elements_per_block;
+
+        int i;
+        for(i = pool->elements_per_block - 1; i >= 0; i--)
+        {
+            void *element = block->data + i * pool->element_size;
+            *((void**)element) = pool->free_list;
+            pool->free_list = element;
+        }
+    }
+
+    void *element = pool->free_list;
+    pool->free_list = *((void**)element);
+    if(++pool->live > pool->high_water)
+        pool->high_water = pool->live;
+    return element;
+}
+
+void rafgl_pool_release(rafgl_pool_t *pool, void *element)
+{
+    if(element == NULL)
+        return;
+    *((void**)element) = pool->free_list;
+    pool->free_list = element;
+    pool->live--;
+}
+
+void rafgl_pool_free(rafgl_pool_t *pool)
+{
+    while(pool->blocks != NULL)
+    {
+        __rafgl_pool_block_t *block = pool->blocks;
+        pool->blocks = block->next;
+        rafgl_free(block);
+    }
+    pool->free_list = NULL;
+    pool->live = 0;
+    pool->capacity = 0;
+}
+
+rafgl_arena_t *rafgl_frame_arena(void)
+{
+    return &__rafgl_frame_arena;
+}
+
+rafgl_arena_t *rafgl_level_arena(void)
+{
+    return &__rafgl_level_arena;
+}
+
+size_t rafgl_memory_peak_rss(void)
+{
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return (size_t)usage.ru_maxrss * 1024;
+}
+
+void rafgl_memory_log_stats(void)
+{
+    rafgl_arena_t *arenas[2] = {&__rafgl_frame_arena, &__rafgl_level_arena};
+    int i;
+    for(i = 0; i < 2; i++)
+    {
+        rafgl_log(RAFGL_INFO, "[memory] %s arena: high-water %.2f KiB, reserved %.2f KiB\n", arenas[i]->name,
+                  arenas[i]->high_water / 1024.0, arenas[i]->reserved / 1024.0);
+    }
+    rafgl_log(RAFGL_INFO, "[memory] peak RSS %.2f MiB\n", rafgl_memory_peak_rss() / (1024.0 * 1024.0));
+
+#ifdef RAFGL_MEMORY_TRACKING
+    for(i = 0; i < RAFGL_MEM_TAG_COUNT; i++)
+    {
+        __rafgl_memory_tag_stats_t *stats = &__rafgl_memory_stats[i];
+        rafgl_log(RAFGL_INFO, "[memory] %-8s current %10.2f KiB, peak %10.2f KiB, lifetime %10.2f KiB, %d allocations\n",
+                  __rafgl_memory_tag_names[i], atomic_load(&stats->current) / 1024.0, atomic_load(&stats->peak) / 1024.0,
+                  atomic_load(&stats->lifetime) / 1024.0, atomic_load(&stats->allocations));
+    }
+#endif
+}
+
+#ifdef RAFGL_MEMORY_TRACKING
+
+void rafgl_memory_snapshot(rafgl_memory_snapshot_t *snapshot)
+{
+    int i;
+    for(i = 0; i < RAFGL_MEM_TAG_COUNT; i++)
+    {
+        snapshot->bytes[i] = atomic_load(&__rafgl_memory_stats[i].current);
+        snapshot->allocations[i] = atomic_load(&__rafgl_memory_stats[i].live);
+    }
+
+    /* a global arena may grow or shrink between the snapshot and the report, that is not a leak */
+    rafgl_arena_t *arenas[2] = {&__rafgl_frame_arena, &__rafgl_level_arena};
+    for(i = 0; i < 2; i++)
+    {
+        __rafgl_arena_block_t *block;
+        for(block = arenas[i]->blocks; block != NULL; block = block->next)
+        {
+            snapshot->bytes[arenas[i]->tag] -= sizeof(__rafgl_arena_block_t) + block->size;
+            snapshot->allocations[arenas[i]->tag]--;
+        }
+    }
+}
+
+size_t rafgl_memory_report_leaks(const rafgl_memory_snapshot_t *since, const char *owner)
+{
+    rafgl_memory_snapshot_t now;
+    rafgl_memory_snapshot(&now);
+
+    size_t leaked = 0;
+    int i;
+    for(i = 0; i < RAFGL_MEM_TAG_COUNT; i++)
+    {
+        if(now.bytes[i] <= since->bytes[i] && now.allocations[i] <= since->allocations[i])
+            continue;
+
+        size_t bytes = now.bytes[i] > since->bytes[i] ? now.bytes[i] - since->bytes[i] : 0;
+        rafgl_log(RAFGL_WARNING, "[memory] %s leaked %zu bytes in %d %s allocations\n", owner, bytes,
+                  now.allocations[i] - since->allocations[i], __rafgl_memory_tag_names[i]);
+        leaked += bytes;
+    }
+    return leaked;
+}
+
+#endif // RAFGL_MEMORY_TRACKING
+
+#endif // RAFGL_IMPLEMENTATION
+#endif // RAFGL_MEMORY_H_INCLUDED
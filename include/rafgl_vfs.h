@@ -0,0 +1,458 @@
+#ifndef RAFGL_VFS_H_INCLUDED
+#define RAFGL_VFS_H_INCLUDED
+
+#include <stddef.h>
+#include <rafgl_jobs.h>
+#include <rafgl_memory.h>
+
+/*
+    rafgl_vfs - asset file reads
+
+    rafgl_vfs_read_async reads a whole file into memory without blocking the caller. The file
+    is opened and sized on the calling thread (one open, one fstat), the read itself goes to
+    an io_uring that a completion thread reaps, short reads are resubmitted from there. When
+    the kernel has no io_uring, or the ring is full, the read runs as a job on the job system
+    instead, where it blocks one worker.
+
+    Every request raises a job system counter by one and lowers it once its data is there, so
+    rafgl_jobs_wait works as the future and rafgl_jobs_run_after chains the parsing jobs to the
+    reads: decoding the first file overlaps with reading the next ones.
+
+    rafgl_vfs_map maps a file read only, with a madvise hint, for parsers that walk a file once
+    front to back. rafgl_vfs_prefetch asks the kernel to start reading a file into the page
+    cache, so a later read or map of it does not wait on the disk.
+
+    Before rafgl_vfs_init (and after rafgl_vfs_shutdown) asynchronous reads run as jobs.
+*/
+
+#define RAFGL_VFS_QUEUE_DEPTH 64    /* io_uring entries, reads in flight beyond that run as jobs */
+
+#define RAFGL_VFS_SEQUENTIAL 0      /* map hint: read once front to back, read ahead aggressively */
+#define RAFGL_VFS_RANDOM 1          /* map hint: scattered access, no read ahead */
+
+typedef struct _rafgl_vfs_read_t
+{
+    /* set by the caller */
+    const char *path;
+    int tag;                    /* rafgl_memory tag of data */
+
+    /* valid once the counter dropped */
+    unsigned char *data;        /* rafgl_malloc'ed with a zero byte past size, NULL on failure */
+    size_t size;
+    int error;                  /* 0 or an errno value */
+
+    /* internal */
+    int fd, ring;
+    size_t done;
+    rafgl_jobs_counter_t *counter;
+    rafgl_job_t job;
+} rafgl_vfs_read_t;
+
+typedef struct _rafgl_vfs_map_t
+{
+    const unsigned char *data;  /* NULL for an empty file */
+    size_t size;
+} rafgl_vfs_map_t;
+
+/* sets up an io_uring of queue_depth entries and its completion thread, queue_depth <= 0 runs every read as a job, returns 1 when io_uring is used */
+int rafgl_vfs_init(int queue_depth);
+/* waits for the reads in flight and closes the ring */
+void rafgl_vfs_shutdown(void);
+
+/* starts reading read->path, the counter (may be NULL) is raised by one and lowered when the read finished, read must stay alive until then */
+void rafgl_vfs_read_async(rafgl_vfs_read_t *read, rafgl_jobs_counter_t *counter);
+/* reads a whole file on the calling thread, *data is rafgl_malloc'ed with a zero byte past size, returns 0 or an errno value */
+int rafgl_vfs_read_all(const char *path, int tag, unsigned char **data, size_t *size);
+
+/* maps a file read only, returns 0 or an errno value */
+int rafgl_vfs_map(const char *path, rafgl_vfs_map_t *map, int hint);
+void rafgl_vfs_unmap(rafgl_vfs_map_t *map);
+
+/* starts reading a file into the page cache and returns right away */
+void rafgl_vfs_prefetch(const char *path);
+
+
+#ifdef RAFGL_IMPLEMENTATION
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define __RAFGL_VFS_MAX_READ (1 << 30)  /* bytes per read call, larger files take several */
+
+static int __vfs_ring_fd = -1;
+static unsigned __vfs_entries;
+static unsigned *__vfs_sq_head, *__vfs_sq_tail, *__vfs_sq_mask, *__vfs_sq_array;
+static unsigned *__vfs_cq_head, *__vfs_cq_tail, *__vfs_cq_mask;
+static struct io_uring_sqe *__vfs_sqes;
+static struct io_uring_cqe *__vfs_cqes;
+static void *__vfs_sq_ring, *__vfs_cq_ring;
+static size_t __vfs_sq_ring_size, __vfs_cq_ring_size;
+
+static pthread_mutex_t __vfs_submit_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t __vfs_thread;
+static atomic_int __vfs_in_flight;
+static atomic_int __vfs_stopping;
+
+static int __vfs_open(const char *path, int tag, unsigned char **data, size_t *size)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return -1;
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    *size = st.st_size;
+    *data = rafgl_malloc(tag, *size + 1);
+    if(*data == NULL)
+    {
+        close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    (*data)[*size] = 0;
+    return fd;
+}
+
+/* blocking read of [*done, size), returns 0 or an errno value */
+static int __vfs_pread(int fd, unsigned char *data, size_t size, size_t *done)
+{
+    while(*done < size)
+    {
+        size_t chunk = size - *done;
+        if(chunk > __RAFGL_VFS_MAX_READ) chunk = __RAFGL_VFS_MAX_READ;
+        ssize_t got = pread(fd, data + *done, chunk, *done);
+        if(got < 0)
+        {
+            if(errno == EINTR || errno == EAGAIN) continue;
+            return errno;
+        }
+        if(got == 0) return EIO;    /* the file shrank since fstat */
+        *done += got;
+    }
+    return 0;
+}
+
+static void __vfs_finish(rafgl_vfs_read_t *read, int error)
+{
+    if(read->fd >= 0) close(read->fd);
+    read->fd = -1;
+    read->error = error;
+    if(error)
+    {
+        rafgl_free(read->data);
+        read->data = NULL;
+        read->size = 0;
+    }
+    if(read->ring) atomic_fetch_sub(&__vfs_in_flight, 1);
+    rafgl_jobs_counter_done(read->counter);
+}
+
+static void __vfs_read_job(void *data)
+{
+    rafgl_vfs_read_t *read = data;
+    __vfs_finish(read, __vfs_pread(read->fd, read->data, read->size, &read->done));
+}
+
+static int __vfs_enter(unsigned submit, unsigned wait)
+{
+    return syscall(__NR_io_uring_enter, __vfs_ring_fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+/* queues one sqe, read NULL is a nop that wakes the completion thread, returns 0 when the kernel took it */
+static int __vfs_submit(rafgl_vfs_read_t *read)
+{
+    int result;
+    pthread_mutex_lock(&__vfs_submit_mutex);
+
+    unsigned tail = *__vfs_sq_tail;
+    unsigned index = tail & *__vfs_sq_mask;
+    struct io_uring_sqe *sqe = &__vfs_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    if(read)
+    {
+        size_t chunk = read->size - read->done;
+        if(chunk > __RAFGL_VFS_MAX_READ) chunk = __RAFGL_VFS_MAX_READ;
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = read->fd;
+        sqe->addr = (uintptr_t)(read->data + read->done);
+        sqe->len = chunk;
+        sqe->off = read->done;
+    }
+    else
+    {
+        sqe->opcode = IORING_OP_NOP;
+    }
+    sqe->user_data = (uintptr_t)read;
+    __vfs_sq_array[index] = index;
+    __atomic_store_n(__vfs_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    do
+    {
+        result = __vfs_enter(1, 0);
+    } while(result < 0 && errno == EINTR);
+
+    if(result != 1)
+    {
+        /* the kernel did not consume it, take it back */
+        __atomic_store_n(__vfs_sq_tail, tail, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&__vfs_submit_mutex);
+    return result == 1 ? 0 : -1;
+}
+
+static void __vfs_complete(rafgl_vfs_read_t *read, int result)
+{
+    if(result == -EINTR || result == -EAGAIN) result = 0;
+    else if(result < 0)
+    {
+        __vfs_finish(read, -result);
+        return;
+    }
+    else if(result == 0)
+    {
+        __vfs_finish(read, EIO);
+        return;
+    }
+
+    read->done += result;
+    if(read->done < read->size)
+    {
+        if(__vfs_submit(read) == 0) return;
+        /* finish the rest the slow way */
+        __vfs_finish(read, __vfs_pread(read->fd, read->data, read->size, &read->done));
+        return;
+    }
+    __vfs_finish(read, 0);
+}
+
+static void* __vfs_thread_main(void *unused)
+{
+    (void)unused;
+    for(;;)
+    {
+        unsigned head = *__vfs_cq_head;
+        if(head == __atomic_load_n(__vfs_cq_tail, __ATOMIC_ACQUIRE))
+        {
+            if(atomic_load(&__vfs_stopping) && atomic_load(&__vfs_in_flight) == 0) break;
+            __vfs_enter(0, 1);
+            continue;
+        }
+
+        struct io_uring_cqe *cqe = &__vfs_cqes[head & *__vfs_cq_mask];
+        rafgl_vfs_read_t *read = (rafgl_vfs_read_t*)(uintptr_t)cqe->user_data;
+        int result = cqe->res;
+        __atomic_store_n(__vfs_cq_head, head + 1, __ATOMIC_RELEASE);
+
+        if(read) __vfs_complete(read, result);
+    }
+    return NULL;
+}
+
+static void __vfs_unmap_rings(void)
+{
+    if(__vfs_sqes) munmap(__vfs_sqes, __vfs_entries * sizeof(struct io_uring_sqe));
+    if(__vfs_cq_ring && __vfs_cq_ring != __vfs_sq_ring) munmap(__vfs_cq_ring, __vfs_cq_ring_size);
+    if(__vfs_sq_ring) munmap(__vfs_sq_ring, __vfs_sq_ring_size);
+    __vfs_sqes = NULL;
+    __vfs_sq_ring = __vfs_cq_ring = NULL;
+    close(__vfs_ring_fd);
+    __vfs_ring_fd = -1;
+}
+
+int rafgl_vfs_init(int queue_depth)
+{
+    if(__vfs_ring_fd >= 0) return 1;
+    if(queue_depth <= 0) return 0;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    __vfs_ring_fd = syscall(__NR_io_uring_setup, queue_depth, &params);
+    if(__vfs_ring_fd < 0) return 0;
+    __vfs_entries = params.sq_entries;
+
+    __vfs_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    __vfs_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if(__vfs_cq_ring_size > __vfs_sq_ring_size) __vfs_sq_ring_size = __vfs_cq_ring_size;
+        __vfs_cq_ring_size = __vfs_sq_ring_size;
+    }
+
+    __vfs_sq_ring = mmap(NULL, __vfs_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, __vfs_ring_fd, IORING_OFF_SQ_RING);
+    if(__vfs_sq_ring == MAP_FAILED) __vfs_sq_ring = NULL;
+    if(params.features & IORING_FEAT_SINGLE_MMAP) __vfs_cq_ring = __vfs_sq_ring;
+    else
+    {
+        __vfs_cq_ring = mmap(NULL, __vfs_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, __vfs_ring_fd, IORING_OFF_CQ_RING);
+        if(__vfs_cq_ring == MAP_FAILED) __vfs_cq_ring = NULL;
+    }
+    __vfs_sqes = mmap(NULL, __vfs_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, __vfs_ring_fd, IORING_OFF_SQES);
+    if(__vfs_sqes == MAP_FAILED) __vfs_sqes = NULL;
+    if(!__vfs_sq_ring || !__vfs_cq_ring || !__vfs_sqes)
+    {
+        __vfs_unmap_rings();
+        return 0;
+    }
+
+    unsigned char *sq = __vfs_sq_ring, *cq = __vfs_cq_ring;
+    __vfs_sq_head = (unsigned*)(sq + params.sq_off.head);
+    __vfs_sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    __vfs_sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    __vfs_sq_array = (unsigned*)(sq + params.sq_off.array);
+    __vfs_cq_head = (unsigned*)(cq + params.cq_off.head);
+    __vfs_cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    __vfs_cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    __vfs_cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    atomic_store(&__vfs_in_flight, 0);
+    atomic_store(&__vfs_stopping, 0);
+    if(pthread_create(&__vfs_thread, NULL, __vfs_thread_main, NULL) != 0)
+    {
+        __vfs_unmap_rings();
+        return 0;
+    }
+    return 1;
+}
+
+void rafgl_vfs_shutdown(void)
+{
+    if(__vfs_ring_fd < 0) return;
+
+    atomic_store(&__vfs_stopping, 1);
+    /* the nop wakes the completion thread, it leaves once nothing is in flight */
+    while(__vfs_submit(NULL) != 0) sched_yield();
+    pthread_join(__vfs_thread, NULL);
+    __vfs_unmap_rings();
+}
+
+void rafgl_vfs_read_async(rafgl_vfs_read_t *read, rafgl_jobs_counter_t *counter)
+{
+    read->data = NULL;
+    read->size = 0;
+    read->error = 0;
+    read->done = 0;
+    read->ring = 0;
+    read->counter = counter;
+    rafgl_jobs_counter_add(counter, 1);
+
+    read->fd = __vfs_open(read->path, read->tag, &read->data, &read->size);
+    if(read->fd < 0)
+    {
+        __vfs_finish(read, errno);
+        return;
+    }
+    if(read->size == 0)
+    {
+        __vfs_finish(read, 0);
+        return;
+    }
+
+    if(__vfs_ring_fd >= 0 && !atomic_load(&__vfs_stopping))
+    {
+        if(atomic_fetch_add(&__vfs_in_flight, 1) < (int)__vfs_entries)
+        {
+            read->ring = 1;
+            if(__vfs_submit(read) == 0) return;
+            read->ring = 0;
+        }
+        atomic_fetch_sub(&__vfs_in_flight, 1);
+    }
+
+    read->job.function = __vfs_read_job;
+    read->job.data = read;
+    rafgl_jobs_run(&read->job, 1, NULL);
+}
+
+int rafgl_vfs_read_all(const char *path, int tag, unsigned char **data, size_t *size)
+{
+    size_t done = 0;
+    int fd = __vfs_open(path, tag, data, size);
+    if(fd < 0)
+    {
+        *data = NULL;
+        *size = 0;
+        return errno;
+    }
+
+    int error = __vfs_pread(fd, *data, *size, &done);
+    close(fd);
+    if(error)
+    {
+        rafgl_free(*data);
+        *data = NULL;
+        *size = 0;
+    }
+    return error;
+}
+
+int rafgl_vfs_map(const char *path, rafgl_vfs_map_t *map, int hint)
+{
+    struct stat st;
+    map->data = NULL;
+    map->size = 0;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return errno;
+    if(fstat(fd, &st) != 0)
+    {
+        int error = errno;
+        close(fd);
+        return error;
+    }
+    if(st.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = data == MAP_FAILED ? errno : 0;
+    close(fd);
+    if(error) return error;
+
+    if(hint == RAFGL_VFS_SEQUENTIAL)
+    {
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        madvise(data, st.st_size, MADV_WILLNEED);
+    }
+    else
+    {
+        madvise(data, st.st_size, MADV_RANDOM);
+    }
+
+    map->data = data;
+    map->size = st.st_size;
+    return 0;
+}
+
+void rafgl_vfs_unmap(rafgl_vfs_map_t *map)
+{
+    if(map->data) munmap((void*)map->data, map->size);
+    map->data = NULL;
+    map->size = 0;
+}
+
+void rafgl_vfs_prefetch(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+}
+
+#endif // RAFGL_IMPLEMENTATION
+
+#endif // RAFGL_VFS_H_INCLUDED
@@ -0,0 +1,81 @@
+#ifndef SCENE_BVH_H
+#define SCENE_BVH_H
+
+#include <rafgl.h>
+
+// Bounding volume hierarchy over the world space AABBs of scene instances.
+// Items are small integers chosen by the caller (transform nodes in the
+// scene), an item is in the tree once it has bounds. The tree is built with
+// binned SAH splits and stored as 4 wide nodes whose child boxes sit in
+// structure of arrays form, so a query tests all four children of a node with
+// one SIMD kernel. Every subtree owns a contiguous run of the item order, so
+// a child found entirely inside a query volume is emitted without descending.
+// Moving items only refits the nodes above them; a rebuild happens when items
+// come or go or when refitting has let the SAH cost grow
+// SCENE_BVH_REBUILD_RATIO times past that of the last build. Queries walk the
+// tree with an explicit stack.
+
+#define SCENE_BVH_WIDTH 4
+#define SCENE_BVH_LEAF_SIZE 4        // most items a leaf child holds
+#define SCENE_BVH_BINS 16            // SAH candidates per axis
+#define SCENE_BVH_REBUILD_RATIO 1.5f
+#define SCENE_BVH_SAH_DEPTH 20       // deeper nodes split their items in half
+#define SCENE_BVH_STACK 128
+
+// Four child boxes, unused slots are cleared from valid
+typedef struct {
+    float min_x[SCENE_BVH_WIDTH], min_y[SCENE_BVH_WIDTH], min_z[SCENE_BVH_WIDTH];
+    float max_x[SCENE_BVH_WIDTH], max_y[SCENE_BVH_WIDTH], max_z[SCENE_BVH_WIDTH];
+    int child[SCENE_BVH_WIDTH];  // node index, -1 for a leaf
+    int first[SCENE_BVH_WIDTH];  // items below the child are order[first, first + count)
+    int count[SCENE_BVH_WIDTH];
+    int valid;                   // bit per used slot
+    int parent, parent_slot;     // -1 for the root
+    int dirty;                   // has to be refitted
+} SceneBvhNode;
+
+typedef struct {
+    int capacity;  // items are 0 to capacity - 1
+
+    // Per item world bounds, an item whose min.x > max.x is not in the tree
+    vec3_t *min, *max;
+    int *node;  // node of the leaf holding the item, -1 outside the tree
+
+    int item_count;  // items in the tree
+    int *order;      // items grouped by leaf
+    int node_count;
+    SceneBvhNode *nodes;  // parents always come before their children
+
+    int changed;       // items were added or removed since the last build
+    int dirty_count;   // items moved since the last update
+    int *dirty_items;
+    unsigned char *moved;  // item is in dirty_items
+    float built_cost;  // SAH cost right after the last build
+    float cost;        // after the last refit
+
+    int builds, refits;  // statistics
+} SceneBvh;
+
+void scene_bvh_init(SceneBvh *bvh, int capacity);
+void scene_bvh_cleanup(SceneBvh *bvh);
+
+// Adds the item or moves it, takes effect on the next scene_bvh_update()
+void scene_bvh_set_bounds(SceneBvh *bvh, int item, vec3_t min, vec3_t max);
+void scene_bvh_remove(SceneBvh *bvh, int item);
+
+// Refits the nodes above moved items, or rebuilds. Returns 1 after a rebuild.
+int scene_bvh_update(SceneBvh *bvh);
+void scene_bvh_build(SceneBvh *bvh);
+
+// The queries write the items whose bounds pass into items, which needs room
+// for item_count entries, and return how many they wrote. Bounds are tested
+// conservatively, an item may pass without the object itself being inside.
+int scene_bvh_query_frustum(const SceneBvh *bvh, const frustum_t *frustum, int *items);
+int scene_bvh_query_sphere(const SceneBvh *bvh, vec3_t center, float radius, int *items);
+
+// Item with the nearest bounds along the ray within max_distance, -1 if there
+// is none. distance receives where the ray enters those bounds.
+int scene_bvh_raycast(const SceneBvh *bvh, vec3_t origin, vec3_t direction, float max_distance,
+                      float *distance);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include <rafgl.h>
+
+// Instanced submission of meshes that share one rafgl_mesh_buffer_t. Every
+// frame the caller adds one instance per drawable, static_batch_end() sorts
+// them by (variant, mesh), uploads the whole instance stream once and merges
+// equal neighbours into draws. A pass then issues one glDrawArraysInstanced
+// per distinct mesh of a variant without ever switching the VAO. GL 3.3 has
+// no base instance, so the instance attribute offsets are moved between draws
+// instead.
+
+// Locations 0 to 3 are the rafgl_vertexPUN_t attributes
+#define STATIC_BATCH_ATTRIB_MODEL 4   // mat4, takes locations 4 to 7
+#define STATIC_BATCH_ATTRIB_PARAMS 8  // vec4, rgb = flat color, a = texture array layer
+
+// One element of the instance buffer
+typedef struct {
+    float model[16];
+    float params[4];
+} StaticInstance;
+
+// A run of instances of the same mesh, variant and condition
+typedef struct {
+    int variant;
+    unsigned int first_vertex, vertex_count;
+    int first_instance, instance_count;
+    GLuint condition;  // occlusion query the run is conditional on, 0 for none
+} StaticDraw;
+
+typedef struct {
+    unsigned long long key;  // variant in the high half, first vertex in the low half
+    unsigned int vertex_count;
+    GLuint condition;
+    StaticInstance instance;
+} StaticBatchEntry;
+
+typedef struct {
+    const rafgl_mesh_buffer_t *meshes;
+
+    int count, capacity;
+    StaticBatchEntry *entries;
+    StaticInstance *instances;  // sorted upload copy of entries
+
+    int draw_count;
+    StaticDraw *draws;
+
+    GLuint instance_buffer;
+} StaticBatch;
+
+// Adds the instance attributes to the VAO of meshes
+void static_batch_init(StaticBatch *batch, const rafgl_mesh_buffer_t *meshes, int capacity);
+void static_batch_cleanup(StaticBatch *batch);
+
+void static_batch_begin(StaticBatch *batch);
+// mesh has to live in the batch's mesh buffer, variant is any small non
+// negative number the caller groups programs by. Returns 0 when the instance
+// was not added.
+int static_batch_add(StaticBatch *batch, const rafgl_meshPUN_t *mesh, int variant,
+                     const mat4_t *model, vec3_t color, int layer);
+// Same, with the draw of the instance skipped by the GPU when query, a
+// GL_ANY_SAMPLES_PASSED query ended before the draw, saw no samples
+int static_batch_add_conditional(StaticBatch *batch, const rafgl_meshPUN_t *mesh, int variant,
+                                 const mat4_t *model, vec3_t color, int layer, GLuint query);
+void static_batch_end(StaticBatch *batch);
+
+// Draws every run of variant, or every run for STATIC_BATCH_ALL_VARIANTS,
+// with whatever program is bound. Returns the number of draw calls.
+#define STATIC_BATCH_ALL_VARIANTS -1
+int static_batch_draw(const StaticBatch *batch, int variant);
+// Ignores the conditions, for passes that run before their queries
+int static_batch_draw_unconditional(const StaticBatch *batch, int variant);
+// Draws instance_count instances of mesh from first_instance on of another
+// buffer of StaticInstance, such as one written on the GPU. Returns the
+// number of draw calls.
+int static_batch_draw_instances(const StaticBatch *batch, const rafgl_meshPUN_t *mesh,
+                                GLuint instance_buffer, int first_instance, int instance_count);
+
+#endif
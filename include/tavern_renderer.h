@@ -2,6 +2,7 @@
 #define TAVERN_RENDERER_H
 
 #include <rafgl.h>
+#include <texture_residency.h>
 
 typedef struct {
     GLuint framebuffer;
@@ -10,13 +11,11 @@ typedef struct {
     int width, height;
 } GBuffer;
 
+// Omnidirectional shadow map of one point light, the light itself lives in the LightSystem
 typedef struct {
-    vec3_t position;
-    vec3_t color;
-    float radius;
     GLuint shadowCubeMap;
     GLuint shadowFBO;
-} PointLight;
+} ShadowCubeMap;
 
 typedef struct {
     vec3_t position;
@@ -48,9 +47,9 @@ void fullscreen_quad_init(FullscreenQuad *quad);
 void fullscreen_quad_render(FullscreenQuad *quad);
 
 // Shadow mapping
-void setup_point_light_shadows(PointLight *light, int shadowWidth, int shadowHeight);
-void render_shadow_map(PointLight *light, rafgl_meshPUN_t *meshes, int meshCount, GLuint shadowProgram);
-void render_cube_shadow_map(PointLight *light, GLuint shadowProgram, void (*render_scene_func)(GLuint program));
+void setup_point_light_shadows(ShadowCubeMap *shadow, int shadowWidth, int shadowHeight);
+void render_cube_shadow_map(ShadowCubeMap *shadow, vec3_t lightPosition, GLuint shadowProgram, void (*render_scene_func)(GLuint program));
+void cleanup_point_light_shadows(ShadowCubeMap *shadow);
 
 // SSAO
 typedef struct {
@@ -65,12 +64,10 @@ void ssao_init(SSAOBuffer *ssao, int width, int height);
 
 // Texture management
 typedef struct {
-    rafgl_texture_t diffuse;
-    rafgl_texture_t normal;
-    rafgl_texture_t specular;
     int has_normal_map;
-    int has_specular_map;
-    float roughness;
+    int has_pbr_map;
+    int layer;              // in the TextureManager arrays
+    float roughness;        // fill the pbr layer when the material has no pbr map
     float metallic;
 } Material;
 
@@ -85,12 +82,23 @@ typedef struct {
     Material food_plate;
     Material wooden_stool;
     Material floor_material;
+
+    // Diffuse, normal and pbr maps of every textured material, one layer
+    // each, with mips streamed by residency. The pbr array is RGTC2,
+    // r = roughness, g = metallic.
+    rafgl_texture_t diffuse_array;
+    rafgl_texture_t normal_array;
+    rafgl_texture_t pbr_array;
+    int layer_count;
+    TextureResidency residency;
 } TextureManager;
 
 // Material & texture functions
 void texture_manager_init(TextureManager *tm);
 void texture_manager_cleanup(TextureManager *tm);
-void material_bind(Material *mat, GLuint shader_program);
+// Binds the material texture arrays to units 5 (diffuse), 6 (normal) and 7
+// (pbr) for the textured gbuffer variants
+void texture_manager_bind(TextureManager *tm);
 
 // Procedural geometry generation
 void create_cylinder_mesh(rafgl_meshPUN_t *mesh, float radius, float height, int segments);
@@ -98,9 +106,6 @@ void create_detailed_barrel_mesh(rafgl_meshPUN_t *mesh, float radius, float heig
 void create_ornate_chair_mesh(rafgl_meshPUN_t *mesh);
 void create_stone_corbel_mesh(rafgl_meshPUN_t *mesh);
 
-// Lighting
-void render_point_lights(PointLight *lights, int count, Camera *cam, GBuffer *gb);
-
 // Unified scene rendering
 typedef enum {
     RENDER_MODE_SHADOW,
@@ -0,0 +1,111 @@
+#ifndef TEXTURE_RESIDENCY_H
+#define TEXTURE_RESIDENCY_H
+
+#include <rafgl.h>
+#include <rafgl_jobs.h>
+
+// Mip residency for material texture arrays. Every few frames the scene is
+// drawn into a small feedback target that records, per pixel, the material
+// layer and the finest mip level it samples. The manager reads that back a
+// feedback later (so it never waits on the GPU), picks the finest level each
+// array needs, coarsens the biggest arrays until everything fits the budget
+// and then clamps GL_TEXTURE_BASE_LEVEL. Levels below the base are released,
+// finer levels are read through rafgl_vfs, decoded on the job system as each
+// read lands and uploaded once all layers are done.
+//
+// Layers of an array share their mip levels, so residency is per array: the
+// finest level any visible layer needs is kept for all of them.
+
+#define TEXTURE_RESIDENCY_MAX_ARRAYS 4
+#define TEXTURE_RESIDENCY_MAX_LAYERS 16
+#define TEXTURE_RESIDENCY_MIN_SIZE 64          // levels at least this big never leave
+#define TEXTURE_RESIDENCY_FEEDBACK_INTERVAL 8  // frames between feedback passes
+#define TEXTURE_RESIDENCY_FEEDBACK_SCALE 8     // feedback target is the screen divided by this
+#define TEXTURE_RESIDENCY_EVICT_DELAY 4        // feedbacks in a row that must want less detail
+
+typedef enum {
+    TEXTURE_FORMAT_RGBA8,
+    TEXTURE_FORMAT_RGTC2,  // two source channels, see texture_residency_set_channels
+} TextureFormat;
+
+typedef struct {
+    const char *path;        // NULL always uses fill
+    rafgl_pixel_rgb_t fill;  // layer contents when there is no image
+    int loaded;              // path decoded on the last load
+} ResidentLayer;
+
+// Levels [first, last) of one layer, produced by a streaming job
+typedef struct {
+    const ResidentLayer *layer;
+    TextureFormat format;
+    int channels[2];
+    int width, height;  // of level 0
+    int first, last;
+
+    rafgl_vfs_read_t read;  // the image file, freed by the job
+    rafgl_jobs_counter_t read_counter;
+    unsigned char *data;    // levels back to back in upload format
+    int loaded;
+} ResidentLevels;
+
+typedef struct {
+    rafgl_texture_t *texture;
+    TextureFormat format;
+    int channels[2];
+    int width, height, levels, layer_count;
+    ResidentLayer layers[TEXTURE_RESIDENCY_MAX_LAYERS];
+
+    int base_level;    // finest resident level, every coarser one is resident too
+    int wanted_level;  // finest level the last feedback asked for
+    int evict_votes;
+
+    // Streaming of levels [stream_level, base_level), -1 when idle
+    int stream_level;
+    rafgl_jobs_counter_t stream_counter;
+    rafgl_job_t jobs[TEXTURE_RESIDENCY_MAX_LAYERS];
+    ResidentLevels streamed[TEXTURE_RESIDENCY_MAX_LAYERS];
+} ResidentArray;
+
+typedef struct {
+    int count;
+    ResidentArray arrays[TEXTURE_RESIDENCY_MAX_ARRAYS];
+    size_t budget;
+    size_t reported_bytes;
+
+    // Feedback target (RG8UI: layer + 1, mip level) and its readback buffer
+    GLuint feedback_framebuffer, feedback_color, feedback_depth, feedback_pbo;
+    int feedback_width, feedback_height;
+    int feedback_pending;  // the pbo holds a readback nobody has looked at
+    int frame;
+} TextureResidency;
+
+void texture_residency_init(TextureResidency *tr, size_t budget);
+void texture_residency_cleanup(TextureResidency *tr);
+void texture_residency_set_budget(TextureResidency *tr, size_t budget);
+
+// texture is filled in by texture_residency_load(), returns the array index
+int texture_residency_add_array(TextureResidency *tr, rafgl_texture_t *texture,
+                                TextureFormat format, int layer_count);
+void texture_residency_set_layer(TextureResidency *tr, int array, int layer, const char *path,
+                                 rafgl_pixel_rgb_t fill);
+// Source image channels that become red and green of an RGTC2 array
+void texture_residency_set_channels(TextureResidency *tr, int array, int red, int green);
+
+// Sizes every array from its first image and loads the finest levels that fit
+// the budget, blocks until they are uploaded
+void texture_residency_load(TextureResidency *tr);
+int texture_residency_layer_loaded(const TextureResidency *tr, int array, int layer);
+
+// Feedback pass. begin() returns 0 on frames without one, otherwise it binds
+// the feedback target, and the caller draws the scene with the feedback
+// program before calling end().
+void texture_residency_feedback_init(TextureResidency *tr, int screen_width, int screen_height);
+int texture_residency_feedback_begin(TextureResidency *tr);
+void texture_residency_feedback_end(TextureResidency *tr);
+
+// Uploads finished streams, call once per frame
+void texture_residency_update(TextureResidency *tr);
+
+size_t texture_residency_resident_bytes(const TextureResidency *tr);
+
+#endif
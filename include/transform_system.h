@@ -0,0 +1,51 @@
+#ifndef TRANSFORM_SYSTEM_H
+#define TRANSFORM_SYSTEM_H
+
+#include <rafgl.h>
+
+// Flat transform hierarchy. Nodes live in parallel arrays sorted so that a
+// parent always comes before its children, which lets transform_system_update()
+// resolve the whole hierarchy in one forward pass. Only nodes whose local
+// matrix changed (or whose parent changed) get their world matrix recomputed,
+// render passes read the cached world matrices.
+
+#define TRANSFORM_NONE -1
+
+typedef struct {
+    int count;
+    int capacity;
+
+    int *parent;            // TRANSFORM_NONE for roots, otherwise a lower index
+    mat4_t *local;
+    mat4_t *world;
+    unsigned char *dirty;   // local changed since the last update
+
+    int dirty_count;        // nodes marked dirty since the last update
+
+    int *updated;           // nodes the last update recomputed
+    int updated_count;
+} TransformSystem;
+
+void transform_system_init(TransformSystem *ts, int capacity);
+void transform_system_cleanup(TransformSystem *ts);
+
+// Adds a node under parent (TRANSFORM_NONE for a root). The parent must
+// already exist, which keeps the arrays parent-sorted. Returns the node index,
+// -1 if the system is full.
+int transform_system_add(TransformSystem *ts, int parent, mat4_t local);
+void transform_system_set_local(TransformSystem *ts, int index, mat4_t local);
+
+// Recomputes world matrices of dirty nodes and their descendants, returns how
+// many were recomputed and lists them in updated
+int transform_system_update(TransformSystem *ts);
+
+static inline const mat4_t *transform_system_world(const TransformSystem *ts, int index) {
+    return &ts->world[index];
+}
+
+static inline vec3_t transform_system_world_position(const TransformSystem *ts, int index) {
+    const mat4_t *world = &ts->world[index];
+    return vec3(world->m30, world->m31, world->m32);
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -10,12 +11,19 @@
 
 #include <game_constants.h>
 #include <main_state.h>
+#include <benchmarks.h>
 
 int main(int argc, char *argv[])
 {
 
     rafgl_game_t game;
 
+    if(argc > 1 && strcmp(argv[1], "--bench") == 0)
+    {
+        benchmarks_run();
+        return 0;
+    }
+
     rafgl_game_init(&game, "D&D Tavern", 1280, 720, 0);
     rafgl_game_add_named_game_state(&game, main_state);
     rafgl_game_start(&game, NULL);
@@ -5,17 +5,32 @@ out vec4 FragColor;
 in vec2 TexCoord;
 
 uniform sampler2D gPosition;
-uniform sampler2D gNormal;
-uniform sampler2D gAlbedoSpec;
+uniform sampler2D gNormal;     // a = metallic
+uniform sampler2D gAlbedoSpec; // a = roughness
 uniform sampler2D ssaoTexture;
 
+#define MAX_LIGHTS 64 // LIGHT_SYSTEM_MAX_GPU_LIGHTS in light_system.h
+
+// Filled by light_system_upload(), std140 layout matches LightGPU
 struct Light {
-    vec3 Position;
-    vec3 Color;
-    float Radius;
+    vec4 PositionRadius; // xyz = position, w = radius
+    vec4 Color;          // rgb = color, a = flicker intensity
+};
+
+layout(std140) uniform LightBlock {
+    Light lights[MAX_LIGHTS];
 };
+// Variants: lights [FIRST_SHADOWED_LIGHT, FIRST_SHADOWED_LIGHT + NUM_SHADOWED_LIGHTS)
+// sample their shadow maps, the range is unrolled at compile time and the
+// caller keeps it below numLights
+#ifndef FIRST_SHADOWED_LIGHT
+#define FIRST_SHADOWED_LIGHT 0
+#endif
+#ifndef NUM_SHADOWED_LIGHTS
+#define NUM_SHADOWED_LIGHTS 0
+#endif
+#define LAST_SHADOWED_LIGHT (FIRST_SHADOWED_LIGHT + NUM_SHADOWED_LIGHTS)
 
-uniform Light lights[8];
 uniform samplerCube shadowMap0;
 uniform samplerCube shadowMap1;
 uniform samplerCube shadowMap2;
@@ -27,35 +42,15 @@ uniform samplerCube shadowMap7;
 uniform int numLights;
 uniform vec3 viewPos;
 uniform float far_plane;
-uniform int flashlightOnlyShadows;
 
-float ShadowCalculation(vec3 fragPos, int lightIndex)
+float ShadowCalculation(samplerCube shadowMap, vec3 fragPos, int lightIndex)
 {
     // Calculate vector from light to fragment for cube map sampling
-    vec3 lightToFrag = fragPos - lights[lightIndex].Position;
+    vec3 lightToFrag = fragPos - lights[lightIndex].PositionRadius.xyz;
     
     // Get distance to fragment (normalize to [0,1] range)
     float currentDepth = length(lightToFrag) / far_plane;
-    
-    // Sample cube map based on light index (support 0-7)
-    float closestDepth;
-    if(lightIndex == 0) {
-        closestDepth = texture(shadowMap0, lightToFrag).r;
-    } else if(lightIndex == 1) {
-        closestDepth = texture(shadowMap1, lightToFrag).r;
-    } else if(lightIndex == 2) {
-        closestDepth = texture(shadowMap2, lightToFrag).r;
-    } else if(lightIndex == 3) {
-        closestDepth = texture(shadowMap3, lightToFrag).r;
-    } else if(lightIndex == 4) {
-        closestDepth = texture(shadowMap4, lightToFrag).r;
-    } else if(lightIndex == 5) {
-        closestDepth = texture(shadowMap5, lightToFrag).r;
-    } else if(lightIndex == 6) {
-        closestDepth = texture(shadowMap6, lightToFrag).r;  // FLASHLIGHT!
-    } else {
-        return 0.0; // No shadow maps for lights beyond index 6 (only 7 lights total)
-    }
+    float closestDepth = texture(shadowMap, lightToFrag).r;
     
     // Shadow bias to prevent shadow acne
     float bias = 0.005;
@@ -66,53 +61,85 @@ float ShadowCalculation(vec3 fragPos, int lightIndex)
     return (currentDepth > closestDepth + bias) ? 0.8 : 0.0; // Darker shadows
 }
 
+// Attenuated diffuse + specular of one light, zero outside its radius.
+// Specular.rgb is the specular color, Specular.a the Blinn-Phong exponent.
+vec3 LightContribution(int i, vec3 FragPos, vec3 Normal, vec3 viewDir, vec3 Diffuse, vec4 Specular)
+{
+    float distance = length(lights[i].PositionRadius.xyz - FragPos);
+    if(distance >= lights[i].PositionRadius.w)
+        return vec3(0.0);
+
+    vec3 lightColor = lights[i].Color.rgb;
+    vec3 lightDir = normalize(lights[i].PositionRadius.xyz - FragPos);
+    vec3 diffuse = max(dot(Normal, lightDir), 0.0) * Diffuse * lightColor;
+    
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(Normal, halfwayDir), 0.0), Specular.a);
+    vec3 specular = lightColor * spec * Specular.rgb;
+    
+    float attenuation = 1.0 / (1.0 + 0.09 * distance + 0.032 * distance * distance);
+    return (diffuse + specular) * attenuation;
+}
+
+// Same as LightContribution, darkened by the light's shadow map
+vec3 ShadowedContribution(samplerCube shadowMap, int i, vec3 FragPos, vec3 Normal, vec3 viewDir, vec3 Diffuse, vec4 Specular)
+{
+    if(length(lights[i].PositionRadius.xyz - FragPos) >= lights[i].PositionRadius.w)
+        return vec3(0.0);
+
+    float shadowFactor = 1.0 - ShadowCalculation(shadowMap, FragPos, i);
+    return shadowFactor * LightContribution(i, FragPos, Normal, viewDir, Diffuse, Specular);
+}
+
 void main()
 {
     vec3 FragPos = texture(gPosition, TexCoord).rgb;
-    vec3 Normal = texture(gNormal, TexCoord).rgb;
-    vec3 Diffuse = texture(gAlbedoSpec, TexCoord).rgb;
-    float Specular = texture(gAlbedoSpec, TexCoord).a;
+    vec4 NormalMetallic = texture(gNormal, TexCoord);
+    vec4 AlbedoRoughness = texture(gAlbedoSpec, TexCoord);
+    vec3 Normal = NormalMetallic.rgb;
+    vec3 Albedo = AlbedoRoughness.rgb;
+
+    // Roughness picks the exponent and metals tint the highlight with their
+    // albedo. The normalisation keeps mid roughness at the old fixed response
+    // (exponent 64, strength 0.3).
+    float shininess = exp2(10.0 * (1.0 - AlbedoRoughness.a) + 1.0);
+    vec4 Specular = vec4(mix(vec3(0.3), Albedo, NormalMetallic.a) * (shininess + 8.0) / 72.0, shininess);
+    vec3 Diffuse = Albedo * (1.0 - NormalMetallic.a);
     
     float ssao = texture(ssaoTexture, TexCoord).r;
-    vec3 lighting = Diffuse * 0.05; // Very subtle ambient to see shadows
+    vec3 lighting = Albedo * 0.05; // Very subtle ambient to see shadows
     vec3 viewDir = normalize(viewPos - FragPos);
     
-    for(int i = 0; i < numLights; ++i)
-    {
-        float distance = length(lights[i].Position - FragPos);
-        if(distance < lights[i].Radius)
-        {
-            vec3 lightColor = lights[i].Color;
-            vec3 lightDir = normalize(lights[i].Position - FragPos);
-            vec3 diffuse = max(dot(Normal, lightDir), 0.0) * Diffuse * lightColor;
-            
-            vec3 halfwayDir = normalize(lightDir + viewDir);
-            float spec = pow(max(dot(Normal, halfwayDir), 0.0), 64.0);
-            vec3 specular = lightColor * spec * Specular;
-            
-            float attenuation = 1.0 / (1.0 + 0.09 * distance + 0.032 * distance * distance);
-            diffuse *= attenuation;
-            specular *= attenuation;
-            
-            // Shadow rendering based on mode
-            float shadow = 0.0;
-            if(flashlightOnlyShadows == 1) {
-                // FLASHLIGHT ONLY MODE: Only cast shadows from flashlight (index 6)
-                if(i == 6 && numLights > 6) { // Only flashlight shadows
-                    shadow = ShadowCalculation(FragPos, i);
-                }
-            } else {
-                // ALL LIGHTS MODE: Cast shadows from all lights (0-6)
-                if(i < 7 && numLights > 0) {
-                    shadow = ShadowCalculation(FragPos, i);
-                }
-            }
-            
-            // Apply shadows
-            float shadowFactor = (1.0 - shadow);
-            lighting += shadowFactor * (diffuse + specular);
-        }
-    }
+    for(int i = 0; i < FIRST_SHADOWED_LIGHT && i < numLights; ++i)
+        lighting += LightContribution(i, FragPos, Normal, viewDir, Diffuse, Specular);
+
+#if FIRST_SHADOWED_LIGHT <= 0 && 0 < LAST_SHADOWED_LIGHT
+    lighting += ShadowedContribution(shadowMap0, 0, FragPos, Normal, viewDir, Diffuse, Specular);
+#endif
+#if FIRST_SHADOWED_LIGHT <= 1 && 1 < LAST_SHADOWED_LIGHT
+    lighting += ShadowedContribution(shadowMap1, 1, FragPos, Normal, viewDir, Diffuse, Specular);
+#endif
+#if FIRST_SHADOWED_LIGHT <= 2 && 2 < LAST_SHADOWED_LIGHT
+    lighting += ShadowedContribution(shadowMap2, 2, FragPos, Normal, viewDir, Diffuse, Specular);
+#endif
+#if FIRST_SHADOWED_LIGHT <= 3 && 3 < LAST_SHADOWED_LIGHT
+    lighting += ShadowedContribution(shadowMap3, 3, FragPos, Normal, viewDir, Diffuse, Specular);
+#endif
+#if FIRST_SHADOWED_LIGHT <= 4 && 4 < LAST_SHADOWED_LIGHT
+    lighting += ShadowedContribution(shadowMap4, 4, FragPos, Normal, viewDir, Diffuse, Specular);
+#endif
+#if FIRST_SHADOWED_LIGHT <= 5 && 5 < LAST_SHADOWED_LIGHT
+    lighting += ShadowedContribution(shadowMap5, 5, FragPos, Normal, viewDir, Diffuse, Specular);
+#endif
+#if FIRST_SHADOWED_LIGHT <= 6 && 6 < LAST_SHADOWED_LIGHT
+    lighting += ShadowedContribution(shadowMap6, 6, FragPos, Normal, viewDir, Diffuse, Specular);
+#endif
+#if FIRST_SHADOWED_LIGHT <= 7 && 7 < LAST_SHADOWED_LIGHT
+    lighting += ShadowedContribution(shadowMap7, 7, FragPos, Normal, viewDir, Diffuse, Specular);
+#endif
+
+    for(int i = LAST_SHADOWED_LIGHT; i < numLights; ++i)
+        lighting += LightContribution(i, FragPos, Normal, viewDir, Diffuse, Specular);
     
     FragColor = vec4(lighting, 1.0);
-}
\ No newline at end of file
+}
@@ -0,0 +1,23 @@
+#version 330 core
+
+// Texture feedback, see texture_residency.h
+layout (location = 0) out uvec2 feedback; // x = material layer + 1 (0 = untextured), y = mip level
+
+in vec2 TexCoord;
+flat in float MaterialLayer;
+
+uniform vec2 materialTextureSize; // level 0 of the first material array
+uniform float lodBias;            // log2 of how much smaller than the screen the target is
+
+void main()
+{
+#ifdef TEXTURED
+    // Same level selection as the hardware, corrected for the smaller target
+    vec2 dx = dFdx(TexCoord * materialTextureSize);
+    vec2 dy = dFdy(TexCoord * materialTextureSize);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) - lodBias;
+    feedback = uvec2(uint(MaterialLayer) + 1u, uint(clamp(floor(lod), 0.0, 15.0)));
+#else
+    feedback = uvec2(0u);
+#endif
+}
@@ -0,0 +1,21 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+
+// Per instance, see static_batch.h
+layout (location = 4) in mat4 instanceModel;
+layout (location = 8) in vec4 instanceParams; // rgb = flat color, a = texture layer
+
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec2 TexCoord;
+flat out float MaterialLayer;
+
+void main()
+{
+    TexCoord = aTexCoord;
+    MaterialLayer = instanceParams.a;
+    gl_Position = projection * view * instanceModel * vec4(aPos, 1.0);
+}
@@ -1,28 +1,49 @@
 #version 330 core
 
 layout (location = 0) out vec3 gPosition;
-layout (location = 1) out vec3 gNormal;
-layout (location = 2) out vec4 gAlbedoSpec;
+layout (location = 1) out vec4 gNormal; // a = metallic
+layout (location = 2) out vec4 gAlbedoSpec; // a = roughness
 
 in vec3 FragPos;
 in vec2 TexCoord;
 in vec3 Normal;
+flat in vec3 MaterialColor;
+flat in float MaterialLayer;
 
-uniform sampler2D texture_diffuse1;
-uniform sampler2D texture_specular1;
-uniform vec3 materialColor;
-uniform float hasTexture;
+// Variants: TEXTURED samples the material's layer of the scene texture
+// arrays, diffuse plus roughness/metallic from the two channel pbr array,
+// otherwise the flat MaterialColor is used with a mid roughness. NORMALMAP
+// (with TEXTURED) also perturbs the normal with the layer's tangent space
+// normal map.
+
+#ifdef TEXTURED
+uniform sampler2DArray texture_diffuse_array;
+uniform sampler2DArray texture_pbr_array;
+#endif
+
+#ifdef NORMALMAP
+uniform sampler2DArray texture_normal_array;
+in vec3 Tangent;
+in vec3 Bitangent;
+#endif
 
 void main()
 {
     gPosition = FragPos;
-    gNormal = normalize(Normal);
+#ifdef NORMALMAP
+    vec3 tangentNormal = texture(texture_normal_array, vec3(TexCoord, MaterialLayer)).xyz * 2.0 - 1.0;
+    vec3 normal = normalize(mat3(Tangent, Bitangent, Normal) * tangentNormal);
+#else
+    vec3 normal = normalize(Normal);
+#endif
     
-    if (hasTexture > 0.5) {
-        gAlbedoSpec.rgb = texture(texture_diffuse1, TexCoord).rgb;
-        gAlbedoSpec.a = texture(texture_specular1, TexCoord).r;
-    } else {
-        gAlbedoSpec.rgb = materialColor;
-        gAlbedoSpec.a = 0.3; // Default specular
-    }
+#ifdef TEXTURED
+    vec2 roughnessMetallic = texture(texture_pbr_array, vec3(TexCoord, MaterialLayer)).rg;
+    gAlbedoSpec.rgb = texture(texture_diffuse_array, vec3(TexCoord, MaterialLayer)).rgb;
+#else
+    vec2 roughnessMetallic = vec2(0.5, 0.0);
+    gAlbedoSpec.rgb = MaterialColor;
+#endif
+    gNormal = vec4(normal, roughnessMetallic.y);
+    gAlbedoSpec.a = roughnessMetallic.x;
 }
\ No newline at end of file
@@ -3,20 +3,46 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord;
 layout (location = 2) in vec3 aNormal;
+layout (location = 3) in vec4 aTangent; // xy = octahedron encoded tangent, w = bitangent sign
+
+// Per instance, see static_batch.h
+layout (location = 4) in mat4 instanceModel;
+layout (location = 8) in vec4 instanceParams; // rgb = flat color, a = texture layer
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
 out vec3 FragPos;
 out vec2 TexCoord;
 out vec3 Normal;
+flat out vec3 MaterialColor;
+flat out float MaterialLayer;
+
+#ifdef NORMALMAP
+out vec3 Tangent;
+out vec3 Bitangent;
+
+vec3 oct_decode(vec2 e)
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0)
+        v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(v);
+}
+#endif
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
+    FragPos = vec3(instanceModel * vec4(aPos, 1.0));
     TexCoord = aTexCoord;
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    Normal = mat3(transpose(inverse(instanceModel))) * aNormal;
+    MaterialColor = instanceParams.rgb;
+    MaterialLayer = instanceParams.a;
+
+#ifdef NORMALMAP
+    Tangent = mat3(instanceModel) * oct_decode(aTangent.xy);
+    Bitangent = cross(Normal, Tangent) * (aTangent.w < 0.0 ? -1.0 : 1.0);
+#endif
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,29 @@
+#version 330 core
+
+// Emits the instance only when its sphere reaches into the frustum, so the
+// captured stream holds the survivors back to back
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+in mat4 vModel[];
+in vec4 vParams[];
+in vec4 vSphere[];
+
+out mat4 outModel;
+out vec4 outParams;
+
+uniform vec4 planes[6];
+uniform float margin;
+
+void main()
+{
+    vec4 sphere = vSphere[0];
+    for (int p = 0; p < 6; p++)
+        if (dot(planes[p].xyz, sphere.xyz) + planes[p].w < -(sphere.w + margin))
+            return;
+
+    outModel = vModel[0];
+    outParams = vParams[0];
+    EmitVertex();
+    EndPrimitive();
+}
@@ -0,0 +1,17 @@
+#version 330 core
+
+// One point per instance, see instance_cull.h
+layout (location = 4) in mat4 aModel;
+layout (location = 8) in vec4 aParams;
+layout (location = 9) in vec4 aSphere;
+
+out mat4 vModel;
+out vec4 vParams;
+out vec4 vSphere;
+
+void main()
+{
+    vModel = aModel;
+    vParams = aParams;
+    vSphere = aSphere;
+}
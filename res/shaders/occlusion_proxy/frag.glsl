@@ -0,0 +1,6 @@
+#version 330 core
+
+// Only the samples passing the depth test count, nothing is written
+void main()
+{
+}
@@ -1,15 +1,15 @@
 #version 330 core
 
 layout (location = 0) in vec3 aPos;
+layout (location = 4) in mat4 instanceModel; // see static_batch.h
 
 uniform mat4 lightProjection;
 uniform mat4 lightView;
-uniform mat4 model;
 
 out vec3 FragPos;
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
+    FragPos = vec3(instanceModel * vec4(aPos, 1.0));
     gl_Position = lightProjection * lightView * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,839 @@
+#include <benchmarks.h>
+#include <entity_store.h>
+#include <light_system.h>
+#include <occlusion_buffer.h>
+#include <portal_cells.h>
+#include <rafgl.h>
+#include <scene_bvh.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Benchmark sizes
+#define BENCH_REPEATS 5
+#define BENCH_SYNTHETIC_ITEMS (1 << 16)
+#define BENCH_SYNTHETIC_WORK 64
+#define BENCH_CULL_OBJECTS (1 << 20)
+#define BENCH_CULL_EXTENT 200.0f
+#define BENCH_LIGHTS 10000
+#define BENCH_LIGHT_BUDGET_US 100.0
+#define BENCH_ENTITIES 100000
+#define BENCH_OBJ_PATH "res/models/Plate with steak and drumstick/base.obj"
+#define BENCH_GLB_PATH "cache/bench_plate.glb"
+#define BENCH_BVH_LIGHTS 16
+#define BENCH_BVH_RAYS 1000
+#define BENCH_BVH_MOVED 10  // percent of the instances moved before a refit
+#define BENCH_OCCLUSION_WALLS 64
+#define BENCH_OCCLUSION_PROPS 10000
+#define BENCH_OCCLUSION_EXTENT 30.0f
+#define BENCH_INN_STOREYS 2
+#define BENCH_INN_ROOM 6.0f    // room pitch, walls sit on the grid lines
+#define BENCH_INN_STOREY 3.0f
+#define BENCH_INN_PROPS 32     // per room
+#define BENCH_INN_LIGHTS 16
+#define BENCH_INN_LIGHT_RADIUS 8.0f
+
+typedef void (*BenchFunction)(void *data);
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Small deterministic generator so every run builds the same scene
+static unsigned int bench_rand_state = 12345u;
+
+static float bench_randf(float lo, float hi) {
+    bench_rand_state = bench_rand_state * 1664525u + 1013904223u;
+    return lo + (hi - lo) * ((bench_rand_state >> 8) * (1.0f / 16777216.0f));
+}
+
+// Best time of BENCH_REPEATS runs, in milliseconds
+static double bench_measure(BenchFunction fn, void *data) {
+    double best = 1e30;
+    fn(data); // warm-up
+    for (int i = 0; i < BENCH_REPEATS; i++) {
+        double start = bench_now();
+        fn(data);
+        double elapsed = (bench_now() - start) * 1000.0;
+        if (elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+// Runs fn once per thread count from 1 to the core count and prints the speedup
+static void bench_scaling(const char *name, BenchFunction fn, void *data) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1)
+        cores = 1;
+    if (cores > RAFGL_JOBS_MAX_THREADS)
+        cores = RAFGL_JOBS_MAX_THREADS;
+
+    printf("\n%s\n", name);
+    printf("  threads      time(ms)   speedup\n");
+
+    double single = 0.0;
+    for (int threads = 1; threads <= cores; threads++) {
+        rafgl_jobs_init(threads - 1);
+        double ms = bench_measure(fn, data);
+        rafgl_jobs_shutdown();
+
+        if (threads == 1)
+            single = ms;
+        printf("  %7d  %12.3f  %8.2fx\n", threads, ms, single / ms);
+    }
+}
+
+// Synthetic workload: independent ALU-bound items, the best case for scaling
+typedef struct {
+    float *results;
+} SyntheticBench;
+
+static void synthetic_range(int begin, int end, void *data) {
+    SyntheticBench *bench = data;
+    for (int i = begin; i < end; i++) {
+        float x = (float)i * 0.001f;
+        for (int k = 0; k < BENCH_SYNTHETIC_WORK; k++)
+            x = x * 0.999f + sinf(x) * 0.001f;
+        bench->results[i] = x;
+    }
+}
+
+static void synthetic_run(void *data) {
+    rafgl_jobs_parallel_for(BENCH_SYNTHETIC_ITEMS, 256, synthetic_range, data);
+}
+
+// Real workload: bounding sphere vs frustum culling over a large generated scene
+typedef struct {
+    float *x, *y, *z, *radii;
+    unsigned char *visible;
+    frustum_t frustum;
+    int count;
+} CullBench;
+
+static void cull_range(int begin, int end, void *data) {
+    CullBench *bench = data;
+    frustum_spheres_batch(&bench->frustum, bench->x + begin, bench->y + begin,
+                          bench->z + begin, bench->radii + begin,
+                          bench->visible + begin, end - begin);
+}
+
+static void cull_run(void *data) {
+    CullBench *bench = data;
+    rafgl_jobs_parallel_for(bench->count, 4096, cull_range, bench);
+}
+
+// Single threaded comparison of the per-element math_3d calls with the batch APIs
+typedef struct {
+    vec3_t *points;
+    vec3_t *results;
+    CullBench *cull;
+    mat4_t matrix;
+    int count;
+} TransformBench;
+
+static void transform_scalar_run(void *data) {
+    TransformBench *bench = data;
+    for (int i = 0; i < bench->count; i++)
+        bench->results[i] = m4_mul_pos(bench->matrix, bench->points[i]);
+}
+
+static void transform_batch_run(void *data) {
+    TransformBench *bench = data;
+    m4_mul_pos_batch(bench->matrix, bench->points, bench->results, bench->count);
+}
+
+static void cull_scalar_run(void *data) {
+    CullBench *bench = data;
+    for (int i = 0; i < bench->count; i++)
+        bench->visible[i] = frustum_sphere(
+            &bench->frustum, vec3(bench->x[i], bench->y[i], bench->z[i]),
+            bench->radii[i]);
+}
+
+static void cull_batch_run(void *data) {
+    CullBench *bench = data;
+    cull_range(0, bench->count, bench);
+}
+
+static void bench_simd(CullBench *cull) {
+    TransformBench transform;
+    transform.count = cull->count;
+    transform.points = malloc(transform.count * sizeof(vec3_t));
+    transform.results = malloc(transform.count * sizeof(vec3_t));
+    transform.matrix = m4_mul(m4_translation(vec3(1.0f, 2.0f, 3.0f)),
+                              m4_rotation(0.5f, vec3(0.0f, 1.0f, 0.0f)));
+    for (int i = 0; i < transform.count; i++)
+        transform.points[i] = vec3(cull->x[i], cull->y[i], cull->z[i]);
+
+    double pos_scalar = bench_measure(transform_scalar_run, &transform);
+    double pos_batch = bench_measure(transform_batch_run, &transform);
+    double cull_scalar = bench_measure(cull_scalar_run, cull);
+    double cull_batch = bench_measure(cull_batch_run, cull);
+
+    printf("\nmath_3d batch kernels, 1 thread (%d elements)\n", cull->count);
+    printf("  %-24s %10s %10s %8s\n", "", "single", "batch", "speedup");
+    printf("  %-24s %10.3f %10.3f %7.2fx\n", "m4_mul_pos", pos_scalar, pos_batch,
+           pos_scalar / pos_batch);
+    printf("  %-24s %10.3f %10.3f %7.2fx\n", "frustum sphere test",
+           cull_scalar, cull_batch, cull_scalar / cull_batch);
+
+    free(transform.points);
+    free(transform.results);
+}
+
+// Light flicker animation for a scene far larger than the tavern, one thread
+typedef struct {
+    LightSystem lights;
+    float time;
+} LightBench;
+
+static void light_animate_run(void *data) {
+    LightBench *bench = data;
+    bench->time += 0.016f;
+    light_system_animate(&bench->lights, bench->time);
+}
+
+static void bench_lights(void) {
+    LightBench bench;
+    bench.time = 0.0f;
+    light_system_init(&bench.lights, BENCH_LIGHTS);
+    for (int i = 0; i < BENCH_LIGHTS; i++) {
+        LightDesc desc = {
+            .position = vec3(bench_randf(-BENCH_CULL_EXTENT, BENCH_CULL_EXTENT),
+                             bench_randf(0.0f, 3.0f),
+                             bench_randf(-BENCH_CULL_EXTENT, BENCH_CULL_EXTENT)),
+            .color = vec3(1.0f, 0.6f, 0.3f),
+            .radius = 8.0f,
+            .flicker_speed = bench_randf(2.0f, 3.5f),
+            .time_offset = bench_randf(0.0f, 6.0f),
+            .intensity_base = 0.85f,
+            .intensity_variation = 0.15f,
+            .jitter = vec3(0.005f, 0.01f, 0.005f)};
+        light_system_add(&bench.lights, &desc);
+    }
+
+    double us = bench_measure(light_animate_run, &bench) * 1000.0;
+    printf("\nlight animation, 1 thread (%d lights, %s kernel)\n", BENCH_LIGHTS,
+           light_system_kernel_name());
+    printf("  %.1f us per frame (budget %.0f us)\n", us, BENCH_LIGHT_BUDGET_US);
+
+    light_system_cleanup(&bench.lights);
+}
+
+// Entity iteration: a movement system over 100k entities spread across four
+// archetypes, against the same update over an array of per-object structs
+enum BenchComponent { BENCH_POSITION, BENCH_VELOCITY, BENCH_MESH, BENCH_TAG, BENCH_COMPONENT_COUNT };
+
+typedef struct {
+    vec3_t position;
+    vec3_t velocity;
+    mat4_t world;        // typical per-object payload the update does not touch
+    int mesh;
+    int flags;           // bit 0: moving
+} BenchObject;
+
+typedef struct {
+    EntityStore store;
+    BenchObject *objects;
+    int count;
+} EntityBench;
+
+static void entity_move_run(void *data) {
+    EntityBench *bench = data;
+    EntityQuery query;
+    entity_query_begin(&query, &bench->store,
+                       COMPONENT_BIT(BENCH_POSITION) | COMPONENT_BIT(BENCH_VELOCITY));
+    while (entity_query_next(&query)) {
+        vec3_t *positions = entity_query_column(&query, BENCH_POSITION);
+        vec3_t *velocities = entity_query_column(&query, BENCH_VELOCITY);
+        for (int i = 0; i < query.count; i++) {
+            positions[i].x += velocities[i].x * 0.016f;
+            positions[i].y += velocities[i].y * 0.016f;
+            positions[i].z += velocities[i].z * 0.016f;
+        }
+    }
+}
+
+static void object_move_run(void *data) {
+    EntityBench *bench = data;
+    for (int i = 0; i < bench->count; i++) {
+        BenchObject *object = &bench->objects[i];
+        if (!(object->flags & 1))
+            continue;
+        object->position.x += object->velocity.x * 0.016f;
+        object->position.y += object->velocity.y * 0.016f;
+        object->position.z += object->velocity.z * 0.016f;
+    }
+}
+
+static void entity_create_run(void *data) {
+    EntityBench *bench = data;
+    static const ComponentMask masks[4] = {
+        COMPONENT_BIT(BENCH_POSITION) | COMPONENT_BIT(BENCH_VELOCITY),
+        COMPONENT_BIT(BENCH_POSITION) | COMPONENT_BIT(BENCH_VELOCITY) | COMPONENT_BIT(BENCH_MESH),
+        COMPONENT_BIT(BENCH_POSITION) | COMPONENT_BIT(BENCH_MESH),
+        COMPONENT_BIT(BENCH_POSITION) | COMPONENT_BIT(BENCH_VELOCITY) | COMPONENT_BIT(BENCH_TAG)};
+    static const int sizes[BENCH_COMPONENT_COUNT] = {sizeof(vec3_t), sizeof(vec3_t), sizeof(int), 0};
+
+    entity_store_cleanup(&bench->store);
+    entity_store_init(&bench->store, sizes, BENCH_COMPONENT_COUNT);
+    for (int i = 0; i < bench->count; i++) {
+        EntityId entity = entity_create(&bench->store, masks[i & 3]);
+        vec3_t *velocity = entity_get(&bench->store, entity, BENCH_VELOCITY);
+        if (velocity)
+            *velocity = vec3(1.0f, 0.5f, -1.0f);
+    }
+}
+
+static void bench_entities(void) {
+    EntityBench bench;
+    bench.count = BENCH_ENTITIES;
+    memset(&bench.store, 0, sizeof(bench.store));
+    bench.objects = calloc(bench.count, sizeof(BenchObject));
+    for (int i = 0; i < bench.count; i++) {
+        bench.objects[i].velocity = vec3(1.0f, 0.5f, -1.0f);
+        bench.objects[i].flags = (i & 3) != 2;
+    }
+
+    double create = bench_measure(entity_create_run, &bench);
+    double archetype = bench_measure(entity_move_run, &bench);
+    double objects = bench_measure(object_move_run, &bench);
+
+    printf("\nentity iteration, 1 thread (%d entities, 4 archetypes)\n", bench.count);
+    printf("  %-24s %10.3f ms\n", "create", create);
+    printf("  %-24s %10.3f ms %8.2f ns/entity\n", "archetype move system",
+           archetype, archetype * 1e6 / bench.count);
+    printf("  %-24s %10.3f ms %8.2f ns/entity\n", "object array move",
+           objects, objects * 1e6 / bench.count);
+
+    entity_store_cleanup(&bench.store);
+    free(bench.objects);
+}
+
+// OBJ parsing: the largest model in the tree, one thread parses it in sequential
+// passes, more split it into pieces, every result must match the sequential one
+typedef struct {
+    rafgl_vertexPUN_t *reference;
+    unsigned int vertex_count;
+    int mismatches;
+} ObjBench;
+
+static void obj_load_run(void *data) {
+    ObjBench *bench = data;
+    rafgl_arena_t arena;
+    unsigned int count = 0;
+
+    rafgl_arena_init(&arena, "obj bench", RAFGL_MEM_MESH, RAFGL_LEVEL_ARENA_BLOCK);
+    rafgl_vertexPUN_t *vertices = rafgl_vertexPUN_load_OBJ(&arena, BENCH_OBJ_PATH, vec3(0.0f, 0.0f, 0.0f), &count, NULL);
+    rafgl_arena_free(&arena);
+
+    if (vertices == NULL || count != bench->vertex_count ||
+        memcmp(vertices, bench->reference, count * sizeof(rafgl_vertexPUN_t)) != 0)
+        bench->mismatches++;
+    rafgl_free(vertices);
+}
+
+static void bench_obj(void) {
+    ObjBench bench;
+    rafgl_arena_t arena;
+
+    // the job system is not running yet, so this is the sequential parse
+    rafgl_arena_init(&arena, "obj bench", RAFGL_MEM_MESH, RAFGL_LEVEL_ARENA_BLOCK);
+    bench.reference = rafgl_vertexPUN_load_OBJ(&arena, BENCH_OBJ_PATH, vec3(0.0f, 0.0f, 0.0f), &bench.vertex_count, NULL);
+    rafgl_arena_free(&arena);
+    bench.mismatches = 0;
+    if (bench.reference == NULL) {
+        printf("\nOBJ parsing: can't read %s\n", BENCH_OBJ_PATH);
+        return;
+    }
+
+    char name[160];
+    snprintf(name, sizeof(name), "OBJ parsing (%u vertices, %d byte pieces)", bench.vertex_count, RAFGL_OBJ_PIECE_BYTES);
+    bench_scaling(name, obj_load_run, &bench);
+    printf("  identical to the sequential parse: %s\n", bench.mismatches == 0 ? "yes" : "NO");
+
+    rafgl_free(bench.reference);
+}
+
+// The same model as OBJ and as a .glb written in the vertex layout, which the
+// loader copies out of the mapped file without touching a vertex
+static void glb_load_run(void *data) {
+    ObjBench *bench = data;
+    rafgl_arena_t arena;
+    unsigned int count = 0;
+
+    rafgl_arena_init(&arena, "glb bench", RAFGL_MEM_MESH, RAFGL_LEVEL_ARENA_BLOCK);
+    rafgl_vertexPUN_t *vertices = rafgl_vertexPUN_load_GLB(&arena, BENCH_GLB_PATH, &count);
+    rafgl_arena_free(&arena);
+    if (vertices == NULL || count != bench->vertex_count ||
+        memcmp(vertices, bench->reference, count * sizeof(rafgl_vertexPUN_t)) != 0)
+        bench->mismatches++;
+    rafgl_free(vertices);
+}
+
+static void bench_glb(void) {
+    ObjBench bench;
+    rafgl_arena_t arena;
+
+    rafgl_arena_init(&arena, "glb bench", RAFGL_MEM_MESH, RAFGL_LEVEL_ARENA_BLOCK);
+    bench.reference = rafgl_vertexPUN_load_OBJ(&arena, BENCH_OBJ_PATH, vec3(0.0f, 0.0f, 0.0f), &bench.vertex_count, NULL);
+    rafgl_arena_free(&arena);
+    bench.mismatches = 0;
+    mkdir("cache", 0755);
+    if (bench.reference == NULL ||
+        rafgl_vertexPUN_save_GLB(BENCH_GLB_PATH, bench.reference, bench.vertex_count, "plate") != 0) {
+        printf("\nOBJ and GLB loading: can't convert %s\n", BENCH_OBJ_PATH);
+        rafgl_free(bench.reference);
+        return;
+    }
+
+    double obj = bench_measure(obj_load_run, &bench);
+    double glb = bench_measure(glb_load_run, &bench);
+
+    printf("\nOBJ and GLB loading, 1 thread (%u vertices)\n", bench.vertex_count);
+    printf("  %-24s %10.3f ms\n", "OBJ", obj);
+    printf("  %-24s %10.3f ms %8.2fx\n", "GLB", glb, obj / glb);
+    printf("  identical to the OBJ: %s\n", bench.mismatches == 0 ? "yes" : "NO");
+
+    remove(BENCH_GLB_PATH);
+    rafgl_free(bench.reference);
+}
+
+// Scene BVH over scattered instance boxes: build, camera and light queries
+// against a linear walk over the same boxes, and a refit after some moved
+typedef struct {
+    SceneBvh bvh;
+    int count;
+    float *min_x, *min_y, *min_z, *max_x, *max_y, *max_z;  // linear walk copy
+    frustum_t camera;
+    frustum_t faces[BENCH_BVH_LIGHTS * 6];
+    vec3_t lights[BENCH_BVH_LIGHTS];
+    vec3_t ray_origins[BENCH_BVH_RAYS], ray_directions[BENCH_BVH_RAYS];
+    int *items;
+    int found;
+} BvhBench;
+
+static void bvh_build_run(void *data) {
+    BvhBench *bench = data;
+    scene_bvh_build(&bench->bvh);
+}
+
+static void bvh_camera_run(void *data) {
+    BvhBench *bench = data;
+    bench->found = scene_bvh_query_frustum(&bench->bvh, &bench->camera, bench->items);
+}
+
+static void bvh_linear_run(void *data) {
+    BvhBench *bench = data;
+    int found = 0;
+    for (int i = 0; i + 8 <= bench->count; i += 8) {
+        int mask = frustum_aabbs8(&bench->camera, bench->min_x + i, bench->min_y + i, bench->min_z + i,
+                                  bench->max_x + i, bench->max_y + i, bench->max_z + i);
+        while (mask) {
+            bench->items[found++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+    for (int i = bench->count & ~7; i < bench->count; i++) {
+        if (frustum_aabb(&bench->camera, vec3(bench->min_x[i], bench->min_y[i], bench->min_z[i]),
+                         vec3(bench->max_x[i], bench->max_y[i], bench->max_z[i])))
+            bench->items[found++] = i;
+    }
+    bench->found = found;
+}
+
+static void bvh_faces_run(void *data) {
+    BvhBench *bench = data;
+    bench->found = 0;
+    for (int f = 0; f < BENCH_BVH_LIGHTS * 6; f++)
+        bench->found += scene_bvh_query_frustum(&bench->bvh, &bench->faces[f], bench->items);
+}
+
+static void bvh_sphere_run(void *data) {
+    BvhBench *bench = data;
+    bench->found = 0;
+    for (int l = 0; l < BENCH_BVH_LIGHTS; l++)
+        bench->found += scene_bvh_query_sphere(&bench->bvh, bench->lights[l], 25.0f, bench->items);
+}
+
+static void bvh_ray_run(void *data) {
+    BvhBench *bench = data;
+    bench->found = 0;
+    for (int r = 0; r < BENCH_BVH_RAYS; r++)
+        bench->found += scene_bvh_raycast(&bench->bvh, bench->ray_origins[r], bench->ray_directions[r],
+                                          200.0f, NULL) >= 0;
+}
+
+// Nudges every tenth instance back and forth, then refits
+static void bvh_refit_run(void *data) {
+    BvhBench *bench = data;
+    static float offset = 0.05f;
+    offset = -offset;
+    for (int i = 0; i < bench->count; i += 100 / BENCH_BVH_MOVED) {
+        vec3_t move = vec3(offset, 0.0f, offset);
+        scene_bvh_set_bounds(&bench->bvh, i, v3_add(bench->bvh.min[i], move), v3_add(bench->bvh.max[i], move));
+    }
+    scene_bvh_update(&bench->bvh);
+}
+
+static void bench_bvh_size(int count) {
+    BvhBench *bench = malloc(sizeof(BvhBench));
+    bench->count = count;
+    bench->items = malloc(count * sizeof(int));
+    bench->min_x = malloc(count * sizeof(float));
+    bench->min_y = malloc(count * sizeof(float));
+    bench->min_z = malloc(count * sizeof(float));
+    bench->max_x = malloc(count * sizeof(float));
+    bench->max_y = malloc(count * sizeof(float));
+    bench->max_z = malloc(count * sizeof(float));
+
+    // Density stays that of a tavern filled town, the area grows with the count
+    float extent = sqrtf((float)count) * 0.5f;
+    scene_bvh_init(&bench->bvh, count);
+    for (int i = 0; i < count; i++) {
+        vec3_t center = vec3(bench_randf(-extent, extent), bench_randf(0.0f, 10.0f), bench_randf(-extent, extent));
+        vec3_t half = vec3(bench_randf(0.1f, 1.0f), bench_randf(0.1f, 1.0f), bench_randf(0.1f, 1.0f));
+        vec3_t min = v3_sub(center, half), max = v3_add(center, half);
+        scene_bvh_set_bounds(&bench->bvh, i, min, max);
+        bench->min_x[i] = min.x;
+        bench->min_y[i] = min.y;
+        bench->min_z[i] = min.z;
+        bench->max_x[i] = max.x;
+        bench->max_y[i] = max.y;
+        bench->max_z[i] = max.z;
+    }
+    scene_bvh_update(&bench->bvh);
+
+    mat4_t projection = m4_perspective(45.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+    bench->camera = frustum_from_m4(m4_mul(projection, m4_look_at(vec3(0.0f, 2.0f, 0.0f), vec3(1.0f, 2.0f, -1.0f),
+                                                                  vec3(0.0f, 1.0f, 0.0f))));
+
+    // Cube map faces of point lights, as render_cube_shadow_map() sets them up
+    const vec3_t directions[6][2] = {{{1, 0, 0}, {0, -1, 0}}, {{-1, 0, 0}, {0, -1, 0}}, {{0, 1, 0}, {0, 0, 1}},
+                                     {{0, -1, 0}, {0, 0, -1}}, {{0, 0, 1}, {0, -1, 0}}, {{0, 0, -1}, {0, -1, 0}}};
+    mat4_t face_projection = m4_perspective(90.0f, 1.0f, 0.1f, 25.0f);
+    for (int l = 0; l < BENCH_BVH_LIGHTS; l++) {
+        bench->lights[l] = vec3(bench_randf(-extent, extent), 3.0f, bench_randf(-extent, extent));
+        for (int f = 0; f < 6; f++) {
+            mat4_t view = m4_look_at(bench->lights[l], v3_add(bench->lights[l], directions[f][0]), directions[f][1]);
+            bench->faces[l * 6 + f] = frustum_from_m4(m4_mul(face_projection, view));
+        }
+    }
+    for (int r = 0; r < BENCH_BVH_RAYS; r++) {
+        bench->ray_origins[r] = vec3(bench_randf(-extent, extent), bench_randf(1.0f, 9.0f), bench_randf(-extent, extent));
+        bench->ray_directions[r] = v3_norm(vec3(bench_randf(-1.0f, 1.0f), bench_randf(-0.2f, 0.2f), bench_randf(-1.0f, 1.0f)));
+    }
+
+    double build = bench_measure(bvh_build_run, bench);
+    double linear = bench_measure(bvh_linear_run, bench);
+    int linear_found = bench->found;
+    double camera = bench_measure(bvh_camera_run, bench);
+    int camera_found = bench->found;
+    double faces = bench_measure(bvh_faces_run, bench);
+    double spheres = bench_measure(bvh_sphere_run, bench);
+    double rays = bench_measure(bvh_ray_run, bench);
+    double refit = bench_measure(bvh_refit_run, bench);
+
+    printf("  %9d %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f   %d/%d %s\n", count, build, linear, camera,
+           faces / (BENCH_BVH_LIGHTS * 6), spheres / BENCH_BVH_LIGHTS, rays * 1000.0 / BENCH_BVH_RAYS, refit,
+           camera_found, count, camera_found == linear_found ? "" : "MISMATCH");
+
+    scene_bvh_cleanup(&bench->bvh);
+    free(bench->items);
+    free(bench->min_x);
+    free(bench->min_y);
+    free(bench->min_z);
+    free(bench->max_x);
+    free(bench->max_y);
+    free(bench->max_z);
+    free(bench);
+}
+
+static void bench_bvh(void) {
+    printf("\nscene BVH, 1 thread (ms, face and sphere per query, ray in us, %d%% moved per refit)\n",
+           BENCH_BVH_MOVED);
+    printf("  %9s %9s %9s %9s %9s %9s %9s %9s   %s\n", "instances", "build", "linear", "camera", "face",
+           "sphere", "ray", "refit", "visible");
+    bench_bvh_size(10000);
+    bench_bvh_size(100000);
+}
+
+// CPU occlusion: wall boxes scattered like the rooms of a village around the
+// camera, the raster scaling over threads and tests of the props among them
+typedef struct {
+    OcclusionBuffer buffer;
+    mat4_t view_projection;
+    vec3_t wall_min[BENCH_OCCLUSION_WALLS], wall_max[BENCH_OCCLUSION_WALLS];
+    vec3_t prop_min[BENCH_OCCLUSION_PROPS], prop_max[BENCH_OCCLUSION_PROPS];
+    int prop_count, visible;
+} OcclusionBench;
+
+static void occlusion_raster_run(void *data) {
+    OcclusionBench *bench = data;
+    mat4_t identity = m4_identity();
+    occlusion_buffer_begin(&bench->buffer, bench->view_projection);
+    for (int i = 0; i < BENCH_OCCLUSION_WALLS; i++)
+        occlusion_buffer_add_box(&bench->buffer, &identity, bench->wall_min[i], bench->wall_max[i]);
+    occlusion_buffer_rasterize(&bench->buffer);
+}
+
+static void occlusion_test_run(void *data) {
+    OcclusionBench *bench = data;
+    bench->visible = 0;
+    for (int i = 0; i < bench->prop_count; i++)
+        bench->visible += occlusion_buffer_test(&bench->buffer, bench->prop_min[i], bench->prop_max[i]);
+}
+
+static void bench_occlusion(void) {
+    OcclusionBench *bench = malloc(sizeof(OcclusionBench));
+    occlusion_buffer_init(&bench->buffer, 256, 144);
+    for (int i = 0; i < BENCH_OCCLUSION_WALLS; i++) {
+        vec3_t center = vec3(bench_randf(-BENCH_OCCLUSION_EXTENT, BENCH_OCCLUSION_EXTENT), 1.5f,
+                             bench_randf(-BENCH_OCCLUSION_EXTENT, BENCH_OCCLUSION_EXTENT));
+        float length = bench_randf(2.0f, 8.0f);
+        vec3_t half = i % 2 ? vec3(length, 1.5f, 0.1f) : vec3(0.1f, 1.5f, length);
+        bench->wall_min[i] = v3_sub(center, half);
+        bench->wall_max[i] = v3_add(center, half);
+    }
+    mat4_t projection = m4_perspective(45.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+    bench->view_projection = m4_mul(projection, m4_look_at(vec3(0.0f, 1.7f, 0.0f), vec3(1.0f, 1.7f, -1.0f),
+                                                           vec3(0.0f, 1.0f, 0.0f)));
+
+    // Only props in the frustum are tested, as in the scene
+    frustum_t frustum = frustum_from_m4(bench->view_projection);
+    bench->prop_count = 0;
+    for (int i = 0; i < BENCH_OCCLUSION_PROPS; i++) {
+        vec3_t center = vec3(bench_randf(-BENCH_OCCLUSION_EXTENT, BENCH_OCCLUSION_EXTENT), bench_randf(0.0f, 2.0f),
+                             bench_randf(-BENCH_OCCLUSION_EXTENT, BENCH_OCCLUSION_EXTENT));
+        vec3_t half = vec3(bench_randf(0.05f, 0.3f), bench_randf(0.05f, 0.3f), bench_randf(0.05f, 0.3f));
+        vec3_t min = v3_sub(center, half), max = v3_add(center, half);
+        if (!frustum_aabb(&frustum, min, max))
+            continue;
+        bench->prop_min[bench->prop_count] = min;
+        bench->prop_max[bench->prop_count++] = max;
+    }
+
+    bench_scaling("CPU occlusion raster (64 walls, 256x144)", occlusion_raster_run, bench);
+    double test = bench_measure(occlusion_test_run, bench);
+    printf("  %d faces, %d props in the frustum tested in %.3f ms (%.3f us each), %d not occluded\n",
+           bench->buffer.polygon_count, bench->prop_count, test, test * 1000.0 / bench->prop_count,
+           bench->visible);
+
+    occlusion_buffer_cleanup(&bench->buffer);
+    free(bench);
+}
+
+// Portal visibility in a generated inn: a square grid of rooms on two
+// storeys, a door in every wall between neighbours and a hatch up from every
+// ground floor room, props scattered inside the rooms
+typedef struct {
+    PortalCells cells;
+    mat4_t view_projection;
+    vec3_t eye;
+    vec3_t lights[BENCH_INN_LIGHTS];
+    int prop_count;
+    vec3_t *prop_min, *prop_max;
+    int *prop_cell;
+    int camera_count, light_count;  // props in the frustum, in reach of a light
+    int *camera_props, *light_props;
+    int visible, lit;
+} InnBench;
+
+static void inn_camera_run(void *data) {
+    InnBench *bench = data;
+    portal_cells_query_camera(&bench->cells, bench->eye, bench->view_projection);
+    bench->visible = 0;
+    for (int i = 0; i < bench->camera_count; i++) {
+        int p = bench->camera_props[i];
+        bench->visible += portal_cells_test(&bench->cells, bench->prop_cell[p], bench->prop_min[p], bench->prop_max[p]);
+    }
+}
+
+static void inn_lights_run(void *data) {
+    InnBench *bench = data;
+    portal_cells_clear_lights(&bench->cells);
+    for (int l = 0; l < BENCH_INN_LIGHTS; l++)
+        portal_cells_add_light(&bench->cells, bench->lights[l], BENCH_INN_LIGHT_RADIUS);
+    bench->lit = 0;
+    for (int i = 0; i < bench->light_count; i++)
+        bench->lit += portal_cells_lit(&bench->cells, bench->prop_cell[bench->light_props[i]]);
+}
+
+// Interior of room (x, z) on storey y, inside its walls, floor and ceiling
+static void inn_room_bounds(int x, int y, int z, vec3_t *min, vec3_t *max) {
+    *min = vec3(x * BENCH_INN_ROOM + 0.1f, y * BENCH_INN_STOREY + 0.1f, z * BENCH_INN_ROOM + 0.1f);
+    *max = vec3((x + 1) * BENCH_INN_ROOM - 0.1f, (y + 1) * BENCH_INN_STOREY - 0.1f, (z + 1) * BENCH_INN_ROOM - 0.1f);
+}
+
+static void bench_inn_size(int side) {
+    InnBench *bench = malloc(sizeof(InnBench));
+    int rooms = side * side * BENCH_INN_STOREYS;
+    portal_cells_init(&bench->cells, rooms, rooms * 3);
+    for (int y = 0; y < BENCH_INN_STOREYS; y++)
+        for (int z = 0; z < side; z++)
+            for (int x = 0; x < side; x++) {
+                vec3_t min, max;
+                inn_room_bounds(x, y, z, &min, &max);
+                portal_cells_add_cell(&bench->cells, min, max);
+            }
+
+    // Doors are a metre wide and two high in the middle of the wall, hatches
+    // a metre square in a corner
+    for (int y = 0; y < BENCH_INN_STOREYS; y++)
+        for (int z = 0; z < side; z++)
+            for (int x = 0; x < side; x++) {
+                int cell = (y * side + z) * side + x;
+                float x0 = x * BENCH_INN_ROOM, y0 = y * BENCH_INN_STOREY + 0.1f, z0 = z * BENCH_INN_ROOM;
+                float middle = BENCH_INN_ROOM * 0.5f;
+                if (x + 1 < side) {
+                    float px = x0 + BENCH_INN_ROOM, pz = z0 + middle;
+                    const vec3_t door[4] = {{px, y0, pz - 0.5f}, {px, y0, pz + 0.5f}, {px, y0 + 2.0f, pz + 0.5f},
+                                            {px, y0 + 2.0f, pz - 0.5f}};
+                    portal_cells_add_portal(&bench->cells, cell, cell + 1, door);
+                }
+                if (z + 1 < side) {
+                    float px = x0 + middle, pz = z0 + BENCH_INN_ROOM;
+                    const vec3_t door[4] = {{px - 0.5f, y0, pz}, {px + 0.5f, y0, pz}, {px + 0.5f, y0 + 2.0f, pz},
+                                            {px - 0.5f, y0 + 2.0f, pz}};
+                    portal_cells_add_portal(&bench->cells, cell, cell + side, door);
+                }
+                if (y + 1 < BENCH_INN_STOREYS) {
+                    float py = (y + 1) * BENCH_INN_STOREY, px = x0 + BENCH_INN_ROOM - 1.5f,
+                          pz = z0 + BENCH_INN_ROOM - 1.5f;
+                    const vec3_t hatch[4] = {{px, py, pz}, {px + 1.0f, py, pz}, {px + 1.0f, py, pz + 1.0f},
+                                             {px, py, pz + 1.0f}};
+                    portal_cells_add_portal(&bench->cells, cell, cell + side * side, hatch);
+                }
+            }
+    portal_cells_finish(&bench->cells);
+
+    bench->prop_count = rooms * BENCH_INN_PROPS;
+    bench->prop_min = malloc(bench->prop_count * sizeof(vec3_t));
+    bench->prop_max = malloc(bench->prop_count * sizeof(vec3_t));
+    bench->prop_cell = malloc(bench->prop_count * sizeof(int));
+    bench->camera_props = malloc(bench->prop_count * sizeof(int));
+    bench->light_props = malloc(bench->prop_count * sizeof(int));
+    for (int i = 0; i < bench->prop_count; i++) {
+        int cell = i / BENCH_INN_PROPS;
+        vec3_t min = bench->cells.cell_min[cell], max = bench->cells.cell_max[cell];
+        vec3_t half = vec3(bench_randf(0.05f, 0.4f), bench_randf(0.05f, 0.4f), bench_randf(0.05f, 0.4f));
+        vec3_t center = vec3(bench_randf(min.x + half.x, max.x - half.x), min.y + half.y,
+                             bench_randf(min.z + half.z, max.z - half.z));
+        bench->prop_min[i] = v3_sub(center, half);
+        bench->prop_max[i] = v3_add(center, half);
+        bench->prop_cell[i] = cell;
+    }
+
+    // Standing in the corner room, looking down the diagonal of the grid
+    bench->eye = vec3(1.0f, 1.7f, 1.0f);
+    mat4_t projection = m4_perspective(60.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+    bench->view_projection = m4_mul(projection, m4_look_at(bench->eye, vec3(2.0f, 1.6f, 1.5f), vec3(0.0f, 1.0f, 0.0f)));
+    for (int l = 0; l < BENCH_INN_LIGHTS; l++) {
+        int cell = (int)bench_randf(0.0f, (float)rooms);
+        vec3_t min = bench->cells.cell_min[cell], max = bench->cells.cell_max[cell];
+        bench->lights[l] = vec3(bench_randf(min.x, max.x), max.y - 0.5f, bench_randf(min.z, max.z));
+    }
+
+    // Only props the frustum or a light sphere takes are tested, as in the scene
+    frustum_t frustum = frustum_from_m4(bench->view_projection);
+    bench->camera_count = bench->light_count = 0;
+    for (int i = 0; i < bench->prop_count; i++) {
+        if (frustum_aabb(&frustum, bench->prop_min[i], bench->prop_max[i]))
+            bench->camera_props[bench->camera_count++] = i;
+        for (int l = 0; l < BENCH_INN_LIGHTS; l++) {
+            vec3_t center = v3_muls(v3_add(bench->prop_min[i], bench->prop_max[i]), 0.5f);
+            if (v3_length(v3_sub(center, bench->lights[l])) < BENCH_INN_LIGHT_RADIUS) {
+                bench->light_props[bench->light_count++] = i;
+                break;
+            }
+        }
+    }
+
+    double camera = bench_measure(inn_camera_run, bench);
+    double lights = bench_measure(inn_lights_run, bench);
+    int lit_cells = 0;
+    for (int c = 0; c < rooms; c++)
+        lit_cells += bench->cells.lit[c];
+    printf("  %7d %7d %9.3f %7d %7d %7d/%-7d %9.3f %7d %7d/%d\n", rooms, bench->cells.portal_count, camera,
+           bench->cells.visited, bench->cells.visible_cells, bench->visible, bench->camera_count, lights,
+           lit_cells, bench->lit, bench->light_count);
+
+    portal_cells_cleanup(&bench->cells);
+    free(bench->prop_min);
+    free(bench->prop_max);
+    free(bench->prop_cell);
+    free(bench->camera_props);
+    free(bench->light_props);
+    free(bench);
+}
+
+static void bench_inn(void) {
+    printf("\nportal cells of a generated inn, %d storeys, %d props per room, %d lights, 1 thread (ms)\n",
+           BENCH_INN_STOREYS, BENCH_INN_PROPS, BENCH_INN_LIGHTS);
+    printf("  %7s %7s %9s %7s %7s %15s %9s %7s %s\n", "rooms", "portals", "camera", "visits", "seen",
+           "props/frustum", "lights", "lit", "props/in reach");
+    bench_inn_size(4);
+    bench_inn_size(8);
+    bench_inn_size(16);
+    bench_inn_size(32);
+}
+
+void benchmarks_run(void) {
+    printf("rafgl benchmarks (%ld cores online)\n",
+           sysconf(_SC_NPROCESSORS_ONLN));
+
+    SyntheticBench synthetic;
+    synthetic.results = malloc(BENCH_SYNTHETIC_ITEMS * sizeof(float));
+    bench_scaling("synthetic ALU workload (65536 items)", synthetic_run,
+                  &synthetic);
+    free(synthetic.results);
+
+    CullBench cull;
+    cull.count = BENCH_CULL_OBJECTS;
+    cull.x = malloc(cull.count * sizeof(float));
+    cull.y = malloc(cull.count * sizeof(float));
+    cull.z = malloc(cull.count * sizeof(float));
+    cull.radii = malloc(cull.count * sizeof(float));
+    cull.visible = malloc(cull.count);
+    for (int i = 0; i < cull.count; i++) {
+        cull.x[i] = bench_randf(-BENCH_CULL_EXTENT, BENCH_CULL_EXTENT);
+        cull.y[i] = bench_randf(-10.0f, 10.0f);
+        cull.z[i] = bench_randf(-BENCH_CULL_EXTENT, BENCH_CULL_EXTENT);
+        cull.radii[i] = bench_randf(0.25f, 2.0f);
+    }
+
+    mat4_t projection = m4_perspective(75.0f, 16.0f / 9.0f, 0.1f, 150.0f);
+    mat4_t view = m4_look_at(vec3(0.0f, 2.0f, 0.0f), vec3(1.0f, 2.0f, -1.0f),
+                             vec3(0.0f, 1.0f, 0.0f));
+    cull.frustum = frustum_from_m4(m4_mul(projection, view));
+
+    bench_scaling("sphere frustum culling (1048576 objects)", cull_run, &cull);
+
+    int visible = 0;
+    for (int i = 0; i < cull.count; i++)
+        visible += cull.visible[i];
+    printf("  visible objects: %d / %d\n", visible, cull.count);
+
+    bench_simd(&cull);
+    bench_lights();
+    bench_entities();
+    bench_obj();
+    bench_glb();
+    bench_bvh();
+    bench_occlusion();
+    bench_inn();
+
+    free(cull.x);
+    free(cull.y);
+    free(cull.z);
+    free(cull.radii);
+    free(cull.visible);
+}
@@ -0,0 +1,256 @@
+#include <entity_store.h>
+#include <rafgl_memory.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ENTITY_INDEX_BITS 24
+#define ENTITY_INDEX_MASK ((1u << ENTITY_INDEX_BITS) - 1)
+#define ENTITY_COLUMN_ALIGN 16
+
+static int entity_index(EntityId entity) {
+    return (int)(entity & ENTITY_INDEX_MASK);
+}
+
+static EntityId entity_make_id(const EntityStore *store, int index) {
+    return ((EntityId)store->entity_generation[index] << ENTITY_INDEX_BITS) | (EntityId)index;
+}
+
+void entity_store_init(EntityStore *store, const int *component_size, int component_count) {
+    memset(store, 0, sizeof(EntityStore));
+    store->component_count = component_count;
+    memcpy(store->component_size, component_size, component_count * sizeof(int));
+}
+
+void entity_store_cleanup(EntityStore *store) {
+    for (int a = 0; a < store->archetype_count; a++) {
+        Archetype *arch = &store->archetypes[a];
+        for (int c = 0; c < arch->chunk_count; c++)
+            rafgl_free(arch->chunks[c].entities);
+        rafgl_free(arch->chunks);
+    }
+    rafgl_free(store->archetypes);
+    rafgl_free(store->entity_archetype);
+    rafgl_free(store->entity_chunk);
+    rafgl_free(store->entity_row);
+    rafgl_free(store->entity_generation);
+    rafgl_free(store->free_list);
+    memset(store, 0, sizeof(EntityStore));
+}
+
+static int archetype_find(EntityStore *store, ComponentMask mask) {
+    for (int a = 0; a < store->archetype_count; a++)
+        if (store->archetypes[a].mask == mask)
+            return a;
+
+    if (store->archetype_count == store->archetype_capacity) {
+        store->archetype_capacity = store->archetype_capacity ? store->archetype_capacity * 2 : 8;
+        store->archetypes = rafgl_realloc(RAFGL_MEM_SCENE, store->archetypes, store->archetype_capacity * sizeof(Archetype));
+    }
+
+    Archetype *arch = &store->archetypes[store->archetype_count];
+    memset(arch, 0, sizeof(Archetype));
+    arch->mask = mask;
+
+    // Column layout inside a chunk: entity ids first, then one aligned
+    // column per component in the mask
+    int offset = ENTITY_CHUNK_CAPACITY * sizeof(EntityId);
+    for (int type = 0; type < store->component_count; type++) {
+        if (!(mask & COMPONENT_BIT(type)))
+            continue;
+        offset = (offset + ENTITY_COLUMN_ALIGN - 1) & ~(ENTITY_COLUMN_ALIGN - 1);
+        arch->column_offset[type] = offset;
+        offset += ENTITY_CHUNK_CAPACITY * store->component_size[type];
+    }
+    arch->row_size = offset;
+
+    return store->archetype_count++;
+}
+
+static EntityChunk *archetype_add_chunk(EntityStore *store, Archetype *arch) {
+    if (arch->chunk_count == arch->chunk_capacity) {
+        arch->chunk_capacity = arch->chunk_capacity ? arch->chunk_capacity * 2 : 4;
+        arch->chunks = rafgl_realloc(RAFGL_MEM_SCENE, arch->chunks, arch->chunk_capacity * sizeof(EntityChunk));
+    }
+
+    EntityChunk *chunk = &arch->chunks[arch->chunk_count++];
+    memset(chunk, 0, sizeof(EntityChunk));
+
+    unsigned char *data = rafgl_aligned_alloc(RAFGL_MEM_SCENE, ENTITY_COLUMN_ALIGN,
+        (arch->row_size + ENTITY_COLUMN_ALIGN - 1) & ~(ENTITY_COLUMN_ALIGN - 1));
+    chunk->entities = (EntityId *)data;
+    for (int type = 0; type < store->component_count; type++)
+        if (arch->mask & COMPONENT_BIT(type))
+            chunk->columns[type] = data + arch->column_offset[type];
+
+    return chunk;
+}
+
+// Appends a zeroed row, chunks are kept dense so only the last one has room
+static void archetype_push(EntityStore *store, int archetype, int index) {
+    Archetype *arch = &store->archetypes[archetype];
+    EntityChunk *chunk = arch->chunk_count ? &arch->chunks[arch->chunk_count - 1] : NULL;
+    if (!chunk || chunk->count == ENTITY_CHUNK_CAPACITY)
+        chunk = archetype_add_chunk(store, arch);
+
+    int row = chunk->count++;
+    chunk->entities[row] = entity_make_id(store, index);
+    for (int type = 0; type < store->component_count; type++)
+        if (arch->mask & COMPONENT_BIT(type))
+            memset((unsigned char *)chunk->columns[type] + row * store->component_size[type], 0,
+                   store->component_size[type]);
+
+    arch->entity_count++;
+    store->entity_archetype[index] = archetype;
+    store->entity_chunk[index] = arch->chunk_count - 1;
+    store->entity_row[index] = row;
+}
+
+// Fills the hole with the archetype's last row
+static void archetype_remove(EntityStore *store, int archetype, int chunk_index, int row) {
+    Archetype *arch = &store->archetypes[archetype];
+    EntityChunk *chunk = &arch->chunks[chunk_index];
+    EntityChunk *last = &arch->chunks[arch->chunk_count - 1];
+    int last_row = last->count - 1;
+
+    if (chunk != last || row != last_row) {
+        for (int type = 0; type < store->component_count; type++) {
+            if (!(arch->mask & COMPONENT_BIT(type)))
+                continue;
+            int size = store->component_size[type];
+            memcpy((unsigned char *)chunk->columns[type] + row * size,
+                   (unsigned char *)last->columns[type] + last_row * size, size);
+        }
+
+        EntityId moved = last->entities[last_row];
+        chunk->entities[row] = moved;
+        store->entity_chunk[entity_index(moved)] = chunk_index;
+        store->entity_row[entity_index(moved)] = row;
+    }
+
+    arch->entity_count--;
+    if (--last->count == 0) {
+        rafgl_free(last->entities);
+        arch->chunk_count--;
+    }
+}
+
+EntityId entity_create(EntityStore *store, ComponentMask mask) {
+    int index;
+    if (store->free_count > 0) {
+        index = store->free_list[--store->free_count];
+    } else {
+        if (store->entity_count == store->entity_capacity) {
+            int capacity = store->entity_capacity ? store->entity_capacity * 2 : 256;
+            if (capacity > (int)ENTITY_INDEX_MASK + 1)
+                return ENTITY_NONE;
+            store->entity_archetype = rafgl_realloc(RAFGL_MEM_SCENE, store->entity_archetype, capacity * sizeof(int));
+            store->entity_chunk = rafgl_realloc(RAFGL_MEM_SCENE, store->entity_chunk, capacity * sizeof(int));
+            store->entity_row = rafgl_realloc(RAFGL_MEM_SCENE, store->entity_row, capacity * sizeof(int));
+            store->entity_generation = rafgl_realloc(RAFGL_MEM_SCENE, store->entity_generation, capacity);
+            store->free_list = rafgl_realloc(RAFGL_MEM_SCENE, store->free_list, capacity * sizeof(int));
+            store->entity_capacity = capacity;
+        }
+        index = store->entity_count++;
+        // Generation 0 is never used, so no live id equals ENTITY_NONE
+        store->entity_generation[index] = 1;
+    }
+
+    archetype_push(store, archetype_find(store, mask), index);
+    return entity_make_id(store, index);
+}
+
+int entity_alive(const EntityStore *store, EntityId entity) {
+    int index = entity_index(entity);
+    return entity != ENTITY_NONE && index < store->entity_count &&
+           entity_make_id(store, index) == entity && store->entity_archetype[index] >= 0;
+}
+
+void entity_destroy(EntityStore *store, EntityId entity) {
+    if (!entity_alive(store, entity))
+        return;
+
+    int index = entity_index(entity);
+    archetype_remove(store, store->entity_archetype[index], store->entity_chunk[index],
+                     store->entity_row[index]);
+    store->entity_archetype[index] = -1;
+
+    if (++store->entity_generation[index] == 0)
+        store->entity_generation[index] = 1;
+    store->free_list[store->free_count++] = index;
+}
+
+ComponentMask entity_mask(const EntityStore *store, EntityId entity) {
+    if (!entity_alive(store, entity))
+        return 0;
+    return store->archetypes[store->entity_archetype[entity_index(entity)]].mask;
+}
+
+void entity_set_mask(EntityStore *store, EntityId entity, ComponentMask mask) {
+    if (!entity_alive(store, entity))
+        return;
+
+    int index = entity_index(entity);
+    int old_archetype = store->entity_archetype[index];
+    int old_chunk = store->entity_chunk[index];
+    int old_row = store->entity_row[index];
+    if (store->archetypes[old_archetype].mask == mask)
+        return;
+
+    int new_archetype = archetype_find(store, mask);
+    archetype_push(store, new_archetype, index);
+
+    // archetype_find may have moved the archetype array, look both up again
+    Archetype *from = &store->archetypes[old_archetype];
+    Archetype *to = &store->archetypes[new_archetype];
+    EntityChunk *src = &from->chunks[old_chunk];
+    EntityChunk *dst = &to->chunks[store->entity_chunk[index]];
+    int row = store->entity_row[index];
+    for (int type = 0; type < store->component_count; type++) {
+        if (!(from->mask & to->mask & COMPONENT_BIT(type)))
+            continue;
+        int size = store->component_size[type];
+        memcpy((unsigned char *)dst->columns[type] + row * size,
+               (unsigned char *)src->columns[type] + old_row * size, size);
+    }
+
+    archetype_remove(store, old_archetype, old_chunk, old_row);
+}
+
+void *entity_get(EntityStore *store, EntityId entity, int type) {
+    if (!entity_alive(store, entity))
+        return NULL;
+
+    int index = entity_index(entity);
+    Archetype *arch = &store->archetypes[store->entity_archetype[index]];
+    if (!(arch->mask & COMPONENT_BIT(type)))
+        return NULL;
+
+    EntityChunk *chunk = &arch->chunks[store->entity_chunk[index]];
+    return (unsigned char *)chunk->columns[type] + store->entity_row[index] * store->component_size[type];
+}
+
+void entity_query_begin(EntityQuery *query, EntityStore *store, ComponentMask mask) {
+    memset(query, 0, sizeof(EntityQuery));
+    query->store = store;
+    query->mask = mask;
+    query->archetype = 0;
+    query->chunk = -1;
+}
+
+int entity_query_next(EntityQuery *query) {
+    EntityStore *store = query->store;
+    while (query->archetype < store->archetype_count) {
+        Archetype *arch = &store->archetypes[query->archetype];
+        if ((arch->mask & query->mask) == query->mask && ++query->chunk < arch->chunk_count) {
+            EntityChunk *chunk = &arch->chunks[query->chunk];
+            query->count = chunk->count;
+            query->entities = chunk->entities;
+            query->columns = chunk->columns;
+            return 1;
+        }
+        query->archetype++;
+        query->chunk = -1;
+    }
+    return 0;
+}
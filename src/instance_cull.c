@@ -0,0 +1,163 @@
+#include <instance_cull.h>
+#include <rafgl_memory.h>
+
+#include <stddef.h>
+#include <string.h>
+
+void instance_cull_init(InstanceCull *cull, const rafgl_meshPUN_t *mesh, int capacity) {
+    memset(cull, 0, sizeof(InstanceCull));
+    cull->mesh = mesh;
+    cull->capacity = capacity;
+    cull->instances = rafgl_malloc(RAFGL_MEM_SCENE, capacity * sizeof(StaticInstance));
+    cull->spheres = rafgl_malloc(RAFGL_MEM_SCENE, capacity * 4 * sizeof(float));
+
+    glGenBuffers(1, &cull->source_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, cull->source_buffer);
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(StaticInstance), NULL, GL_STATIC_DRAW);
+    glGenBuffers(1, &cull->sphere_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, cull->sphere_buffer);
+    glBufferData(GL_ARRAY_BUFFER, capacity * 4 * sizeof(float), NULL, GL_STATIC_DRAW);
+
+    glGenBuffers(INSTANCE_CULL_LATENCY, cull->outputs);
+    for (int i = 0; i < INSTANCE_CULL_LATENCY; i++) {
+        glBindBuffer(GL_ARRAY_BUFFER, cull->outputs[i]);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(StaticInstance), NULL, GL_STREAM_COPY);
+        cull->output_frame[i] = -1;
+        cull->output_count[i] = -1;
+    }
+    glGenQueries(INSTANCE_CULL_LATENCY, cull->queries);
+    cull->ready = -1;
+
+    // One point per instance, the StaticInstance attributes at the locations
+    // the batch uses and the sphere after them
+    glGenVertexArrays(1, &cull->vao);
+    glBindVertexArray(cull->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, cull->source_buffer);
+    for (int column = 0; column < 4; column++) {
+        glVertexAttribPointer(STATIC_BATCH_ATTRIB_MODEL + column, 4, GL_FLOAT, GL_FALSE,
+                              sizeof(StaticInstance), (void *)(column * 4 * sizeof(float)));
+        glEnableVertexAttribArray(STATIC_BATCH_ATTRIB_MODEL + column);
+    }
+    glVertexAttribPointer(STATIC_BATCH_ATTRIB_PARAMS, 4, GL_FLOAT, GL_FALSE, sizeof(StaticInstance),
+                          (void *)offsetof(StaticInstance, params));
+    glEnableVertexAttribArray(STATIC_BATCH_ATTRIB_PARAMS);
+    glBindBuffer(GL_ARRAY_BUFFER, cull->sphere_buffer);
+    glVertexAttribPointer(INSTANCE_CULL_ATTRIB_SPHERE, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(INSTANCE_CULL_ATTRIB_SPHERE);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    const char *varyings[] = {"outModel", "outParams"};
+    cull->program = rafgl_program_create_feedback("instance_cull", varyings, 2);
+    cull->planes = glGetUniformLocation(cull->program, "planes");
+    cull->margin = glGetUniformLocation(cull->program, "margin");
+}
+
+void instance_cull_cleanup(InstanceCull *cull) {
+    glDeleteProgram(cull->program);
+    glDeleteVertexArrays(1, &cull->vao);
+    glDeleteQueries(INSTANCE_CULL_LATENCY, cull->queries);
+    glDeleteBuffers(INSTANCE_CULL_LATENCY, cull->outputs);
+    glDeleteBuffers(1, &cull->source_buffer);
+    glDeleteBuffers(1, &cull->sphere_buffer);
+    rafgl_free(cull->instances);
+    rafgl_free(cull->spheres);
+    memset(cull, 0, sizeof(InstanceCull));
+}
+
+int instance_cull_add(InstanceCull *cull, const mat4_t *model, vec3_t color, int layer,
+                      vec3_t center, float radius) {
+    if (cull->count == cull->capacity)
+        return 0;
+
+    int i = cull->count++;
+    StaticInstance *instance = &cull->instances[i];
+    memcpy(instance->model, model->m, sizeof(instance->model));
+    instance->params[0] = color.x;
+    instance->params[1] = color.y;
+    instance->params[2] = color.z;
+    instance->params[3] = (float)layer;
+    float *sphere = &cull->spheres[i * 4];
+    sphere[0] = center.x;
+    sphere[1] = center.y;
+    sphere[2] = center.z;
+    sphere[3] = radius;
+    return 1;
+}
+
+void instance_cull_upload(InstanceCull *cull) {
+    glBindBuffer(GL_ARRAY_BUFFER, cull->source_buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, cull->count * sizeof(StaticInstance), cull->instances);
+    glBindBuffer(GL_ARRAY_BUFFER, cull->sphere_buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, cull->count * 4 * sizeof(float), cull->spheres);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    instance_cull_reset(cull);
+}
+
+void instance_cull_reset(InstanceCull *cull) {
+    // A pass still in flight is forgotten, its query is simply begun again
+    for (int i = 0; i < INSTANCE_CULL_LATENCY; i++)
+        cull->output_frame[i] = cull->output_count[i] = -1;
+    cull->ready = -1;
+}
+
+// Reads back every count that is available and moves ready to the newest
+static void instance_cull_poll(InstanceCull *cull) {
+    for (int i = 0; i < INSTANCE_CULL_LATENCY; i++) {
+        if (cull->output_frame[i] < 0 || cull->output_count[i] >= 0)
+            continue;
+        GLuint available = 0, written = 0;
+        glGetQueryObjectuiv(cull->queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+        glGetQueryObjectuiv(cull->queries[i], GL_QUERY_RESULT, &written);
+        cull->output_count[i] = (int)written;
+        if (cull->ready < 0 || cull->output_frame[i] > cull->output_frame[cull->ready])
+            cull->ready = i;
+    }
+}
+
+void instance_cull_run(InstanceCull *cull, mat4_t view_projection) {
+    cull->frame++;
+    instance_cull_poll(cull);
+    if (cull->count == 0)
+        return;
+
+    // The oldest output other than the one being drawn, a pass whose count
+    // never came back is simply overwritten
+    int slot = -1;
+    for (int i = 0; i < INSTANCE_CULL_LATENCY; i++)
+        if (i != cull->ready && (slot < 0 || cull->output_frame[i] < cull->output_frame[slot]))
+            slot = i;
+    cull->output_frame[slot] = cull->frame;
+    cull->output_count[slot] = -1;
+
+    frustum_t frustum = frustum_from_m4(view_projection);
+    glUseProgram(cull->program);
+    glUniform4fv(cull->planes, 6, &frustum.planes[0][0]);
+    glUniform1f(cull->margin, INSTANCE_CULL_MARGIN);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(cull->vao);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, cull->outputs[slot]);
+    glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, cull->queries[slot]);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, cull->count);
+    glEndTransformFeedback();
+    glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+}
+
+int instance_cull_draw(InstanceCull *cull, const StaticBatch *batch) {
+    if (cull->ready < 0) {
+        cull->drawn = cull->count;
+        cull->lag = 0;
+        return static_batch_draw_instances(batch, cull->mesh, cull->source_buffer, 0, cull->count);
+    }
+
+    cull->drawn = cull->output_count[cull->ready];
+    cull->lag = cull->frame - cull->output_frame[cull->ready];
+    return static_batch_draw_instances(batch, cull->mesh, cull->outputs[cull->ready], 0, cull->drawn);
+}
@@ -0,0 +1,351 @@
+#include <light_system.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define LIGHT_SYSTEM_X86 1
+#include <immintrin.h>
+#endif
+
+// Sine approximation shared by all kernels. The angle is converted to turns and
+// wrapped to [-0.5, 0.5] by subtracting the nearest integer (no fmod, no
+// divide), folded into [-0.25, 0.25] with sin(pi - a) = sin(a) and evaluated
+// with a degree 9 odd polynomial on [-pi/2, pi/2] (error below 4e-6).
+#define LIGHT_INV_TWO_PI 0.15915494309f
+#define LIGHT_TWO_PI 6.28318530718f
+#define LIGHT_SIN_C3 (-1.6666667e-1f)
+#define LIGHT_SIN_C5 8.3333333e-3f
+#define LIGHT_SIN_C7 (-1.9841270e-4f)
+#define LIGHT_SIN_C9 2.7557319e-6f
+
+static float light_sin(float x) {
+    float y = x * LIGHT_INV_TWO_PI;
+    y -= floorf(y + 0.5f);
+    if (y > 0.25f)
+        y = 0.5f - y;
+    else if (y < -0.25f)
+        y = -0.5f - y;
+
+    float a = y * LIGHT_TWO_PI;
+    float a2 = a * a;
+    return a * (1.0f + a2 * (LIGHT_SIN_C3 + a2 * (LIGHT_SIN_C5 + a2 * (LIGHT_SIN_C7 + a2 * LIGHT_SIN_C9))));
+}
+
+static void light_animate_one(LightSystem *ls, float time, int i) {
+    float phase = time * ls->flicker_speed[i] + ls->time_offset[i];
+    float intensity = ls->intensity_base[i] +
+                      ls->intensity_variation[i] * light_sin(phase) * light_sin(phase * 1.3f);
+
+    LightGPU *out = &ls->gpu[i];
+    out->position_radius[0] = ls->base_x[i] + ls->jitter_x[i] * light_sin(phase * 2.1f);
+    out->position_radius[1] = ls->base_y[i] + ls->jitter_y[i] * light_sin(phase * 1.7f);
+    out->position_radius[2] = ls->base_z[i] + ls->jitter_z[i] * light_sin(phase * 2.3f);
+    out->position_radius[3] = ls->radius[i];
+    out->color_intensity[0] = ls->color_r[i] * intensity;
+    out->color_intensity[1] = ls->color_g[i] * intensity;
+    out->color_intensity[2] = ls->color_b[i] * intensity;
+    out->color_intensity[3] = intensity;
+}
+
+static void light_animate_scalar(LightSystem *ls, float time, int count) {
+    for (int i = 0; i < count; i++)
+        light_animate_one(ls, time, i);
+}
+
+#ifdef LIGHT_SYSTEM_X86
+
+static inline __m128 light_sin4(__m128 x) {
+    __m128 y = _mm_mul_ps(x, _mm_set1_ps(LIGHT_INV_TWO_PI));
+    y = _mm_sub_ps(y, _mm_cvtepi32_ps(_mm_cvtps_epi32(y)));
+
+    __m128 sign = _mm_and_ps(y, _mm_set1_ps(-0.0f));
+    __m128 fold = _mm_cmpgt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), y), _mm_set1_ps(0.25f));
+    __m128 folded = _mm_sub_ps(_mm_or_ps(sign, _mm_set1_ps(0.5f)), y);
+    y = _mm_or_ps(_mm_and_ps(fold, folded), _mm_andnot_ps(fold, y));
+
+    __m128 a = _mm_mul_ps(y, _mm_set1_ps(LIGHT_TWO_PI));
+    __m128 a2 = _mm_mul_ps(a, a);
+    __m128 p = _mm_add_ps(_mm_set1_ps(LIGHT_SIN_C7), _mm_mul_ps(a2, _mm_set1_ps(LIGHT_SIN_C9)));
+    p = _mm_add_ps(_mm_set1_ps(LIGHT_SIN_C5), _mm_mul_ps(a2, p));
+    p = _mm_add_ps(_mm_set1_ps(LIGHT_SIN_C3), _mm_mul_ps(a2, p));
+    p = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(a2, p));
+    return _mm_mul_ps(a, p);
+}
+
+static void light_animate_sse(LightSystem *ls, float time, int count) {
+    __m128 t = _mm_set1_ps(time);
+
+    for (int i = 0; i < count; i += 4) {
+        __m128 phase = _mm_add_ps(_mm_mul_ps(t, _mm_load_ps(ls->flicker_speed + i)),
+                                  _mm_load_ps(ls->time_offset + i));
+        __m128 flicker = _mm_mul_ps(light_sin4(phase),
+                                    light_sin4(_mm_mul_ps(phase, _mm_set1_ps(1.3f))));
+        __m128 intensity = _mm_add_ps(_mm_load_ps(ls->intensity_base + i),
+                                      _mm_mul_ps(_mm_load_ps(ls->intensity_variation + i), flicker));
+
+        __m128 x = _mm_add_ps(_mm_load_ps(ls->base_x + i),
+                              _mm_mul_ps(_mm_load_ps(ls->jitter_x + i),
+                                         light_sin4(_mm_mul_ps(phase, _mm_set1_ps(2.1f)))));
+        __m128 y = _mm_add_ps(_mm_load_ps(ls->base_y + i),
+                              _mm_mul_ps(_mm_load_ps(ls->jitter_y + i),
+                                         light_sin4(_mm_mul_ps(phase, _mm_set1_ps(1.7f)))));
+        __m128 z = _mm_add_ps(_mm_load_ps(ls->base_z + i),
+                              _mm_mul_ps(_mm_load_ps(ls->jitter_z + i),
+                                         light_sin4(_mm_mul_ps(phase, _mm_set1_ps(2.3f)))));
+        __m128 r = _mm_load_ps(ls->radius + i);
+        __m128 cr = _mm_mul_ps(_mm_load_ps(ls->color_r + i), intensity);
+        __m128 cg = _mm_mul_ps(_mm_load_ps(ls->color_g + i), intensity);
+        __m128 cb = _mm_mul_ps(_mm_load_ps(ls->color_b + i), intensity);
+
+        // Streams to upload layout: two 4x4 transposes give one row per light
+        _MM_TRANSPOSE4_PS(x, y, z, r);
+        _MM_TRANSPOSE4_PS(cr, cg, cb, intensity);
+        float *out = (float *)(ls->gpu + i);
+        _mm_store_ps(out + 0, x);
+        _mm_store_ps(out + 4, cr);
+        _mm_store_ps(out + 8, y);
+        _mm_store_ps(out + 12, cg);
+        _mm_store_ps(out + 16, z);
+        _mm_store_ps(out + 20, cb);
+        _mm_store_ps(out + 24, r);
+        _mm_store_ps(out + 28, intensity);
+    }
+}
+
+// The AVX kernel is compiled for AVX regardless of the global compiler flags
+// and only selected when the CPU supports it.
+#define LIGHT_AVX __attribute__((target("avx")))
+
+static inline LIGHT_AVX __m256 light_sin8(__m256 x) {
+    __m256 y = _mm256_mul_ps(x, _mm256_set1_ps(LIGHT_INV_TWO_PI));
+    y = _mm256_sub_ps(y, _mm256_round_ps(y, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+
+    __m256 sign = _mm256_and_ps(y, _mm256_set1_ps(-0.0f));
+    __m256 fold = _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), y), _mm256_set1_ps(0.25f), _CMP_GT_OQ);
+    __m256 folded = _mm256_sub_ps(_mm256_or_ps(sign, _mm256_set1_ps(0.5f)), y);
+    // and/andnot/or instead of blendv, GCC scalarizes a blend of a compare
+    // result inside a target("avx") function
+    y = _mm256_or_ps(_mm256_and_ps(fold, folded), _mm256_andnot_ps(fold, y));
+
+    __m256 a = _mm256_mul_ps(y, _mm256_set1_ps(LIGHT_TWO_PI));
+    __m256 a2 = _mm256_mul_ps(a, a);
+    __m256 p = _mm256_add_ps(_mm256_set1_ps(LIGHT_SIN_C7), _mm256_mul_ps(a2, _mm256_set1_ps(LIGHT_SIN_C9)));
+    p = _mm256_add_ps(_mm256_set1_ps(LIGHT_SIN_C5), _mm256_mul_ps(a2, p));
+    p = _mm256_add_ps(_mm256_set1_ps(LIGHT_SIN_C3), _mm256_mul_ps(a2, p));
+    p = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(a2, p));
+    return _mm256_mul_ps(a, p);
+}
+
+static LIGHT_AVX void light_animate_avx(LightSystem *ls, float time, int count) {
+    __m256 t = _mm256_set1_ps(time);
+
+    for (int i = 0; i < count; i += 8) {
+        __m256 phase = _mm256_add_ps(_mm256_mul_ps(t, _mm256_load_ps(ls->flicker_speed + i)),
+                                     _mm256_load_ps(ls->time_offset + i));
+        __m256 flicker = _mm256_mul_ps(light_sin8(phase),
+                                       light_sin8(_mm256_mul_ps(phase, _mm256_set1_ps(1.3f))));
+        __m256 intensity = _mm256_add_ps(_mm256_load_ps(ls->intensity_base + i),
+                                         _mm256_mul_ps(_mm256_load_ps(ls->intensity_variation + i), flicker));
+
+        __m256 r0 = _mm256_add_ps(_mm256_load_ps(ls->base_x + i),
+                                  _mm256_mul_ps(_mm256_load_ps(ls->jitter_x + i),
+                                                light_sin8(_mm256_mul_ps(phase, _mm256_set1_ps(2.1f)))));
+        __m256 r1 = _mm256_add_ps(_mm256_load_ps(ls->base_y + i),
+                                  _mm256_mul_ps(_mm256_load_ps(ls->jitter_y + i),
+                                                light_sin8(_mm256_mul_ps(phase, _mm256_set1_ps(1.7f)))));
+        __m256 r2 = _mm256_add_ps(_mm256_load_ps(ls->base_z + i),
+                                  _mm256_mul_ps(_mm256_load_ps(ls->jitter_z + i),
+                                                light_sin8(_mm256_mul_ps(phase, _mm256_set1_ps(2.3f)))));
+        __m256 r3 = _mm256_load_ps(ls->radius + i);
+        __m256 r4 = _mm256_mul_ps(_mm256_load_ps(ls->color_r + i), intensity);
+        __m256 r5 = _mm256_mul_ps(_mm256_load_ps(ls->color_g + i), intensity);
+        __m256 r6 = _mm256_mul_ps(_mm256_load_ps(ls->color_b + i), intensity);
+        __m256 r7 = intensity;
+
+        // 8x8 transpose: the eight streams become one LightGPU row per light
+        __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+        __m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+        __m256 t4 = _mm256_unpacklo_ps(r4, r5), t5 = _mm256_unpackhi_ps(r4, r5);
+        __m256 t6 = _mm256_unpacklo_ps(r6, r7), t7 = _mm256_unpackhi_ps(r6, r7);
+        __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+        float *out = (float *)(ls->gpu + i);
+        _mm256_store_ps(out + 0, _mm256_permute2f128_ps(s0, s4, 0x20));
+        _mm256_store_ps(out + 8, _mm256_permute2f128_ps(s1, s5, 0x20));
+        _mm256_store_ps(out + 16, _mm256_permute2f128_ps(s2, s6, 0x20));
+        _mm256_store_ps(out + 24, _mm256_permute2f128_ps(s3, s7, 0x20));
+        _mm256_store_ps(out + 32, _mm256_permute2f128_ps(s0, s4, 0x31));
+        _mm256_store_ps(out + 40, _mm256_permute2f128_ps(s1, s5, 0x31));
+        _mm256_store_ps(out + 48, _mm256_permute2f128_ps(s2, s6, 0x31));
+        _mm256_store_ps(out + 56, _mm256_permute2f128_ps(s3, s7, 0x31));
+    }
+}
+
+#endif // LIGHT_SYSTEM_X86
+
+typedef void (*LightKernel)(LightSystem *ls, float time, int count);
+
+static LightKernel light_kernel = NULL;
+static const char *light_kernel_name = "scalar";
+
+static void light_select_kernel(void) {
+    if (light_kernel)
+        return;
+
+    light_kernel = light_animate_scalar;
+#ifdef LIGHT_SYSTEM_X86
+    light_kernel = light_animate_sse;
+    light_kernel_name = "sse 4-wide";
+    if (__builtin_cpu_supports("avx")) {
+        light_kernel = light_animate_avx;
+        light_kernel_name = "avx 8-wide";
+    }
+#endif
+}
+
+static float *light_stream_alloc(int capacity) {
+    float *stream = rafgl_aligned_alloc(RAFGL_MEM_SCENE, 32, capacity * sizeof(float));
+    memset(stream, 0, capacity * sizeof(float));
+    return stream;
+}
+
+void light_system_init(LightSystem *ls, int capacity) {
+    memset(ls, 0, sizeof(LightSystem));
+    light_select_kernel();
+
+    // Padding lanes stay zeroed so the kernels can always run full vectors
+    capacity = (capacity + LIGHT_SYSTEM_LANES - 1) / LIGHT_SYSTEM_LANES * LIGHT_SYSTEM_LANES;
+    if (capacity < LIGHT_SYSTEM_LANES)
+        capacity = LIGHT_SYSTEM_LANES;
+    ls->capacity = capacity;
+
+    ls->base_x = light_stream_alloc(capacity);
+    ls->base_y = light_stream_alloc(capacity);
+    ls->base_z = light_stream_alloc(capacity);
+    ls->radius = light_stream_alloc(capacity);
+    ls->color_r = light_stream_alloc(capacity);
+    ls->color_g = light_stream_alloc(capacity);
+    ls->color_b = light_stream_alloc(capacity);
+    ls->flicker_speed = light_stream_alloc(capacity);
+    ls->time_offset = light_stream_alloc(capacity);
+    ls->intensity_base = light_stream_alloc(capacity);
+    ls->intensity_variation = light_stream_alloc(capacity);
+    ls->jitter_x = light_stream_alloc(capacity);
+    ls->jitter_y = light_stream_alloc(capacity);
+    ls->jitter_z = light_stream_alloc(capacity);
+
+    ls->gpu = rafgl_aligned_alloc(RAFGL_MEM_SCENE, 32, capacity * sizeof(LightGPU));
+    memset(ls->gpu, 0, capacity * sizeof(LightGPU));
+}
+
+void light_system_cleanup(LightSystem *ls) {
+    rafgl_free(ls->base_x);
+    rafgl_free(ls->base_y);
+    rafgl_free(ls->base_z);
+    rafgl_free(ls->radius);
+    rafgl_free(ls->color_r);
+    rafgl_free(ls->color_g);
+    rafgl_free(ls->color_b);
+    rafgl_free(ls->flicker_speed);
+    rafgl_free(ls->time_offset);
+    rafgl_free(ls->intensity_base);
+    rafgl_free(ls->intensity_variation);
+    rafgl_free(ls->jitter_x);
+    rafgl_free(ls->jitter_y);
+    rafgl_free(ls->jitter_z);
+    rafgl_free(ls->gpu);
+
+    if (ls->ubo)
+        glDeleteBuffers(1, &ls->ubo);
+
+    memset(ls, 0, sizeof(LightSystem));
+}
+
+int light_system_add(LightSystem *ls, const LightDesc *desc) {
+    if (ls->count >= ls->capacity)
+        return -1;
+
+    int i = ls->count++;
+    ls->base_x[i] = desc->position.x;
+    ls->base_y[i] = desc->position.y;
+    ls->base_z[i] = desc->position.z;
+    ls->radius[i] = desc->radius;
+    ls->color_r[i] = desc->color.x;
+    ls->color_g[i] = desc->color.y;
+    ls->color_b[i] = desc->color.z;
+    ls->flicker_speed[i] = desc->flicker_speed;
+    ls->time_offset[i] = desc->time_offset;
+    ls->intensity_base[i] = desc->intensity_base;
+    ls->intensity_variation[i] = desc->intensity_variation;
+    ls->jitter_x[i] = desc->jitter.x;
+    ls->jitter_y[i] = desc->jitter.y;
+    ls->jitter_z[i] = desc->jitter.z;
+
+    // Valid output before the first animate call
+    light_animate_one(ls, 0.0f, i);
+    return i;
+}
+
+void light_system_set_position(LightSystem *ls, int index, vec3_t position) {
+    ls->base_x[index] = position.x;
+    ls->base_y[index] = position.y;
+    ls->base_z[index] = position.z;
+}
+
+void light_system_set_color(LightSystem *ls, int index, vec3_t color) {
+    ls->color_r[index] = color.x;
+    ls->color_g[index] = color.y;
+    ls->color_b[index] = color.z;
+}
+
+void light_system_set_radius(LightSystem *ls, int index, float radius) {
+    ls->radius[index] = radius;
+}
+
+void light_system_animate(LightSystem *ls, float time) {
+    int count = (ls->count + LIGHT_SYSTEM_LANES - 1) / LIGHT_SYSTEM_LANES * LIGHT_SYSTEM_LANES;
+    light_kernel(ls, time, count);
+}
+
+vec3_t light_system_position(const LightSystem *ls, int index) {
+    const float *p = ls->gpu[index].position_radius;
+    return vec3(p[0], p[1], p[2]);
+}
+
+const char *light_system_kernel_name(void) {
+    light_select_kernel();
+    return light_kernel_name;
+}
+
+void light_system_create_buffer(LightSystem *ls) {
+    glGenBuffers(1, &ls->ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, ls->ubo);
+    glBufferData(GL_UNIFORM_BUFFER, LIGHT_SYSTEM_MAX_GPU_LIGHTS * sizeof(LightGPU), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT_SYSTEM_UBO_BINDING, ls->ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void light_system_bind_program(GLuint program) {
+    GLuint block = glGetUniformBlockIndex(program, "LightBlock");
+    if (block != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, block, LIGHT_SYSTEM_UBO_BINDING);
+}
+
+void light_system_upload(LightSystem *ls, int count) {
+    if (count > LIGHT_SYSTEM_MAX_GPU_LIGHTS)
+        count = LIGHT_SYSTEM_MAX_GPU_LIGHTS;
+    if (count <= 0)
+        return;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, ls->ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, count * sizeof(LightGPU), ls->gpu);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
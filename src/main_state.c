@@ -1,7 +1,17 @@
+#include <entity_store.h>
 #include <glad/glad.h>
+#include <instance_cull.h>
+#include <light_system.h>
 #include <main_state.h>
 #include <math.h>
+#include <mesh_residency.h>
+#include <occlusion_buffer.h>
+#include <occlusion_queries.h>
+#include <portal_cells.h>
+#include <scene_bvh.h>
+#include <static_batch.h>
 #include <tavern_renderer.h>
+#include <transform_system.h>
 
 #include <rafgl.h>
 
@@ -19,6 +29,24 @@
 #define BAR_COUNTER_HEIGHT 0.95f
 #define CANDLE_FLAME_HEIGHT 0.15f
 #define LIGHT_OFFSET_DISTANCE 0.5f
+#define FLOOR_SIZE 20.0f
+#define CUBE_HALF_SIZE 1.0f
+#define CANDLE_BASE_HALF_SIZE 0.1f
+#define CANDLE_FLAME_HALF_SIZE 0.05f
+#define SHADOW_FAR_PLANE 25.0f  // of render_cube_shadow_map()
+// Solid parts of the prop models in mesh space, measured from the .obj files
+#define BAR_OCCLUDER_MIN vec3(-0.85f, 0.01f, -0.14f)
+#define BAR_OCCLUDER_MAX vec3(0.85f, 0.77f, 0.14f)
+#define TABLE_TOP_OCCLUDER_MIN vec3(-0.55f, 1.73f, -0.55f) // square inside the round top
+#define TABLE_TOP_OCCLUDER_MAX vec3(0.55f, 1.87f, 0.55f)
+// Open space inside the walls' inner faces and in front of the door, joined
+// by the door opening between the front wall segments and under the lintel
+#define TAVERN_INTERIOR_HALF 5.3f
+#define TAVERN_INTERIOR_TOP 6.0f
+#define STREET_DEPTH 10.0f
+#define DOOR_Z 5.5f
+#define DOOR_HALF_WIDTH 0.5f
+#define DOOR_HEIGHT 2.0f
 
 // Animation constants
 #define FLAME_INTENSITY_BASE 0.85f
@@ -30,78 +58,45 @@
 #define TABLE_FLAME_OFFSET_Y 0.02f
 #define TABLE_FLAME_OFFSET_Z 0.01f
 
-// Sine wave lookup table for performance optimization
-#define SINE_LUT_SIZE 1024                       // Power of 2 for fast indexing
-#define SINE_LUT_MASK (SINE_LUT_SIZE - 1)       // Bitmask for wraparound
-static float sine_lut[SINE_LUT_SIZE];
-static int sine_lut_initialized = 0;
-
 // Debug system
 #define DEBUG_LEVEL 0
-#define DEBUG_PRINT(level, ...) do { if (DEBUG_LEVEL >= level) printf(__VA_ARGS__); } while(0)
-
-// Fast sine lookup function using linear interpolation
-static inline float fast_sin(float angle) {
-    // Normalize angle to [0, 2π] range
-    float normalized = fmodf(angle, 2.0f * M_PIf);
-    if (normalized < 0.0f) normalized += 2.0f * M_PIf;
-    
-    float index_float = (normalized / (2.0f * M_PIf)) * SINE_LUT_SIZE;
-    int index0 = (int)index_float & SINE_LUT_MASK;
-    int index1 = (index0 + 1) & SINE_LUT_MASK;
-    
-    // Linear interpolation between lookup table values
-    float frac = index_float - (int)index_float;
-    return sine_lut[index0] + frac * (sine_lut[index1] - sine_lut[index0]);
-}
+#define DEBUG_PRINT(level, ...) do { if (DEBUG_LEVEL >= level) rafgl_log(RAFGL_INFO, __VA_ARGS__); } while(0)
 
 // Cached uniform locations for performance optimization
 typedef struct {
-  // G-buffer program uniforms
-  GLint gbuffer_model, gbuffer_view, gbuffer_projection;
-  GLint gbuffer_hasTexture, gbuffer_materialColor;
-  
-  // Shadow program uniforms
-  GLint shadow_model;
-  
-  // Lighting program uniforms  
-  GLint lighting_gPosition, lighting_gNormal, lighting_gAlbedoSpec;
-  GLint lighting_ssaoTexture, lighting_far_plane;
-  GLint lighting_shadowMaps[8]; // Pre-calculated for up to 8 lights
-  GLint lighting_numLights;
-  GLint lighting_viewPos;
-  GLint lighting_lights_position[8];  // Pre-cached light uniform arrays
-  GLint lighting_lights_color[8];
-  GLint lighting_lights_radius[8];
-  GLint lighting_flashlightOnlyShadows;
-  
-  // Material binding uniforms
-  GLint material_texture_diffuse1, material_texture_normal1, material_texture_specular1;
-  GLint material_hasNormalMap, material_hasTexture;
-  GLint material_roughness, material_metallic;
-  
   // SSAO program uniforms
   GLint ssao_gPosition, ssao_gNormal, ssao_projection;
   
   // Post-processing program uniforms
   GLint postprocess_screenTexture, postprocess_gamma, postprocess_exposure, postprocess_time;
-  
-  // Additional cached uniforms
-  GLint gbuffer_hasTexture_other;
-  GLint gbuffer_materialColor_other;
-  GLint gbuffer_model_other;
 } UniformLocations;
 
 static UniformLocations uniforms;
 
+// Deferred lighting program compiled for one range of shadow casting lights,
+// [first_shadowed, first_shadowed + shadowed) is unrolled in the shader
+typedef struct {
+  int first_shadowed, shadowed;
+  GLuint program;
+  GLint gPosition, gNormal, gAlbedoSpec, ssaoTexture, far_plane;
+  GLint shadowMaps[8];
+  GLint numLights, viewPos;
+} LightingVariant;
+
+#define MAX_LIGHTING_VARIANTS 16
+static LightingVariant lighting_variants[MAX_LIGHTING_VARIANTS];
+static int lighting_variant_count = 0;
+
 // Key state management
-enum KeyIndex { KEY_F = 0, KEY_Q = 1, KEY_E = 2, KEY_TAB = 3, KEY_R = 4, KEY_SHIFT = 5, MAX_KEYS = 6 };
+enum KeyIndex { KEY_F = 0, KEY_Q = 1, KEY_E = 2, KEY_TAB = 3, KEY_R = 4, KEY_SHIFT = 5, KEY_O = 6, KEY_G = 7, MAX_KEYS = 8 };
 static int key_states[MAX_KEYS] = {0};
 
 static int w, h;
 static Camera camera;
 static GBuffer gbuffer;
-static PointLight lights[8];
+static LightSystem light_system;       // Positions, colors and flicker of all lights
+#define MAX_SHADOW_LIGHTS 8            // Shadow cube map samplers in deferred/frag.glsl
+static ShadowCubeMap light_shadows[MAX_SHADOW_LIGHTS]; // Shadow maps of the first lights, indexed like the lights
 static int num_lights = 0;
 static int base_num_lights = 0;
 static int flashlight_active = 0;
@@ -110,10 +105,11 @@ static float global_light_radius = 8.0f;
 static int flashlight_only_shadows = 1;
 static int postprocess_enabled = 1;  // Post-processing enabled by default
 static TextureManager texture_manager;
+#define TEXTURE_BUDGET_MB 256          // Resident material texture memory, see texture_residency.h
+static rafgl_memory_snapshot_t memory_at_init; // Compared against in cleanup to report leaks
 
 static rafgl_meshPUN_t floor_mesh;
-static GLuint gbuffer_program, lighting_program, shadow_program,
-    postprocess_program, ssao_program;
+static GLuint shadow_program, postprocess_program, ssao_program;
 static FullscreenQuad quad;
 
 // Post-processing framebuffer
@@ -129,54 +125,134 @@ static rafgl_meshPUN_t beer_mug_mesh, green_bottle_mesh, wall_candle_mesh,
 static rafgl_meshPUN_t cube_mesh;
 static rafgl_meshPUN_t candle_base_mesh, candle_flame_mesh;
 
-// Wall candles
+// Scene entities. Drawable objects are entities with a transform node and a
+// renderable, candles also emit a light and table candle flames follow their
+// animated light. Systems below iterate over whatever entities exist, so new
+// content is just more spawn calls.
+enum SceneComponent {
+  COMPONENT_NODE,       // int, node in the transform hierarchy
+  COMPONENT_RENDERABLE, // Renderable
+  COMPONENT_LIGHT,      // LightEmitter
+  COMPONENT_FLAME,      // AnimatedFlame
+  COMPONENT_OCCLUDER,   // Occluder
+  COMPONENT_COUNT
+};
+
+typedef struct {
+  rafgl_meshPUN_t *mesh;
+  int stream; // MeshResidency handle of mesh, -1 when it is always resident
+  Material *material; // NULL draws the flat color
+  vec3_t color;
+  vec3_t local_min, local_max; // mesh bounds, min.x > max.x while unknown
+  int occlusion_query; // OcclusionQueries handle, -1 when drawn unconditionally
+} Renderable;
+
+// Keeps the rest position of a light attached to the entity's node
 typedef struct {
-  vec3_t position;
-  float intensity;
-  float flicker_speed;
-  float time_offset;
   int light_index;
-} WallCandle;
+  vec3_t offset; // From the node origin to the flame
+} LightEmitter;
 
-// Table candles with hierarchy (base + animated flame)
+// Flame mesh that follows the animated position of its light (child movement
+// relative to the candle anchor)
 typedef struct {
-  vec3_t base_position; // Parent: candle base (static)
-  vec3_t flame_offset;  // Child: flame offset (animated)
-  float intensity;
-  float flicker_speed;
-  float time_offset;
   int light_index;
-} TableCandle;
+  int anchor_node;
+  vec3_t scale;
+} AnimatedFlame;
 
-static WallCandle wall_candles[3];
-static int num_wall_candles = 3; // Re-enable wall candles
-static TableCandle table_candles[3];
-static int num_table_candles =
-    3; // Re-enable table candles - they work correctly
-
-// Dining table and barrel objects - consistent with candle pattern
+// Box inside the solid part of the entity's mesh, in mesh space. Everything
+// the camera sees is tested against the occluders before it is drawn.
 typedef struct {
-  vec3_t position;
-} DiningTable;
-
+  vec3_t min, max;
+} Occluder;
+
+#define SCENE_RENDERABLE (COMPONENT_BIT(COMPONENT_NODE) | COMPONENT_BIT(COMPONENT_RENDERABLE))
+#define SCENE_MAX_NODES 256
+
+static EntityStore scene;
+// Every scene mesh is a range of one vertex buffer, so the whole scene is
+// drawn with one instanced call per mesh and gbuffer variant
+static rafgl_mesh_buffer_t scene_meshes;
+static StaticBatch scene_batch;
+// Prop meshes are streamed into the end of scene_meshes and drawn as coarse
+// proxies while their full data is out
+static MeshResidency mesh_residency;
+#define MESH_BUDGET_MB 128
+#define MESH_STREAM_RADIUS 25.0f
+#define SCENE_VARIANT_FLAT 0
+#define SCENE_VARIANT_TEXTURED 1
+#define SCENE_VARIANT_NORMALMAPPED 2
+#define SCENE_VARIANT_COUNT 3
+#define SCENE_VARIANT_SHADOW SCENE_VARIANT_COUNT // shadow casters, no gbuffer program
+
+// G-buffer program of one scene variant. Model matrices and material colors
+// come from the instance stream, so only the camera is set per frame.
 typedef struct {
-  vec3_t position;
-} Barrel;
-
-static DiningTable dining_tables[3];
-static Barrel barrels[4];
-
-// Pre-calculated transformation matrices for static geometry (performance optimization)
-static mat4_t wall_transforms[6];        // Back, left, right, front segments + door lintel
-static mat4_t table_transforms[3];       // 3 dining tables
-static mat4_t barrel_transforms[4];      // 4 barrels
-static mat4_t bar_counter_transform;     // Massive bar counter
-static mat4_t fireplace_transform;       // Fireplace
-
-// Pre-calculated stool positions (eliminates cos/sin in render loop)
-static vec3_t stool_positions[3][3];     // [table_index][stool_index]
-static mat4_t beer_mug_transforms[4];    // Pre-calculated beer mug matrices
-static mat4_t bottle_transforms[2];      // Pre-calculated bottle matrices
+  const char *defines;
+  GLuint program;
+  GLint view, projection;
+} GBufferVariant;
+
+static GBufferVariant gbuffer_variants[SCENE_VARIANT_COUNT] = {
+    [SCENE_VARIANT_FLAT] = {NULL},
+    [SCENE_VARIANT_TEXTURED] = {"TEXTURED"},
+    [SCENE_VARIANT_NORMALMAPPED] = {"TEXTURED|NORMALMAP"},
+};
+
+// Texture feedback program for flat and for textured scene variants, the
+// flat one only marks its pixels as untextured
+typedef struct {
+  const char *defines;
+  GLuint program;
+  GLint view, projection, textureSize, lodBias;
+} FeedbackVariant;
+
+#define FEEDBACK_VARIANT_COUNT 2
+static FeedbackVariant feedback_variants[FEEDBACK_VARIANT_COUNT] = {{NULL}, {"TEXTURED"}};
+// World matrices are computed once per frame in main_state_update and shared
+// by the shadow and geometry passes
+static TransformSystem transforms;
+// World bounds of every renderable by transform node. The gbuffer variants of
+// the batch only get what the camera sees, the shadow variant what is within
+// reach of a shadow casting light.
+static SceneBvh scene_bvh;
+static EntityId node_entities[SCENE_MAX_NODES]; // ENTITY_NONE for nodes without a renderable
+static int scene_query[SCENE_MAX_NODES];
+#define SCENE_SEEN_BY_CAMERA 1
+#define SCENE_SEEN_BY_LIGHT 2
+static unsigned char scene_visible[SCENE_MAX_NODES];
+// Occluders the camera sees rasterized on the CPU, only the gbuffer variants
+// are culled by it as the lights see the scene from elsewhere
+static OcclusionBuffer occlusion;
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_LOG_FRAMES 60 // between statistics while the debug view is on
+static int occlusion_debug = 0; // O key, depth buffer in the lower left corner
+static int occlusion_debug_frame = 0;
+static GLuint occlusion_debug_fbo, occlusion_debug_texture;
+static unsigned char *occlusion_debug_pixels;
+// High poly props are also tested on the GPU against the flat pass (walls,
+// floor, fireplace) and their gbuffer draws made conditional on the result
+static OcclusionQueries occlusion_queries;
+// Rooms of the scene and the doors between them. A renderable lying wholly
+// inside a cell is dropped for the camera when the cell is not seen through
+// the portals, and for the lights when no shadow light reaches it.
+static PortalCells cells;
+static int node_cells[SCENE_MAX_NODES]; // -1 outside every cell
+#define SCENE_MAX_CELLS 8
+// Stress field of small crates over the floor, frustum culled on the GPU and
+// drawn from the compacted output. Built the first time G shows it.
+static InstanceCull crate_field;
+static int crate_field_enabled = 0;
+static int crate_field_frame = 0;
+#define CRATE_FIELD_COUNT 20000
+#define CRATE_FIELD_HALF_SIZE 0.04f
+
+// Scene layout
+static const vec3_t dining_table_positions[] = {
+    {-3.5f, 0.0f, 1.0f}, {-1.0f, 0.0f, 3.5f}, {1.5f, 0.0f, 0.5f}};
+static const vec3_t barrel_positions[] = {
+    {4.5f, 0.0f, 4.0f}, {-4.5f, 0.0f, 4.0f}, {-4.5f, 0.0f, -2.0f}, {2.0f, 0.0f, 4.0f}};
 
 static float animation_time = 0.0f;
 static float startup_flashlight_timer = 0.0f;
@@ -203,100 +279,242 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
   }
 }
 
-void main_state_init(GLFWwindow *window, void *args, int width, int height) {
-  w = width;
-  h = height;
+// Mesh space bounds, streamed meshes know theirs once they were loaded
+static void mesh_local_bounds(const rafgl_meshPUN_t *mesh, int stream, vec3_t *min, vec3_t *max) {
+  *min = vec3(1.0f, 1.0f, 1.0f);
+  *max = vec3(-1.0f, -1.0f, -1.0f);
+  if (stream >= 0) {
+    mesh_residency_bounds(&mesh_residency, stream, min, max);
+    return;
+  }
 
-  // Capture mouse cursor
-  glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+  float half = 0.0f;
+  if (mesh == &floor_mesh) {
+    *min = vec3(-FLOOR_SIZE / 2.0f, 0.0f, -FLOOR_SIZE / 2.0f);
+    *max = vec3(FLOOR_SIZE / 2.0f, 0.0f, FLOOR_SIZE / 2.0f);
+    return;
+  } else if (mesh == &cube_mesh) {
+    half = CUBE_HALF_SIZE;
+  } else if (mesh == &candle_base_mesh) {
+    half = CANDLE_BASE_HALF_SIZE;
+  } else if (mesh == &candle_flame_mesh) {
+    half = CANDLE_FLAME_HALF_SIZE;
+  } else {
+    return;
+  }
+  *min = vec3(-half, -half, -half);
+  *max = vec3(half, half, half);
+}
 
-  // Set up scroll wheel callback for flashlight control
-  glfwSetScrollCallback(window, scroll_callback);
+// Adds a drawable entity under parent (TRANSFORM_NONE for the scene root),
+// ENTITY_NONE when the entity store or the transform system is full
+static EntityId spawn_renderable(int parent, mat4_t local, rafgl_meshPUN_t *mesh,
+                                 Material *material, vec3_t color) {
+  EntityId entity = entity_create(&scene, SCENE_RENDERABLE);
+  if (entity == ENTITY_NONE)
+    return ENTITY_NONE;
+  int node = transform_system_add(&transforms, parent, local);
+  if (node < 0) {
+    entity_destroy(&scene, entity);
+    return ENTITY_NONE;
+  }
+  *(int *)entity_get(&scene, entity, COMPONENT_NODE) = node;
+  Renderable *renderable = entity_get(&scene, entity, COMPONENT_RENDERABLE);
+  *renderable = (Renderable){.mesh = mesh,
+                             .stream = mesh_residency_find(&mesh_residency, mesh),
+                             .material = material,
+                             .color = color,
+                             .occlusion_query = -1};
+  mesh_local_bounds(mesh, renderable->stream, &renderable->local_min, &renderable->local_max);
+  node_entities[node] = entity;
+  return entity;
+}
 
-  // Initialize camera
-  camera_init(&camera);
+// Marks a box of the entity's mesh that is solid all the way through
+static void add_occluder(EntityId entity, vec3_t min, vec3_t max) {
+  if (entity == ENTITY_NONE)
+    return;
+  entity_set_mask(&scene, entity, entity_mask(&scene, entity) | COMPONENT_BIT(COMPONENT_OCCLUDER));
+  *(Occluder *)entity_get(&scene, entity, COMPONENT_OCCLUDER) = (Occluder){min, max};
+}
 
-  // Initialize sine wave lookup table for performance
-  if (!sine_lut_initialized) {
-    for (int i = 0; i < SINE_LUT_SIZE; i++) {
-      float angle = (float)i / SINE_LUT_SIZE * 2.0f * M_PIf;
-      sine_lut[i] = sinf(angle);
-    }
-    sine_lut_initialized = 1;
-  }
+// Makes the camera draws of a high poly entity wait on a hardware occlusion
+// query of its bounds
+static void add_occlusion_query(EntityId entity) {
+  Renderable *renderable = entity_get(&scene, entity, COMPONENT_RENDERABLE);
+  if (renderable)
+    renderable->occlusion_query = occlusion_queries_add(&occlusion_queries);
+}
 
-  // Create procedural candle geometry using available RAFGL functions
-  rafgl_meshPUN_init(&candle_base_mesh);
-  rafgl_meshPUN_load_cube(&candle_base_mesh,
-                          0.1f); // Simple cube for candle base
+// Scene bounds system: world bounds of the renderable on a node, after its
+// world matrix changed
+static void scene_bounds_update(int node) {
+  if (node_entities[node] == ENTITY_NONE)
+    return;
+  const Renderable *renderable = entity_get(&scene, node_entities[node], COMPONENT_RENDERABLE);
+  if (renderable->local_min.x > renderable->local_max.x)
+    return;
+  vec3_t min, max;
+  m4_mul_aabb(*transform_system_world(&transforms, node), renderable->local_min,
+              renderable->local_max, &min, &max);
+  scene_bvh_set_bounds(&scene_bvh, node, min, max);
+  node_cells[node] = portal_cells_locate_box(&cells, min, max);
+}
 
-  rafgl_meshPUN_init(&candle_flame_mesh);
-  rafgl_meshPUN_load_cube(&candle_flame_mesh, 0.05f); // Small cube for flame
+// Warm flickering candle light, with a shadow map while samplers are left
+static int spawn_candle_light(vec3_t position, vec3_t jitter, float flicker_speed,
+                              float time_offset) {
+  LightDesc desc = {
+      .position = position,
+      .color = vec3(1.0f, 0.6f, 0.3f), // Warm candle light
+      .radius = global_light_radius,   // Use global radius for all
+      .flicker_speed = flicker_speed,
+      .time_offset = time_offset,
+      .intensity_base = FLAME_INTENSITY_BASE,
+      .intensity_variation = FLAME_INTENSITY_VARIATION,
+      .jitter = jitter};
+  int light_index = light_system_add(&light_system, &desc);
+  if (light_index >= 0 && light_index < MAX_SHADOW_LIGHTS)
+    setup_point_light_shadows(&light_shadows[light_index], 512, 512);
+  return light_index;
+}
 
-  // Initialize G-Buffer
-  gbuffer_init(&gbuffer, width, height);
+// Wall candle rotated to face the tavern center, the light sits at
+// light_offset from the candle toward the room
+static void spawn_wall_candle(vec3_t position, float rotation, vec3_t light_offset,
+                              float flicker_speed, float time_offset) {
+  EntityId candle = spawn_renderable(
+      TRANSFORM_NONE,
+      m4_mul(m4_translation(position),
+             m4_mul(m4_rotation_y(rotation), m4_scaling(vec3(0.4f, 0.4f, 0.4f)))),
+      &wall_candle_mesh, &texture_manager.wall_candle, vec3(1.0f, 1.0f, 1.0f));
+
+  LightEmitter emitter = {
+      .light_index = spawn_candle_light(
+          v3_add(position, light_offset),
+          vec3(FLAME_FLICKER_SCALE_X, FLAME_FLICKER_SCALE_Y, FLAME_FLICKER_SCALE_Z),
+          flicker_speed, time_offset),
+      .offset = light_offset};
+  if (emitter.light_index < 0 || candle == ENTITY_NONE)
+    return;
+
+  entity_set_mask(&scene, candle, SCENE_RENDERABLE | COMPONENT_BIT(COMPONENT_LIGHT));
+  *(LightEmitter *)entity_get(&scene, candle, COMPONENT_LIGHT) = emitter;
+}
 
-  // Create shaders
-  gbuffer_program = rafgl_program_create_from_name("gbuffer");
-  lighting_program = rafgl_program_create_from_name("deferred");
-  postprocess_program = rafgl_program_create_from_name("postprocess");
-  shadow_program = rafgl_program_create_from_name("shadows");
-  ssao_program = rafgl_program_create_from_name("ssao");
+// Table candle - object hierarchy: table -> anchor -> base + animated flame
+static void spawn_table_candle(int table_node, float flicker_speed, float time_offset) {
+  // Table model scaled by 0.7f, need to calculate actual table surface height
+  // Assuming original table height ~2.0f, scaled = 1.4f surface height
+  int anchor = transform_system_add(&transforms, table_node,
+                                    m4_translation(vec3(0.0f, TABLE_SURFACE_HEIGHT, 0.0f)));
+  if (anchor < 0)
+    return;
+  transform_system_update(&transforms);
+
+  EntityId base = spawn_renderable(anchor, m4_scaling(vec3(0.3f, 0.8f, 0.3f)),
+                                   &candle_base_mesh, NULL, vec3(0.95f, 0.95f, 0.9f));
+
+  vec3_t flame_offset = vec3(0.0f, 0.12f, 0.0f); // Above base
+  LightEmitter emitter = {
+      .light_index = spawn_candle_light(
+          v3_add(transform_system_world_position(&transforms, anchor), flame_offset),
+          vec3(TABLE_FLAME_OFFSET_X, TABLE_FLAME_OFFSET_Y, TABLE_FLAME_OFFSET_Z),
+          flicker_speed, time_offset),
+      .offset = flame_offset};
+  if (emitter.light_index < 0 || base == ENTITY_NONE)
+    return;
+
+  entity_set_mask(&scene, base, SCENE_RENDERABLE | COMPONENT_BIT(COMPONENT_LIGHT));
+  *(LightEmitter *)entity_get(&scene, base, COMPONENT_LIGHT) = emitter;
+
+  AnimatedFlame flame = {.light_index = emitter.light_index,
+                         .anchor_node = anchor,
+                         .scale = vec3(0.2f, 0.4f, 0.2f)};
+  EntityId flame_entity = spawn_renderable(
+      anchor, m4_mul(m4_translation(flame_offset), m4_scaling(flame.scale)),
+      &candle_flame_mesh, NULL, vec3(1.0f, 0.7f, 0.2f));
+  if (flame_entity == ENTITY_NONE)
+    return;
+  entity_set_mask(&scene, flame_entity, SCENE_RENDERABLE | COMPONENT_BIT(COMPONENT_FLAME));
+  *(AnimatedFlame *)entity_get(&scene, flame_entity, COMPONENT_FLAME) = flame;
+}
 
-  // Cache uniform locations for performance (eliminates string lookups in render loop)
-  uniforms.gbuffer_model = glGetUniformLocation(gbuffer_program, "model");
-  uniforms.gbuffer_view = glGetUniformLocation(gbuffer_program, "view");
-  uniforms.gbuffer_projection = glGetUniformLocation(gbuffer_program, "projection");
-  uniforms.gbuffer_hasTexture = glGetUniformLocation(gbuffer_program, "hasTexture");
-  uniforms.gbuffer_materialColor = glGetUniformLocation(gbuffer_program, "materialColor");
-
-  uniforms.lighting_gPosition = glGetUniformLocation(lighting_program, "gPosition");
-  uniforms.lighting_gNormal = glGetUniformLocation(lighting_program, "gNormal");
-  uniforms.lighting_gAlbedoSpec = glGetUniformLocation(lighting_program, "gAlbedoSpec");
-  uniforms.lighting_ssaoTexture = glGetUniformLocation(lighting_program, "ssaoTexture");
-  uniforms.lighting_far_plane = glGetUniformLocation(lighting_program, "far_plane");
-  
-  // Pre-cache shadow map uniform locations
-  char shadowMapName[32];
-  for (int i = 0; i < 8; i++) {
-    sprintf(shadowMapName, "shadowMap%d", i);
-    uniforms.lighting_shadowMaps[i] = glGetUniformLocation(lighting_program, shadowMapName);
+// Light emitter system: light rest positions follow their nodes
+static void light_emitter_system(void) {
+  EntityQuery query;
+  entity_query_begin(&query, &scene,
+                     COMPONENT_BIT(COMPONENT_NODE) | COMPONENT_BIT(COMPONENT_LIGHT));
+  while (entity_query_next(&query)) {
+    int *nodes = entity_query_column(&query, COMPONENT_NODE);
+    LightEmitter *emitters = entity_query_column(&query, COMPONENT_LIGHT);
+    for (int i = 0; i < query.count; i++) {
+      vec3_t origin = transform_system_world_position(&transforms, nodes[i]);
+      light_system_set_position(&light_system, emitters[i].light_index,
+                                v3_add(origin, emitters[i].offset));
+    }
   }
+}
+
+// Animated flame system: flames follow their lights, relative to the anchor
+static void animated_flame_system(void) {
+  EntityQuery query;
+  entity_query_begin(&query, &scene,
+                     COMPONENT_BIT(COMPONENT_NODE) | COMPONENT_BIT(COMPONENT_FLAME));
+  while (entity_query_next(&query)) {
+    int *nodes = entity_query_column(&query, COMPONENT_NODE);
+    AnimatedFlame *flames = entity_query_column(&query, COMPONENT_FLAME);
+    for (int i = 0; i < query.count; i++) {
+      vec3_t offset = v3_sub(
+          light_system_position(&light_system, flames[i].light_index),
+          transform_system_world_position(&transforms, flames[i].anchor_node));
+      transform_system_set_local(&transforms, nodes[i],
+                                 m4_mul(m4_translation(offset), m4_scaling(flames[i].scale)));
+    }
+  }
+}
+
+// Looking up a uniform waits for its program to link, so this runs once
+// loading is done
+static void cache_uniform_locations(void) {
+  for (int v = 0; v < SCENE_VARIANT_COUNT; v++) {
+    GBufferVariant *variant = &gbuffer_variants[v];
+    variant->program = rafgl_program_variant("gbuffer", variant->defines);
+    variant->view = glGetUniformLocation(variant->program, "view");
+    variant->projection = glGetUniformLocation(variant->program, "projection");
+
+    // Material arrays stay on units 5 to 7, see texture_manager_bind
+    glUseProgram(variant->program);
+    glUniform1i(glGetUniformLocation(variant->program, "texture_diffuse_array"), 5);
+    glUniform1i(glGetUniformLocation(variant->program, "texture_normal_array"), 6);
+    glUniform1i(glGetUniformLocation(variant->program, "texture_pbr_array"), 7);
+  }
+  glUseProgram(0);
+
+  postprocess_program = rafgl_program_variant("postprocess", NULL);
+  shadow_program = rafgl_program_variant("shadows", NULL);
+  ssao_program = rafgl_program_variant("ssao", NULL);
+  occlusion_queries_set_program(&occlusion_queries, rafgl_program_variant("occlusion_proxy", NULL));
 
+  // Cache uniform locations for performance (eliminates string lookups in render loop)
   uniforms.ssao_gPosition = glGetUniformLocation(ssao_program, "gPosition");
   uniforms.ssao_gNormal = glGetUniformLocation(ssao_program, "gNormal");
   uniforms.ssao_projection = glGetUniformLocation(ssao_program, "projection");
 
-  // Cache shadow program uniforms
-  uniforms.shadow_model = glGetUniformLocation(shadow_program, "model");
-
-  // Cache lighting program light uniform arrays (eliminates sprintf + uniform lookups)
-  char lightUniformName[64];
-  for (int i = 0; i < 8; i++) {
-    sprintf(lightUniformName, "lights[%d].Position", i);
-    uniforms.lighting_lights_position[i] = glGetUniformLocation(lighting_program, lightUniformName);
-    sprintf(lightUniformName, "lights[%d].Color", i);
-    uniforms.lighting_lights_color[i] = glGetUniformLocation(lighting_program, lightUniformName);
-    sprintf(lightUniformName, "lights[%d].Radius", i);
-    uniforms.lighting_lights_radius[i] = glGetUniformLocation(lighting_program, lightUniformName);
-  }
-  uniforms.lighting_numLights = glGetUniformLocation(lighting_program, "numLights");
-  uniforms.lighting_viewPos = glGetUniformLocation(lighting_program, "viewPos");
-  uniforms.lighting_flashlightOnlyShadows = glGetUniformLocation(lighting_program, "flashlightOnlyShadows");
-
-  // Cache material binding uniforms (eliminates 8 lookups per material bind)
-  uniforms.material_texture_diffuse1 = glGetUniformLocation(gbuffer_program, "texture_diffuse1");
-  uniforms.material_texture_normal1 = glGetUniformLocation(gbuffer_program, "texture_normal1");
-  uniforms.material_texture_specular1 = glGetUniformLocation(gbuffer_program, "texture_specular1");
-  uniforms.material_hasNormalMap = glGetUniformLocation(gbuffer_program, "hasNormalMap");
-  uniforms.material_hasTexture = glGetUniformLocation(gbuffer_program, "hasTexture");
-  uniforms.material_roughness = glGetUniformLocation(gbuffer_program, "material.roughness");
-  uniforms.material_metallic = glGetUniformLocation(gbuffer_program, "material.metallic");
-  
   // Cache post-processing uniforms
   uniforms.postprocess_screenTexture = glGetUniformLocation(postprocess_program, "screenTexture");
   uniforms.postprocess_gamma = glGetUniformLocation(postprocess_program, "gamma");
   uniforms.postprocess_exposure = glGetUniformLocation(postprocess_program, "exposure");
+
+  // Cache texture feedback uniforms
+  for (int v = 0; v < FEEDBACK_VARIANT_COUNT; v++) {
+    FeedbackVariant *variant = &feedback_variants[v];
+    variant->program = rafgl_program_variant("feedback", variant->defines);
+    variant->view = glGetUniformLocation(variant->program, "view");
+    variant->projection = glGetUniformLocation(variant->program, "projection");
+    variant->textureSize = glGetUniformLocation(variant->program, "materialTextureSize");
+    variant->lodBias = glGetUniformLocation(variant->program, "lodBias");
+  }
   uniforms.postprocess_time = glGetUniformLocation(postprocess_program, "time");
   
   // Debug uniform locations
@@ -305,11 +523,130 @@ void main_state_init(GLFWwindow *window, void *args, int width, int height) {
   printf("  gamma: %d\n", uniforms.postprocess_gamma);
   printf("  exposure: %d\n", uniforms.postprocess_exposure);
   printf("  time: %d\n", uniforms.postprocess_time);
-  
-  // Cache additional uniforms for non-gbuffer programs (eliminates remaining 18 runtime lookups)
-  uniforms.gbuffer_hasTexture_other = glGetUniformLocation(gbuffer_program, "hasTexture");  // Same as gbuffer_hasTexture but kept separate for clarity
-  uniforms.gbuffer_materialColor_other = glGetUniformLocation(gbuffer_program, "materialColor");  // Same as gbuffer_materialColor but kept separate for clarity
-  uniforms.gbuffer_model_other = glGetUniformLocation(gbuffer_program, "model");  // Same as gbuffer_model but kept separate for clarity
+}
+
+static void lighting_variant_defines(char *defines, int first_shadowed, int shadowed) {
+  sprintf(defines, "FIRST_SHADOWED_LIGHT=%d|NUM_SHADOWED_LIGHTS=%d", first_shadowed, shadowed);
+}
+
+// Deferred lighting program with lights [first_shadowed, first_shadowed +
+// shadowed) sampling their shadow maps, compiled on first use
+static LightingVariant *lighting_variant(int first_shadowed, int shadowed) {
+  if (first_shadowed + shadowed > MAX_SHADOW_LIGHTS)
+    first_shadowed = shadowed = 0;
+
+  for (int i = 0; i < lighting_variant_count; i++)
+    if (lighting_variants[i].first_shadowed == first_shadowed &&
+        lighting_variants[i].shadowed == shadowed)
+      return &lighting_variants[i];
+
+  // Cache is sized for every range the render loop asks for
+  if (lighting_variant_count == MAX_LIGHTING_VARIANTS)
+    return &lighting_variants[0];
+
+  char defines[64];
+  lighting_variant_defines(defines, first_shadowed, shadowed);
+
+  LightingVariant *variant = &lighting_variants[lighting_variant_count++];
+  variant->first_shadowed = first_shadowed;
+  variant->shadowed = shadowed;
+  variant->program = rafgl_program_variant("deferred", defines);
+
+  variant->gPosition = glGetUniformLocation(variant->program, "gPosition");
+  variant->gNormal = glGetUniformLocation(variant->program, "gNormal");
+  variant->gAlbedoSpec = glGetUniformLocation(variant->program, "gAlbedoSpec");
+  variant->ssaoTexture = glGetUniformLocation(variant->program, "ssaoTexture");
+  variant->far_plane = glGetUniformLocation(variant->program, "far_plane");
+  variant->numLights = glGetUniformLocation(variant->program, "numLights");
+  variant->viewPos = glGetUniformLocation(variant->program, "viewPos");
+
+  // Samplers outside the range are compiled out and come back as -1
+  char shadowMapName[32];
+  for (int i = 0; i < MAX_SHADOW_LIGHTS; i++) {
+    sprintf(shadowMapName, "shadowMap%d", i);
+    variant->shadowMaps[i] = glGetUniformLocation(variant->program, shadowMapName);
+  }
+
+  light_system_bind_program(variant->program);
+  return variant;
+}
+
+// Draws every program once with the VAO it renders and into the target it
+// renders to, so drivers that compile lazily do it now and not on the first
+// frame
+static void warm_up_programs(void) {
+  // Every scene mesh shares the mesh buffer's VAO
+  gbuffer_bind_for_writing(&gbuffer);
+  for (int v = 0; v < SCENE_VARIANT_COUNT; v++)
+    rafgl_program_warm_up(gbuffer_variants[v].program, scene_meshes.vao_id, scene_meshes.vertex_count);
+  rafgl_program_warm_up(occlusion_queries.program, occlusion_queries.vao, 8);
+
+  if (light_system.count > 0) {
+    glBindFramebuffer(GL_FRAMEBUFFER, light_shadows[0].shadowFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X,
+                           light_shadows[0].shadowCubeMap, 0);
+    rafgl_program_warm_up(shadow_program, scene_meshes.vao_id, scene_meshes.vertex_count);
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
+  rafgl_program_warm_up(ssao_program, quad.VAO, 6);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  for (int i = 0; i < lighting_variant_count; i++)
+    rafgl_program_warm_up(lighting_variants[i].program, quad.VAO, 6);
+  rafgl_program_warm_up(postprocess_program, quad.VAO, 6);
+
+  glUseProgram(0);
+  glFinish();
+}
+
+void main_state_init(GLFWwindow *window, void *args, int width, int height) {
+  rafgl_memory_snapshot(&memory_at_init);
+
+  w = width;
+  h = height;
+
+  // Capture mouse cursor
+  glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+  // Set up scroll wheel callback for flashlight control
+  glfwSetScrollCallback(window, scroll_callback);
+
+  // Initialize camera
+  camera_init(&camera);
+
+  // Candles plus the flashlight
+  light_system_init(&light_system, 8);
+
+  // Every mesh loaded from here on is appended to the scene mesh buffer
+  rafgl_mesh_buffer_init(&scene_meshes, 1 << 18);
+  rafgl_mesh_buffer_bind(&scene_meshes);
+
+  // Create procedural candle geometry using available RAFGL functions
+  rafgl_meshPUN_init(&candle_base_mesh);
+  rafgl_meshPUN_load_cube(&candle_base_mesh,
+                          CANDLE_BASE_HALF_SIZE); // Simple cube for candle base
+
+  rafgl_meshPUN_init(&candle_flame_mesh);
+  rafgl_meshPUN_load_cube(&candle_flame_mesh, CANDLE_FLAME_HALF_SIZE); // Small cube for flame
+
+  // Initialize G-Buffer
+  gbuffer_init(&gbuffer, width, height);
+
+  // Start every fixed program compiling, with parallel shader compile the
+  // driver builds them while the meshes and textures load
+  for (int v = 0; v < SCENE_VARIANT_COUNT; v++)
+    rafgl_program_variant_request("gbuffer", gbuffer_variants[v].defines);
+  rafgl_program_variant_request("postprocess", NULL);
+  rafgl_program_variant_request("shadows", NULL);
+  rafgl_program_variant_request("ssao", NULL);
+  for (int v = 0; v < FEEDBACK_VARIANT_COUNT; v++)
+    rafgl_program_variant_request("feedback", feedback_variants[v].defines);
+  rafgl_program_variant_request("occlusion_proxy", NULL);
+
+  // Lights are uploaded as one uniform block instead of per-light uniforms,
+  // every lighting variant binds it when it is created
+  light_system_create_buffer(&light_system);
 
   // Initialize fullscreen quad
   fullscreen_quad_init(&quad);
@@ -358,224 +695,256 @@ void main_state_init(GLFWwindow *window, void *args, int width, int height) {
 
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+  // CPU occlusion buffer with the screen's aspect, its debug view is blitted
+  // from its own framebuffer
+  occlusion_buffer_init(&occlusion, OCCLUSION_WIDTH, OCCLUSION_WIDTH * height / width);
+  occlusion_debug_pixels = rafgl_malloc(RAFGL_MEM_SCENE, occlusion.width * occlusion.height * 4);
+  glGenFramebuffers(1, &occlusion_debug_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, occlusion_debug_fbo);
+  glGenTextures(1, &occlusion_debug_texture);
+  glBindTexture(GL_TEXTURE_2D, occlusion_debug_texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, occlusion.width, occlusion.height, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, NULL);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         occlusion_debug_texture, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  occlusion_queries_init(&occlusion_queries);
+
   // Create detailed floor geometry for better shadow receiving
   rafgl_meshPUN_init(&floor_mesh);
-  rafgl_meshPUN_load_plane(&floor_mesh, 20.0f, 20.0f, 50,
+  rafgl_meshPUN_load_plane(&floor_mesh, FLOOR_SIZE, FLOOR_SIZE, 50,
                            50); // High subdivision for shadows
 
-  // Load tavern models from .obj files
-  rafgl_meshPUN_init(&barrel_mesh);
-  rafgl_meshPUN_load_from_OBJ(
-      &barrel_mesh, "res/models/Wooden barrel with metal bands/base.obj");
-
-  rafgl_meshPUN_init(&table_round_mesh);
-  rafgl_meshPUN_load_from_OBJ(
-      &table_round_mesh,
-      "res/models/Round wooden table with pedestal base/base.obj");
-
-  rafgl_meshPUN_init(&bench_mesh);
-  rafgl_meshPUN_load_from_OBJ(&bench_mesh,
-                              "res/models/Wooden bench with panels/base.obj");
-
-  rafgl_meshPUN_init(&stool_mesh);
-  rafgl_meshPUN_load_from_OBJ(
-      &stool_mesh, "res/models/Wooden stool with ocagonal seat/base.obj");
-
-  rafgl_meshPUN_init(&beer_mug_mesh);
-  rafgl_meshPUN_load_from_OBJ(&beer_mug_mesh,
-                              "res/models/Wooden beer mug with foam/base.obj");
-
-  rafgl_meshPUN_init(&green_bottle_mesh);
-  rafgl_meshPUN_load_from_OBJ(
-      &green_bottle_mesh, "res/models/Green bottle with cork stopper/base.obj");
-
-  rafgl_meshPUN_init(&wall_candle_mesh);
-  rafgl_meshPUN_load_from_OBJ(
-      &wall_candle_mesh, "res/models/Wall-mounted candle with flame/base.obj");
-
-  rafgl_meshPUN_init(&food_plate_mesh);
-  rafgl_meshPUN_load_from_OBJ(
-      &food_plate_mesh, "res/models/Plate with steak and drumstick/base.obj");
-
   // Keep basic cube for debugging
   rafgl_meshPUN_init(&cube_mesh);
-  rafgl_meshPUN_load_cube(&cube_mesh, 1.0f);
-
-  // Initialize wall candles - visual position close to walls
-  wall_candles[0] = (WallCandle){
-      .position =
-          vec3(0.0f, 1.8f, -5.15f), // Back wall - visual position close to wall
-      .intensity = 1.0f,
-      .flicker_speed = 3.0f,
-      .time_offset = 0.0f,
-      .light_index = 0};
-
-  wall_candles[1] = (WallCandle){
-      .position =
-          vec3(-5.15f, 1.5f, 2.0f), // Left wall - visual position close to wall
-      .intensity = 1.0f,
-      .flicker_speed = 2.5f,
-      .time_offset = 1.0f,
-      .light_index = 1};
-
-  wall_candles[2] = (WallCandle){
-      .position = vec3(5.15f, 1.5f,
-                       -1.0f), // Right wall - visual position close to wall
-      .intensity = 1.0f,
-      .flicker_speed = 2.8f,
-      .time_offset = 2.0f,
-      .light_index = 2};
-
-  // Initialize dining tables - consistent with candle pattern
-  dining_tables[0].position = vec3(-3.5f, 0.0f, 1.0f);
-  dining_tables[1].position = vec3(-1.0f, 0.0f, 3.5f);
-  dining_tables[2].position = vec3(1.5f, 0.0f, 0.5f);
-
-  // Initialize barrels - consistent with candle pattern
-  barrels[0].position = vec3(4.5f, 0.0f, 4.0f);
-  barrels[1].position = vec3(-4.5f, 0.0f, 4.0f);
-  barrels[2].position = vec3(-4.5f, 0.0f, -2.0f);
-  barrels[3].position = vec3(2.0f, 0.0f, 4.0f);
-
-  // Pre-calculate static transformation matrices
-  // Wall transforms
-  wall_transforms[0] = m4_mul(m4_translation(vec3(0.0f, WALL_HEIGHT, -5.5f)),
-                              m4_scaling(vec3(WALL_LENGTH, 4.0f, WALL_THICKNESS))); // Back wall
-  wall_transforms[1] = m4_mul(m4_translation(vec3(-5.5f, WALL_HEIGHT, 0.0f)),
-                              m4_scaling(vec3(WALL_THICKNESS, 4.0f, WALL_LENGTH))); // Left wall  
-  wall_transforms[2] = m4_mul(m4_translation(vec3(5.5f, WALL_HEIGHT, 0.0f)),
-                              m4_scaling(vec3(WALL_THICKNESS, 4.0f, WALL_LENGTH))); // Right wall
-  wall_transforms[3] = m4_mul(m4_translation(vec3(-3.0f, WALL_HEIGHT, 5.5f)),
-                              m4_scaling(vec3(5.0f, 4.0f, WALL_THICKNESS))); // Front left segment
-  wall_transforms[4] = m4_mul(m4_translation(vec3(3.0f, WALL_HEIGHT, 5.5f)),
-                              m4_scaling(vec3(5.0f, 4.0f, WALL_THICKNESS))); // Front right segment
-  wall_transforms[5] = m4_mul(m4_translation(vec3(0.0f, 3.0f, 5.5f)),
-                              m4_scaling(vec3(2.0f, 2.0f, WALL_THICKNESS))); // Door lintel
-
-  // Table transforms
-  for (int i = 0; i < 3; i++) {
-    table_transforms[i] = m4_mul(m4_translation(dining_tables[i].position),
-                                 m4_scaling(vec3(0.7f, 0.7f, 0.7f)));
+  rafgl_meshPUN_load_cube(&cube_mesh, CUBE_HALF_SIZE);
+
+  // Tavern models from .obj files are streamed, the streaming region has to
+  // be the last thing in the mesh buffer
+  mesh_residency_init(&mesh_residency, &scene_meshes, (size_t)MESH_BUDGET_MB * 1024 * 1024,
+                      MESH_STREAM_RADIUS);
+  const struct {
+    rafgl_meshPUN_t *mesh;
+    const char *path;
+  } props[] = {
+      {&barrel_mesh, "res/models/Wooden barrel with metal bands/base.obj"},
+      {&table_round_mesh, "res/models/Round wooden table with pedestal base/base.obj"},
+      {&bench_mesh, "res/models/Wooden bench with panels/base.obj"},
+      {&stool_mesh, "res/models/Wooden stool with ocagonal seat/base.obj"},
+      {&beer_mug_mesh, "res/models/Wooden beer mug with foam/base.obj"},
+      {&green_bottle_mesh, "res/models/Green bottle with cork stopper/base.obj"},
+      {&wall_candle_mesh, "res/models/Wall-mounted candle with flame/base.obj"},
+      {&food_plate_mesh, "res/models/Plate with steak and drumstick/base.obj"},
+  };
+  for (int i = 0; i < (int)(sizeof(props) / sizeof(props[0])); i++) {
+    rafgl_meshPUN_init(props[i].mesh);
+    mesh_residency_add(&mesh_residency, props[i].mesh, props[i].path);
   }
-
-  // Barrel transforms
-  for (int i = 0; i < 4; i++) {
-    barrel_transforms[i] = m4_mul(m4_translation(barrels[i].position),
-                                  m4_scaling(vec3(0.8f, 0.8f, 0.8f)));
+  mesh_residency_load(&mesh_residency);
+
+  rafgl_mesh_buffer_bind(NULL);
+  // Up to a gbuffer and a shadow instance per node
+  static_batch_init(&scene_batch, &scene_meshes, 2 * SCENE_MAX_NODES);
+
+  // Build the scene, parents are always added before their children
+  int component_size[COMPONENT_COUNT] = {
+      [COMPONENT_NODE] = sizeof(int),
+      [COMPONENT_RENDERABLE] = sizeof(Renderable),
+      [COMPONENT_LIGHT] = sizeof(LightEmitter),
+      [COMPONENT_FLAME] = sizeof(AnimatedFlame),
+      [COMPONENT_OCCLUDER] = sizeof(Occluder)};
+  entity_store_init(&scene, component_size, COMPONENT_COUNT);
+  transform_system_init(&transforms, SCENE_MAX_NODES);
+  scene_bvh_init(&scene_bvh, SCENE_MAX_NODES);
+  for (int i = 0; i < SCENE_MAX_NODES; i++) {
+    node_entities[i] = ENTITY_NONE;
+    node_cells[i] = -1;
   }
 
-  // Bar counter transform
-  bar_counter_transform = m4_mul(m4_translation(vec3(3.5f, 0.0f, -2.0f)),
-                                 m4_scaling(vec3(4.5f, 1.2f, 1.5f)));
-
-  // Fireplace transform
-  fireplace_transform = m4_mul(m4_translation(vec3(-4.5f, 1.0f, -4.0f)),
-                               m4_scaling(vec3(1.0f, 2.0f, 1.0f)));
+  // The tavern and the street outside its door
+  portal_cells_init(&cells, SCENE_MAX_CELLS, SCENE_MAX_CELLS);
+  int tavern_cell = portal_cells_add_cell(
+      &cells, vec3(-TAVERN_INTERIOR_HALF, -0.1f, -TAVERN_INTERIOR_HALF),
+      vec3(TAVERN_INTERIOR_HALF, TAVERN_INTERIOR_TOP, TAVERN_INTERIOR_HALF));
+  int street_cell = portal_cells_add_cell(
+      &cells, vec3(-WALL_LENGTH, -0.1f, DOOR_Z + WALL_THICKNESS),
+      vec3(WALL_LENGTH, TAVERN_INTERIOR_TOP, DOOR_Z + WALL_THICKNESS + STREET_DEPTH));
+  const vec3_t door[4] = {{-DOOR_HALF_WIDTH, 0.0f, DOOR_Z},
+                          {DOOR_HALF_WIDTH, 0.0f, DOOR_Z},
+                          {DOOR_HALF_WIDTH, DOOR_HEIGHT, DOOR_Z},
+                          {-DOOR_HALF_WIDTH, DOOR_HEIGHT, DOOR_Z}};
+  portal_cells_add_portal(&cells, tavern_cell, street_cell, door);
+  portal_cells_finish(&cells);
 
-  // Pre-calculate stool positions
-  for (int table_idx = 0; table_idx < 3; table_idx++) {
-    for (int stool_idx = 0; stool_idx < 3; stool_idx++) {
-      float angle = stool_idx * STOOL_ANGLE_STEP; // 120 degrees apart
-      float stool_x = dining_tables[table_idx].position.x + cosf(angle) * STOOL_RADIUS;
-      float stool_z = dining_tables[table_idx].position.z + sinf(angle) * STOOL_RADIUS;
-      stool_positions[table_idx][stool_idx] = vec3(stool_x, 0.0f, stool_z);
-    }
+  // Floor - at exact ground level for clean shadows
+  spawn_renderable(TRANSFORM_NONE, m4_identity(), &floor_mesh, NULL,
+                   vec3(0.5f, 0.35f, 0.2f));
+
+  // Complete wall system
+  const struct {
+    vec3_t position, scale;
+  } walls[] = {
+      {{0.0f, WALL_HEIGHT, -5.5f}, {WALL_LENGTH, 4.0f, WALL_THICKNESS}}, // Back wall
+      {{-5.5f, WALL_HEIGHT, 0.0f}, {WALL_THICKNESS, 4.0f, WALL_LENGTH}}, // Left wall
+      {{5.5f, WALL_HEIGHT, 0.0f}, {WALL_THICKNESS, 4.0f, WALL_LENGTH}},  // Right wall
+      {{-3.0f, WALL_HEIGHT, 5.5f}, {5.0f, 4.0f, WALL_THICKNESS}},        // Front left segment
+      {{3.0f, WALL_HEIGHT, 5.5f}, {5.0f, 4.0f, WALL_THICKNESS}},         // Front right segment
+      {{0.0f, 3.0f, 5.5f}, {2.0f, 2.0f, WALL_THICKNESS}}};               // Door lintel
+  vec3_t cube_min = vec3(-CUBE_HALF_SIZE, -CUBE_HALF_SIZE, -CUBE_HALF_SIZE);
+  vec3_t cube_max = vec3(CUBE_HALF_SIZE, CUBE_HALF_SIZE, CUBE_HALF_SIZE);
+  for (int i = 0; i < (int)(sizeof(walls) / sizeof(walls[0])); i++) {
+    EntityId wall = spawn_renderable(TRANSFORM_NONE,
+                                     m4_mul(m4_translation(walls[i].position), m4_scaling(walls[i].scale)),
+                                     &cube_mesh, NULL, vec3(0.5f, 0.3f, 0.2f));
+    add_occluder(wall, cube_min, cube_max);
   }
 
-  // Pre-calculate beer mug transforms (eliminates matrix math in render loop)
+  // Massive bar counter with beer mugs and bottles, the bench model is solid
+  // between its front and back panels
+  EntityId bar = spawn_renderable(TRANSFORM_NONE,
+                                  m4_mul(m4_translation(vec3(3.5f, 0.0f, -2.0f)),
+                                         m4_scaling(vec3(4.5f, 1.2f, 1.5f))),
+                                  &bench_mesh, &texture_manager.wooden_bench, vec3(1.0f, 1.0f, 1.0f));
+  add_occluder(bar, BAR_OCCLUDER_MIN, BAR_OCCLUDER_MAX);
+
   for (int i = 0; i < 4; i++) {
     float bar_x = 2.0f + (i * 0.8f) - 1.0f;
-    beer_mug_transforms[i] = m4_mul(m4_translation(vec3(bar_x, BAR_COUNTER_HEIGHT, -2.0f)),
-                                    m4_scaling(vec3(BEER_MUG_SCALE, BEER_MUG_SCALE, BEER_MUG_SCALE)));
+    EntityId mug = spawn_renderable(TRANSFORM_NONE,
+                                    m4_mul(m4_translation(vec3(bar_x, BAR_COUNTER_HEIGHT, -2.0f)),
+                                           m4_scaling(vec3(BEER_MUG_SCALE, BEER_MUG_SCALE, BEER_MUG_SCALE))),
+                                    &beer_mug_mesh, &texture_manager.beer_mug, vec3(1.0f, 1.0f, 1.0f));
+    add_occlusion_query(mug);
   }
 
-  // Pre-calculate bottle transforms (eliminates matrix math in render loop)
   for (int i = 0; i < 2; i++) {
     float bottle_x = 4.0f + (i * 0.8f) - 0.4f;
-    bottle_transforms[i] = m4_mul(m4_translation(vec3(bottle_x, 0.95f, -1.8f)),
-                                  m4_scaling(vec3(GREEN_BOTTLE_SCALE, GREEN_BOTTLE_SCALE, GREEN_BOTTLE_SCALE)));
+    EntityId bottle = spawn_renderable(
+        TRANSFORM_NONE,
+        m4_mul(m4_translation(vec3(bottle_x, 0.95f, -1.8f)),
+               m4_scaling(vec3(GREEN_BOTTLE_SCALE, GREEN_BOTTLE_SCALE, GREEN_BOTTLE_SCALE))),
+        &green_bottle_mesh, &texture_manager.green_bottle, vec3(1.0f, 1.0f, 1.0f));
+    add_occlusion_query(bottle);
   }
 
-  // Initialize table candles - Object hierarchy with programmatic animation
-  // Table model scaled by 0.7f, need to calculate actual table surface height
-  // Assuming original table height ~2.0f, scaled = 1.4f surface height
-  for (int i = 0; i < num_table_candles; i++) {
-    table_candles[i] = (TableCandle){
-        .base_position =
-            vec3(dining_tables[i].position.x, TABLE_SURFACE_HEIGHT,
-                 dining_tables[i].position.z),  // Use dining table positions
-        .flame_offset = vec3(0.0f, 0.0f, 0.0f), // Will be animated
-        .intensity = 1.0f,
-        .flicker_speed = 2.5f + i * 0.3f,
-        .time_offset = i * 0.8f,
-        .light_index = num_wall_candles + i};
+  // Dining tables, each the parent of its stools
+  int num_tables = sizeof(dining_table_positions) / sizeof(dining_table_positions[0]);
+  int table_nodes[sizeof(dining_table_positions) / sizeof(dining_table_positions[0])];
+  for (int table_idx = 0; table_idx < num_tables; table_idx++) {
+    table_nodes[table_idx] = transform_system_add(
+        &transforms, TRANSFORM_NONE, m4_translation(dining_table_positions[table_idx]));
+    EntityId table = spawn_renderable(table_nodes[table_idx], m4_scaling(vec3(0.7f, 0.7f, 0.7f)),
+                                      &table_round_mesh, &texture_manager.round_table,
+                                      vec3(1.0f, 1.0f, 1.0f));
+    add_occluder(table, TABLE_TOP_OCCLUDER_MIN, TABLE_TOP_OCCLUDER_MAX);
   }
 
-  // Create lights for all candles
-  // Wall candles - calculate light position based on candle position and wall
-  // orientation
-  for (int i = 0; i < num_wall_candles; i++) {
-    // Calculate light offset from wall surface toward room center
-    vec3_t light_offset = vec3(0.0f, CANDLE_FLAME_HEIGHT, 0.0f); // Default: above candle
-
-    if (i == 0) {
-      // Back wall candle - offset forward (positive Z) toward room
-      light_offset = vec3(0.0f, CANDLE_FLAME_HEIGHT, LIGHT_OFFSET_DISTANCE);
-    } else if (i == 1) {
-      // Left wall candle - offset right (positive X) toward room
-      light_offset = vec3(LIGHT_OFFSET_DISTANCE, CANDLE_FLAME_HEIGHT, 0.0f);
-    } else if (i == 2) {
-      // Right wall candle - offset left (negative X) toward room
-      light_offset = vec3(-LIGHT_OFFSET_DISTANCE, CANDLE_FLAME_HEIGHT, 0.0f);
+  for (int table_idx = 0; table_idx < num_tables; table_idx++) {
+    for (int stool_idx = 0; stool_idx < 3; stool_idx++) {
+      float angle = stool_idx * STOOL_ANGLE_STEP; // 120 degrees apart
+      vec3_t offset = vec3(cosf(angle) * STOOL_RADIUS, 0.0f, sinf(angle) * STOOL_RADIUS);
+      spawn_renderable(table_nodes[table_idx],
+                       m4_mul(m4_translation(offset), m4_scaling(vec3(0.4f, 0.4f, 0.4f))),
+                       &stool_mesh, &texture_manager.wooden_stool, vec3(1.0f, 1.0f, 1.0f));
     }
-
-    vec3_t flame_pos = v3_add(wall_candles[i].position, light_offset);
-    lights[i] =
-        (PointLight){.position = flame_pos,
-                     .color = vec3(1.0f, 0.6f, 0.3f), // Warm candle light
-                     .radius = global_light_radius,
-                     .shadowFBO = 0,
-                     .shadowCubeMap = 0};
-    setup_point_light_shadows(&lights[i], 512, 512);
   }
 
-  // Table candles - position lights at flame location (will be updated in
-  // animation loop)
-  for (int i = 0; i < num_table_candles; i++) {
-    vec3_t initial_flame_pos = v3_add(table_candles[i].base_position,
-                                      vec3(0.0f, 0.12f, 0.0f)); // Above base
-
-    lights[num_wall_candles + i] =
-        (PointLight){.position = initial_flame_pos,
-                     .color = vec3(1.0f, 0.6f, 0.3f), // Warm candle light
-                     .radius = global_light_radius, // Use global radius for all
-                     .shadowFBO = 0,
-                     .shadowCubeMap = 0};
-    setup_point_light_shadows(&lights[num_wall_candles + i], 512, 512);
+  // Barrels
+  for (int i = 0; i < (int)(sizeof(barrel_positions) / sizeof(barrel_positions[0])); i++) {
+    EntityId barrel = spawn_renderable(
+        TRANSFORM_NONE, m4_mul(m4_translation(barrel_positions[i]), m4_scaling(vec3(0.8f, 0.8f, 0.8f))),
+        &barrel_mesh, &texture_manager.wooden_barrel, vec3(1.0f, 1.0f, 1.0f));
+    add_occlusion_query(barrel);
   }
 
-  num_lights = num_wall_candles + num_table_candles;
+  // Fireplace
+  EntityId fireplace = spawn_renderable(TRANSFORM_NONE,
+                                        m4_mul(m4_translation(vec3(-4.5f, 1.0f, -4.0f)),
+                                               m4_scaling(vec3(1.0f, 2.0f, 1.0f))),
+                                        &cube_mesh, NULL, vec3(0.3f, 0.3f, 0.3f));
+  add_occluder(fireplace, cube_min, cube_max);
+
+  // Items on round tables, relative to their table
+  add_occlusion_query(spawn_renderable(
+      table_nodes[0],
+      m4_mul(m4_translation(vec3(0.3f, TABLE_ITEM_HEIGHT, 0.2f)),
+             m4_scaling(vec3(GREEN_BOTTLE_SCALE, GREEN_BOTTLE_SCALE, GREEN_BOTTLE_SCALE))),
+      &beer_mug_mesh, &texture_manager.beer_mug, vec3(1.0f, 1.0f, 1.0f)));
+  add_occlusion_query(spawn_renderable(
+      table_nodes[1],
+      m4_mul(m4_translation(vec3(-0.3f, TABLE_ITEM_HEIGHT, -0.2f)),
+             m4_scaling(vec3(FOOD_PLATE_SCALE, FOOD_PLATE_SCALE, FOOD_PLATE_SCALE))),
+      &food_plate_mesh, &texture_manager.food_plate, vec3(1.0f, 1.0f, 1.0f)));
+  add_occlusion_query(spawn_renderable(
+      table_nodes[1],
+      m4_mul(m4_translation(vec3(0.3f, 1.33f, 0.2f)), m4_scaling(vec3(0.08f, 0.08f, 0.08f))),
+      &green_bottle_mesh, &texture_manager.green_bottle, vec3(1.0f, 1.0f, 1.0f)));
+
+  // Wall candles - visual position close to walls, lights offset toward the
+  // room center
+  spawn_wall_candle(vec3(0.0f, 1.8f, -5.15f), 0.0f, // Back wall
+                    vec3(0.0f, CANDLE_FLAME_HEIGHT, LIGHT_OFFSET_DISTANCE), 3.0f, 0.0f);
+  spawn_wall_candle(vec3(-5.15f, 1.5f, 2.0f), M_PIf / 2.0f, // Left wall
+                    vec3(LIGHT_OFFSET_DISTANCE, CANDLE_FLAME_HEIGHT, 0.0f), 2.5f, 1.0f);
+  spawn_wall_candle(vec3(5.15f, 1.5f, -1.0f), -M_PIf / 2.0f, // Right wall
+                    vec3(-LIGHT_OFFSET_DISTANCE, CANDLE_FLAME_HEIGHT, 0.0f), 2.8f, 2.0f);
+  int num_wall_candles = light_system.count;
+
+  // One candle on every dining table
+  for (int i = 0; i < num_tables; i++)
+    spawn_table_candle(table_nodes[i], 2.5f + i * 0.3f, i * 0.8f);
+
+  transform_system_update(&transforms);
+  for (int node = 0; node < transforms.count; node++)
+    scene_bounds_update(node);
+  scene_bvh_build(&scene_bvh);
+
+  num_lights = light_system.count;
   base_num_lights = num_lights; // All candles are now base lights
 
   printf("INITIALIZATION: %d candle lights created (%d wall + %d table)\n",
-         num_lights, num_wall_candles, num_table_candles);
+         num_lights, num_wall_candles, num_lights - num_wall_candles);
+
+  // Request every lighting variant the candles and the flashlight can need
+  // before the textures load, so they compile alongside the decoding
+  char defines[64];
+  for (int shadowed = 0; shadowed <= base_num_lights + 1 && shadowed <= MAX_SHADOW_LIGHTS; shadowed++) {
+    lighting_variant_defines(defines, 0, shadowed);
+    rafgl_program_variant_request("deferred", defines);
+  }
+  if (base_num_lights < MAX_SHADOW_LIGHTS) {
+    lighting_variant_defines(defines, base_num_lights, 1);
+    rafgl_program_variant_request("deferred", defines);
+  }
 
   // Initialize texture manager
   texture_manager_init(&texture_manager);
+  texture_residency_feedback_init(&texture_manager.residency, width, height);
 
   // Auto-activate flashlight at startup (so lights are visible immediately)
   flashlight_active = 1;
-  lights[base_num_lights] = (PointLight){
+  LightDesc flashlight = {
       .position =
           v3_add(camera.position, v3_muls(camera.front, flashlight_distance)),
       .color = vec3(1.0f, 1.0f, 1.0f), // White flashlight
       .radius = global_light_radius,
-      .shadowFBO = 0,
-      .shadowCubeMap = 0};
-  setup_point_light_shadows(&lights[base_num_lights], 512, 512);
-  num_lights = base_num_lights + 1;
+      .intensity_base = 1.0f}; // No flicker or jitter
+  int flashlight_index = light_system_add(&light_system, &flashlight);
+  if (flashlight_index >= 0 && flashlight_index < MAX_SHADOW_LIGHTS)
+    setup_point_light_shadows(&light_shadows[flashlight_index], 512, 512);
+  light_system_animate(&light_system, animation_time);
+  num_lights = base_num_lights + (flashlight_index >= 0);
   // Flashlight auto-activated to initialize lighting
 
+  // Every program has been building in the background, now wait for them
+  cache_uniform_locations();
+
+  // Compile every lighting variant up front so toggling shadow modes or the
+  // flashlight never stalls on a shader compile
+  for (int shadowed = 0; shadowed <= num_lights && shadowed <= MAX_SHADOW_LIGHTS; shadowed++)
+    lighting_variant(0, shadowed);
+  lighting_variant(base_num_lights, 1);
+  warm_up_programs();
+
   glEnable(GL_DEPTH_TEST);
 }
 
@@ -597,75 +966,6 @@ void main_state_update(GLFWwindow *window, float delta_time,
     }
   }
 
-  // Animate wall candle lights only (no geometry movement)
-  for (int i = 0; i < num_wall_candles; i++) {
-    WallCandle *candle = &wall_candles[i];
-
-    // Calculate animation phase for this candle
-    float phase = animation_time * candle->flicker_speed + candle->time_offset;
-
-    // Animate flame intensity using optimized sine lookup
-    candle->intensity = FLAME_INTENSITY_BASE + FLAME_INTENSITY_VARIATION * fast_sin(phase) * fast_sin(phase * 1.3f);
-
-    // Calculate light position based on candle position and wall orientation using optimized sine
-    vec3_t flame_flicker =
-        vec3(FLAME_FLICKER_SCALE_X * fast_sin(phase * 2.1f), 
-             FLAME_FLICKER_SCALE_Y * fast_sin(phase * 1.7f),
-             FLAME_FLICKER_SCALE_Z * fast_sin(phase * 2.3f));
-
-    // Calculate light offset from wall surface toward room center
-    vec3_t light_offset = vec3(0.0f, CANDLE_FLAME_HEIGHT, 0.0f); // Default: above candle
-
-    if (i == 0) {
-      // Back wall candle - offset forward (positive Z) toward room
-      light_offset = vec3(0.0f, CANDLE_FLAME_HEIGHT, LIGHT_OFFSET_DISTANCE);
-    } else if (i == 1) {
-      // Left wall candle - offset right (positive X) toward room
-      light_offset = vec3(LIGHT_OFFSET_DISTANCE, CANDLE_FLAME_HEIGHT, 0.0f);
-    } else if (i == 2) {
-      // Right wall candle - offset left (negative X) toward room
-      light_offset = vec3(-LIGHT_OFFSET_DISTANCE, CANDLE_FLAME_HEIGHT, 0.0f);
-    }
-
-    lights[candle->light_index].position =
-        v3_add(candle->position, v3_add(light_offset, flame_flicker));
-
-    // Update light color
-    lights[candle->light_index].color =
-        vec3(candle->intensity * 1.0f, // Red channel
-             candle->intensity * 0.6f, // Green channel
-             candle->intensity * 0.3f  // Blue channel (warm orange)
-        );
-  }
-
-  // Animate table candle flames - Object hierarchy with programmatic movement
-  for (int i = 0; i < num_table_candles; i++) {
-    TableCandle *candle = &table_candles[i];
-
-    // Calculate animation phase for this candle
-    float phase = animation_time * candle->flicker_speed + candle->time_offset;
-
-    // Animate flame intensity using optimized sine lookup
-    candle->intensity = FLAME_INTENSITY_BASE + FLAME_INTENSITY_VARIATION * fast_sin(phase) * fast_sin(phase * 1.3f);
-
-    // Animate flame position using optimized sine (subtle wobble - child movement relative to parent)
-    candle->flame_offset.x = TABLE_FLAME_OFFSET_X * fast_sin(phase * 2.1f);
-    candle->flame_offset.y = TABLE_FLAME_OFFSET_Y * fast_sin(phase * 1.7f); // More vertical movement
-    candle->flame_offset.z = TABLE_FLAME_OFFSET_Z * fast_sin(phase * 2.3f);
-
-    // Update light properties - Position light at animated flame location
-    // (Parent + Child + flame height)
-    vec3_t flame_light_pos =
-        v3_add(candle->base_position,
-               v3_add(candle->flame_offset, vec3(0.0f, 0.12f, 0.0f)));
-    lights[candle->light_index].position = flame_light_pos;
-    lights[candle->light_index].color =
-        vec3(candle->intensity * 1.0f, // Red channel
-             candle->intensity * 0.6f, // Green channel
-             candle->intensity * 0.3f  // Blue channel (warm orange)
-        );
-  }
-
   // Key state management now handled at global scope for performance
   
   // Handle flashlight toggle with F key
@@ -674,9 +974,9 @@ void main_state_update(GLFWwindow *window, float delta_time,
       // F key just pressed - toggle flashlight
       if (!flashlight_active) {
         // Reactivate flashlight (shadow resources already allocated in init)
-        lights[base_num_lights].position = camera.position;
-        lights[base_num_lights].color = vec3(1.0f, 0.9f, 0.7f); // Warm white flashlight
-        lights[base_num_lights].radius = 50.0f;                 // Very strong flashlight
+        light_system_set_position(&light_system, base_num_lights, camera.position);
+        light_system_set_color(&light_system, base_num_lights, vec3(1.0f, 0.9f, 0.7f)); // Warm white flashlight
+        light_system_set_radius(&light_system, base_num_lights, 50.0f);                 // Very strong flashlight
         
         flashlight_active = 1;
         num_lights = base_num_lights + 1;
@@ -704,7 +1004,7 @@ void main_state_update(GLFWwindow *window, float delta_time,
 
       // Update all active lights
       for (int i = 0; i < base_num_lights; i++) {
-        lights[i].radius = global_light_radius;
+        light_system_set_radius(&light_system, i, global_light_radius);
       }
       DEBUG_PRINT(2, "Light radius decreased to: %.1f\n", global_light_radius);
     }
@@ -722,7 +1022,7 @@ void main_state_update(GLFWwindow *window, float delta_time,
 
       // Update all active lights
       for (int i = 0; i < base_num_lights; i++) {
-        lights[i].radius = global_light_radius;
+        light_system_set_radius(&light_system, i, global_light_radius);
       }
       DEBUG_PRINT(2, "Light radius increased to: %.1f\n", global_light_radius);
     }
@@ -775,233 +1075,147 @@ void main_state_update(GLFWwindow *window, float delta_time,
     key_states[KEY_SHIFT] = 0;
   }
 
-  // Update flashlight position to follow camera at controlled distance
-  if (flashlight_active) {
-    lights[base_num_lights].position =
-        v3_add(camera.position, v3_muls(camera.front, flashlight_distance));
-  }
-}
-
-// Unified rendering function for both shadow and geometry passes
-void render_unified_scene(GLuint shader_program, RenderMode mode) {
-  mat4_t model = m4_identity();
-  
-  // Get appropriate model uniform location for this shader program
-  GLint model_location;
-  if (shader_program == gbuffer_program) {
-    model_location = uniforms.gbuffer_model;
+  // Handle the GPU culled crate field with G key
+  if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS) {
+    if (!key_states[KEY_G]) {
+      crate_field_enabled = !crate_field_enabled;
+      crate_field_frame = 0;
+      // The culled set from before it was hidden is stale
+      if (crate_field_enabled && crate_field.program)
+        instance_cull_reset(&crate_field);
+    }
+    key_states[KEY_G] = 1;
   } else {
-    // For shadow program, use cached uniform location
-    model_location = uniforms.shadow_model;
+    key_states[KEY_G] = 0;
   }
-  
-  // Floor - at exact ground level for clean shadows
-  model = m4_translation(vec3(0.0f, 0.0f, 0.0f));
-  glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)model.m);
-  if (mode == RENDER_MODE_GEOMETRY) {
-    glUniform3f(uniforms.gbuffer_materialColor, 0.5f, 0.35f, 0.2f);
-    glUniform1f(uniforms.gbuffer_hasTexture, 0.0f);
-  }
-  glBindVertexArray(floor_mesh.vao_id);
-  glDrawArrays(GL_TRIANGLES, 0, floor_mesh.vertex_count);
 
-  // Complete wall system - batched cube rendering for optimal performance
-  if (mode == RENDER_MODE_GEOMETRY) {
-    glUniform3f(uniforms.gbuffer_materialColor, 0.5f, 0.3f, 0.2f);
-    glUniform1f(uniforms.gbuffer_hasTexture, 0.0f);
-  }
-  glBindVertexArray(cube_mesh.vao_id);
-  
-  // Back wall
-  model = m4_mul(m4_translation(vec3(0.0f, WALL_HEIGHT, -5.5f)),
-                 m4_scaling(vec3(WALL_LENGTH, 4.0f, WALL_THICKNESS)));
-  glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)model.m);
-  glDrawArrays(GL_TRIANGLES, 0, cube_mesh.vertex_count);
-
-  // Left wall
-  model = m4_mul(m4_translation(vec3(-5.5f, 2.0f, 0.0f)), m4_scaling(vec3(0.2f, 4.0f, 11.0f)));
-  glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)model.m);
-  glDrawArrays(GL_TRIANGLES, 0, cube_mesh.vertex_count);
-
-  // Right wall
-  model = m4_mul(m4_translation(vec3(5.5f, 2.0f, 0.0f)), m4_scaling(vec3(0.2f, 4.0f, 11.0f)));
-  glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)model.m);
-  glDrawArrays(GL_TRIANGLES, 0, cube_mesh.vertex_count);
-
-  // Front wall with door opening (two segments)
-  model = m4_mul(m4_translation(vec3(-3.0f, 2.0f, 5.5f)), m4_scaling(vec3(5.0f, 4.0f, 0.2f)));
-  glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)model.m);
-  glDrawArrays(GL_TRIANGLES, 0, cube_mesh.vertex_count);
-
-  model = m4_mul(m4_translation(vec3(3.0f, 2.0f, 5.5f)), m4_scaling(vec3(5.0f, 4.0f, 0.2f)));
-  glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)model.m);
-  glDrawArrays(GL_TRIANGLES, 0, cube_mesh.vertex_count);
-
-  // Door lintel
-  model = m4_mul(m4_translation(vec3(0.0f, 3.0f, 5.5f)), m4_scaling(vec3(2.0f, 2.0f, 0.2f)));
-  glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)model.m);
-  glDrawArrays(GL_TRIANGLES, 0, cube_mesh.vertex_count);
-
-  // Massive bar counter - use pre-calculated transform
-  if (mode == RENDER_MODE_GEOMETRY) {
-    material_bind(&texture_manager.wooden_bench, shader_program);
-    glUniform1f(uniforms.gbuffer_hasTexture, 1.0f);
-  }
-  glUniformMatrix4fv(model_location, 1, GL_FALSE,
-                     (float *)bar_counter_transform.m);
-  glBindVertexArray(bench_mesh.vao_id);
-  glDrawArrays(GL_TRIANGLES, 0, bench_mesh.vertex_count);
-
-  // Beer mugs on massive bar counter
-  if (mode == RENDER_MODE_GEOMETRY) {
-    material_bind(&texture_manager.beer_mug, shader_program);
-    glUniform1f(uniforms.gbuffer_hasTexture, 1.0f);
-  }
-  glBindVertexArray(beer_mug_mesh.vao_id);
-  for (int i = 0; i < 4; i++) {
-    glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)beer_mug_transforms[i].m);
-    glDrawArrays(GL_TRIANGLES, 0, beer_mug_mesh.vertex_count);
+  // Handle the occlusion buffer debug view with O key
+  if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) {
+    if (!key_states[KEY_O]) {
+      occlusion_debug = !occlusion_debug;
+      occlusion_debug_frame = 0;
+    }
+    key_states[KEY_O] = 1;
+  } else {
+    key_states[KEY_O] = 0;
   }
 
-  // Bottles on bar counter
-  if (mode == RENDER_MODE_GEOMETRY) {
-    material_bind(&texture_manager.green_bottle, shader_program);
-    glUniform1f(uniforms.gbuffer_hasTexture, 1.0f);
-  }
-  glBindVertexArray(green_bottle_mesh.vao_id);
-  for (int i = 0; i < 2; i++) {
-    glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)bottle_transforms[i].m);
-    glDrawArrays(GL_TRIANGLES, 0, green_bottle_mesh.vertex_count);
+  // Update flashlight position to follow camera at controlled distance
+  if (flashlight_active) {
+    light_system_set_position(
+        &light_system, base_num_lights,
+        v3_add(camera.position, v3_muls(camera.front, flashlight_distance)));
   }
 
-  // 3 dining tables - use pre-calculated transforms
-  if (mode == RENDER_MODE_GEOMETRY) {
-    material_bind(&texture_manager.round_table, shader_program);
-    glUniform1f(uniforms.gbuffer_hasTexture, 1.0f);
-  }
-  glBindVertexArray(table_round_mesh.vao_id);
-  for (int i = 0; i < 3; i++) {
-    glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)table_transforms[i].m);
-    glDrawArrays(GL_TRIANGLES, 0, table_round_mesh.vertex_count);
-  }
+  // Lights follow their nodes, then flicker and wobble in one pass
+  light_emitter_system();
+  light_system_animate(&light_system, animation_time);
+  animated_flame_system();
+
+  // World matrices of everything that moved, read by all render passes, and
+  // the bounds that follow them
+  transform_system_update(&transforms);
+  for (int i = 0; i < transforms.updated_count; i++)
+    scene_bounds_update(transforms.updated[i]);
+  scene_bvh_update(&scene_bvh);
+}
 
-  // All 9 octagonal stools in one batch - use pre-calculated positions
-  if (mode == RENDER_MODE_GEOMETRY) {
-    material_bind(&texture_manager.wooden_stool, shader_program);
-    glUniform1f(uniforms.gbuffer_hasTexture, 1.0f);
-  }
-  glBindVertexArray(stool_mesh.vao_id);
-  for (int i = 0; i < 3; i++) {
-    for (int stool = 0; stool < 3; stool++) {
-      model = m4_mul(m4_translation(stool_positions[i][stool]), m4_scaling(vec3(0.4f, 0.4f, 0.4f)));
-      glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)model.m);
-      glDrawArrays(GL_TRIANGLES, 0, stool_mesh.vertex_count);
-    }
-  }
+// Marks the nodes a query returned as seen by
+static void scene_mark_visible(int count, int by) {
+  for (int i = 0; i < count; i++)
+    scene_visible[scene_query[i]] |= by;
+}
 
-  // Barrels - use pre-calculated transforms
-  if (mode == RENDER_MODE_GEOMETRY) {
-    material_bind(&texture_manager.wooden_barrel, shader_program);
-    glUniform1f(uniforms.gbuffer_hasTexture, 1.0f);
-  }
-  glBindVertexArray(barrel_mesh.vao_id);
-  for (int i = 0; i < 4; i++) {
-    glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)barrel_transforms[i].m);
-    glDrawArrays(GL_TRIANGLES, 0, barrel_mesh.vertex_count);
+// Renderable system: an instance in its gbuffer variant for every renderable
+// the camera sees through the portals and past the occluders and one in the
+// shadow variant for every renderable a shadow casting light reaches through
+// the portals, uploaded once for all passes. Streamed meshes are requested
+// here and draw their proxy until they are resident.
+static void scene_batch_build(mat4_t view_projection, int shadow_lights) {
+  mesh_residency_begin(&mesh_residency, camera.position, view_projection);
+
+  memset(scene_visible, 0, sizeof(scene_visible));
+  frustum_t frustum = frustum_from_m4(view_projection);
+  scene_mark_visible(scene_bvh_query_frustum(&scene_bvh, &frustum, scene_query), SCENE_SEEN_BY_CAMERA);
+  for (int light = 0; light < shadow_lights && light < MAX_SHADOW_LIGHTS; light++)
+    scene_mark_visible(scene_bvh_query_sphere(&scene_bvh, light_system_position(&light_system, light),
+                                              SHADOW_FAR_PLANE, scene_query),
+                       SCENE_SEEN_BY_LIGHT);
+
+  portal_cells_query_camera(&cells, camera.position, view_projection);
+  portal_cells_clear_lights(&cells);
+  for (int light = 0; light < shadow_lights && light < MAX_SHADOW_LIGHTS; light++)
+    portal_cells_add_light(&cells, light_system_position(&light_system, light), SHADOW_FAR_PLANE);
+  for (int node = 0; node < transforms.count; node++) {
+    if ((scene_visible[node] & SCENE_SEEN_BY_CAMERA) &&
+        !portal_cells_test(&cells, node_cells[node], scene_bvh.min[node], scene_bvh.max[node]))
+      scene_visible[node] &= ~SCENE_SEEN_BY_CAMERA;
+    if (!portal_cells_lit(&cells, node_cells[node]))
+      scene_visible[node] &= ~SCENE_SEEN_BY_LIGHT;
   }
 
-  // Fireplace - use pre-calculated transform
-  if (mode == RENDER_MODE_GEOMETRY) {
-    glUniform3f(uniforms.gbuffer_materialColor, 0.3f, 0.3f, 0.3f);
-    glUniform1f(uniforms.gbuffer_hasTexture, 0.0f);
-  }
-  glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)fireplace_transform.m);
-  glBindVertexArray(cube_mesh.vao_id);
-  glDrawArrays(GL_TRIANGLES, 0, cube_mesh.vertex_count);
-
-  // Wall candles with proper rotations
-  if (mode == RENDER_MODE_GEOMETRY) {
-    material_bind(&texture_manager.wall_candle, shader_program);
-    glUniform1f(uniforms.gbuffer_hasTexture, 1.0f);
+  occlusion_buffer_begin(&occlusion, view_projection);
+  EntityQuery query;
+  entity_query_begin(&query, &scene, COMPONENT_BIT(COMPONENT_NODE) | COMPONENT_BIT(COMPONENT_OCCLUDER));
+  while (entity_query_next(&query)) {
+    const int *nodes = entity_query_column(&query, COMPONENT_NODE);
+    const Occluder *occluders = entity_query_column(&query, COMPONENT_OCCLUDER);
+    for (int i = 0; i < query.count; i++)
+      if (scene_visible[nodes[i]] & SCENE_SEEN_BY_CAMERA)
+        occlusion_buffer_add_box(&occlusion, transform_system_world(&transforms, nodes[i]),
+                                 occluders[i].min, occluders[i].max);
   }
-  for (int i = 0; i < num_wall_candles; i++) {
-    WallCandle *candle = &wall_candles[i];
-
-    // Apply wall-specific rotations to face tavern center
-    mat4_t rotation = m4_identity();
-    if (i == 0) {
-      rotation = m4_identity();
-    } else if (i == 1) {
-      rotation = m4_rotation_y(M_PIf / 2.0f);
-    } else if (i == 2) {
-      rotation = m4_rotation_y(-M_PIf / 2.0f);
+  occlusion_buffer_rasterize(&occlusion);
+  occlusion_queries_begin(&occlusion_queries, camera.position);
+
+  static_batch_begin(&scene_batch);
+  for (int node = 0; node < transforms.count; node++) {
+    if ((scene_visible[node] & SCENE_SEEN_BY_CAMERA) &&
+        !occlusion_buffer_test(&occlusion, scene_bvh.min[node], scene_bvh.max[node]))
+      scene_visible[node] &= ~SCENE_SEEN_BY_CAMERA;
+    if (!scene_visible[node])
+      continue;
+    Renderable *renderable = entity_get(&scene, node_entities[node], COMPONENT_RENDERABLE);
+    const mat4_t *world = transform_system_world(&transforms, node);
+    const rafgl_meshPUN_t *mesh = renderable->mesh;
+    if (renderable->stream >= 0)
+      mesh = mesh_residency_request(&mesh_residency, renderable->stream, world);
+    if (mesh == NULL)
+      continue;
+
+    const Material *material = renderable->material;
+    if (scene_visible[node] & SCENE_SEEN_BY_CAMERA) {
+      int variant = SCENE_VARIANT_FLAT;
+      if (material)
+        variant = material->has_normal_map ? SCENE_VARIANT_NORMALMAPPED : SCENE_VARIANT_TEXTURED;
+      GLuint condition = 0;
+      if (renderable->occlusion_query >= 0)
+        condition = occlusion_queries_request(&occlusion_queries, renderable->occlusion_query,
+                                              scene_bvh.min[node], scene_bvh.max[node]);
+      static_batch_add_conditional(&scene_batch, mesh, variant, world, renderable->color,
+                                   material ? material->layer : 0, condition);
     }
-
-    model = m4_mul(m4_translation(candle->position), m4_mul(rotation, m4_scaling(vec3(0.4f, 0.4f, 0.4f))));
-    glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)model.m);
-    glBindVertexArray(wall_candle_mesh.vao_id);
-    glDrawArrays(GL_TRIANGLES, 0, wall_candle_mesh.vertex_count);
+    if (scene_visible[node] & SCENE_SEEN_BY_LIGHT)
+      static_batch_add(&scene_batch, mesh, SCENE_VARIANT_SHADOW, world, renderable->color, 0);
   }
+  static_batch_end(&scene_batch);
+}
 
-  // Table candles
-  for (int i = 0; i < num_table_candles; i++) {
-    TableCandle *candle = &table_candles[i];
-
-    // Candle base
-    if (mode == RENDER_MODE_GEOMETRY) {
-      glUniform3f(uniforms.gbuffer_materialColor, 0.95f, 0.95f, 0.9f);
-      glUniform1f(uniforms.gbuffer_hasTexture, 0.0f);
-    }
-    model = m4_mul(m4_translation(candle->base_position), m4_scaling(vec3(0.3f, 0.8f, 0.3f)));
-    glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)model.m);
-    glBindVertexArray(candle_base_mesh.vao_id);
-    glDrawArrays(GL_TRIANGLES, 0, candle_base_mesh.vertex_count);
-
-    // Candle flame
-    if (mode == RENDER_MODE_GEOMETRY) {
-      glUniform3f(uniforms.gbuffer_materialColor, 1.0f, 0.7f, 0.2f);
-      glUniform1f(uniforms.gbuffer_hasTexture, 0.0f);
-    }
-    vec3_t flame_pos = v3_add(candle->base_position, v3_add(candle->flame_offset, vec3(0.0f, 0.12f, 0.0f)));
-    model = m4_mul(m4_translation(flame_pos), m4_scaling(vec3(0.2f, 0.4f, 0.2f)));
-    glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)model.m);
-    glBindVertexArray(candle_flame_mesh.vao_id);
-    glDrawArrays(GL_TRIANGLES, 0, candle_flame_mesh.vertex_count);
+// Unified rendering function for both shadow and geometry passes
+void render_unified_scene(GLuint shader_program, RenderMode mode) {
+  if (mode == RENDER_MODE_SHADOW) {
+    static_batch_draw(&scene_batch, SCENE_VARIANT_SHADOW);
+    return;
   }
 
-  // Items on round tables (for shadow casting) - use dining table positions
-  // Table 0: beer mug
-  if (mode == RENDER_MODE_GEOMETRY) {
-    material_bind(&texture_manager.beer_mug, shader_program);
-    glUniform1f(uniforms.gbuffer_hasTexture, 1.0f);
-  }
-  model = m4_mul(m4_translation(vec3(dining_tables[0].position.x + 0.3f, 1.35f, dining_tables[0].position.z + 0.2f)),
-                 m4_scaling(vec3(GREEN_BOTTLE_SCALE, GREEN_BOTTLE_SCALE, GREEN_BOTTLE_SCALE)));
-  glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)model.m);
-  glBindVertexArray(beer_mug_mesh.vao_id);
-  glDrawArrays(GL_TRIANGLES, 0, beer_mug_mesh.vertex_count);
-
-  // Table 1: food plate
-  if (mode == RENDER_MODE_GEOMETRY) {
-    material_bind(&texture_manager.food_plate, shader_program);
-    glUniform1f(uniforms.gbuffer_hasTexture, 1.0f);
+  // Each gbuffer variant only draws the renderables it was compiled for
+  for (int v = 0; v < SCENE_VARIANT_COUNT; v++) {
+    if (gbuffer_variants[v].program != shader_program)
+      continue;
+    if (v != SCENE_VARIANT_FLAT)
+      texture_manager_bind(&texture_manager);
+    static_batch_draw(&scene_batch, v);
   }
-  model = m4_mul(m4_translation(vec3(dining_tables[1].position.x - 0.3f, 1.35f, dining_tables[1].position.z - 0.2f)),
-                 m4_scaling(vec3(FOOD_PLATE_SCALE, FOOD_PLATE_SCALE, FOOD_PLATE_SCALE)));
-  glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)model.m);
-  glBindVertexArray(food_plate_mesh.vao_id);
-  glDrawArrays(GL_TRIANGLES, 0, food_plate_mesh.vertex_count);
-
-  // Table 1: green bottle
-  if (mode == RENDER_MODE_GEOMETRY) {
-    material_bind(&texture_manager.green_bottle, shader_program);
-    glUniform1f(uniforms.gbuffer_hasTexture, 1.0f);
-  }
-  model = m4_mul(m4_translation(vec3(dining_tables[1].position.x + 0.3f, 1.33f, dining_tables[1].position.z + 0.2f)),
-                 m4_scaling(vec3(0.08f, 0.08f, 0.08f)));
-  glUniformMatrix4fv(model_location, 1, GL_FALSE, (float *)model.m);
-  glBindVertexArray(green_bottle_mesh.vao_id);
-  glDrawArrays(GL_TRIANGLES, 0, green_bottle_mesh.vertex_count);
 }
 
 // Wrapper function for shadow pass that uses unified rendering
@@ -1011,7 +1225,73 @@ void render_scene_shadow_wrapper(GLuint shadow_program) {
 
 // Old render_scene_geometry function removed - replaced by render_unified_scene
 
+// Draws the scene into the residency manager's feedback target on the frames
+// it asks for one, before this frame's occlusion queries exist
+static void render_texture_feedback(const mat4_t *view, const mat4_t *projection) {
+  if (!texture_residency_feedback_begin(&texture_manager.residency))
+    return;
+
+  for (int v = 0; v < SCENE_VARIANT_COUNT; v++) {
+    const FeedbackVariant *variant = &feedback_variants[v != SCENE_VARIANT_FLAT];
+    glUseProgram(variant->program);
+    glUniformMatrix4fv(variant->view, 1, GL_FALSE, (float *)view->m);
+    glUniformMatrix4fv(variant->projection, 1, GL_FALSE, (float *)projection->m);
+    glUniform2f(variant->textureSize, texture_manager.diffuse_array.width,
+                texture_manager.diffuse_array.height);
+    glUniform1f(variant->lodBias, log2f(TEXTURE_RESIDENCY_FEEDBACK_SCALE));
+    static_batch_draw_unconditional(&scene_batch, v);
+  }
+
+  texture_residency_feedback_end(&texture_manager.residency);
+}
+
+// Scatters the crates over the floor with a fixed seed, rand() is left alone
+// so the rest of the scene does not change with the field
+static void crate_field_build(void) {
+  instance_cull_init(&crate_field, &cube_mesh, CRATE_FIELD_COUNT);
+  unsigned int seed = 12345u;
+  float scale = CRATE_FIELD_HALF_SIZE / CUBE_HALF_SIZE;
+  float radius = CRATE_FIELD_HALF_SIZE * sqrtf(3.0f);
+  for (int i = 0; i < CRATE_FIELD_COUNT; i++) {
+    float position[2];
+    for (int axis = 0; axis < 2; axis++) {
+      seed = seed * 1664525u + 1013904223u;
+      position[axis] = ((seed >> 8) / 16777216.0f - 0.5f) * FLOOR_SIZE;
+    }
+    vec3_t center = vec3(position[0], CRATE_FIELD_HALF_SIZE, position[1]);
+    mat4_t model = m4_mul(m4_translation(center), m4_scaling(vec3(scale, scale, scale)));
+    instance_cull_add(&crate_field, &model, vec3(0.45f, 0.3f, 0.15f), 0, center, radius);
+  }
+  instance_cull_upload(&crate_field);
+}
+
+// Occlusion buffer at twice its size in the lower left corner, and the cull
+// statistics every OCCLUSION_LOG_FRAMES frames
+static void render_occlusion_debug(void) {
+  if (occlusion_debug_frame++ % OCCLUSION_LOG_FRAMES == 0)
+    rafgl_log(RAFGL_INFO,
+              "Occlusion: %d of %d cells seen, %d occluders, %d faces, %d of %d culled, "
+              "%d of %d props queried, %d of %d results hidden\n",
+              cells.visible_cells, cells.cell_count, occlusion.occluders, occlusion.polygon_count,
+              occlusion.culled, occlusion.tested,
+              occlusion_queries.queried, occlusion_queries.requested, occlusion_queries.hidden,
+              occlusion_queries.read_back);
+
+  occlusion_buffer_visualize(&occlusion, occlusion_debug_pixels);
+  glBindTexture(GL_TEXTURE_2D, occlusion_debug_texture);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, occlusion.width, occlusion.height, GL_RGBA,
+                  GL_UNSIGNED_BYTE, occlusion_debug_pixels);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, occlusion_debug_fbo);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  glBlitFramebuffer(0, 0, occlusion.width, occlusion.height, 0, 0, occlusion.width * 2,
+                    occlusion.height * 2, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
 void main_state_render(GLFWwindow *window, void *args) {
+  mat4_t view = camera_get_view_matrix(&camera);
+  mat4_t projection = m4_perspective(45.0f, (float)w / (float)h, 0.1f, 100.0f);
+
   // Shadow pass - render depth from active lights (candles + flashlight if
   // active)
   int num_shadow_lights = base_num_lights; // Start with candle lights
@@ -1019,27 +1299,51 @@ void main_state_render(GLFWwindow *window, void *args) {
     num_shadow_lights = num_lights; // Include flashlight if active
   }
 
+  // Streaming changes land before the batch that draws them is built
+  mesh_residency_update(&mesh_residency);
+  scene_batch_build(m4_mul(projection, view), num_shadow_lights);
+  texture_residency_update(&texture_manager.residency);
+
   // Render cube map shadows for all active lights using omnidirectional system
-  for (int shadow_light_index = 0; shadow_light_index < num_shadow_lights;
+  for (int shadow_light_index = 0;
+       shadow_light_index < num_shadow_lights && shadow_light_index < MAX_SHADOW_LIGHTS;
        shadow_light_index++) {
-    render_cube_shadow_map(&lights[shadow_light_index], shadow_program,
-                           render_scene_shadow_wrapper);
+    render_cube_shadow_map(&light_shadows[shadow_light_index],
+                           light_system_position(&light_system, shadow_light_index),
+                           shadow_program, render_scene_shadow_wrapper);
   }
 
-  // Geometry pass - render to G-Buffer
-  gbuffer_bind_for_writing(&gbuffer);
+  render_texture_feedback(&view, &projection);
 
-  glUseProgram(gbuffer_program);
-
-  mat4_t view = camera_get_view_matrix(&camera);
-  mat4_t projection = m4_perspective(45.0f, (float)w / (float)h, 0.1f, 100.0f);
+  if (crate_field_enabled) {
+    if (crate_field.program == 0)
+      crate_field_build();
+    instance_cull_run(&crate_field, m4_mul(projection, view));
+  }
 
-  glUniformMatrix4fv(uniforms.gbuffer_view, 1, GL_FALSE, (float *)view.m);
-  glUniformMatrix4fv(uniforms.gbuffer_projection, 1, GL_FALSE, (float *)projection.m);
-  glUniform1f(uniforms.gbuffer_hasTexture, 0.0f);
+  // Geometry pass - render to G-Buffer
+  gbuffer_bind_for_writing(&gbuffer);
 
-  // Render all scene geometry using unified function
-  render_unified_scene(gbuffer_program, RENDER_MODE_GEOMETRY);
+  // Flat colored, textured and normal mapped geometry each with its own
+  // program variant so none branches on the material per pixel. The flat
+  // variant holds the walls and floor, the occlusion query proxies are drawn
+  // against its depth before any textured prop.
+  for (int v = 0; v < SCENE_VARIANT_COUNT; v++) {
+    GBufferVariant *variant = &gbuffer_variants[v];
+    glUseProgram(variant->program);
+    glUniformMatrix4fv(variant->view, 1, GL_FALSE, (float *)view.m);
+    glUniformMatrix4fv(variant->projection, 1, GL_FALSE, (float *)projection.m);
+    render_unified_scene(variant->program, RENDER_MODE_GEOMETRY);
+    if (v != SCENE_VARIANT_FLAT)
+      continue;
+    if (crate_field_enabled) {
+      instance_cull_draw(&crate_field, &scene_batch);
+      if (crate_field_frame++ % OCCLUSION_LOG_FRAMES == 0)
+        rafgl_log(RAFGL_INFO, "GPU cull: %d of %d crates drawn, %d frames behind\n", crate_field.drawn,
+                  crate_field.count, crate_field.lag);
+    }
+    occlusion_queries_issue(&occlusion_queries, m4_mul(projection, view));
+  }
 
   // SSAO pass
   glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
@@ -1062,52 +1366,49 @@ void main_state_render(GLFWwindow *window, void *args) {
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  glUseProgram(lighting_program);
+  // Pick the lighting variant whose unrolled shadow range matches the lights
+  // that cast shadows this frame
+  int first_shadowed = 0;
+  int shadowed = base_num_lights; // Always use candle shadows
+  if (flashlight_active) {
+    shadowed = num_lights; // Include flashlight shadow when active
+  }
+  if (flashlight_only_shadows) {
+    first_shadowed = base_num_lights;
+    shadowed = flashlight_active ? 1 : 0;
+  }
+  if (shadowed > MAX_SHADOW_LIGHTS - first_shadowed)
+    shadowed = MAX_SHADOW_LIGHTS - first_shadowed;
+  LightingVariant *lighting = lighting_variant(first_shadowed, shadowed);
+
+  glUseProgram(lighting->program);
   gbuffer_bind_for_reading(&gbuffer);
 
-  glUniform1i(uniforms.lighting_gPosition, 0);
-  glUniform1i(uniforms.lighting_gNormal, 1);
-  glUniform1i(uniforms.lighting_gAlbedoSpec, 2);
+  glUniform1i(lighting->gPosition, 0);
+  glUniform1i(lighting->gNormal, 1);
+  glUniform1i(lighting->gAlbedoSpec, 2);
 
   // Bind SSAO texture
   glActiveTexture(GL_TEXTURE3);
   glBindTexture(GL_TEXTURE_2D, ssaoColorBuffer);
-  glUniform1i(uniforms.lighting_ssaoTexture, 3);
-
-  // Bind shadow maps for all active lights (up to 4 supported by shader)
-  int active_shadow_lights = base_num_lights; // Always bind candle shadows
-  if (flashlight_active) {
-    active_shadow_lights = num_lights; // Include flashlight shadow when active
-  }
+  glUniform1i(lighting->ssaoTexture, 3);
 
-  // Bind shadow maps for all active lights using cached uniform locations
-  for (int i = 0; i < active_shadow_lights && i < 8; i++) {
+  // Bind shadow maps of the variant's range using cached uniform locations
+  for (int i = lighting->first_shadowed; i < lighting->first_shadowed + lighting->shadowed; i++) {
     // Bind shadow cube map texture
     glActiveTexture(GL_TEXTURE4 + i);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, lights[i].shadowCubeMap);
-    glUniform1i(uniforms.lighting_shadowMaps[i], 4 + i);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, light_shadows[i].shadowCubeMap);
+    glUniform1i(lighting->shadowMaps[i], 4 + i);
   }
 
   // Send far_plane uniform for cube map shadow calculations
-  glUniform1f(uniforms.lighting_far_plane, 25.0f);
-
-  // Send shadow mode toggle
-  glUniform1i(uniforms.lighting_flashlightOnlyShadows,
-              flashlight_only_shadows);
+  glUniform1f(lighting->far_plane, SHADOW_FAR_PLANE);
 
   // Send lights to shader
-  glUniform1i(uniforms.lighting_numLights, num_lights);
-  for (int i = 0; i < num_lights; i++) {
-    glUniform3f(uniforms.lighting_lights_position[i],
-                lights[i].position.x, lights[i].position.y,
-                lights[i].position.z);
-    glUniform3f(uniforms.lighting_lights_color[i],
-                lights[i].color.x, lights[i].color.y, lights[i].color.z);
-    glUniform1f(uniforms.lighting_lights_radius[i],
-                lights[i].radius);
-  }
+  glUniform1i(lighting->numLights, num_lights);
+  light_system_upload(&light_system, num_lights);
 
-  glUniform3f(uniforms.lighting_viewPos,
+  glUniform3f(lighting->viewPos,
               camera.position.x, camera.position.y, camera.position.z);
 
   fullscreen_quad_render(&quad);
@@ -1132,88 +1433,61 @@ void main_state_render(GLFWwindow *window, void *args) {
     fullscreen_quad_render(&quad);
     glEnable(GL_DEPTH_TEST);
   }
+
+  if (occlusion_debug)
+    render_occlusion_debug();
 }
 
 void main_state_cleanup(GLFWwindow *window, void *args) {
   texture_manager_cleanup(&texture_manager);
+  for (int i = 0; i < light_system.count && i < MAX_SHADOW_LIGHTS; i++)
+    cleanup_point_light_shadows(&light_shadows[i]);
+  light_system_cleanup(&light_system);
+  transform_system_cleanup(&transforms);
+  scene_bvh_cleanup(&scene_bvh);
+  portal_cells_cleanup(&cells);
+  occlusion_buffer_cleanup(&occlusion);
+  rafgl_free(occlusion_debug_pixels);
+  glDeleteFramebuffers(1, &occlusion_debug_fbo);
+  glDeleteTextures(1, &occlusion_debug_texture);
+  occlusion_queries_cleanup(&occlusion_queries);
+  if (crate_field.program)
+    instance_cull_cleanup(&crate_field);
+  entity_store_cleanup(&scene);
+  static_batch_cleanup(&scene_batch);
+  mesh_residency_cleanup(&mesh_residency);
+  rafgl_mesh_buffer_cleanup(&scene_meshes);
+
+  rafgl_memory_report_leaks(&memory_at_init, "main_state");
 }
 
 // Texture management implementation
 void material_init(Material *mat) {
-  rafgl_texture_init(&mat->diffuse);
-  rafgl_texture_init(&mat->normal);
-  rafgl_texture_init(&mat->specular);
   mat->has_normal_map = 0;
-  mat->has_specular_map = 0;
+  mat->has_pbr_map = 0;
+  mat->layer = 0;
   mat->roughness = 0.8f;
   mat->metallic = 0.0f;
 }
 
-void material_load_diffuse(Material *mat, const char *diffuse_path) {
-  rafgl_raster_t raster;
-  if (rafgl_raster_load_from_image(&raster, diffuse_path) == 0) {
-    glGenTextures(1, &mat->diffuse.tex_id);
-    rafgl_texture_load_from_raster(&mat->diffuse, &raster);
-    DEBUG_PRINT(2, "Loaded diffuse: %s\n", diffuse_path);
-  } else {
-    DEBUG_PRINT(1, "Failed diffuse: %s\n", diffuse_path);
-  }
-}
+void texture_manager_bind(TextureManager *tm) {
+  glActiveTexture(GL_TEXTURE5);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, tm->diffuse_array.tex_id);
 
-void material_load_normal(Material *mat, const char *normal_path) {
-  rafgl_raster_t raster;
-  if (rafgl_raster_load_from_image(&raster, normal_path) == 0) {
-    glGenTextures(1, &mat->normal.tex_id);
-    rafgl_texture_load_from_raster(&mat->normal, &raster);
-    mat->has_normal_map = 1;
-    DEBUG_PRINT(2, "Loaded normal: %s\n", normal_path);
-  } else {
-    DEBUG_PRINT(1, "Failed normal: %s\n", normal_path);
-    mat->has_normal_map = 0;
-  }
-}
+  glActiveTexture(GL_TEXTURE6);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, tm->normal_array.tex_id);
 
-void material_load_specular(Material *mat, const char *specular_path) {
-  rafgl_raster_t raster;
-  if (rafgl_raster_load_from_image(&raster, specular_path) == 0) {
-    glGenTextures(1, &mat->specular.tex_id);
-    rafgl_texture_load_from_raster(&mat->specular, &raster);
-    mat->has_specular_map = 1;
-    DEBUG_PRINT(2, "Loaded specular: %s\n", specular_path);
-  } else {
-    DEBUG_PRINT(1, "Failed specular: %s\n", specular_path);
-    mat->has_specular_map = 0;
-  }
+  glActiveTexture(GL_TEXTURE7);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, tm->pbr_array.tex_id);
 }
 
-void material_bind(Material *mat, GLuint shader_program) {
-  // Bind diffuse texture using cached uniform location
-  glActiveTexture(GL_TEXTURE5);
-  glBindTexture(GL_TEXTURE_2D, mat->diffuse.tex_id);
-  glUniform1i(uniforms.material_texture_diffuse1, 5);
-
-  // Bind normal texture if available using cached uniform locations
-  if (mat->has_normal_map) {
-    glActiveTexture(GL_TEXTURE6);
-    glBindTexture(GL_TEXTURE_2D, mat->normal.tex_id);
-    glUniform1i(uniforms.material_texture_normal1, 6);
-    glUniform1f(uniforms.material_hasNormalMap, 1.0f);
-  } else {
-    glUniform1f(uniforms.material_hasNormalMap, 0.0f);
-  }
-
-  // Bind specular texture if available using cached uniform location
-  if (mat->has_specular_map) {
-    glActiveTexture(GL_TEXTURE7);
-    glBindTexture(GL_TEXTURE_2D, mat->specular.tex_id);
-    glUniform1i(uniforms.material_texture_specular1, 7);
-  }
+// Arrays registered with the residency manager, in this order
+enum { TEXTURE_ARRAY_DIFFUSE, TEXTURE_ARRAY_NORMAL, TEXTURE_ARRAY_PBR };
 
-  // Set material properties using cached uniform locations
-  glUniform1f(uniforms.material_roughness, mat->roughness);
-  glUniform1f(uniforms.material_metallic, mat->metallic);
-  glUniform1f(uniforms.material_hasTexture, 1.0f);
-}
+typedef struct {
+  Material *material;
+  const char *diffuse, *normal, *pbr;
+} MaterialSources;
 
 void texture_manager_init(TextureManager *tm) {
   // Initialize all materials - each object gets its own dedicated material
@@ -1228,85 +1502,102 @@ void texture_manager_init(TextureManager *tm) {
   material_init(&tm->floor_material);
 
   // Load EACH object's OWN specific textures
-
-  // 1. Wooden barrel - uses SHADED texture with metal bands, wood, etc.
-  material_load_diffuse(&tm->wooden_barrel,
-                        "res/textures/wooden_barrel_shaded.png");
-  material_load_normal(&tm->wooden_barrel,
-                       "res/textures/wooden_barrel_normal.png");
+  MaterialSources sources[] = {
+      // 1. Wooden barrel - uses SHADED texture with metal bands, wood, etc.
+      {&tm->wooden_barrel, "res/textures/wooden_barrel_shaded.png", "res/textures/wooden_barrel_normal.png",
+       "res/models/Wooden barrel with metal bands/texture_pbr.png"},
+      // 2. Round table - uses SHADED texture with full detail
+      {&tm->round_table, "res/textures/round_table_shaded.png", "res/textures/round_table_normal.png",
+       "res/models/Round wooden table with pedestal base/texture_pbr.png"},
+      // 3. Wooden bench - uses SHADED texture with panels and details
+      {&tm->wooden_bench, "res/textures/wooden_bench_shaded.png", "res/textures/wooden_bench_normal.png",
+       "res/models/Wooden bench with panels/texture_pbr.png"},
+      // 4. Wall candle - uses SHADED texture with wax, holder, flame colors
+      {&tm->wall_candle, "res/textures/wall_candle_shaded.png", "res/textures/wall_candle_normal.png",
+       "res/models/Wall-mounted candle with flame/texture_pbr.png"},
+      // 5. Beer mug - uses its own beer mug textures
+      {&tm->beer_mug, "res/textures/beer_mug_diffuse.png", "res/textures/beer_mug_normal.png",
+       "res/models/Wooden beer mug with foam/texture_pbr.png"},
+      // 6. Green bottle - uses SHADED texture with glass and cork
+      {&tm->green_bottle, "res/textures/green_bottle_shaded.png", "res/textures/green_bottle_normal.png",
+       "res/models/Green bottle with cork stopper/texture_pbr.png"},
+      // 7. Food plate - uses SHADED texture with food and plate colors
+      {&tm->food_plate, "res/textures/food_plate_shaded.png", "res/textures/food_plate_normal.png",
+       "res/models/Plate with steak and drumstick/texture_pbr.png"},
+      // 8. Wooden stool - uses SHADED texture with full wood detail
+      {&tm->wooden_stool, "res/textures/wooden_stool_shaded.png", "res/textures/wooden_stool_normal.png",
+       "res/models/Wooden stool with ocagonal seat/texture_pbr.png"},
+  };
+
+  // Each textured material owns one layer in every array
+  tm->layer_count = sizeof(sources) / sizeof(sources[0]);
+  for (int i = 0; i < tm->layer_count; i++)
+    sources[i].material->layer = i;
+
+  // Fallbacks for materials whose pbr map fails to load
   tm->wooden_barrel.roughness = 0.8f;
   tm->wooden_barrel.metallic = 0.0f;
-
-  // 2. Round table - uses SHADED texture with full detail
-  material_load_diffuse(&tm->round_table,
-                        "res/textures/round_table_shaded.png");
-  material_load_normal(&tm->round_table, "res/textures/round_table_normal.png");
   tm->round_table.roughness = 0.6f;
   tm->round_table.metallic = 0.0f;
-
-  // 3. Wooden bench - uses SHADED texture with panels and details
-  material_load_diffuse(&tm->wooden_bench,
-                        "res/textures/wooden_bench_shaded.png");
-  material_load_normal(&tm->wooden_bench,
-                       "res/textures/wooden_bench_normal.png");
   tm->wooden_bench.roughness = 0.7f;
   tm->wooden_bench.metallic = 0.0f;
-
-  // 4. Wall candle - uses SHADED texture with wax, holder, flame colors
-  material_load_diffuse(&tm->wall_candle,
-                        "res/textures/wall_candle_shaded.png");
-  material_load_normal(&tm->wall_candle, "res/textures/wall_candle_normal.png");
   tm->wall_candle.roughness = 0.9f;
   tm->wall_candle.metallic = 0.0f;
-
-  // 5. Beer mug - uses its own beer mug textures (already working!)
-  material_load_diffuse(&tm->beer_mug, "res/textures/beer_mug_diffuse.png");
-  material_load_normal(&tm->beer_mug, "res/textures/beer_mug_normal.png");
   tm->beer_mug.roughness = 0.8f;
   tm->beer_mug.metallic = 0.0f;
-
-  // 6. Green bottle - uses SHADED texture with glass and cork
-  material_load_diffuse(&tm->green_bottle,
-                        "res/textures/green_bottle_shaded.png");
-  material_load_normal(&tm->green_bottle,
-                       "res/textures/green_bottle_normal.png");
   tm->green_bottle.roughness = 0.1f;
   tm->green_bottle.metallic = 0.0f;
-
-  // 7. Food plate - uses SHADED texture with food and plate colors
-  material_load_diffuse(&tm->food_plate, "res/textures/food_plate_shaded.png");
-  material_load_normal(&tm->food_plate, "res/textures/food_plate_normal.png");
   tm->food_plate.roughness = 0.2f;
   tm->food_plate.metallic = 0.0f;
-
-  // 8. Wooden stool - uses SHADED texture with full wood detail
-  material_load_diffuse(&tm->wooden_stool,
-                        "res/textures/wooden_stool_shaded.png");
-  material_load_normal(&tm->wooden_stool,
-                       "res/textures/wooden_stool_normal.png");
   tm->wooden_stool.roughness = 0.6f;
   tm->wooden_stool.metallic = 0.0f;
+
+  // Images are decoded on the job system, only the uploads run here. The
+  // residency manager keeps the finest mip levels the screen needs within
+  // TEXTURE_BUDGET_MB and streams the rest in and out later.
+  TextureResidency *tr = &tm->residency;
+  texture_residency_init(tr, (size_t)TEXTURE_BUDGET_MB * 1024 * 1024);
+  texture_residency_add_array(tr, &tm->diffuse_array, TEXTURE_FORMAT_RGBA8, tm->layer_count);
+  texture_residency_add_array(tr, &tm->normal_array, TEXTURE_FORMAT_RGBA8, tm->layer_count);
+  texture_residency_add_array(tr, &tm->pbr_array, TEXTURE_FORMAT_RGTC2, tm->layer_count);
+
+  // texture_pbr.png is already channel packed (r = occlusion, g = roughness,
+  // b = metallic). Occlusion is white in every shipped map and SSAO covers it,
+  // so only roughness and metallic are kept.
+  texture_residency_set_channels(tr, TEXTURE_ARRAY_PBR, 1, 2);
+
+  rafgl_pixel_rgb_t grey = {{128, 128, 128, 255}};
+  rafgl_pixel_rgb_t flat_normal = {{128, 128, 255, 255}};
+  for (int i = 0; i < tm->layer_count; i++) {
+    const Material *mat = sources[i].material;
+    // A material without a pbr map gets its constant roughness and metallic
+    rafgl_pixel_rgb_t constant = {{255, (uint8_t)(mat->roughness * 255.0f + 0.5f),
+                                   (uint8_t)(mat->metallic * 255.0f + 0.5f), 255}};
+    texture_residency_set_layer(tr, TEXTURE_ARRAY_DIFFUSE, i, sources[i].diffuse, grey);
+    texture_residency_set_layer(tr, TEXTURE_ARRAY_NORMAL, i, sources[i].normal, flat_normal);
+    texture_residency_set_layer(tr, TEXTURE_ARRAY_PBR, i, sources[i].pbr, constant);
+  }
+
+  texture_residency_load(tr);
+
+  for (int i = 0; i < tm->layer_count; i++) {
+    Material *mat = sources[i].material;
+    mat->has_normal_map = texture_residency_layer_loaded(tr, TEXTURE_ARRAY_NORMAL, i);
+    mat->has_pbr_map = texture_residency_layer_loaded(tr, TEXTURE_ARRAY_PBR, i);
+    if (!texture_residency_layer_loaded(tr, TEXTURE_ARRAY_DIFFUSE, i))
+      DEBUG_PRINT(1, "Failed texture: %s\n", sources[i].diffuse);
+    if (!mat->has_normal_map)
+      DEBUG_PRINT(1, "Failed texture: %s\n", sources[i].normal);
+    if (!mat->has_pbr_map)
+      DEBUG_PRINT(1, "Failed texture: %s\n", sources[i].pbr);
+  }
 }
 
 void texture_manager_cleanup(TextureManager *tm) {
-  rafgl_texture_cleanup(&tm->wooden_barrel.diffuse);
-  rafgl_texture_cleanup(&tm->wooden_barrel.normal);
-  rafgl_texture_cleanup(&tm->round_table.diffuse);
-  rafgl_texture_cleanup(&tm->round_table.normal);
-  rafgl_texture_cleanup(&tm->wooden_bench.diffuse);
-  rafgl_texture_cleanup(&tm->wooden_bench.normal);
-  rafgl_texture_cleanup(&tm->wall_candle.diffuse);
-  rafgl_texture_cleanup(&tm->wall_candle.normal);
-  rafgl_texture_cleanup(&tm->beer_mug.diffuse);
-  rafgl_texture_cleanup(&tm->beer_mug.normal);
-  rafgl_texture_cleanup(&tm->green_bottle.diffuse);
-  rafgl_texture_cleanup(&tm->green_bottle.normal);
-  rafgl_texture_cleanup(&tm->food_plate.diffuse);
-  rafgl_texture_cleanup(&tm->food_plate.normal);
-  rafgl_texture_cleanup(&tm->wooden_stool.diffuse);
-  rafgl_texture_cleanup(&tm->wooden_stool.normal);
-  rafgl_texture_cleanup(&tm->floor_material.diffuse);
-  rafgl_texture_cleanup(&tm->floor_material.normal);
+  texture_residency_cleanup(&tm->residency);
+  rafgl_texture_cleanup(&tm->diffuse_array);
+  rafgl_texture_cleanup(&tm->normal_array);
+  rafgl_texture_cleanup(&tm->pbr_array);
 }
 
 // Simplified approach using existing RAFGL functions creatively
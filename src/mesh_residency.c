@@ -0,0 +1,408 @@
+#include <mesh_residency.h>
+#include <rafgl_memory.h>
+
+#include <float.h>
+#include <stdint.h>
+#include <string.h>
+
+void mesh_residency_init(MeshResidency *mr, rafgl_mesh_buffer_t *buffer, size_t budget, float radius) {
+    memset(mr, 0, sizeof(MeshResidency));
+    mr->buffer = buffer;
+    mr->radius = radius;
+    mr->region_size = budget / sizeof(rafgl_vertexPUN_t);
+    mr->region_first = rafgl_mesh_buffer_reserve(buffer, mr->region_size);
+    mr->free_ranges[0].first = mr->region_first;
+    mr->free_ranges[0].count = mr->region_size;
+    mr->free_count = 1;
+}
+
+int mesh_residency_add(MeshResidency *mr, rafgl_meshPUN_t *mesh, const char *path) {
+    if (mr->count == MESH_RESIDENCY_MAX_MESHES)
+        return -1;
+
+    StreamedMesh *sm = &mr->meshes[mr->count];
+    memset(sm, 0, sizeof(StreamedMesh));
+    sm->path = path;
+    sm->mesh = mesh;
+    sm->last_requested = -MESH_RESIDENCY_EVICT_FRAMES - 1;
+    rafgl_meshPUN_init(&sm->proxy);
+    rafgl_jobs_counter_init(&sm->counter);
+    return mr->count++;
+}
+
+int mesh_residency_find(const MeshResidency *mr, const rafgl_meshPUN_t *mesh) {
+    for (int i = 0; i < mr->count; i++)
+        if (mr->meshes[i].mesh == mesh)
+            return i;
+    return -1;
+}
+
+int mesh_residency_bounds(const MeshResidency *mr, int handle, vec3_t *min, vec3_t *max) {
+    const StreamedMesh *sm = &mr->meshes[handle];
+    if (!sm->has_bounds)
+        return 0;
+    *min = sm->min;
+    *max = sm->max;
+    return 1;
+}
+
+// First fit, returns 0 when no free range is big enough
+static int region_alloc(MeshResidency *mr, unsigned int count, unsigned int *first) {
+    for (int i = 0; i < mr->free_count; i++) {
+        MeshRange *range = &mr->free_ranges[i];
+        if (range->count < count)
+            continue;
+
+        *first = range->first;
+        range->first += count;
+        range->count -= count;
+        if (range->count == 0) {
+            memmove(range, range + 1, (mr->free_count - i - 1) * sizeof(MeshRange));
+            mr->free_count--;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+static void region_free(MeshResidency *mr, unsigned int first, unsigned int count) {
+    int i = 0;
+    while (i < mr->free_count && mr->free_ranges[i].first < first)
+        i++;
+
+    int joins_previous = i > 0 && mr->free_ranges[i - 1].first + mr->free_ranges[i - 1].count == first;
+    int joins_next = i < mr->free_count && first + count == mr->free_ranges[i].first;
+
+    if (joins_previous && joins_next) {
+        mr->free_ranges[i - 1].count += count + mr->free_ranges[i].count;
+        memmove(&mr->free_ranges[i], &mr->free_ranges[i + 1], (mr->free_count - i - 1) * sizeof(MeshRange));
+        mr->free_count--;
+    } else if (joins_previous) {
+        mr->free_ranges[i - 1].count += count;
+    } else if (joins_next) {
+        mr->free_ranges[i].first = first;
+        mr->free_ranges[i].count += count;
+    } else {
+        memmove(&mr->free_ranges[i + 1], &mr->free_ranges[i], (mr->free_count - i) * sizeof(MeshRange));
+        mr->free_ranges[i].first = first;
+        mr->free_ranges[i].count = count;
+        mr->free_count++;
+    }
+}
+
+// Coarse stand-in: vertices are clustered on a grid over the bounds, every
+// triangle whose corners land in three different cells survives once
+typedef struct {
+    vec3_t position, normal;
+    int count, first;  // first vertex in the cell gives the UV and tangent
+} ProxyCell;
+
+static void streamed_mesh_build_proxy(StreamedMesh *sm) {
+    const rafgl_vertexPUN_t *v = sm->vertices;
+    unsigned int n = sm->vertex_count;
+
+    vec3_t lo = v[0].position, hi = v[0].position;
+    for (unsigned int i = 1; i < n; i++) {
+        lo = vec3(fminf(lo.x, v[i].position.x), fminf(lo.y, v[i].position.y), fminf(lo.z, v[i].position.z));
+        hi = vec3(fmaxf(hi.x, v[i].position.x), fmaxf(hi.y, v[i].position.y), fmaxf(hi.z, v[i].position.z));
+    }
+    sm->loaded_center = v3_muls(v3_add(lo, hi), 0.5f);
+    sm->loaded_radius = v3_length(v3_sub(hi, sm->loaded_center));
+    sm->loaded_min = lo;
+    sm->loaded_max = hi;
+
+    const int grid = MESH_RESIDENCY_PROXY_GRID;
+    vec3_t extent = v3_sub(hi, lo);
+    vec3_t scale = vec3(extent.x > 0.0f ? grid / extent.x : 0.0f, extent.y > 0.0f ? grid / extent.y : 0.0f,
+                        extent.z > 0.0f ? grid / extent.z : 0.0f);
+
+    ProxyCell *cells = rafgl_calloc(RAFGL_MEM_MESH, grid * grid * grid, sizeof(ProxyCell));
+    int *cell_of = rafgl_malloc(RAFGL_MEM_MESH, n * sizeof(int));
+    for (unsigned int i = 0; i < n; i++) {
+        vec3_t p = v3_mul(v3_sub(v[i].position, lo), scale);
+        int x = p.x < grid ? (int)p.x : grid - 1;
+        int y = p.y < grid ? (int)p.y : grid - 1;
+        int z = p.z < grid ? (int)p.z : grid - 1;
+        int c = (z * grid + y) * grid + x;
+
+        ProxyCell *cell = &cells[c];
+        if (cell->count++ == 0)
+            cell->first = i;
+        cell->position = v3_add(cell->position, v[i].position);
+        cell->normal = v3_add(cell->normal, v[i].normal);
+        cell_of[i] = c;
+    }
+
+    // Set of cell triples already emitted, keys are never 0
+    unsigned int table_size = 1024;
+    while (table_size < n / 3 * 2)
+        table_size <<= 1;
+    uint64_t *table = rafgl_calloc(RAFGL_MEM_MESH, table_size, sizeof(uint64_t));
+    rafgl_vertexPUN_t *out = rafgl_malloc(RAFGL_MEM_MESH, n * sizeof(rafgl_vertexPUN_t));
+    unsigned int out_count = 0;
+    const uint64_t cell_count = (uint64_t)grid * grid * grid;
+
+    for (unsigned int t = 0; t + 2 < n; t += 3) {
+        int c[3] = {cell_of[t], cell_of[t + 1], cell_of[t + 2]};
+        if (c[0] == c[1] || c[1] == c[2] || c[0] == c[2])
+            continue;
+
+        uint64_t k[3] = {c[0], c[1], c[2]}, tmp;
+        if (k[0] > k[1]) { tmp = k[0]; k[0] = k[1]; k[1] = tmp; }
+        if (k[1] > k[2]) { tmp = k[1]; k[1] = k[2]; k[2] = tmp; }
+        if (k[0] > k[1]) { tmp = k[0]; k[0] = k[1]; k[1] = tmp; }
+        uint64_t key = (k[0] * cell_count + k[1]) * cell_count + k[2] + 1;
+
+        unsigned int slot = (unsigned int)(key * 0x9E3779B97F4A7C15ull >> 40) & (table_size - 1);
+        while (table[slot] != 0 && table[slot] != key)
+            slot = (slot + 1) & (table_size - 1);
+        if (table[slot] == key)
+            continue;
+        table[slot] = key;
+
+        for (int corner = 0; corner < 3; corner++) {
+            const ProxyCell *cell = &cells[c[corner]];
+            rafgl_vertexPUN_t *vertex = &out[out_count++];
+            *vertex = v[cell->first];
+            vertex->position = v3_muls(cell->position, 1.0f / cell->count);
+            if (v3_length(cell->normal) > 1e-6f)
+                vertex->normal = v3_norm(cell->normal);
+        }
+    }
+
+    rafgl_free(cells);
+    rafgl_free(cell_of);
+    rafgl_free(table);
+    sm->proxy_vertices = out;
+    sm->proxy_vertex_count = out_count;
+}
+
+// Job: parses the OBJ with an arena of its own, the first load also builds
+// the proxy and the bounds
+static void streamed_mesh_parse(void *data) {
+    StreamedMesh *sm = data;
+    rafgl_arena_t arena;
+    rafgl_arena_init(&arena, "mesh stream", RAFGL_MEM_MESH, RAFGL_LEVEL_ARENA_BLOCK);
+    sm->vertices = rafgl_vertexPUN_load_OBJ(&arena, sm->path, vec3(0.0f, 0.0f, 0.0f), &sm->vertex_count, NULL);
+    rafgl_arena_free(&arena);
+
+    if (sm->vertices != NULL && sm->vertex_count > 0 && !sm->has_bounds)
+        streamed_mesh_build_proxy(sm);
+}
+
+static void streamed_mesh_start_load(StreamedMesh *sm) {
+    sm->state = MESH_LOADING;
+    sm->prefetched = 0;
+    sm->vertices = NULL;
+    sm->proxy_vertices = NULL;
+    sm->vertex_count = sm->proxy_vertex_count = 0;
+    sm->job.function = streamed_mesh_parse;
+    sm->job.data = sm;
+    sm->job.counter = NULL;
+    rafgl_jobs_run(&sm->job, 1, &sm->counter);
+}
+
+static void streamed_mesh_evict(MeshResidency *mr, StreamedMesh *sm) {
+    region_free(mr, sm->mesh->first_vertex, sm->mesh->vertex_count);
+    sm->mesh->loaded = 0;
+    sm->state = MESH_UNLOADED;
+}
+
+// Evicts meshes not requested in the current frame, least recently
+// requested first, until count vertices fit
+static int make_room(MeshResidency *mr, unsigned int count, unsigned int *first) {
+    while (!region_alloc(mr, count, first)) {
+        StreamedMesh *victim = NULL;
+        for (int i = 0; i < mr->count; i++) {
+            StreamedMesh *sm = &mr->meshes[i];
+            if (sm->state == MESH_RESIDENT && sm->last_requested < mr->frame &&
+                (victim == NULL || sm->last_requested < victim->last_requested))
+                victim = sm;
+        }
+        if (victim == NULL)
+            return 0;
+        streamed_mesh_evict(mr, victim);
+    }
+    return 1;
+}
+
+// Whether make_room() could succeed, ignoring fragmentation
+static int could_fit(const MeshResidency *mr, unsigned int count) {
+    unsigned int available = 0;
+    for (int i = 0; i < mr->free_count; i++)
+        available += mr->free_ranges[i].count;
+    for (int i = 0; i < mr->count; i++) {
+        const StreamedMesh *sm = &mr->meshes[i];
+        if (sm->state == MESH_RESIDENT && sm->last_requested < mr->frame)
+            available += sm->mesh->vertex_count;
+    }
+    return available >= count;
+}
+
+// Main thread: keeps the proxy the first time and the full data while it is
+// still wanted and fits
+static void streamed_mesh_finish_load(MeshResidency *mr, StreamedMesh *sm) {
+    sm->state = MESH_UNLOADED;
+    if (sm->vertices == NULL) {
+        rafgl_log(RAFGL_WARNING, "Failed to stream %s\n", sm->path);
+        sm->state = MESH_FAILED;
+        return;
+    }
+
+    sm->full_vertex_count = sm->vertex_count;
+    unsigned int first;
+    if (sm->proxy_vertices) {
+        sm->has_bounds = 1;
+        sm->center = sm->loaded_center;
+        sm->radius = sm->loaded_radius;
+        sm->min = sm->loaded_min;
+        sm->max = sm->loaded_max;
+        if (sm->proxy_vertex_count > 0 && region_alloc(mr, sm->proxy_vertex_count, &first)) {
+            rafgl_mesh_buffer_write(mr->buffer, first, sm->proxy_vertices, sm->proxy_vertex_count);
+            sm->proxy.vao_id = mr->buffer->vao_id;
+            sm->proxy.first_vertex = first;
+            sm->proxy.vertex_count = sm->proxy_vertex_count;
+            sm->proxy.triangle_count = sm->proxy_vertex_count / 3;
+            sm->proxy.loaded = 1;
+        }
+        rafgl_free(sm->proxy_vertices);
+        sm->proxy_vertices = NULL;
+    }
+
+    int wanted = mr->frame - sm->last_requested <= MESH_RESIDENCY_EVICT_FRAMES;
+    if (wanted && make_room(mr, sm->vertex_count, &first)) {
+        rafgl_mesh_buffer_write(mr->buffer, first, sm->vertices, sm->vertex_count);
+        sm->mesh->vao_id = mr->buffer->vao_id;
+        sm->mesh->first_vertex = first;
+        sm->mesh->vertex_count = sm->vertex_count;
+        sm->mesh->triangle_count = sm->vertex_count / 3;
+        sm->mesh->loaded = 1;
+        sm->state = MESH_RESIDENT;
+    }
+    rafgl_free(sm->vertices);
+    sm->vertices = NULL;
+}
+
+size_t mesh_residency_resident_bytes(const MeshResidency *mr) {
+    size_t vertices = 0;
+    for (int i = 0; i < mr->count; i++) {
+        const StreamedMesh *sm = &mr->meshes[i];
+        vertices += sm->proxy.vertex_count;
+        if (sm->state == MESH_RESIDENT)
+            vertices += sm->mesh->vertex_count;
+    }
+    return vertices * sizeof(rafgl_vertexPUN_t);
+}
+
+static void mesh_residency_report(MeshResidency *mr) {
+    size_t bytes = mesh_residency_resident_bytes(mr);
+    if (bytes == mr->reported_bytes)
+        return;
+    mr->reported_bytes = bytes;
+
+    int resident = 0;
+    for (int i = 0; i < mr->count; i++)
+        resident += mr->meshes[i].state == MESH_RESIDENT;
+    rafgl_log(RAFGL_INFO, "Meshes: %.1f of %.1f MB resident, %d of %d at full detail\n",
+              bytes / (1024.0 * 1024.0), mr->region_size * sizeof(rafgl_vertexPUN_t) / (1024.0 * 1024.0),
+              resident, mr->count);
+}
+
+void mesh_residency_load(MeshResidency *mr) {
+    // Everything counts as requested, the first frames sort it out
+    for (int i = 0; i < mr->count; i++) {
+        mr->meshes[i].last_requested = mr->frame;
+        streamed_mesh_start_load(&mr->meshes[i]);
+    }
+    for (int i = 0; i < mr->count; i++) {
+        rafgl_jobs_wait(&mr->meshes[i].counter);
+        streamed_mesh_finish_load(mr, &mr->meshes[i]);
+    }
+    mesh_residency_report(mr);
+}
+
+// Nearest mesh requested this frame that is not loaded and would fit
+static StreamedMesh *next_load(MeshResidency *mr) {
+    StreamedMesh *next = NULL;
+    for (int i = 0; i < mr->count; i++) {
+        StreamedMesh *sm = &mr->meshes[i];
+        if (sm->state == MESH_UNLOADED && sm->last_requested == mr->frame &&
+            could_fit(mr, sm->full_vertex_count) && (next == NULL || sm->distance < next->distance))
+            next = sm;
+    }
+    return next;
+}
+
+void mesh_residency_update(MeshResidency *mr) {
+    int loading = 0;
+    for (int i = 0; i < mr->count; i++) {
+        StreamedMesh *sm = &mr->meshes[i];
+        if (sm->state == MESH_LOADING && !rafgl_jobs_counter_busy(&sm->counter))
+            streamed_mesh_finish_load(mr, sm);
+        else if (sm->state == MESH_RESIDENT && mr->frame - sm->last_requested > MESH_RESIDENCY_EVICT_FRAMES)
+            streamed_mesh_evict(mr, sm);
+        loading += sm->state == MESH_LOADING;
+    }
+
+    // Nearest requested meshes first
+    StreamedMesh *next;
+    while (loading < MESH_RESIDENCY_MAX_LOADS && (next = next_load(mr)) != NULL) {
+        streamed_mesh_start_load(next);
+        loading++;
+    }
+    // The one next in line is read into the page cache while the others parse
+    if ((next = next_load(mr)) != NULL && !next->prefetched) {
+        rafgl_vfs_prefetch(next->path);
+        next->prefetched = 1;
+    }
+
+    mesh_residency_report(mr);
+}
+
+void mesh_residency_begin(MeshResidency *mr, vec3_t camera, mat4_t view_projection) {
+    mr->frame++;
+    mr->camera = camera;
+    mr->frustum = frustum_from_m4(view_projection);
+    for (int i = 0; i < mr->count; i++)
+        mr->meshes[i].distance = FLT_MAX;
+}
+
+const rafgl_meshPUN_t *mesh_residency_request(MeshResidency *mr, int handle, const mat4_t *model) {
+    StreamedMesh *sm = &mr->meshes[handle];
+
+    if (sm->has_bounds) {
+        const float (*m)[4] = model->m;
+        float scale = 0.0f;
+        for (int column = 0; column < 3; column++) {
+            float length = sqrtf(m[column][0] * m[column][0] + m[column][1] * m[column][1] +
+                                 m[column][2] * m[column][2]);
+            scale = length > scale ? length : scale;
+        }
+        vec3_t center = m4_mul_pos(*model, sm->center);
+        float radius = sm->radius * scale;
+        float distance = v3_length(v3_sub(center, mr->camera)) - radius;
+
+        if (distance <= mr->radius && frustum_sphere(&mr->frustum, center, radius)) {
+            sm->last_requested = mr->frame;
+            if (distance < sm->distance)
+                sm->distance = distance;
+        }
+    }
+
+    if (sm->state == MESH_RESIDENT)
+        return sm->mesh;
+    return sm->proxy.vertex_count > 0 ? &sm->proxy : NULL;
+}
+
+void mesh_residency_cleanup(MeshResidency *mr) {
+    for (int i = 0; i < mr->count; i++) {
+        StreamedMesh *sm = &mr->meshes[i];
+        if (sm->state != MESH_LOADING)
+            continue;
+        rafgl_jobs_wait(&sm->counter);
+        rafgl_free(sm->vertices);
+        rafgl_free(sm->proxy_vertices);
+        sm->state = MESH_UNLOADED;
+    }
+    mr->count = 0;
+}
@@ -0,0 +1,314 @@
+#include <occlusion_buffer.h>
+#include <rafgl_jobs.h>
+#include <rafgl_memory.h>
+
+#include <math.h>
+#include <string.h>
+
+static inline float min_f(float a, float b) {
+    return a < b ? a : b;
+}
+
+static inline float max_f(float a, float b) {
+    return a > b ? a : b;
+}
+
+// Corner i of a box takes max on x for bit 0, on y for bit 1 and on z for
+// bit 2. Faces wind counterclockwise seen from outside the box.
+static const int box_faces[6][4] = {
+    {0, 4, 6, 2}, {1, 3, 7, 5},  // -x, +x
+    {0, 1, 5, 4}, {2, 6, 7, 3},  // -y, +y
+    {0, 2, 3, 1}, {4, 5, 7, 6},  // -z, +z
+};
+
+typedef struct {
+    float x, y, z, w;
+} ClipVertex;
+
+static ClipVertex clip_point(const mat4_t *m, vec3_t p) {
+    return (ClipVertex){m->m00 * p.x + m->m10 * p.y + m->m20 * p.z + m->m30,
+                        m->m01 * p.x + m->m11 * p.y + m->m21 * p.z + m->m31,
+                        m->m02 * p.x + m->m12 * p.y + m->m22 * p.z + m->m32,
+                        m->m03 * p.x + m->m13 * p.y + m->m23 * p.z + m->m33};
+}
+
+static void box_corners(const mat4_t *m, vec3_t min, vec3_t max, ClipVertex *corners) {
+    for (int i = 0; i < 8; i++)
+        corners[i] = clip_point(m, vec3(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z));
+}
+
+void occlusion_buffer_init(OcclusionBuffer *ob, int width, int height) {
+    memset(ob, 0, sizeof(*ob));
+    ob->tiles_x = (width + OCCLUSION_TILE - 1) / OCCLUSION_TILE;
+    ob->tiles_y = (height + OCCLUSION_TILE - 1) / OCCLUSION_TILE;
+    ob->width = ob->tiles_x * OCCLUSION_TILE;
+    ob->height = ob->tiles_y * OCCLUSION_TILE;
+    ob->depth = rafgl_malloc(RAFGL_MEM_SCENE, ob->width * ob->height * sizeof(float));
+    ob->tile_max = rafgl_malloc(RAFGL_MEM_SCENE, ob->tiles_x * ob->tiles_y * sizeof(float));
+    ob->polygons = rafgl_malloc(RAFGL_MEM_SCENE, OCCLUSION_MAX_POLYGONS * sizeof(OcclusionPolygon));
+    ob->view_projection = m4_identity();
+    for (int i = 0; i < ob->width * ob->height; i++)
+        ob->depth[i] = 1.0f;
+    for (int i = 0; i < ob->tiles_x * ob->tiles_y; i++)
+        ob->tile_max[i] = 1.0f;
+}
+
+void occlusion_buffer_cleanup(OcclusionBuffer *ob) {
+    rafgl_free(ob->depth);
+    rafgl_free(ob->tile_max);
+    rafgl_free(ob->polygons);
+    memset(ob, 0, sizeof(*ob));
+}
+
+void occlusion_buffer_begin(OcclusionBuffer *ob, mat4_t view_projection) {
+    ob->view_projection = view_projection;
+    ob->polygon_count = 0;
+    ob->occluders = ob->tested = ob->culled = 0;
+}
+
+// Screen space setup of a counterclockwise convex polygon, skipped when it
+// covers no pixel entirely
+static void setup_polygon(OcclusionBuffer *ob, const float *x, const float *y, const float *z, int count) {
+    // The depth plane comes from the fan triangle with the largest area
+    float area = 0.0f, best = 0.0f;
+    int apex = 1;
+    for (int i = 1; i + 1 < count; i++) {
+        float a = (x[i] - x[0]) * (y[i + 1] - y[0]) - (x[i + 1] - x[0]) * (y[i] - y[0]);
+        area += a;
+        if (a > best) {
+            best = a;
+            apex = i;
+        }
+    }
+    if (area <= 0.0f || best <= 0.0f || ob->polygon_count == OCCLUSION_MAX_POLYGONS)
+        return;
+
+    OcclusionPolygon poly;
+    float min_x = x[0], max_x = x[0], min_y = y[0], max_y = y[0], max_z = z[0];
+    for (int i = 1; i < count; i++) {
+        min_x = min_f(min_x, x[i]);
+        max_x = max_f(max_x, x[i]);
+        min_y = min_f(min_y, y[i]);
+        max_y = max_f(max_y, y[i]);
+        max_z = max_f(max_z, z[i]);
+    }
+    poly.x0 = (int)ceilf(max_f(min_x, 0.0f));
+    poly.y0 = (int)ceilf(max_f(min_y, 0.0f));
+    poly.x1 = (int)floorf(min_f(max_x, (float)ob->width));
+    poly.y1 = (int)floorf(min_f(max_y, (float)ob->height));
+    if (poly.x0 >= poly.x1 || poly.y0 >= poly.y1)
+        return;
+
+    // A pixel is entirely inside when its center is and its corners, which
+    // lie at most (|a| + |b|) / 2 further along an edge, are too
+    poly.edge_count = count;
+    for (int i = 0; i < count; i++) {
+        int j = (i + 1) % count;
+        float a = y[i] - y[j], b = x[j] - x[i], c = x[i] * y[j] - y[i] * x[j];
+        float rounding = 1e-6f * (fabsf(a) * ob->width + fabsf(b) * ob->height + fabsf(c));
+        poly.edge_a[i] = a;
+        poly.edge_b[i] = b;
+        poly.edge_c[i] = c - 0.5f * (fabsf(a) + fabsf(b)) - rounding;
+    }
+
+    int i1 = apex, i2 = apex + 1;
+    float dx1 = x[i1] - x[0], dy1 = y[i1] - y[0], dz1 = z[i1] - z[0];
+    float dx2 = x[i2] - x[0], dy2 = y[i2] - y[0], dz2 = z[i2] - z[0];
+    poly.depth_a = (dz1 * dy2 - dz2 * dy1) / best;
+    poly.depth_b = (dz2 * dx1 - dz1 * dx2) / best;
+    poly.depth_c = z[0] - poly.depth_a * x[0] - poly.depth_b * y[0] +
+                   0.5f * (fabsf(poly.depth_a) + fabsf(poly.depth_b)) + OCCLUSION_DEPTH_EPSILON;
+    poly.depth_max = max_z + OCCLUSION_DEPTH_EPSILON;
+    ob->polygons[ob->polygon_count++] = poly;
+}
+
+// Clips a box face against the near plane (z >= -w) and sets up what is left
+static void add_face(OcclusionBuffer *ob, const ClipVertex *corners, const int *face, int flip) {
+    ClipVertex out[OCCLUSION_MAX_EDGES];
+    int count = 0;
+    for (int i = 0; i < 4; i++) {
+        // A mirrored face is walked backwards to stay counterclockwise
+        ClipVertex p = corners[face[flip ? 3 - i : i]], q = corners[face[flip ? (6 - i) % 4 : (i + 1) % 4]];
+        float dp = p.z + p.w, dq = q.z + q.w;
+        if (dp >= 0.0f)
+            out[count++] = p;
+        if ((dp >= 0.0f) != (dq >= 0.0f)) {
+            float t = dp / (dp - dq);
+            out[count++] = (ClipVertex){p.x + (q.x - p.x) * t, p.y + (q.y - p.y) * t,
+                                        p.z + (q.z - p.z) * t, p.w + (q.w - p.w) * t};
+        }
+    }
+    if (count < 3)
+        return;
+
+    float x[OCCLUSION_MAX_EDGES], y[OCCLUSION_MAX_EDGES], z[OCCLUSION_MAX_EDGES];
+    for (int i = 0; i < count; i++) {
+        x[i] = (out[i].x / out[i].w * 0.5f + 0.5f) * ob->width;
+        y[i] = (out[i].y / out[i].w * 0.5f + 0.5f) * ob->height;
+        z[i] = out[i].z / out[i].w;
+    }
+    setup_polygon(ob, x, y, z, count);
+}
+
+void occlusion_buffer_add_box(OcclusionBuffer *ob, const mat4_t *model, vec3_t min, vec3_t max) {
+    mat4_t m = m4_mul(ob->view_projection, *model);
+    ClipVertex corners[8];
+    box_corners(&m, min, max, corners);
+
+    // A mirroring model matrix turns the winding of the faces around
+    float det = model->m00 * (model->m11 * model->m22 - model->m21 * model->m12) -
+                model->m10 * (model->m01 * model->m22 - model->m21 * model->m02) +
+                model->m20 * (model->m01 * model->m12 - model->m11 * model->m02);
+    int flip = det < 0.0f;
+    for (int f = 0; f < 6; f++)
+        add_face(ob, corners, box_faces[f], flip);
+    ob->occluders++;
+}
+
+static void rasterize_rows(OcclusionBuffer *ob, const OcclusionPolygon *poly, int row_begin, int row_end) {
+    int x_begin = poly->x0 & ~3;
+    for (int y = row_begin; y < row_end; y++) {
+        float cy = y + 0.5f;
+        float *row = &ob->depth[y * ob->width];
+#if defined(MATH_3D_SSE)
+        __m128 edge_a[OCCLUSION_MAX_EDGES], edge_base[OCCLUSION_MAX_EDGES];
+        for (int i = 0; i < poly->edge_count; i++) {
+            edge_a[i] = _mm_set1_ps(poly->edge_a[i]);
+            edge_base[i] = _mm_set1_ps(poly->edge_b[i] * cy + poly->edge_c[i]);
+        }
+        __m128 depth_base = _mm_set1_ps(poly->depth_b * cy + poly->depth_c);
+        __m128 depth_a = _mm_set1_ps(poly->depth_a), depth_max = _mm_set1_ps(poly->depth_max);
+        __m128 zero = _mm_setzero_ps();
+        // Columns past x1 are still inside the screen since width is a whole
+        // number of tiles, and the edges decide coverage on their own
+        for (int x = x_begin; x < poly->x1; x += 4) {
+            __m128 cx = _mm_add_ps(_mm_set1_ps((float)x), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edge_a[0], cx), edge_base[0]), zero);
+            for (int i = 1; i < poly->edge_count; i++)
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edge_a[i], cx), edge_base[i]), zero));
+            if (!_mm_movemask_ps(inside))
+                continue;
+            __m128 depth = _mm_min_ps(_mm_add_ps(_mm_mul_ps(depth_a, cx), depth_base), depth_max);
+            __m128 old = _mm_loadu_ps(&row[x]);
+            __m128 nearer = _mm_min_ps(old, depth);
+            _mm_storeu_ps(&row[x], _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+        }
+#else
+        for (int x = x_begin; x < poly->x1; x++) {
+            float cx = x + 0.5f;
+            int inside = 1;
+            for (int i = 0; i < poly->edge_count; i++)
+                inside &= poly->edge_a[i] * cx + poly->edge_b[i] * cy + poly->edge_c[i] >= 0.0f;
+            if (!inside)
+                continue;
+            float depth = min_f(poly->depth_a * cx + poly->depth_b * cy + poly->depth_c, poly->depth_max);
+            row[x] = min_f(row[x], depth);
+        }
+#endif
+    }
+}
+
+// Job: clears, rasterizes and reduces rows of tiles [begin, end)
+static void rasterize_band(int begin, int end, void *data) {
+    OcclusionBuffer *ob = data;
+    int row_begin = begin * OCCLUSION_TILE, row_end = end * OCCLUSION_TILE;
+    for (int i = row_begin * ob->width; i < row_end * ob->width; i++)
+        ob->depth[i] = 1.0f;
+
+    for (int p = 0; p < ob->polygon_count; p++) {
+        const OcclusionPolygon *poly = &ob->polygons[p];
+        int y0 = poly->y0 > row_begin ? poly->y0 : row_begin;
+        int y1 = poly->y1 < row_end ? poly->y1 : row_end;
+        if (y0 < y1)
+            rasterize_rows(ob, poly, y0, y1);
+    }
+
+    for (int ty = begin; ty < end; ty++) {
+        for (int tx = 0; tx < ob->tiles_x; tx++) {
+            float farthest = 0.0f;
+            for (int y = 0; y < OCCLUSION_TILE; y++) {
+                const float *row = &ob->depth[(ty * OCCLUSION_TILE + y) * ob->width + tx * OCCLUSION_TILE];
+                for (int x = 0; x < OCCLUSION_TILE; x++)
+                    farthest = max_f(farthest, row[x]);
+            }
+            ob->tile_max[ty * ob->tiles_x + tx] = farthest;
+        }
+    }
+}
+
+void occlusion_buffer_rasterize(OcclusionBuffer *ob) {
+    rafgl_jobs_parallel_for(ob->tiles_y, 2, rasterize_band, ob);
+}
+
+int occlusion_buffer_test(OcclusionBuffer *ob, vec3_t min, vec3_t max) {
+    ob->tested++;
+    ClipVertex corners[8];
+    box_corners(&ob->view_projection, min, max, corners);
+
+    // Boxes reaching past the near plane have no bounded screen rectangle
+    int behind = 0;
+    for (int i = 0; i < 8; i++)
+        behind += corners[i].z < -corners[i].w;
+    if (behind == 8) {
+        ob->culled++;
+        return 0;
+    }
+    if (behind > 0)
+        return 1;
+
+    float x0 = 1e30f, y0 = 1e30f, x1 = -1e30f, y1 = -1e30f, nearest = 1e30f;
+    for (int i = 0; i < 8; i++) {
+        const ClipVertex *c = &corners[i];
+        float sx = (c->x / c->w * 0.5f + 0.5f) * ob->width;
+        float sy = (c->y / c->w * 0.5f + 0.5f) * ob->height;
+        x0 = min_f(x0, sx);
+        x1 = max_f(x1, sx);
+        y0 = min_f(y0, sy);
+        y1 = max_f(y1, sy);
+        nearest = min_f(nearest, c->z / c->w);
+    }
+
+    // Pixels the rectangle touches, clamped before the conversion
+    int px0 = (int)min_f(max_f(x0, 0.0f), (float)ob->width);
+    int py0 = (int)min_f(max_f(y0, 0.0f), (float)ob->height);
+    int px1 = (int)ceilf(min_f(max_f(x1, 0.0f), (float)ob->width));
+    int py1 = (int)ceilf(min_f(max_f(y1, 0.0f), (float)ob->height));
+    if (px0 < px1 && py0 < py1) {
+        for (int ty = py0 / OCCLUSION_TILE; ty <= (py1 - 1) / OCCLUSION_TILE; ty++) {
+            for (int tx = px0 / OCCLUSION_TILE; tx <= (px1 - 1) / OCCLUSION_TILE; tx++) {
+                if (ob->tile_max[ty * ob->tiles_x + tx] < nearest)
+                    continue;
+                // Some pixel of the tile is not hidden, look at those in the rectangle
+                int ry0 = ty * OCCLUSION_TILE, ry1 = ry0 + OCCLUSION_TILE;
+                int rx0 = tx * OCCLUSION_TILE, rx1 = rx0 + OCCLUSION_TILE;
+                ry0 = ry0 > py0 ? ry0 : py0;
+                ry1 = ry1 < py1 ? ry1 : py1;
+                rx0 = rx0 > px0 ? rx0 : px0;
+                rx1 = rx1 < px1 ? rx1 : px1;
+                for (int y = ry0; y < ry1; y++) {
+                    const float *row = &ob->depth[y * ob->width];
+                    for (int x = rx0; x < rx1; x++)
+                        if (row[x] >= nearest)
+                            return 1;
+                }
+            }
+        }
+    }
+    ob->culled++;
+    return 0;
+}
+
+void occlusion_buffer_visualize(const OcclusionBuffer *ob, unsigned char *rgba) {
+    // NDC depths crowd towards 1, so the covered range is stretched to fill
+    // the grey levels
+    int count = ob->width * ob->height;
+    float nearest = 1.0f;
+    for (int i = 0; i < count; i++)
+        nearest = min_f(nearest, ob->depth[i]);
+    float scale = nearest < 1.0f ? 255.0f / (1.0f - nearest) : 0.0f;
+    for (int i = 0; i < count; i++) {
+        unsigned char grey = (unsigned char)((1.0f - ob->depth[i]) * scale);
+        rgba[i * 4 + 0] = rgba[i * 4 + 1] = rgba[i * 4 + 2] = grey;
+        rgba[i * 4 + 3] = 255;
+    }
+}
@@ -0,0 +1,149 @@
+#include <occlusion_queries.h>
+
+#include <string.h>
+
+// Corners of the unit cube, the proxy shader stretches them over a box
+static const float cube_corners[8][3] = {
+    {0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {1, 1, 0}, {0, 0, 1}, {1, 0, 1}, {0, 1, 1}, {1, 1, 1},
+};
+static const unsigned char cube_indices[36] = {
+    0, 4, 6, 0, 6, 2,  1, 3, 7, 1, 7, 5,  // -x, +x
+    0, 1, 5, 0, 5, 4,  2, 6, 7, 2, 7, 3,  // -y, +y
+    0, 2, 3, 0, 3, 1,  4, 5, 7, 4, 7, 6,  // -z, +z
+};
+
+void occlusion_queries_init(OcclusionQueries *oq) {
+    memset(oq, 0, sizeof(*oq));
+
+    glGenVertexArrays(1, &oq->vao);
+    glBindVertexArray(oq->vao);
+    glGenBuffers(1, &oq->vertex_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, oq->vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(cube_corners), cube_corners, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(0);
+    glGenBuffers(1, &oq->index_buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, oq->index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_indices), cube_indices, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void occlusion_queries_cleanup(OcclusionQueries *oq) {
+    for (int i = 0; i < oq->count; i++)
+        glDeleteQueries(OCCLUSION_QUERY_LATENCY, oq->props[i].queries);
+    glDeleteVertexArrays(1, &oq->vao);
+    glDeleteBuffers(1, &oq->vertex_buffer);
+    glDeleteBuffers(1, &oq->index_buffer);
+    memset(oq, 0, sizeof(*oq));
+}
+
+void occlusion_queries_set_program(OcclusionQueries *oq, GLuint program) {
+    oq->program = program;
+    oq->view_projection = glGetUniformLocation(program, "viewProjection");
+    oq->box_min = glGetUniformLocation(program, "boxMin");
+    oq->box_max = glGetUniformLocation(program, "boxMax");
+}
+
+int occlusion_queries_add(OcclusionQueries *oq) {
+    if (oq->count == OCCLUSION_QUERY_MAX_PROPS)
+        return -1;
+
+    int handle = oq->count++;
+    OcclusionQueryProp *prop = &oq->props[handle];
+    memset(prop, 0, sizeof(*prop));
+    glGenQueries(OCCLUSION_QUERY_LATENCY, prop->queries);
+    for (int i = 0; i < OCCLUSION_QUERY_LATENCY; i++)
+        prop->issued_frame[i] = -1;
+    // Props start out visible and take turns with their first query, so the
+    // queries spread over the frames
+    prop->visible = 1;
+    prop->result_frame = -1;
+    prop->last_issued = handle % OCCLUSION_QUERY_VISIBLE_FRAMES - OCCLUSION_QUERY_VISIBLE_FRAMES;
+    prop->slot = -1;
+    return handle;
+}
+
+void occlusion_queries_begin(OcclusionQueries *oq, vec3_t camera) {
+    oq->frame++;
+    oq->camera = camera;
+    oq->issue_count = 0;
+    oq->requested = oq->queried = oq->read_back = oq->hidden = 0;
+
+    for (int i = 0; i < oq->count; i++) {
+        OcclusionQueryProp *prop = &oq->props[i];
+        prop->slot = -1;
+        for (int slot = 0; slot < OCCLUSION_QUERY_LATENCY; slot++) {
+            if (prop->issued_frame[slot] < 0)
+                continue;
+            GLuint available = 0, samples = 0;
+            glGetQueryObjectuiv(prop->queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            glGetQueryObjectuiv(prop->queries[slot], GL_QUERY_RESULT, &samples);
+            // Results of one prop may come back out of order
+            if (prop->issued_frame[slot] > prop->result_frame) {
+                prop->visible = samples != 0;
+                prop->result_frame = prop->issued_frame[slot];
+            }
+            prop->issued_frame[slot] = -1;
+            oq->read_back++;
+            oq->hidden += samples == 0;
+        }
+    }
+}
+
+GLuint occlusion_queries_request(OcclusionQueries *oq, int handle, vec3_t min, vec3_t max) {
+    OcclusionQueryProp *prop = &oq->props[handle];
+    oq->requested++;
+    prop->min = min;
+    prop->max = max;
+
+    // With the camera inside the box its faces are behind the near plane and
+    // no sample would pass
+    vec3_t c = oq->camera;
+    float margin = OCCLUSION_QUERY_NEAR_MARGIN;
+    if (c.x > min.x - margin && c.x < max.x + margin && c.y > min.y - margin &&
+        c.y < max.y + margin && c.z > min.z - margin && c.z < max.z + margin)
+        return 0;
+
+    // Props seen recently are drawn without asking, and one whose queries
+    // are all still in flight is drawn rather than waited for
+    if (prop->visible && oq->frame - prop->last_issued < OCCLUSION_QUERY_VISIBLE_FRAMES)
+        return 0;
+    int slot = prop->next;
+    if (prop->issued_frame[slot] >= 0)
+        return 0;
+
+    prop->slot = slot;
+    prop->next = (slot + 1) % OCCLUSION_QUERY_LATENCY;
+    prop->issued_frame[slot] = oq->frame;
+    prop->last_issued = oq->frame;
+    oq->issue[oq->issue_count++] = handle;
+    oq->queried++;
+    return prop->queries[slot];
+}
+
+void occlusion_queries_issue(OcclusionQueries *oq, mat4_t view_projection) {
+    if (oq->issue_count == 0)
+        return;
+
+    glUseProgram(oq->program);
+    glUniformMatrix4fv(oq->view_projection, 1, GL_FALSE, (float *)view_projection.m);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glBindVertexArray(oq->vao);
+
+    for (int i = 0; i < oq->issue_count; i++) {
+        const OcclusionQueryProp *prop = &oq->props[oq->issue[i]];
+        glUniform3f(oq->box_min, prop->min.x, prop->min.y, prop->min.z);
+        glUniform3f(oq->box_max, prop->max.x, prop->max.y, prop->max.z);
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, prop->queries[prop->slot]);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, (void *)0);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+    }
+
+    glBindVertexArray(0);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+}
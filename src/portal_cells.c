@@ -0,0 +1,260 @@
+#include <portal_cells.h>
+#include <rafgl_memory.h>
+
+#include <float.h>
+#include <string.h>
+
+// One walk through the portals from a cell, by the camera or by one face of
+// a light's cube
+typedef struct {
+    mat4_t view_projection;
+    unsigned char *seen;  // per cell
+    PortalRect *rects;    // per cell, union of the rectangles it was seen through
+    vec3_t origin;        // portals farther than radius from it are skipped
+    float radius2;
+    int visited, seen_cells;
+} PortalWalk;
+
+// Cube map faces around a light, as render_cube_shadow_map() sets them up
+static const vec3_t portal_cells_faces[6][2] = {
+    {{1, 0, 0}, {0, -1, 0}}, {{-1, 0, 0}, {0, -1, 0}}, {{0, 1, 0}, {0, 0, 1}},
+    {{0, -1, 0}, {0, 0, -1}}, {{0, 0, 1}, {0, -1, 0}}, {{0, 0, -1}, {0, -1, 0}}};
+#define PORTAL_CELLS_LIGHT_NEAR 0.01f  // a light right next to a door still sees through it
+
+static inline float min_f(float a, float b) {
+    return a < b ? a : b;
+}
+
+static inline float max_f(float a, float b) {
+    return a > b ? a : b;
+}
+
+void portal_cells_init(PortalCells *pc, int cell_capacity, int portal_capacity) {
+    memset(pc, 0, sizeof(PortalCells));
+    pc->cell_capacity = cell_capacity;
+    pc->portal_capacity = portal_capacity;
+    pc->cell_min = rafgl_malloc(RAFGL_MEM_SCENE, cell_capacity * sizeof(vec3_t));
+    pc->cell_max = rafgl_malloc(RAFGL_MEM_SCENE, cell_capacity * sizeof(vec3_t));
+    pc->cell_first = rafgl_malloc(RAFGL_MEM_SCENE, cell_capacity * sizeof(int));
+    pc->cell_portal_count = rafgl_malloc(RAFGL_MEM_SCENE, cell_capacity * sizeof(int));
+    pc->cell_portals = rafgl_malloc(RAFGL_MEM_SCENE, 2 * portal_capacity * sizeof(int));
+    pc->portals = rafgl_malloc(RAFGL_MEM_SCENE, portal_capacity * sizeof(Portal));
+    pc->visible = rafgl_malloc(RAFGL_MEM_SCENE, cell_capacity);
+    pc->rects = rafgl_malloc(RAFGL_MEM_SCENE, cell_capacity * sizeof(PortalRect));
+    pc->lit = rafgl_malloc(RAFGL_MEM_SCENE, cell_capacity);
+    pc->light_seen = rafgl_malloc(RAFGL_MEM_SCENE, cell_capacity);
+    pc->light_rects = rafgl_malloc(RAFGL_MEM_SCENE, cell_capacity * sizeof(PortalRect));
+    pc->camera_cell = -1;
+}
+
+void portal_cells_cleanup(PortalCells *pc) {
+    rafgl_free(pc->cell_min);
+    rafgl_free(pc->cell_max);
+    rafgl_free(pc->cell_first);
+    rafgl_free(pc->cell_portal_count);
+    rafgl_free(pc->cell_portals);
+    rafgl_free(pc->portals);
+    rafgl_free(pc->visible);
+    rafgl_free(pc->rects);
+    rafgl_free(pc->lit);
+    rafgl_free(pc->light_seen);
+    rafgl_free(pc->light_rects);
+    memset(pc, 0, sizeof(PortalCells));
+}
+
+int portal_cells_add_cell(PortalCells *pc, vec3_t min, vec3_t max) {
+    if (pc->cell_count == pc->cell_capacity)
+        return -1;
+    int cell = pc->cell_count++;
+    pc->cell_min[cell] = min;
+    pc->cell_max[cell] = max;
+    pc->cell_first[cell] = pc->cell_portal_count[cell] = 0;
+    return cell;
+}
+
+int portal_cells_add_portal(PortalCells *pc, int cell_a, int cell_b, const vec3_t corners[4]) {
+    if (pc->portal_count == pc->portal_capacity)
+        return -1;
+    int index = pc->portal_count++;
+    Portal *portal = &pc->portals[index];
+    portal->min = portal->max = corners[0];
+    for (int i = 0; i < 4; i++) {
+        portal->corners[i] = corners[i];
+        portal->min = vec3(min_f(portal->min.x, corners[i].x), min_f(portal->min.y, corners[i].y),
+                           min_f(portal->min.z, corners[i].z));
+        portal->max = vec3(max_f(portal->max.x, corners[i].x), max_f(portal->max.y, corners[i].y),
+                           max_f(portal->max.z, corners[i].z));
+    }
+    portal->cells[0] = cell_a;
+    portal->cells[1] = cell_b;
+    return index;
+}
+
+void portal_cells_finish(PortalCells *pc) {
+    memset(pc->cell_portal_count, 0, pc->cell_count * sizeof(int));
+    for (int p = 0; p < pc->portal_count; p++) {
+        pc->cell_portal_count[pc->portals[p].cells[0]]++;
+        pc->cell_portal_count[pc->portals[p].cells[1]]++;
+    }
+    int first = 0;
+    for (int c = 0; c < pc->cell_count; c++) {
+        pc->cell_first[c] = first;
+        first += pc->cell_portal_count[c];
+        pc->cell_portal_count[c] = 0;
+    }
+    for (int p = 0; p < pc->portal_count; p++)
+        for (int side = 0; side < 2; side++) {
+            int cell = pc->portals[p].cells[side];
+            pc->cell_portals[pc->cell_first[cell] + pc->cell_portal_count[cell]++] = p;
+        }
+}
+
+int portal_cells_locate(const PortalCells *pc, vec3_t point) {
+    return portal_cells_locate_box(pc, point, point);
+}
+
+int portal_cells_locate_box(const PortalCells *pc, vec3_t min, vec3_t max) {
+    for (int c = 0; c < pc->cell_count; c++) {
+        vec3_t lo = pc->cell_min[c], hi = pc->cell_max[c];
+        if (min.x >= lo.x && min.y >= lo.y && min.z >= lo.z && max.x <= hi.x && max.y <= hi.y &&
+            max.z <= hi.z)
+            return c;
+    }
+    return -1;
+}
+
+// Screen rectangle of the points, the whole screen when some lie behind the
+// near plane. Returns 0 when all of them do.
+static int portal_cells_project(const mat4_t *m, const vec3_t *points, int count, PortalRect *rect) {
+    int behind = 0;
+    *rect = (PortalRect){1e30f, 1e30f, -1e30f, -1e30f};
+    for (int i = 0; i < count; i++) {
+        vec3_t p = points[i];
+        float x = m->m00 * p.x + m->m10 * p.y + m->m20 * p.z + m->m30;
+        float y = m->m01 * p.x + m->m11 * p.y + m->m21 * p.z + m->m31;
+        float z = m->m02 * p.x + m->m12 * p.y + m->m22 * p.z + m->m32;
+        float w = m->m03 * p.x + m->m13 * p.y + m->m23 * p.z + m->m33;
+        if (z < -w) {
+            behind++;
+            continue;
+        }
+        rect->x0 = min_f(rect->x0, x / w);
+        rect->y0 = min_f(rect->y0, y / w);
+        rect->x1 = max_f(rect->x1, x / w);
+        rect->y1 = max_f(rect->y1, y / w);
+    }
+    if (behind == count)
+        return 0;
+    if (behind > 0)
+        *rect = (PortalRect){-1.0f, -1.0f, 1.0f, 1.0f};
+    return 1;
+}
+
+static PortalRect portal_rect_intersect(PortalRect a, PortalRect b) {
+    return (PortalRect){max_f(a.x0, b.x0), max_f(a.y0, b.y0), min_f(a.x1, b.x1), min_f(a.y1, b.y1)};
+}
+
+static int portal_rect_empty(PortalRect r) {
+    return r.x0 >= r.x1 || r.y0 >= r.y1;
+}
+
+// Distance from the point to the box, squared
+static float portal_cells_box_distance2(vec3_t p, vec3_t min, vec3_t max) {
+    float dx = max_f(max_f(min.x - p.x, p.x - max.x), 0.0f);
+    float dy = max_f(max_f(min.y - p.y, p.y - max.y), 0.0f);
+    float dz = max_f(max_f(min.z - p.z, p.z - max.z), 0.0f);
+    return dx * dx + dy * dy + dz * dz;
+}
+
+static void portal_cells_visit(const PortalCells *pc, PortalWalk *walk, int cell, PortalRect rect, int depth,
+                               int from) {
+    PortalRect *seen = &walk->rects[cell];
+    if (walk->seen[cell]) {
+        // Nothing new to see through a part of the screen already walked
+        if (rect.x0 >= seen->x0 && rect.y0 >= seen->y0 && rect.x1 <= seen->x1 && rect.y1 <= seen->y1)
+            return;
+        // Walk the union, so it is all covered the next time
+        *seen = (PortalRect){min_f(seen->x0, rect.x0), min_f(seen->y0, rect.y0), max_f(seen->x1, rect.x1),
+                             max_f(seen->y1, rect.y1)};
+        rect = *seen;
+    } else {
+        walk->seen[cell] = 1;
+        walk->seen_cells++;
+        *seen = rect;
+    }
+    walk->visited++;
+    if (depth == PORTAL_CELLS_MAX_DEPTH)
+        return;
+
+    for (int i = 0; i < pc->cell_portal_count[cell]; i++) {
+        int p = pc->cell_portals[pc->cell_first[cell] + i];
+        if (p == from)
+            continue;
+        const Portal *portal = &pc->portals[p];
+        if (portal_cells_box_distance2(walk->origin, portal->min, portal->max) > walk->radius2)
+            continue;
+        PortalRect opening;
+        if (!portal_cells_project(&walk->view_projection, portal->corners, 4, &opening))
+            continue;
+        opening = portal_rect_intersect(opening, rect);
+        if (portal_rect_empty(opening))
+            continue;
+        int next = portal->cells[0] == cell ? portal->cells[1] : portal->cells[0];
+        portal_cells_visit(pc, walk, next, opening, depth + 1, p);
+    }
+}
+
+void portal_cells_query_camera(PortalCells *pc, vec3_t eye, mat4_t view_projection) {
+    pc->view_projection = view_projection;
+    pc->camera_cell = portal_cells_locate(pc, eye);
+    memset(pc->visible, 0, pc->cell_count);
+    PortalWalk walk = {view_projection, pc->visible, pc->rects, eye, FLT_MAX, 0, 0};
+    if (pc->camera_cell >= 0)
+        portal_cells_visit(pc, &walk, pc->camera_cell, (PortalRect){-1.0f, -1.0f, 1.0f, 1.0f}, 0, -1);
+    pc->visited = walk.visited;
+    pc->visible_cells = walk.seen_cells;
+}
+
+int portal_cells_test(const PortalCells *pc, int cell, vec3_t min, vec3_t max) {
+    if (cell < 0 || pc->camera_cell < 0)
+        return 1;
+    if (!pc->visible[cell])
+        return 0;
+
+    vec3_t corners[8];
+    for (int i = 0; i < 8; i++)
+        corners[i] = vec3(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z);
+    PortalRect rect;
+    if (!portal_cells_project(&pc->view_projection, corners, 8, &rect))
+        return 0;
+    return !portal_rect_empty(portal_rect_intersect(rect, pc->rects[cell]));
+}
+
+void portal_cells_clear_lights(PortalCells *pc) {
+    pc->all_lit = 0;
+    memset(pc->lit, 0, pc->cell_count);
+}
+
+void portal_cells_add_light(PortalCells *pc, vec3_t position, float radius) {
+    int start = portal_cells_locate(pc, position);
+    if (start < 0) {
+        pc->all_lit = 1;
+        return;
+    }
+
+    // The light is a camera looking down each face of a cube, a degree wider
+    // than the face so no door falls between two of them
+    mat4_t projection = m4_perspective(91.0f, 1.0f, PORTAL_CELLS_LIGHT_NEAR, radius);
+    for (int f = 0; f < 6; f++) {
+        mat4_t view = m4_look_at(position, v3_add(position, portal_cells_faces[f][0]), portal_cells_faces[f][1]);
+        PortalWalk walk = {m4_mul(projection, view), pc->light_seen, pc->light_rects, position, radius * radius, 0, 0};
+        memset(pc->light_seen, 0, pc->cell_count);
+        portal_cells_visit(pc, &walk, start, (PortalRect){-1.0f, -1.0f, 1.0f, 1.0f}, 0, -1);
+        for (int c = 0; c < pc->cell_count; c++)
+            pc->lit[c] |= pc->light_seen[c];
+    }
+}
+
+int portal_cells_lit(const PortalCells *pc, int cell) {
+    return cell < 0 || pc->all_lit || pc->lit[cell];
+}
@@ -0,0 +1,598 @@
+#include <scene_bvh.h>
+#include <rafgl_memory.h>
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+// min_f() and max_f() are library calls unless NaNs may be ignored
+static inline float min_f(float a, float b) {
+    return a < b ? a : b;
+}
+
+static inline float max_f(float a, float b) {
+    return a > b ? a : b;
+}
+
+static int item_present(const SceneBvh *bvh, int item) {
+    return bvh->min[item].x <= bvh->max[item].x;
+}
+
+static float box_area(vec3_t min, vec3_t max) {
+    vec3_t d = v3_sub(max, min);
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static void box_grow(vec3_t *min, vec3_t *max, vec3_t other_min, vec3_t other_max) {
+    *min = vec3(min_f(min->x, other_min.x), min_f(min->y, other_min.y), min_f(min->z, other_min.z));
+    *max = vec3(max_f(max->x, other_max.x), max_f(max->y, other_max.y), max_f(max->z, other_max.z));
+}
+
+static void box_empty(vec3_t *min, vec3_t *max) {
+    *min = vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    *max = vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+}
+
+static void slot_bounds(const SceneBvhNode *node, int slot, vec3_t *min, vec3_t *max) {
+    *min = vec3(node->min_x[slot], node->min_y[slot], node->min_z[slot]);
+    *max = vec3(node->max_x[slot], node->max_y[slot], node->max_z[slot]);
+}
+
+// Recomputes the child boxes of a node from its items and child nodes, which
+// have to be up to date already
+static void node_refit(SceneBvh *bvh, int index) {
+    SceneBvhNode *node = &bvh->nodes[index];
+    for (int slot = 0; slot < SCENE_BVH_WIDTH; slot++) {
+        vec3_t min, max;
+        box_empty(&min, &max);
+        if (node->valid & (1 << slot)) {
+            if (node->child[slot] < 0) {
+                const int *items = &bvh->order[node->first[slot]];
+                for (int i = 0; i < node->count[slot]; i++)
+                    box_grow(&min, &max, bvh->min[items[i]], bvh->max[items[i]]);
+            } else {
+                const SceneBvhNode *child = &bvh->nodes[node->child[slot]];
+                for (int s = 0; s < SCENE_BVH_WIDTH; s++) {
+                    if (!(child->valid & (1 << s)))
+                        continue;
+                    vec3_t child_min, child_max;
+                    slot_bounds(child, s, &child_min, &child_max);
+                    box_grow(&min, &max, child_min, child_max);
+                }
+            }
+        }
+        node->min_x[slot] = min.x;
+        node->min_y[slot] = min.y;
+        node->min_z[slot] = min.z;
+        node->max_x[slot] = max.x;
+        node->max_y[slot] = max.y;
+        node->max_z[slot] = max.z;
+    }
+}
+
+// Expected cost of a query through the whole tree relative to testing the
+// root box, one unit per node visit and per item test
+static float tree_cost(const SceneBvh *bvh) {
+    if (bvh->node_count == 0)
+        return 0.0f;
+
+    vec3_t root_min, root_max;
+    box_empty(&root_min, &root_max);
+    const SceneBvhNode *root = &bvh->nodes[0];
+    for (int slot = 0; slot < SCENE_BVH_WIDTH; slot++) {
+        if (!(root->valid & (1 << slot)))
+            continue;
+        vec3_t min, max;
+        slot_bounds(root, slot, &min, &max);
+        box_grow(&root_min, &root_max, min, max);
+    }
+    float root_area = box_area(root_min, root_max);
+    if (root_area <= 0.0f)
+        return 1.0f;
+
+    float cost = 0.0f;
+    for (int i = 0; i < bvh->node_count; i++) {
+        const SceneBvhNode *node = &bvh->nodes[i];
+        for (int slot = 0; slot < SCENE_BVH_WIDTH; slot++) {
+            if (!(node->valid & (1 << slot)))
+                continue;
+            vec3_t min, max;
+            slot_bounds(node, slot, &min, &max);
+            cost += box_area(min, max) * (node->child[slot] < 0 ? node->count[slot] : 1);
+        }
+    }
+    return 1.0f + cost / root_area;
+}
+
+typedef struct {
+    vec3_t min, max;
+    int count;
+} SahBin;
+
+// Build time copy of an item, the splits partition these in place so they
+// read memory in order instead of chasing item indices
+typedef struct {
+    vec3_t min, max, centroid;
+    int item;
+} BuildItem;
+
+static float vec3_axis(vec3_t v, int axis) {
+    return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+// Reorders items into two groups with a binned SAH split along the best axis
+// and returns the size of the first group
+static int split_range(BuildItem *items, int count, int depth) {
+    vec3_t lo, hi;
+    box_empty(&lo, &hi);
+    for (int i = 0; i < count; i++)
+        box_grow(&lo, &hi, items[i].centroid, items[i].centroid);
+
+    float best_cost = FLT_MAX;
+    int best_axis = -1, best_bin = 0;
+    if (depth < SCENE_BVH_SAH_DEPTH) {
+        // All three axes are binned in one pass, an axis without extent
+        // drops everything into its first bin and never finds a split. Small
+        // ranges near the leaves get a bin per item at most.
+        int bin_count = count < SCENE_BVH_BINS ? count : SCENE_BVH_BINS;
+        float axis_lo[3], scale[3];
+        SahBin bins[3][SCENE_BVH_BINS];
+        for (int axis = 0; axis < 3; axis++) {
+            axis_lo[axis] = vec3_axis(lo, axis);
+            float extent = vec3_axis(hi, axis) - axis_lo[axis];
+            scale[axis] = extent > 0.0f ? bin_count * 0.9999f / extent : 0.0f;
+            for (int b = 0; b < bin_count; b++) {
+                box_empty(&bins[axis][b].min, &bins[axis][b].max);
+                bins[axis][b].count = 0;
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            const BuildItem *item = &items[i];
+            for (int axis = 0; axis < 3; axis++) {
+                int b = (int)((vec3_axis(item->centroid, axis) - axis_lo[axis]) * scale[axis]);
+                b = b < 0 ? 0 : b >= bin_count ? bin_count - 1 : b;
+                SahBin *bin = &bins[axis][b];
+                box_grow(&bin->min, &bin->max, item->min, item->max);
+                bin->count++;
+            }
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            // Right side costs swept from the end, then the left side from the start
+            float right_cost[SCENE_BVH_BINS];
+            vec3_t min, max;
+            box_empty(&min, &max);
+            int right = 0;
+            for (int b = bin_count - 1; b > 0; b--) {
+                box_grow(&min, &max, bins[axis][b].min, bins[axis][b].max);
+                right += bins[axis][b].count;
+                right_cost[b] = right > 0 ? box_area(min, max) * right : 0.0f;
+            }
+            box_empty(&min, &max);
+            int left = 0;
+            for (int b = 1; b < bin_count; b++) {
+                box_grow(&min, &max, bins[axis][b - 1].min, bins[axis][b - 1].max);
+                left += bins[axis][b - 1].count;
+                if (left == 0 || left == count)
+                    continue;
+                float cost = box_area(min, max) * left + right_cost[b];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = b;
+                }
+            }
+        }
+    }
+
+    // Everything in one spot or too deep already, halves keep the tree shallow
+    if (best_axis < 0)
+        return count / 2;
+
+    float axis_lo = vec3_axis(lo, best_axis);
+    int bin_count = count < SCENE_BVH_BINS ? count : SCENE_BVH_BINS;
+    float scale = bin_count * 0.9999f / (vec3_axis(hi, best_axis) - axis_lo);
+    int i = 0, j = count - 1;
+    while (i <= j) {
+        int b = (int)((vec3_axis(items[i].centroid, best_axis) - axis_lo) * scale);
+        if (b < best_bin) {
+            i++;
+        } else {
+            BuildItem swap = items[i];
+            items[i] = items[j];
+            items[j--] = swap;
+        }
+    }
+    return i > 0 && i < count ? i : count / 2;
+}
+
+// Splits the largest range until there are four or all fit in a leaf, leaf
+// ranges go straight into the node and the rest get nodes of their own
+static int build_node(SceneBvh *bvh, BuildItem *items, int first, int count, int parent, int parent_slot,
+                      int depth) {
+    int index = bvh->node_count++;
+    int range_first[SCENE_BVH_WIDTH] = {first}, range_count[SCENE_BVH_WIDTH] = {count};
+    int ranges = 1;
+    while (ranges < SCENE_BVH_WIDTH) {
+        int pick = -1;
+        for (int r = 0; r < ranges; r++) {
+            if (range_count[r] > SCENE_BVH_LEAF_SIZE && (pick < 0 || range_count[r] > range_count[pick]))
+                pick = r;
+        }
+        if (pick < 0)
+            break;
+        int left = split_range(&items[range_first[pick]], range_count[pick], depth);
+        range_first[ranges] = range_first[pick] + left;
+        range_count[ranges] = range_count[pick] - left;
+        range_count[pick] = left;
+        ranges++;
+    }
+
+    SceneBvhNode *node = &bvh->nodes[index];
+    memset(node, 0, sizeof(SceneBvhNode));
+    node->parent = parent;
+    node->parent_slot = parent_slot;
+    for (int slot = 0; slot < ranges; slot++) {
+        node->valid |= 1 << slot;
+        node->child[slot] = -1;
+        node->first[slot] = range_first[slot];
+        node->count[slot] = range_count[slot];
+        if (range_count[slot] > SCENE_BVH_LEAF_SIZE)
+            continue;
+        for (int i = range_first[slot]; i < range_first[slot] + range_count[slot]; i++) {
+            bvh->order[i] = items[i].item;
+            bvh->node[items[i].item] = index;
+        }
+    }
+    for (int slot = 0; slot < ranges; slot++) {
+        if (range_count[slot] > SCENE_BVH_LEAF_SIZE) {
+            int child = build_node(bvh, items, range_first[slot], range_count[slot], index, slot, depth + 1);
+            bvh->nodes[index].child[slot] = child;
+        }
+    }
+
+    node_refit(bvh, index);
+    return index;
+}
+
+void scene_bvh_init(SceneBvh *bvh, int capacity) {
+    memset(bvh, 0, sizeof(SceneBvh));
+    bvh->capacity = capacity;
+    bvh->min = rafgl_malloc(RAFGL_MEM_SCENE, capacity * sizeof(vec3_t));
+    bvh->max = rafgl_malloc(RAFGL_MEM_SCENE, capacity * sizeof(vec3_t));
+    bvh->node = rafgl_malloc(RAFGL_MEM_SCENE, capacity * sizeof(int));
+    bvh->order = rafgl_malloc(RAFGL_MEM_SCENE, capacity * sizeof(int));
+    bvh->dirty_items = rafgl_malloc(RAFGL_MEM_SCENE, capacity * sizeof(int));
+    bvh->moved = rafgl_calloc(RAFGL_MEM_SCENE, capacity, 1);
+    // Every node but the root has at least two children
+    bvh->nodes = rafgl_malloc(RAFGL_MEM_SCENE, (capacity + 1) * sizeof(SceneBvhNode));
+
+    for (int i = 0; i < capacity; i++) {
+        box_empty(&bvh->min[i], &bvh->max[i]);
+        bvh->node[i] = -1;
+    }
+}
+
+void scene_bvh_cleanup(SceneBvh *bvh) {
+    rafgl_free(bvh->min);
+    rafgl_free(bvh->max);
+    rafgl_free(bvh->node);
+    rafgl_free(bvh->order);
+    rafgl_free(bvh->dirty_items);
+    rafgl_free(bvh->moved);
+    rafgl_free(bvh->nodes);
+    memset(bvh, 0, sizeof(SceneBvh));
+}
+
+void scene_bvh_set_bounds(SceneBvh *bvh, int item, vec3_t min, vec3_t max) {
+    int present = item_present(bvh, item);
+    bvh->min[item] = min;
+    bvh->max[item] = max;
+    if (present != item_present(bvh, item))
+        bvh->changed = 1;
+    else if (present && bvh->node[item] >= 0 && !bvh->moved[item]) {
+        bvh->moved[item] = 1;
+        bvh->dirty_items[bvh->dirty_count++] = item;
+    }
+}
+
+void scene_bvh_remove(SceneBvh *bvh, int item) {
+    if (!item_present(bvh, item))
+        return;
+    box_empty(&bvh->min[item], &bvh->max[item]);
+    bvh->changed = 1;
+}
+
+void scene_bvh_build(SceneBvh *bvh) {
+    BuildItem *items = rafgl_malloc(RAFGL_MEM_SCENE, bvh->capacity * sizeof(BuildItem));
+    bvh->item_count = 0;
+    for (int i = 0; i < bvh->capacity; i++) {
+        bvh->node[i] = -1;
+        bvh->moved[i] = 0;
+        if (!item_present(bvh, i))
+            continue;
+        BuildItem *item = &items[bvh->item_count++];
+        item->min = bvh->min[i];
+        item->max = bvh->max[i];
+        item->centroid = v3_muls(v3_add(bvh->min[i], bvh->max[i]), 0.5f);
+        item->item = i;
+    }
+
+    bvh->node_count = 0;
+    if (bvh->item_count > 0)
+        build_node(bvh, items, 0, bvh->item_count, -1, -1, 0);
+    rafgl_free(items);
+
+    bvh->changed = 0;
+    bvh->dirty_count = 0;
+    bvh->built_cost = bvh->cost = tree_cost(bvh);
+    bvh->builds++;
+}
+
+int scene_bvh_update(SceneBvh *bvh) {
+    if (bvh->changed) {
+        scene_bvh_build(bvh);
+        return 1;
+    }
+    if (bvh->dirty_count == 0)
+        return 0;
+
+    // Marks the path up from every moved item, then refits children before
+    // parents, which is back to front in node order
+    int lowest = bvh->node_count;
+    for (int i = 0; i < bvh->dirty_count; i++) {
+        int item = bvh->dirty_items[i];
+        bvh->moved[item] = 0;
+        for (int n = bvh->node[item]; n >= 0 && !bvh->nodes[n].dirty; n = bvh->nodes[n].parent) {
+            bvh->nodes[n].dirty = 1;
+            if (n < lowest)
+                lowest = n;
+        }
+    }
+    bvh->dirty_count = 0;
+    for (int n = bvh->node_count - 1; n >= lowest; n--) {
+        if (!bvh->nodes[n].dirty)
+            continue;
+        node_refit(bvh, n);
+        bvh->nodes[n].dirty = 0;
+    }
+    bvh->refits++;
+
+    bvh->cost = tree_cost(bvh);
+    if (bvh->cost > bvh->built_cost * SCENE_BVH_REBUILD_RATIO) {
+        scene_bvh_build(bvh);
+        return 1;
+    }
+    return 0;
+}
+
+// Appends every item below a child
+static int emit_all(const SceneBvh *bvh, const SceneBvhNode *node, int slot, int *items, int count) {
+    memcpy(&items[count], &bvh->order[node->first[slot]], node->count[slot] * sizeof(int));
+    return count + node->count[slot];
+}
+
+// Appends the items of a leaf child whose own bounds are inside the frustum
+static int emit_leaf_frustum(const SceneBvh *bvh, const SceneBvhNode *node, int slot, const frustum_t *frustum,
+                             int *items, int count) {
+    const int *leaf = &bvh->order[node->first[slot]];
+    float min_x[SCENE_BVH_LEAF_SIZE], min_y[SCENE_BVH_LEAF_SIZE], min_z[SCENE_BVH_LEAF_SIZE];
+    float max_x[SCENE_BVH_LEAF_SIZE], max_y[SCENE_BVH_LEAF_SIZE], max_z[SCENE_BVH_LEAF_SIZE];
+    for (int i = 0; i < SCENE_BVH_LEAF_SIZE; i++) {
+        int item = leaf[i < node->count[slot] ? i : 0];
+        min_x[i] = bvh->min[item].x;
+        min_y[i] = bvh->min[item].y;
+        min_z[i] = bvh->min[item].z;
+        max_x[i] = bvh->max[item].x;
+        max_y[i] = bvh->max[item].y;
+        max_z[i] = bvh->max[item].z;
+    }
+    int mask = frustum_aabbs4(frustum, min_x, min_y, min_z, max_x, max_y, max_z) & ((1 << node->count[slot]) - 1);
+    while (mask) {
+        items[count++] = leaf[__builtin_ctz(mask)];
+        mask &= mask - 1;
+    }
+    return count;
+}
+
+int scene_bvh_query_frustum(const SceneBvh *bvh, const frustum_t *frustum, int *items) {
+    if (bvh->node_count == 0)
+        return 0;
+
+    int stack[SCENE_BVH_STACK];
+    int top = 0, count = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const SceneBvhNode *node = &bvh->nodes[stack[--top]];
+        int inside;
+        int mask = frustum_aabbs4_classify(frustum, node->min_x, node->min_y, node->min_z, node->max_x,
+                                           node->max_y, node->max_z, &inside) &
+                   node->valid;
+        while (mask) {
+            int slot = __builtin_ctz(mask);
+            mask &= mask - 1;
+            if (inside & (1 << slot))
+                count = emit_all(bvh, node, slot, items, count);
+            else if (node->child[slot] < 0)
+                count = emit_leaf_frustum(bvh, node, slot, frustum, items, count);
+            else
+                stack[top++] = node->child[slot];
+        }
+    }
+    return count;
+}
+
+static int box_sphere(vec3_t min, vec3_t max, vec3_t center, float radius) {
+    float dx = max_f(max_f(min.x - center.x, center.x - max.x), 0.0f);
+    float dy = max_f(max_f(min.y - center.y, center.y - max.y), 0.0f);
+    float dz = max_f(max_f(min.z - center.z, center.z - max.z), 0.0f);
+    return dx * dx + dy * dy + dz * dz <= radius * radius;
+}
+
+// Children whose box is within radius of the center, inside receives those
+// whose farthest corner is
+static int node_sphere_mask(const SceneBvhNode *node, vec3_t center, float radius, int *inside) {
+#if defined(MATH_3D_SSE)
+    __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+    __m128 zero = _mm_setzero_ps(), r2 = _mm_set1_ps(radius * radius);
+    __m128 lx = _mm_sub_ps(_mm_loadu_ps(node->min_x), cx), hx = _mm_sub_ps(cx, _mm_loadu_ps(node->max_x));
+    __m128 ly = _mm_sub_ps(_mm_loadu_ps(node->min_y), cy), hy = _mm_sub_ps(cy, _mm_loadu_ps(node->max_y));
+    __m128 lz = _mm_sub_ps(_mm_loadu_ps(node->min_z), cz), hz = _mm_sub_ps(cz, _mm_loadu_ps(node->max_z));
+    __m128 dx = _mm_max_ps(_mm_max_ps(lx, hx), zero);
+    __m128 dy = _mm_max_ps(_mm_max_ps(ly, hy), zero);
+    __m128 dz = _mm_max_ps(_mm_max_ps(lz, hz), zero);
+    __m128 near2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    // The farthest corner is min(l, h) away from the center on each axis, negated
+    __m128 fx = _mm_min_ps(lx, hx), fy = _mm_min_ps(ly, hy), fz = _mm_min_ps(lz, hz);
+    __m128 far2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(fx, fx), _mm_mul_ps(fy, fy)), _mm_mul_ps(fz, fz));
+    int mask = _mm_movemask_ps(_mm_cmple_ps(near2, r2)) & node->valid;
+    *inside = _mm_movemask_ps(_mm_cmple_ps(far2, r2)) & mask;
+    return mask;
+#else
+    int mask = 0, all = 0;
+    for (int slot = 0; slot < SCENE_BVH_WIDTH; slot++) {
+        vec3_t min, max;
+        slot_bounds(node, slot, &min, &max);
+        float fx = max_f(center.x - min.x, max.x - center.x);
+        float fy = max_f(center.y - min.y, max.y - center.y);
+        float fz = max_f(center.z - min.z, max.z - center.z);
+        mask |= box_sphere(min, max, center, radius) << slot;
+        all |= (fx * fx + fy * fy + fz * fz <= radius * radius) << slot;
+    }
+    mask &= node->valid;
+    *inside = all & mask;
+    return mask;
+#endif
+}
+
+int scene_bvh_query_sphere(const SceneBvh *bvh, vec3_t center, float radius, int *items) {
+    if (bvh->node_count == 0)
+        return 0;
+
+    int stack[SCENE_BVH_STACK];
+    int top = 0, count = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const SceneBvhNode *node = &bvh->nodes[stack[--top]];
+        int inside;
+        int mask = node_sphere_mask(node, center, radius, &inside);
+        while (mask) {
+            int slot = __builtin_ctz(mask);
+            mask &= mask - 1;
+            if (inside & (1 << slot)) {
+                count = emit_all(bvh, node, slot, items, count);
+            } else if (node->child[slot] >= 0) {
+                stack[top++] = node->child[slot];
+            } else {
+                const int *leaf = &bvh->order[node->first[slot]];
+                for (int i = 0; i < node->count[slot]; i++) {
+                    if (box_sphere(bvh->min[leaf[i]], bvh->max[leaf[i]], center, radius))
+                        items[count++] = leaf[i];
+                }
+            }
+        }
+    }
+    return count;
+}
+
+// Slab test of the four children, entry distances go into entry
+static int node_ray_mask(const SceneBvhNode *node, vec3_t origin, vec3_t inverse, float max_distance,
+                         float *entry) {
+#if defined(MATH_3D_SSE)
+    __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+    __m128 ix = _mm_set1_ps(inverse.x), iy = _mm_set1_ps(inverse.y), iz = _mm_set1_ps(inverse.z);
+    __m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->min_x), ox), ix);
+    __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->max_x), ox), ix);
+    __m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->min_y), oy), iy);
+    __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->max_y), oy), iy);
+    __m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->min_z), oz), iz);
+    __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->max_z), oz), iz);
+    __m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)),
+                              _mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps()));
+    __m128 leave = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)),
+                              _mm_min_ps(_mm_max_ps(z0, z1), _mm_set1_ps(max_distance)));
+    _mm_storeu_ps(entry, enter);
+    return _mm_movemask_ps(_mm_cmple_ps(enter, leave)) & node->valid;
+#else
+    int mask = 0;
+    for (int slot = 0; slot < SCENE_BVH_WIDTH; slot++) {
+        float x0 = (node->min_x[slot] - origin.x) * inverse.x, x1 = (node->max_x[slot] - origin.x) * inverse.x;
+        float y0 = (node->min_y[slot] - origin.y) * inverse.y, y1 = (node->max_y[slot] - origin.y) * inverse.y;
+        float z0 = (node->min_z[slot] - origin.z) * inverse.z, z1 = (node->max_z[slot] - origin.z) * inverse.z;
+        float enter = max_f(max_f(min_f(x0, x1), min_f(y0, y1)), max_f(min_f(z0, z1), 0.0f));
+        float leave = min_f(min_f(max_f(x0, x1), max_f(y0, y1)), min_f(max_f(z0, z1), max_distance));
+        entry[slot] = enter;
+        mask |= (enter <= leave) << slot;
+    }
+    return mask & node->valid;
+#endif
+}
+
+static int ray_box(vec3_t origin, vec3_t inverse, vec3_t min, vec3_t max, float max_distance, float *enter) {
+    float x0 = (min.x - origin.x) * inverse.x, x1 = (max.x - origin.x) * inverse.x;
+    float y0 = (min.y - origin.y) * inverse.y, y1 = (max.y - origin.y) * inverse.y;
+    float z0 = (min.z - origin.z) * inverse.z, z1 = (max.z - origin.z) * inverse.z;
+    *enter = max_f(max_f(min_f(x0, x1), min_f(y0, y1)), max_f(min_f(z0, z1), 0.0f));
+    float leave = min_f(min_f(max_f(x0, x1), max_f(y0, y1)), min_f(max_f(z0, z1), max_distance));
+    return *enter <= leave;
+}
+
+int scene_bvh_raycast(const SceneBvh *bvh, vec3_t origin, vec3_t direction, float max_distance,
+                      float *distance) {
+    if (bvh->node_count == 0)
+        return -1;
+
+    vec3_t inverse = vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+    float best = max_distance;
+    int hit = -1;
+
+    // Nearer children are pushed last so they are visited first, and every
+    // entry keeps its distance so it can be dropped once something is closer
+    struct {
+        int node;
+        float enter;
+    } stack[SCENE_BVH_STACK];
+    int top = 0;
+    stack[top].node = 0;
+    stack[top++].enter = 0.0f;
+    while (top > 0) {
+        top--;
+        if (stack[top].enter > best)
+            continue;
+        const SceneBvhNode *node = &bvh->nodes[stack[top].node];
+
+        float entry[SCENE_BVH_WIDTH];
+        int mask = node_ray_mask(node, origin, inverse, best, entry);
+        int slots[SCENE_BVH_WIDTH], hits = 0;
+        while (mask) {
+            int slot = __builtin_ctz(mask);
+            mask &= mask - 1;
+            int i = hits++;
+            for (; i > 0 && entry[slots[i - 1]] < entry[slot]; i--)
+                slots[i] = slots[i - 1];
+            slots[i] = slot;
+        }
+
+        for (int h = 0; h < hits; h++) {
+            int slot = slots[h];
+            if (node->child[slot] >= 0) {
+                stack[top].node = node->child[slot];
+                stack[top++].enter = entry[slot];
+                continue;
+            }
+            const int *leaf = &bvh->order[node->first[slot]];
+            for (int i = 0; i < node->count[slot]; i++) {
+                float enter;
+                if (ray_box(origin, inverse, bvh->min[leaf[i]], bvh->max[leaf[i]], best, &enter) &&
+                    (hit < 0 || enter < best)) {
+                    best = enter;
+                    hit = leaf[i];
+                }
+            }
+        }
+    }
+
+    if (hit >= 0 && distance)
+        *distance = best;
+    return hit;
+}
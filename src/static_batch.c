@@ -0,0 +1,155 @@
+#include <static_batch.h>
+#include <rafgl_memory.h>
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Points the instance attributes of the bound VAO at instance first of the
+// bound GL_ARRAY_BUFFER
+static void static_batch_point_instances(int first) {
+    size_t offset = first * sizeof(StaticInstance);
+    for (int column = 0; column < 4; column++)
+        glVertexAttribPointer(STATIC_BATCH_ATTRIB_MODEL + column, 4, GL_FLOAT, GL_FALSE,
+                              sizeof(StaticInstance), (void *)(offset + column * 4 * sizeof(float)));
+    glVertexAttribPointer(STATIC_BATCH_ATTRIB_PARAMS, 4, GL_FLOAT, GL_FALSE, sizeof(StaticInstance),
+                          (void *)(offset + offsetof(StaticInstance, params)));
+}
+
+void static_batch_init(StaticBatch *batch, const rafgl_mesh_buffer_t *meshes, int capacity) {
+    memset(batch, 0, sizeof(StaticBatch));
+    batch->meshes = meshes;
+    batch->capacity = capacity;
+    batch->entries = rafgl_malloc(RAFGL_MEM_SCENE, capacity * sizeof(StaticBatchEntry));
+    batch->instances = rafgl_malloc(RAFGL_MEM_SCENE, capacity * sizeof(StaticInstance));
+    batch->draws = rafgl_malloc(RAFGL_MEM_SCENE, capacity * sizeof(StaticDraw));
+
+    glGenBuffers(1, &batch->instance_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, batch->instance_buffer);
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(StaticInstance), NULL, GL_STREAM_DRAW);
+
+    glBindVertexArray(meshes->vao_id);
+    static_batch_point_instances(0);
+    for (int i = 0; i < 5; i++) {
+        glEnableVertexAttribArray(STATIC_BATCH_ATTRIB_MODEL + i);
+        glVertexAttribDivisor(STATIC_BATCH_ATTRIB_MODEL + i, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void static_batch_cleanup(StaticBatch *batch) {
+    glDeleteBuffers(1, &batch->instance_buffer);
+    rafgl_free(batch->entries);
+    rafgl_free(batch->instances);
+    rafgl_free(batch->draws);
+    memset(batch, 0, sizeof(StaticBatch));
+}
+
+void static_batch_begin(StaticBatch *batch) {
+    batch->count = 0;
+    batch->draw_count = 0;
+}
+
+int static_batch_add(StaticBatch *batch, const rafgl_meshPUN_t *mesh, int variant,
+                     const mat4_t *model, vec3_t color, int layer) {
+    return static_batch_add_conditional(batch, mesh, variant, model, color, layer, 0);
+}
+
+int static_batch_add_conditional(StaticBatch *batch, const rafgl_meshPUN_t *mesh, int variant,
+                                 const mat4_t *model, vec3_t color, int layer, GLuint query) {
+    if (batch->count == batch->capacity || mesh->vao_id != batch->meshes->vao_id)
+        return 0;
+
+    StaticBatchEntry *entry = &batch->entries[batch->count++];
+    entry->key = ((unsigned long long)variant << 32) | mesh->first_vertex;
+    entry->vertex_count = mesh->vertex_count;
+    entry->condition = query;
+    memcpy(entry->instance.model, model->m, sizeof(entry->instance.model));
+    entry->instance.params[0] = color.x;
+    entry->instance.params[1] = color.y;
+    entry->instance.params[2] = color.z;
+    entry->instance.params[3] = (float)layer;
+    return 1;
+}
+
+static int static_batch_entry_compare(const void *a, const void *b) {
+    const StaticBatchEntry *ea = a, *eb = b;
+    if (ea->key != eb->key)
+        return (ea->key > eb->key) - (ea->key < eb->key);
+    return (ea->condition > eb->condition) - (ea->condition < eb->condition);
+}
+
+void static_batch_end(StaticBatch *batch) {
+    qsort(batch->entries, batch->count, sizeof(StaticBatchEntry), static_batch_entry_compare);
+
+    StaticDraw *draw = NULL;
+    for (int i = 0; i < batch->count; i++) {
+        StaticBatchEntry *entry = &batch->entries[i];
+        batch->instances[i] = entry->instance;
+
+        if (draw && entry->key == batch->entries[i - 1].key &&
+            entry->condition == batch->entries[i - 1].condition) {
+            draw->instance_count++;
+            continue;
+        }
+        draw = &batch->draws[batch->draw_count++];
+        draw->variant = (int)(entry->key >> 32);
+        draw->first_vertex = (unsigned int)entry->key;
+        draw->vertex_count = entry->vertex_count;
+        draw->first_instance = i;
+        draw->instance_count = 1;
+        draw->condition = entry->condition;
+    }
+
+    // Orphan the old storage so the driver does not wait for last frame's draws
+    glBindBuffer(GL_ARRAY_BUFFER, batch->instance_buffer);
+    glBufferData(GL_ARRAY_BUFFER, batch->capacity * sizeof(StaticInstance), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, batch->count * sizeof(StaticInstance), batch->instances);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static int static_batch_draw_runs(const StaticBatch *batch, int variant, int conditional) {
+    int calls = 0;
+    glBindVertexArray(batch->meshes->vao_id);
+    glBindBuffer(GL_ARRAY_BUFFER, batch->instance_buffer);
+
+    for (int d = 0; d < batch->draw_count; d++) {
+        const StaticDraw *draw = &batch->draws[d];
+        if (variant != STATIC_BATCH_ALL_VARIANTS && draw->variant != variant)
+            continue;
+
+        static_batch_point_instances(draw->first_instance);
+        if (conditional && draw->condition)
+            glBeginConditionalRender(draw->condition, GL_QUERY_NO_WAIT);
+        glDrawArraysInstanced(GL_TRIANGLES, draw->first_vertex, draw->vertex_count,
+                              draw->instance_count);
+        if (conditional && draw->condition)
+            glEndConditionalRender();
+        calls++;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return calls;
+}
+
+int static_batch_draw(const StaticBatch *batch, int variant) {
+    return static_batch_draw_runs(batch, variant, 1);
+}
+
+int static_batch_draw_unconditional(const StaticBatch *batch, int variant) {
+    return static_batch_draw_runs(batch, variant, 0);
+}
+
+int static_batch_draw_instances(const StaticBatch *batch, const rafgl_meshPUN_t *mesh,
+                                GLuint instance_buffer, int first_instance, int instance_count) {
+    if (instance_count <= 0 || mesh->vao_id != batch->meshes->vao_id)
+        return 0;
+
+    glBindVertexArray(batch->meshes->vao_id);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+    static_batch_point_instances(first_instance);
+    glDrawArraysInstanced(GL_TRIANGLES, mesh->first_vertex, mesh->vertex_count, instance_count);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return 1;
+}
@@ -16,15 +16,15 @@ void gbuffer_init(GBuffer *gb, int width, int height) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gb->gPosition, 0);
     
-    // Normal texture
+    // Normal + metallic texture
     glGenTextures(1, &gb->gNormal);
     glBindTexture(GL_TEXTURE_2D, gb->gNormal);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gb->gNormal, 0);
     
-    // Albedo + Specular texture
+    // Albedo + roughness texture
     glGenTextures(1, &gb->gAlbedoSpec);
     glBindTexture(GL_TEXTURE_2D, gb->gAlbedoSpec);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
@@ -159,12 +159,12 @@ void fullscreen_quad_render(FullscreenQuad *quad) {
     glBindVertexArray(0);
 }
 
-void setup_point_light_shadows(PointLight *light, int shadowWidth, int shadowHeight) {
-    glGenFramebuffers(1, &light->shadowFBO);
+void setup_point_light_shadows(ShadowCubeMap *shadow, int shadowWidth, int shadowHeight) {
+    glGenFramebuffers(1, &shadow->shadowFBO);
     
     // Create a proper cube map texture for omnidirectional shadows
-    glGenTextures(1, &light->shadowCubeMap);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, light->shadowCubeMap);
+    glGenTextures(1, &shadow->shadowCubeMap);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, shadow->shadowCubeMap);
     
     // Create all 6 faces of the cube map as color texture (not depth)
     for (unsigned int i = 0; i < 6; ++i) {
@@ -179,14 +179,14 @@ void setup_point_light_shadows(PointLight *light, int shadowWidth, int shadowHei
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     
-    glBindFramebuffer(GL_FRAMEBUFFER, light->shadowFBO);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, light->shadowCubeMap, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, shadow->shadowFBO);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, shadow->shadowCubeMap, 0);
     glDrawBuffer(GL_COLOR_ATTACHMENT0);
     glReadBuffer(GL_NONE);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void render_cube_shadow_map(PointLight *light, GLuint shadowProgram, void (*render_scene_func)(GLuint program)) {
+void render_cube_shadow_map(ShadowCubeMap *shadow, vec3_t lightPosition, GLuint shadowProgram, void (*render_scene_func)(GLuint program)) {
     // The 6 view directions for a cube map (from a point light's perspective)
     vec3_t directions[6] = {
         vec3( 1.0f,  0.0f,  0.0f), // +X
@@ -206,7 +206,7 @@ void render_cube_shadow_map(PointLight *light, GLuint shadowProgram, void (*rend
         vec3(0.0f, -1.0f,  0.0f)  // -Z
     };
     
-    glBindFramebuffer(GL_FRAMEBUFFER, light->shadowFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, shadow->shadowFBO);
     glViewport(0, 0, 512, 512);
     
     glUseProgram(shadowProgram);
@@ -216,18 +216,18 @@ void render_cube_shadow_map(PointLight *light, GLuint shadowProgram, void (*rend
     glUniformMatrix4fv(glGetUniformLocation(shadowProgram, "lightProjection"), 1, GL_FALSE, (float*)lightProjection.m);
     
     // Pass light position to shader for distance calculation
-    glUniform3f(glGetUniformLocation(shadowProgram, "lightPos"), light->position.x, light->position.y, light->position.z);
+    glUniform3f(glGetUniformLocation(shadowProgram, "lightPos"), lightPosition.x, lightPosition.y, lightPosition.z);
     glUniform1f(glGetUniformLocation(shadowProgram, "far_plane"), 25.0f);
     
     // Render to each face of the cube map
     for (int face = 0; face < 6; ++face) {
         // Calculate view matrix for this face
-        vec3_t target = v3_add(light->position, directions[face]);
-        mat4_t lightView = m4_look_at(light->position, target, ups[face]);
+        vec3_t target = v3_add(lightPosition, directions[face]);
+        mat4_t lightView = m4_look_at(lightPosition, target, ups[face]);
         
         // Attach the specific face of the cube map to the framebuffer
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 
-                              GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, light->shadowCubeMap, 0);
+                              GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, shadow->shadowCubeMap, 0);
         
         glClear(GL_COLOR_BUFFER_BIT);
         
@@ -239,4 +239,11 @@ void render_cube_shadow_map(PointLight *light, GLuint shadowProgram, void (*rend
     }
     
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
\ No newline at end of file
+}
+
+void cleanup_point_light_shadows(ShadowCubeMap *shadow) {
+    glDeleteFramebuffers(1, &shadow->shadowFBO);
+    glDeleteTextures(1, &shadow->shadowCubeMap);
+    shadow->shadowFBO = 0;
+    shadow->shadowCubeMap = 0;
+}
@@ -0,0 +1,496 @@
+#include <texture_residency.h>
+#include <rafgl_memory.h>
+
+#include <string.h>
+
+static int level_extent(int size, int level) {
+    return size >> level > 0 ? size >> level : 1;
+}
+
+static size_t level_bytes(TextureFormat format, int width, int height) {
+    if (format == TEXTURE_FORMAT_RGTC2)
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 16;
+    return (size_t)width * height * 4;
+}
+
+// One layer of one level
+static size_t array_level_bytes(const ResidentArray *a, int level) {
+    return level_bytes(a->format, level_extent(a->width, level), level_extent(a->height, level));
+}
+
+// Everything resident when base is the finest level
+static size_t array_bytes(const ResidentArray *a, int base) {
+    size_t bytes = 0;
+    for (int level = base; level < a->levels; level++)
+        bytes += array_level_bytes(a, level) * a->layer_count;
+    return bytes;
+}
+
+// Coarsest level the array may drop to
+static int array_max_base(const ResidentArray *a) {
+    int size = a->width > a->height ? a->width : a->height;
+    int level = 0;
+    while (level + 1 < a->levels && (size >> (level + 1)) >= TEXTURE_RESIDENCY_MIN_SIZE)
+        level++;
+    return level;
+}
+
+void texture_residency_init(TextureResidency *tr, size_t budget) {
+    memset(tr, 0, sizeof(TextureResidency));
+    tr->budget = budget;
+}
+
+void texture_residency_set_budget(TextureResidency *tr, size_t budget) {
+    tr->budget = budget;
+}
+
+int texture_residency_add_array(TextureResidency *tr, rafgl_texture_t *texture,
+                                TextureFormat format, int layer_count) {
+    if (tr->count == TEXTURE_RESIDENCY_MAX_ARRAYS || layer_count > TEXTURE_RESIDENCY_MAX_LAYERS)
+        return -1;
+
+    ResidentArray *a = &tr->arrays[tr->count];
+    memset(a, 0, sizeof(ResidentArray));
+    a->texture = texture;
+    a->format = format;
+    a->channels[0] = 0;
+    a->channels[1] = 1;
+    a->layer_count = layer_count;
+    a->stream_level = -1;
+    rafgl_jobs_counter_init(&a->stream_counter);
+    return tr->count++;
+}
+
+void texture_residency_set_layer(TextureResidency *tr, int array, int layer, const char *path,
+                                 rafgl_pixel_rgb_t fill) {
+    ResidentLayer *l = &tr->arrays[array].layers[layer];
+    l->path = path;
+    l->fill = fill;
+    l->loaded = 0;
+}
+
+void texture_residency_set_channels(TextureResidency *tr, int array, int red, int green) {
+    tr->arrays[array].channels[0] = red;
+    tr->arrays[array].channels[1] = green;
+}
+
+int texture_residency_layer_loaded(const TextureResidency *tr, int array, int layer) {
+    return tr->arrays[array].layers[layer].loaded;
+}
+
+size_t texture_residency_resident_bytes(const TextureResidency *tr) {
+    size_t bytes = 0;
+    for (int i = 0; i < tr->count; i++)
+        bytes += array_bytes(&tr->arrays[i], tr->arrays[i].base_level);
+    return bytes;
+}
+
+static void texture_residency_report(TextureResidency *tr) {
+    size_t bytes = texture_residency_resident_bytes(tr);
+    if (bytes == tr->reported_bytes)
+        return;
+    tr->reported_bytes = bytes;
+
+    char levels[64] = "";
+    for (int i = 0; i < tr->count; i++) {
+        size_t length = strlen(levels);
+        snprintf(levels + length, sizeof(levels) - length, i ? " %d" : "%d", tr->arrays[i].base_level);
+    }
+    rafgl_log(RAFGL_INFO, "Textures: %.1f of %.1f MB resident, base levels %s\n",
+              bytes / (1024.0 * 1024.0), tr->budget / (1024.0 * 1024.0), levels);
+}
+
+// Job, runs once the layer's file was read: decodes it and builds levels
+// [first, last) in upload format. Images that fail to load or have the wrong
+// size become the layer's fill.
+static void resident_levels_build(void *data) {
+    ResidentLevels *lv = data;
+    rafgl_raster_t raster = {0};
+
+    lv->loaded = 0;
+    if (lv->read.data) {
+        rafgl_raster_load_from_memory(&raster, lv->read.data, lv->read.size);
+        rafgl_free(lv->read.data);
+        lv->read.data = NULL;
+    }
+    if (lv->layer->path) {
+        lv->loaded = raster.data != NULL && raster.width == lv->width && raster.height == lv->height;
+        if (raster.data && !lv->loaded) {
+            rafgl_log(RAFGL_WARNING, "%s is %dx%d, its texture array is %dx%d\n", lv->layer->path,
+                      raster.width, raster.height, lv->width, lv->height);
+            rafgl_raster_cleanup(&raster);
+        }
+    }
+
+    int level = 0;
+    if (!lv->loaded) {
+        level = lv->first;
+        rafgl_raster_init(&raster, level_extent(lv->width, level), level_extent(lv->height, level));
+        for (int i = 0; i < raster.width * raster.height; i++)
+            raster.data[i] = lv->layer->fill;
+    }
+
+    size_t size = 0;
+    for (int l = lv->first; l < lv->last; l++)
+        size += level_bytes(lv->format, level_extent(lv->width, l), level_extent(lv->height, l));
+    lv->data = rafgl_malloc(RAFGL_MEM_TEXTURE, size);
+
+    // Walk down to the first level, the RGBA8 levels are copied on the way
+    unsigned char *out = lv->data;
+    for (; level < lv->last; level++) {
+        if (level >= lv->first && lv->format == TEXTURE_FORMAT_RGBA8) {
+            memcpy(out, raster.data, level_bytes(lv->format, raster.width, raster.height));
+            out += level_bytes(lv->format, raster.width, raster.height);
+        }
+        if (level == lv->first && lv->format == TEXTURE_FORMAT_RGTC2)
+            break;
+        if (level + 1 == lv->last)
+            break;
+
+        rafgl_raster_t next;
+        rafgl_raster_init(&next, level_extent(lv->width, level + 1), level_extent(lv->height, level + 1));
+        rafgl_raster_box_downsample(&next, &raster);
+        rafgl_raster_cleanup(&raster);
+        raster = next;
+    }
+
+    // The RGTC2 encoder builds its own chain from the first level down
+    if (lv->format == TEXTURE_FORMAT_RGTC2) {
+        rafgl_rgtc2_image_t image;
+        rafgl_rgtc2_image_from_raster(&image, &raster, lv->channels[0], lv->channels[1]);
+        memcpy(lv->data, image.data, size);
+        rafgl_rgtc2_image_cleanup(&image);
+    }
+
+    rafgl_raster_cleanup(&raster);
+}
+
+static void resident_array_start_stream(ResidentArray *a, int first, int last) {
+    a->stream_level = first;
+    for (int layer = 0; layer < a->layer_count; layer++) {
+        ResidentLevels *lv = &a->streamed[layer];
+        lv->layer = &a->layers[layer];
+        lv->format = a->format;
+        lv->channels[0] = a->channels[0];
+        lv->channels[1] = a->channels[1];
+        lv->width = a->width;
+        lv->height = a->height;
+        lv->first = first;
+        lv->last = last;
+        lv->data = NULL;
+        lv->read.data = NULL;
+        if (lv->layer->path) {
+            lv->read.path = lv->layer->path;
+            lv->read.tag = RAFGL_MEM_TEXTURE;
+            rafgl_vfs_read_async(&lv->read, &lv->read_counter);
+        }
+        a->jobs[layer].function = resident_levels_build;
+        a->jobs[layer].data = lv;
+        a->jobs[layer].counter = NULL;
+        // Decoding starts as soon as this layer's read is in
+        rafgl_jobs_run_after(&lv->read_counter, &a->jobs[layer], 1, &a->stream_counter);
+    }
+}
+
+static void define_level(const ResidentArray *a, int level, int width, int height, int layers) {
+    if (a->format == TEXTURE_FORMAT_RGTC2)
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_COMPRESSED_RG_RGTC2, width, height,
+                               layers, 0, level_bytes(a->format, width, height) * layers, NULL);
+    else
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA, width, height, layers, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, NULL);
+}
+
+// Main thread: gives the streamed levels storage, uploads every layer and
+// only then lowers the base level
+static void resident_array_finish_stream(ResidentArray *a) {
+    int first = a->stream_level, last = a->streamed[0].last;
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, a->texture->tex_id);
+    for (int level = first; level < last; level++)
+        define_level(a, level, level_extent(a->width, level), level_extent(a->height, level), a->layer_count);
+
+    for (int layer = 0; layer < a->layer_count; layer++) {
+        ResidentLevels *lv = &a->streamed[layer];
+        const unsigned char *data = lv->data;
+        for (int level = first; level < last; level++) {
+            int w = level_extent(a->width, level), h = level_extent(a->height, level);
+            size_t size = level_bytes(a->format, w, h);
+            if (a->format == TEXTURE_FORMAT_RGTC2)
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, w, h, 1,
+                                          GL_COMPRESSED_RG_RGTC2, size, data);
+            else
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, w, h, 1, GL_RGBA,
+                                GL_UNSIGNED_BYTE, data);
+            data += size;
+        }
+        a->layers[layer].loaded = lv->loaded;
+        rafgl_free(lv->data);
+        lv->data = NULL;
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, first);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    a->base_level = first;
+    a->stream_level = -1;
+}
+
+// Raises the base level and gives the storage of the finer levels back
+static void resident_array_evict(ResidentArray *a, int base) {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, a->texture->tex_id);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, base);
+    for (int level = a->base_level; level < base; level++)
+        define_level(a, level, 0, 0, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    a->base_level = base;
+}
+
+// Coarsens the array whose finest level costs the most until the targets fit
+static void fit_budget(const TextureResidency *tr, int *targets) {
+    for (;;) {
+        size_t total = 0;
+        for (int i = 0; i < tr->count; i++)
+            total += array_bytes(&tr->arrays[i], targets[i]);
+        if (total <= tr->budget)
+            return;
+
+        int largest = -1;
+        size_t largest_bytes = 0;
+        for (int i = 0; i < tr->count; i++) {
+            const ResidentArray *a = &tr->arrays[i];
+            size_t bytes = array_level_bytes(a, targets[i]) * a->layer_count;
+            if (targets[i] < array_max_base(a) && bytes > largest_bytes) {
+                largest = i;
+                largest_bytes = bytes;
+            }
+        }
+        if (largest < 0)
+            return;
+        targets[largest]++;
+    }
+}
+
+void texture_residency_load(TextureResidency *tr) {
+    int targets[TEXTURE_RESIDENCY_MAX_ARRAYS];
+
+    for (int i = 0; i < tr->count; i++) {
+        ResidentArray *a = &tr->arrays[i];
+
+        // The first image that exists sets the size of the whole array
+        a->width = a->height = 1;
+        for (int layer = 0; layer < a->layer_count; layer++) {
+            int width, height, channels;
+            if (a->layers[layer].path && stbi_info(a->layers[layer].path, &width, &height, &channels)) {
+                a->width = width;
+                a->height = height;
+                break;
+            }
+        }
+
+        int size = a->width > a->height ? a->width : a->height;
+        a->levels = 1;
+        while (size > 1) {
+            size >>= 1;
+            a->levels++;
+        }
+        targets[i] = 0;
+    }
+    fit_budget(tr, targets);
+
+    for (int i = 0; i < tr->count; i++) {
+        ResidentArray *a = &tr->arrays[i];
+        rafgl_texture_t *texture = a->texture;
+
+        glGenTextures(1, &texture->tex_id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture->tex_id);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, a->levels - 1);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        texture->width = a->width;
+        texture->height = a->height;
+        texture->channels = a->format == TEXTURE_FORMAT_RGTC2 ? 2 : 4;
+        texture->layers = a->layer_count;
+        texture->tex_type = GL_TEXTURE_2D_ARRAY;
+
+        // Nothing is resident yet, the stream brings in everything from the target down
+        a->base_level = a->levels;
+        resident_array_start_stream(a, targets[i], a->levels);
+    }
+
+    for (int i = 0; i < tr->count; i++) {
+        rafgl_jobs_wait(&tr->arrays[i].stream_counter);
+        resident_array_finish_stream(&tr->arrays[i]);
+    }
+    texture_residency_report(tr);
+}
+
+void texture_residency_update(TextureResidency *tr) {
+    for (int i = 0; i < tr->count; i++) {
+        ResidentArray *a = &tr->arrays[i];
+        if (a->stream_level >= 0 && !rafgl_jobs_counter_busy(&a->stream_counter))
+            resident_array_finish_stream(a);
+    }
+    texture_residency_report(tr);
+}
+
+// Turns the finest level each layer asked for into targets per array, then
+// evicts and streams towards them
+static void texture_residency_apply(TextureResidency *tr, const int *finest) {
+    int targets[TEXTURE_RESIDENCY_MAX_ARRAYS];
+    const ResidentArray *reference = &tr->arrays[0];
+
+    for (int i = 0; i < tr->count; i++) {
+        ResidentArray *a = &tr->arrays[i];
+        int max_base = array_max_base(a);
+
+        // Feedback levels are relative to the first array's level 0
+        int offset = 0;
+        for (int size = a->width; size < reference->width; size <<= 1)
+            offset--;
+        for (int size = reference->width; size < a->width; size <<= 1)
+            offset++;
+
+        int wanted = max_base;
+        for (int layer = 0; layer < a->layer_count; layer++) {
+            if (finest[layer] < 0)
+                continue;
+            int level = finest[layer] + offset;
+            if (level < wanted)
+                wanted = level < 0 ? 0 : level;
+        }
+        a->wanted_level = wanted;
+        targets[i] = wanted;
+    }
+    fit_budget(tr, targets);
+
+    // What stays resident if every array at or above its target keeps its
+    // levels, evictions are immediate when even that does not fit
+    size_t projected = 0;
+    for (int i = 0; i < tr->count; i++) {
+        const ResidentArray *a = &tr->arrays[i];
+        projected += array_bytes(a, targets[i] < a->base_level ? targets[i] : a->base_level);
+    }
+
+    for (int i = 0; i < tr->count; i++) {
+        ResidentArray *a = &tr->arrays[i];
+        if (a->stream_level >= 0 || targets[i] <= a->base_level) {
+            a->evict_votes = 0;
+            continue;
+        }
+        if (projected > tr->budget || ++a->evict_votes >= TEXTURE_RESIDENCY_EVICT_DELAY) {
+            projected -= array_bytes(a, a->base_level) - array_bytes(a, targets[i]);
+            resident_array_evict(a, targets[i]);
+            a->evict_votes = 0;
+        }
+    }
+
+    for (int i = 0; i < tr->count; i++) {
+        ResidentArray *a = &tr->arrays[i];
+        if (a->stream_level < 0 && targets[i] < a->base_level)
+            resident_array_start_stream(a, targets[i], a->base_level);
+    }
+}
+
+void texture_residency_feedback_init(TextureResidency *tr, int screen_width, int screen_height) {
+    tr->feedback_width = level_extent(screen_width / TEXTURE_RESIDENCY_FEEDBACK_SCALE, 0);
+    tr->feedback_height = level_extent(screen_height / TEXTURE_RESIDENCY_FEEDBACK_SCALE, 0);
+
+    glGenFramebuffers(1, &tr->feedback_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, tr->feedback_framebuffer);
+
+    glGenRenderbuffers(1, &tr->feedback_color);
+    glBindRenderbuffer(GL_RENDERBUFFER, tr->feedback_color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RG8UI, tr->feedback_width, tr->feedback_height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, tr->feedback_color);
+
+    glGenRenderbuffers(1, &tr->feedback_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, tr->feedback_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, tr->feedback_width, tr->feedback_height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, tr->feedback_depth);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        rafgl_log(RAFGL_ERROR, "Texture feedback framebuffer is incomplete\n");
+
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glGenBuffers(1, &tr->feedback_pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, tr->feedback_pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)tr->feedback_width * tr->feedback_height * 2, NULL,
+                 GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// The readback was issued a whole feedback interval ago, so mapping it does
+// not wait for the GPU
+static void texture_residency_read_feedback(TextureResidency *tr) {
+    int finest[TEXTURE_RESIDENCY_MAX_LAYERS];
+    for (int layer = 0; layer < TEXTURE_RESIDENCY_MAX_LAYERS; layer++)
+        finest[layer] = -1;
+
+    size_t size = (size_t)tr->feedback_width * tr->feedback_height * 2;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, tr->feedback_pbo);
+    const unsigned char *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if (pixels) {
+        for (size_t i = 0; i < size; i += 2) {
+            int layer = pixels[i] - 1, level = pixels[i + 1];
+            if (layer < 0 || layer >= TEXTURE_RESIDENCY_MAX_LAYERS)
+                continue;
+            if (finest[layer] < 0 || level < finest[layer])
+                finest[layer] = level;
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    tr->feedback_pending = 0;
+    if (pixels)
+        texture_residency_apply(tr, finest);
+}
+
+int texture_residency_feedback_begin(TextureResidency *tr) {
+    if (tr->count == 0 || tr->frame++ % TEXTURE_RESIDENCY_FEEDBACK_INTERVAL != 0)
+        return 0;
+
+    if (tr->feedback_pending)
+        texture_residency_read_feedback(tr);
+
+    static const GLuint nothing[4] = {0, 0, 0, 0};
+    glBindFramebuffer(GL_FRAMEBUFFER, tr->feedback_framebuffer);
+    glViewport(0, 0, tr->feedback_width, tr->feedback_height);
+    glClearBufferuiv(GL_COLOR, 0, nothing);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    return 1;
+}
+
+void texture_residency_feedback_end(TextureResidency *tr) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, tr->feedback_pbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, tr->feedback_width, tr->feedback_height, GL_RG_INTEGER, GL_UNSIGNED_BYTE, NULL);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    tr->feedback_pending = 1;
+}
+
+void texture_residency_cleanup(TextureResidency *tr) {
+    for (int i = 0; i < tr->count; i++) {
+        ResidentArray *a = &tr->arrays[i];
+        if (a->stream_level < 0)
+            continue;
+        rafgl_jobs_wait(&a->stream_counter);
+        for (int layer = 0; layer < a->layer_count; layer++)
+            rafgl_free(a->streamed[layer].data);
+        a->stream_level = -1;
+    }
+
+    glDeleteFramebuffers(1, &tr->feedback_framebuffer);
+    glDeleteRenderbuffers(1, &tr->feedback_color);
+    glDeleteRenderbuffers(1, &tr->feedback_depth);
+    glDeleteBuffers(1, &tr->feedback_pbo);
+    tr->count = 0;
+}
@@ -0,0 +1,70 @@
+#include <transform_system.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+void transform_system_init(TransformSystem *ts, int capacity) {
+    memset(ts, 0, sizeof(TransformSystem));
+    ts->capacity = capacity;
+
+    ts->parent = rafgl_malloc(RAFGL_MEM_SCENE, capacity * sizeof(int));
+    ts->local = rafgl_malloc(RAFGL_MEM_SCENE, capacity * sizeof(mat4_t));
+    ts->world = rafgl_malloc(RAFGL_MEM_SCENE, capacity * sizeof(mat4_t));
+    ts->dirty = rafgl_calloc(RAFGL_MEM_SCENE, capacity, 1);
+    ts->updated = rafgl_malloc(RAFGL_MEM_SCENE, capacity * sizeof(int));
+}
+
+void transform_system_cleanup(TransformSystem *ts) {
+    rafgl_free(ts->parent);
+    rafgl_free(ts->local);
+    rafgl_free(ts->world);
+    rafgl_free(ts->dirty);
+    rafgl_free(ts->updated);
+    memset(ts, 0, sizeof(TransformSystem));
+}
+
+int transform_system_add(TransformSystem *ts, int parent, mat4_t local) {
+    if (ts->count >= ts->capacity || parent >= ts->count)
+        return -1;
+
+    int i = ts->count++;
+    ts->parent[i] = parent;
+    ts->local[i] = local;
+    ts->world[i] = local;
+    ts->dirty[i] = 1;
+    ts->dirty_count++;
+    return i;
+}
+
+void transform_system_set_local(TransformSystem *ts, int index, mat4_t local) {
+    ts->local[index] = local;
+    if (!ts->dirty[index]) {
+        ts->dirty[index] = 1;
+        ts->dirty_count++;
+    }
+}
+
+int transform_system_update(TransformSystem *ts) {
+    ts->updated_count = 0;
+    if (ts->dirty_count == 0)
+        return 0;
+
+    // Parents come first, so by the time a node is visited its parent's dirty
+    // flag already includes everything above it
+    for (int i = 0; i < ts->count; i++) {
+        int parent = ts->parent[i];
+        if (parent != TRANSFORM_NONE)
+            ts->dirty[i] |= ts->dirty[parent];
+        if (!ts->dirty[i])
+            continue;
+
+        ts->world[i] = parent == TRANSFORM_NONE
+                           ? ts->local[i]
+                           : m4_mul(ts->world[parent], ts->local[i]);
+        ts->updated[ts->updated_count++] = i;
+    }
+
+    memset(ts->dirty, 0, ts->count);
+    ts->dirty_count = 0;
+    return ts->updated_count;
+}